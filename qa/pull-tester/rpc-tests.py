@@ -113,6 +113,7 @@ testScripts = [
     'walletbackup.py',
     'nodehandling.py',
     'reindex.py',
+    'compactblocks.py',
     'addressindex.py',
     'timestampindex.py',
     'spentindex.py',
@@ -0,0 +1,84 @@
+#!/usr/bin/env python2
+#
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+import time
+
+'''
+CompactBlocksTest -- block relay with and without -compactblocks.
+
+Two nodes on regtest. node0 mines, node1 receives. For each mode node1 is
+(re)started with or without -compactblocks, node0 sends it a batch of
+transactions, and once they are in node1's mempool node0 mines them into a
+block. Reported per mode:
+- the bytes node1 received from node0 while the block propagated
+- the time from the block being mined until it is node1's tip
+
+With -compactblocks node1 should rebuild the block from its mempool and
+receive a fraction of the bytes. The reconstruction itself shows up in
+node1's debug.log ("reconstructed compact block ... in ...ms").
+'''
+
+TXS_PER_BLOCK = 50
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=net"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=net"]))
+        connect_nodes(self.nodes[1], 0)
+
+    def restart_receiver(self, compact):
+        stop_node(self.nodes[1], 1)
+        wait_bitcoinds()
+        self.nodes[1] = start_node(1, self.options.tmpdir, ["-debug=net", "-compactblocks=%d" % compact])
+        connect_nodes(self.nodes[1], 0)
+        sync_blocks(self.nodes)
+
+    def bytes_from_node0(self):
+        # node1 has a single peer
+        return self.nodes[1].getpeerinfo()[0]['bytesrecv']
+
+    def relay_block(self, compact):
+        self.restart_receiver(compact)
+
+        address = self.nodes[1].getnewaddress()
+        for i in range(TXS_PER_BLOCK):
+            self.nodes[0].sendtoaddress(address, 0.1)
+        sync_mempools(self.nodes)
+
+        bytes_before = self.bytes_from_node0()
+        start = time.time()
+        self.nodes[0].setgenerate(True, 1)
+        tip = self.nodes[0].getbestblockhash()
+        while self.nodes[1].getbestblockhash() != tip:
+            if time.time() - start > 60:
+                raise AssertionError("block did not reach node1")
+            time.sleep(0.01)
+        elapsed = time.time() - start
+        received = self.bytes_from_node0() - bytes_before
+
+        assert_equal(self.nodes[1].getrawmempool(), [])
+        print("%s: %d bytes, %.1fms" % ("compact" if compact else "full", received, elapsed * 1000))
+        return received
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 101)
+        sync_blocks(self.nodes)
+
+        full = self.relay_block(False)
+        compact = self.relay_block(True)
+        assert(compact < full)
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -214,7 +214,10 @@ bool CActiveMasternode::Dseep(CTxIn vin, CService service, CKey keyMasternode, C
         if(stop)
             mnodeman.Remove(pmn->vin);
         else
+        {
             pmn->UpdateLastSeen();
+            mnodeman.NotifyChanged(pmn->vin);
+        }
     }
     else
     {
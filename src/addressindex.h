@@ -0,0 +1,191 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** Address and spent output indexes (-addressindex, -spentindex)
+ *
+ *  Both live in the block tree database (blocks/index/) next to the
+ *  transaction index and are kept up to date by ConnectBlock and
+ *  DisconnectBlock:
+ *  - 'a': one record for every output paying to an address and every input
+ *    spending from one, keyed by (address, height, position in block, txid,
+ *    index, spending) and holding the amount, negative for spends. The
+ *    history of an address within a range of heights is one range scan.
+ *  - 'u': one record for every unspent output paying to an address, keyed
+ *    by (address, txid, index).
+ *  - 'p': for every spent output, the input that spent it.
+ *  Only outputs paying to a single public key, key hash or script hash
+ *  belong to an address.
+ */
+
+enum AddressIndexType
+{
+    ADDRESS_NONE = 0,
+    ADDRESS_PUBKEYHASH = 1,
+    ADDRESS_SCRIPTHASH = 2
+};
+
+/** Wrapper serializing a 32-bit integer most significant byte first, so
+ *  that keys holding it sort by its value. */
+template<typename I>
+class CBigEndian
+{
+protected:
+    I &n;
+public:
+    CBigEndian(I& nIn) : n(nIn) { }
+
+    unsigned int GetSerializeSize(int, int) const {
+        return 4;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int, int) const {
+        unsigned char buf[4];
+        buf[0] = (uint32_t)n >> 24;
+        buf[1] = (uint32_t)n >> 16;
+        buf[2] = (uint32_t)n >> 8;
+        buf[3] = (uint32_t)n;
+        s.write((char*)buf, 4);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int) {
+        unsigned char buf[4];
+        s.read((char*)buf, 4);
+        n = (I)(((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3]);
+    }
+};
+
+template<typename I>
+CBigEndian<I> WrapBigEndian(I& n) { return CBigEndian<I>(n); }
+
+#define BIGENDIAN(obj) REF(WrapBigEndian(REF(obj)))
+
+/** Key of an 'a' record. With only the address and a height set, it is the
+ *  first possible key of that address at that height. */
+struct CAddressIndexKey
+{
+    unsigned char nAddressType;
+    uint160 hashBytes;
+    int nHeight;
+    unsigned int nTxIndex;
+    uint256 txhash;
+    unsigned int nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : nAddressType(ADDRESS_NONE), nHeight(0), nTxIndex(0), nIndex(0), fSpending(false) {}
+
+    CAddressIndexKey(unsigned char nAddressTypeIn, const uint160 &hashBytesIn, int nHeightIn, unsigned int nTxIndexIn = 0,
+                     const uint256 &txhashIn = 0, unsigned int nIndexIn = 0, bool fSpendingIn = false) :
+        nAddressType(nAddressTypeIn), hashBytes(hashBytesIn), nHeight(nHeightIn), nTxIndex(nTxIndexIn),
+        txhash(txhashIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(nAddressType);
+        READWRITE(hashBytes);
+        READWRITE(BIGENDIAN(nHeight));
+        READWRITE(BIGENDIAN(nTxIndex));
+        READWRITE(txhash);
+        READWRITE(nIndex);
+        READWRITE(fSpending);
+    )
+};
+
+/** Key of a 'u' record. */
+struct CAddressUnspentKey
+{
+    unsigned char nAddressType;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int nIndex;
+
+    CAddressUnspentKey() : nAddressType(ADDRESS_NONE), nIndex(0) {}
+
+    CAddressUnspentKey(unsigned char nAddressTypeIn, const uint160 &hashBytesIn, const uint256 &txhashIn = 0, unsigned int nIndexIn = 0) :
+        nAddressType(nAddressTypeIn), hashBytes(hashBytesIn), txhash(txhashIn), nIndex(nIndexIn) {}
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(nAddressType);
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(nIndex);
+    )
+};
+
+/** Value of a 'u' record. A null value in an update erases the record. */
+struct CAddressUnspentValue
+{
+    int64_t nValue;
+    CScript script;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(-1), nHeight(0) {}
+
+    CAddressUnspentValue(int64_t nValueIn, const CScript &scriptIn, int nHeightIn) :
+        nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    bool IsNull() const { return nValue == -1; }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(nValue);
+        READWRITE(script);
+        READWRITE(nHeight);
+    )
+};
+
+/** Key of a 'p' record: the spent output. */
+struct CSpentIndexKey
+{
+    uint256 txid;
+    unsigned int nIndex;
+
+    CSpentIndexKey() : nIndex(0) {}
+    CSpentIndexKey(const uint256 &txidIn, unsigned int nIndexIn) : txid(txidIn), nIndex(nIndexIn) {}
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(txid);
+        READWRITE(nIndex);
+    )
+};
+
+/** Value of a 'p' record: the input spending it, and what it spent. A null
+ *  value in an update erases the record. */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    unsigned int nInputIndex;
+    int nHeight;
+    int64_t nValue;
+    unsigned char nAddressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() : nInputIndex(0), nHeight(0), nValue(0), nAddressType(ADDRESS_NONE) {}
+
+    CSpentIndexValue(const uint256 &txidIn, unsigned int nInputIndexIn, int nHeightIn, int64_t nValueIn,
+                     unsigned char nAddressTypeIn, const uint160 &addressHashIn) :
+        txid(txidIn), nInputIndex(nInputIndexIn), nHeight(nHeightIn), nValue(nValueIn),
+        nAddressType(nAddressTypeIn), addressHash(addressHashIn) {}
+
+    bool IsNull() const { return txid == 0; }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(txid);
+        READWRITE(nInputIndex);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(nAddressType);
+        READWRITE(addressHash);
+    )
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,152 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "util.h"
+
+#include "json/json_spirit_value.h"
+#include "json/json_spirit_writer_template.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace benchmark {
+
+State::State(unsigned int nSamplesIn, int64_t nSampleMicrosIn) :
+    nSamples(std::max(nSamplesIn, 1U)), nSampleMicros(std::max(nSampleMicrosIn, (int64_t)1)),
+    fWarmup(true), nBatch(0), nLeft(0), nBatchStart(0)
+{
+}
+
+bool State::KeepRunning()
+{
+    if (nLeft > 0) {
+        nLeft--;
+        return true;
+    }
+
+    int64_t nNow = GetTimeMicros();
+    if (nBatch == 0) {
+        nBatch = 1;
+    } else if (fWarmup) {
+        int64_t nElapsed = nNow - nBatchStart;
+        if (nElapsed * 10 < nSampleMicros) {
+            nBatch *= 2;
+        } else {
+            fWarmup = false;
+            nBatch = std::max((uint64_t)1, nBatch * nSampleMicros / std::max(nElapsed, (int64_t)1));
+        }
+    } else {
+        vSampleNanos.push_back((nNow - nBatchStart) * 1000.0 / nBatch);
+        if (vSampleNanos.size() >= nSamples)
+            return false;
+    }
+
+    nLeft = nBatch - 1;
+    nBatchStart = GetTimeMicros();
+    return true;
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::Benchmarks()
+{
+    // a function static, so it is there before the BENCHMARK()s register
+    static BenchmarkMap benchmarks;
+    return benchmarks;
+}
+
+BenchRunner::BenchRunner(const std::string& strName, BenchFunction func)
+{
+    Benchmarks().insert(std::make_pair(strName, func));
+}
+
+std::vector<std::string> BenchRunner::List()
+{
+    std::vector<std::string> vNames;
+    for (BenchmarkMap::const_iterator it = Benchmarks().begin(); it != Benchmarks().end(); ++it)
+        vNames.push_back(it->first);
+    return vNames;
+}
+
+std::vector<Result> BenchRunner::RunAll(const std::string& strFilter, unsigned int nSamples, int64_t nSampleMicros)
+{
+    std::vector<Result> vResults;
+    for (BenchmarkMap::const_iterator it = Benchmarks().begin(); it != Benchmarks().end(); ++it)
+    {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+
+        Result result;
+        result.strName = it->first;
+        result.nBatchSize = 0;
+        result.nSamples = 0;
+        result.dMinNanos = result.dMedianNanos = result.dMaxNanos = 0;
+
+        State state(nSamples, nSampleMicros);
+        try {
+            it->second(state);
+        } catch (std::exception& e) {
+            result.strError = e.what();
+        }
+
+        std::vector<double> vSamples = state.Samples();
+        if (vSamples.empty() && result.strError.empty())
+            result.strError = "no samples taken";
+        if (!vSamples.empty()) {
+            std::sort(vSamples.begin(), vSamples.end());
+            result.nBatchSize = state.BatchSize();
+            result.nSamples = vSamples.size();
+            result.dMinNanos = vSamples.front();
+            result.dMaxNanos = vSamples.back();
+            size_t nMid = vSamples.size() / 2;
+            result.dMedianNanos = vSamples.size() % 2 ? vSamples[nMid] : (vSamples[nMid - 1] + vSamples[nMid]) / 2;
+        }
+        vResults.push_back(result);
+    }
+    return vResults;
+}
+
+std::string FormatText(const std::vector<Result>& vResults)
+{
+    std::string strOut = strprintf("%-32s %12s %14s %14s %14s\n", "# benchmark", "iterations", "min ns/op", "median ns/op", "max ns/op");
+    for (std::vector<Result>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+    {
+        if (!it->strError.empty())
+            strOut += strprintf("%-32s failed: %s\n", it->strName, it->strError);
+        else
+            strOut += strprintf("%-32s %12u %14.1f %14.1f %14.1f\n", it->strName, it->nBatchSize * it->nSamples,
+                                it->dMinNanos, it->dMedianNanos, it->dMaxNanos);
+    }
+    return strOut;
+}
+
+std::string FormatJSON(const std::vector<Result>& vResults, unsigned int nSamples, int64_t nSampleMicros)
+{
+    json_spirit::Array benchmarks;
+    for (std::vector<Result>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+    {
+        json_spirit::Object bench;
+        bench.push_back(json_spirit::Pair("name", it->strName));
+        if (!it->strError.empty()) {
+            bench.push_back(json_spirit::Pair("error", it->strError));
+        } else {
+            bench.push_back(json_spirit::Pair("iterations_per_sample", (uint64_t)it->nBatchSize));
+            bench.push_back(json_spirit::Pair("samples", (int)it->nSamples));
+            bench.push_back(json_spirit::Pair("min_ns", it->dMinNanos));
+            bench.push_back(json_spirit::Pair("median_ns", it->dMedianNanos));
+            bench.push_back(json_spirit::Pair("max_ns", it->dMaxNanos));
+        }
+        benchmarks.push_back(bench);
+    }
+
+    json_spirit::Object root;
+    root.push_back(json_spirit::Pair("version", FormatFullVersion()));
+    root.push_back(json_spirit::Pair("time", GetTime()));
+    root.push_back(json_spirit::Pair("samples", (int)nSamples));
+    root.push_back(json_spirit::Pair("sample_us", nSampleMicros));
+    root.push_back(json_spirit::Pair("benchmarks", benchmarks));
+    return write_string(json_spirit::Value(root), true) + "\n";
+}
+
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+class CBlock;
+
+// Simple micro-benchmarking framework for bench_bolt. A benchmark is a
+// function that does its setup and then runs the code being measured in a
+// loop:
+//
+// static void CODE_TO_TIME(benchmark::State& state)
+// {
+//     ... do any setup needed...
+//     while (state.KeepRunning()) {
+//        ... do stuff you want to time...
+//     }
+//     ... do any cleanup needed...
+// }
+//
+// BENCHMARK(CODE_TO_TIME);
+
+namespace benchmark {
+
+/** Timing of one benchmark. The loop first runs in batches that double in
+ *  size until a batch takes a tenth of the sample time; that is the warmup
+ *  and it also sizes the batches. Then nSamples batches of about the sample
+ *  time each are timed, and each gives one time per iteration.
+ */
+class State
+{
+public:
+    State(unsigned int nSamplesIn, int64_t nSampleMicrosIn);
+
+    bool KeepRunning();
+
+    // per iteration times of the samples, in nanoseconds
+    const std::vector<double>& Samples() const { return vSampleNanos; }
+    // iterations in each sample
+    uint64_t BatchSize() const { return nBatch; }
+
+private:
+    unsigned int nSamples;
+    int64_t nSampleMicros;
+    bool fWarmup;
+    uint64_t nBatch;
+    uint64_t nLeft;
+    int64_t nBatchStart;
+    std::vector<double> vSampleNanos;
+};
+
+typedef void (*BenchFunction)(State&);
+
+struct Result
+{
+    std::string strName;
+    std::string strError;
+    uint64_t nBatchSize;
+    unsigned int nSamples;
+    double dMinNanos;
+    double dMedianNanos;
+    double dMaxNanos;
+};
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& Benchmarks();
+
+public:
+    BenchRunner(const std::string& strName, BenchFunction func);
+
+    static std::vector<std::string> List();
+    /** Run every benchmark whose name contains strFilter */
+    static std::vector<Result> RunAll(const std::string& strFilter, unsigned int nSamples, int64_t nSampleMicros);
+};
+
+/** Results as a table, one benchmark per line */
+std::string FormatText(const std::vector<Result>& vResults);
+/** Results as a JSON document, for tracking them across builds */
+std::string FormatJSON(const std::vector<Result>& vResults, unsigned int nSamples, int64_t nSampleMicros);
+
+}
+
+/** A block of about 500kB on a random parent, for the benchmarks that need one */
+CBlock SyntheticBlock();
+
+// BENCHMARK(foo) registers foo under the name "foo"
+#define BENCHMARK(n) \
+    static benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
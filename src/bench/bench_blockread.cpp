@@ -0,0 +1,107 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Random block reads from a few block files laid out like blk?????.dat: once
+// opening and seeking the file for every read (as OpenBlockFile does) and
+// once through CFileCache. The files are written first and are normally in
+// the OS cache, so this measures the per read overhead, not the disk.
+
+#include "filecache.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+static const int nFiles = 4;
+static const int nBlocksPerFile = 200;
+
+struct BenchBlock {
+    int nFile;
+    unsigned int nPos;
+    unsigned int nSize;
+};
+
+static void Report(const char* pszName, int64_t nMicros, int nCount)
+{
+    printf("%-28s %8d ops %10.2f us/op %10.0f ops/s\n", pszName, nCount,
+           (double)nMicros / nCount, nMicros ? nCount * 1000000.0 / nMicros : 0.0);
+}
+
+static boost::filesystem::path BlockFilePath(const boost::filesystem::path& dir, int nFile)
+{
+    return dir / strprintf("blk%05u.dat", nFile);
+}
+
+int main(int argc, char* argv[])
+{
+    int nIters = argc > 1 ? atoi(argv[1]) : 20000;
+    if (nIters <= 0)
+        nIters = 20000;
+
+    boost::filesystem::path dir = GetTempPath() / strprintf("bench_blockread_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(dir);
+
+    // magic, size and 1 to 100kB of data per block
+    std::vector<BenchBlock> blocks;
+    std::vector<char> vData(100000, 'x');
+    for (int nFile = 0; nFile < nFiles; nFile++) {
+        FILE* file = fopen(BlockFilePath(dir, nFile).string().c_str(), "wb");
+        if (!file) {
+            fprintf(stderr, "bench_blockread: unable to create %s\n", BlockFilePath(dir, nFile).string().c_str());
+            return 1;
+        }
+        unsigned int nPos = 0;
+        for (int i = 0; i < nBlocksPerFile; i++) {
+            BenchBlock block;
+            block.nFile = nFile;
+            block.nSize = 1000 + GetRand(99000);
+            block.nPos = nPos + 8;
+            fwrite("\xd1\x2b\xb3\x7a", 1, 4, file);
+            fwrite(&block.nSize, 1, 4, file);
+            fwrite(&vData[0], 1, block.nSize, file);
+            nPos = block.nPos + block.nSize;
+            blocks.push_back(block);
+        }
+        fclose(file);
+    }
+
+    std::vector<int> vOrder(nIters);
+    for (int i = 0; i < nIters; i++)
+        vOrder[i] = GetRand(blocks.size());
+
+    int nFailed = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchBlock& block = blocks[vOrder[i]];
+        FILE* file = fopen(BlockFilePath(dir, block.nFile).string().c_str(), "rb+");
+        if (!file || fseek(file, block.nPos, SEEK_SET) || fread(&vData[0], 1, block.nSize, file) != block.nSize)
+            nFailed++;
+        if (file)
+            fclose(file);
+    }
+    Report("reopen, fseek and fread", GetTimeMicros() - nStart, nIters);
+
+    CFileCache cache(32);
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchBlock& block = blocks[vOrder[i]];
+        unsigned int nSize = 0;
+        if (!cache.Read(BlockFilePath(dir, block.nFile), block.nPos - 4, (char*)&nSize, 4) || nSize != block.nSize ||
+            !cache.Read(BlockFilePath(dir, block.nFile), block.nPos, &vData[0], nSize))
+            nFailed++;
+    }
+    Report("CFileCache pread", GetTimeMicros() - nStart, nIters);
+
+    cache.Clear();
+    boost::filesystem::remove_all(dir);
+
+    if (nFailed) {
+        fprintf(stderr, "bench_blockread: %d reads failed\n", nFailed);
+        return 1;
+    }
+    return 0;
+}
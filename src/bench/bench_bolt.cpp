@@ -0,0 +1,148 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Runs the benchmarks registered with BENCHMARK() in bench/*.cpp. They get a
+// node set up in a temporary data directory, like test_bolt's: block and
+// coin databases in memory, the genesis block, and a chain of headers on top
+// of it for the code that needs a tip.
+
+#include "bench/bench.h"
+
+#include "chainparams.h"
+#include "init.h"
+#include "main.h"
+#include "noui.h"
+#include "txdb.h"
+#include "util.h"
+#ifdef ENABLE_WALLET
+#include "wallet.h"
+#endif
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+
+/** Default for -samples, timed samples per benchmark */
+static const unsigned int DEFAULT_BENCH_SAMPLES = 10;
+/** Default for -sampletime, milliseconds per sample */
+static const int64_t DEFAULT_BENCH_SAMPLE_TIME = 100;
+/** Headers on top of genesis for the benchmarks that need a chain */
+static const int BENCH_CHAIN_HEIGHT = 1000;
+
+// Defined here so that init.cpp isn't linked in, as in test_bolt
+CWallet* pwalletMain;
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+// Index nBlocks headers on top of the tip, one a minute up to now, and make
+// the last one the tip. The blocks don't exist; only their index does.
+static void ExtendChain(int nBlocks)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    int64_t nTimeStart = GetTime() - nBlocks * 60;
+    for (int i = 0; i < nBlocks; i++)
+    {
+        CBlockHeader header;
+        header.nVersion = 2;
+        header.hashPrevBlock = pindexPrev->GetBlockHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = nTimeStart + i * 60;
+        header.nBits = pindexPrev->nBits;
+        header.nNonce = i;
+
+        CBlockIndex* pindex = new CBlockIndex(header);
+        pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(header.GetHash(), pindex)).first->first;
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev->nHeight + 1;
+        pindex->nChainWork = pindexPrev->nChainWork + pindex->GetBlockWork();
+        pindex->nStatus = BLOCK_VALID_TREE;
+        pindexPrev = pindex;
+    }
+    chainActive.SetTip(pindexPrev);
+    pcoinsTip->SetBestBlock(pindexPrev->GetBlockHash());
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help"))
+    {
+        std::string strUsage = "Usage:\n";
+        strUsage += "  bench_bolt [options]\n\n";
+        strUsage += "Options:\n";
+        strUsage += "  -?                     This help message\n";
+        strUsage += "  -list                  List the benchmarks and exit\n";
+        strUsage += "  -filter=<str>          Only run benchmarks whose name contains <str>\n";
+        strUsage += strprintf("  -samples=<n>           Timed samples per benchmark (default: %u)\n", DEFAULT_BENCH_SAMPLES);
+        strUsage += strprintf("  -sampletime=<n>        Milliseconds per sample (default: %d)\n", DEFAULT_BENCH_SAMPLE_TIME);
+        strUsage += "  -json                  Print the results as JSON\n";
+        fprintf(stdout, "%s", strUsage.c_str());
+        return 0;
+    }
+
+    if (mapArgs.count("-list"))
+    {
+        std::vector<std::string> vNames = benchmark::BenchRunner::List();
+        for (std::vector<std::string>::const_iterator it = vNames.begin(); it != vNames.end(); ++it)
+            fprintf(stdout, "%s\n", it->c_str());
+        return 0;
+    }
+
+    unsigned int nSamples = std::max((int64_t)1, GetArg("-samples", DEFAULT_BENCH_SAMPLES));
+    int64_t nSampleMicros = std::max((int64_t)1, GetArg("-sampletime", DEFAULT_BENCH_SAMPLE_TIME)) * 1000;
+
+    fPrintToDebugLog = false;
+    noui_connect();
+
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("bench_bolt_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    CCoinsViewDB* pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(*pcoinsdbview);
+    if (!InitBlockIndex()) {
+        fprintf(stderr, "bench_bolt: unable to create the genesis block\n");
+        return 1;
+    }
+    ExtendChain(BENCH_CHAIN_HEIGHT);
+#ifdef ENABLE_WALLET
+    pwalletMain = new CWallet();
+#endif
+
+    // as set up by AppInit2
+    darkSendDenominations.push_back( (100      * COIN)+100000 );
+    darkSendDenominations.push_back( (10       * COIN)+10000 );
+    darkSendDenominations.push_back( (1        * COIN)+1000 );
+    darkSendDenominations.push_back( (.1       * COIN)+100 );
+
+    std::vector<benchmark::Result> vResults = benchmark::BenchRunner::RunAll(GetArg("-filter", ""), nSamples, nSampleMicros);
+    if (GetBoolArg("-json", false))
+        fprintf(stdout, "%s", benchmark::FormatJSON(vResults, nSamples, nSampleMicros).c_str());
+    else
+        fprintf(stdout, "%s", benchmark::FormatText(vResults).c_str());
+
+#ifdef ENABLE_WALLET
+    delete pwalletMain;
+    pwalletMain = NULL;
+#endif
+    delete pcoinsTip;
+    delete pcoinsdbview;
+    delete pblocktree;
+    boost::filesystem::remove_all(pathTemp);
+
+    for (std::vector<benchmark::Result>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+        if (!it->strError.empty())
+            return 1;
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Compare ECDSA verification and compact key recovery through CPubKey (the
+// in-tree secp256k1 engine) against the OpenSSL code path.
+
+#include "key.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <vector>
+
+static const int nKeys = 64;
+
+struct BenchItem {
+    CPubKey pubkey;
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    std::vector<unsigned char> vchCompact;
+};
+
+static void Report(const char* pszName, int64_t nMicros, int nCount)
+{
+    printf("%-28s %8d ops %10.2f us/op %10.0f ops/s\n", pszName, nCount,
+           (double)nMicros / nCount, nMicros ? nCount * 1000000.0 / nMicros : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+    int nIters = argc > 1 ? atoi(argv[1]) : 20000;
+    if (nIters <= 0)
+        nIters = 20000;
+
+    std::vector<BenchItem> items(nKeys);
+    for (int i = 0; i < nKeys; i++) {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        items[i].pubkey = key.GetPubKey();
+        items[i].hash = GetRandHash();
+        if (!key.Sign(items[i].hash, items[i].vchSig) || !key.SignCompact(items[i].hash, items[i].vchCompact)) {
+            fprintf(stderr, "bench_verify: signing failed\n");
+            return 1;
+        }
+    }
+
+    int nFailed = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchItem& item = items[i % nKeys];
+        if (!item.pubkey.Verify(item.hash, item.vchSig))
+            nFailed++;
+    }
+    Report("verify (secp256k1)", GetTimeMicros() - nStart, nIters);
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchItem& item = items[i % nKeys];
+        if (!ECC_VerifyOpenSSL(item.pubkey, item.hash, item.vchSig))
+            nFailed++;
+    }
+    Report("verify (OpenSSL)", GetTimeMicros() - nStart, nIters);
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchItem& item = items[i % nKeys];
+        CPubKey pubkey;
+        if (!pubkey.RecoverCompact(item.hash, item.vchCompact) || pubkey != item.pubkey)
+            nFailed++;
+    }
+    Report("recover (secp256k1)", GetTimeMicros() - nStart, nIters);
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIters; i++) {
+        const BenchItem& item = items[i % nKeys];
+        CPubKey pubkey;
+        if (!ECC_RecoverCompactOpenSSL(pubkey, item.hash, item.vchCompact) || pubkey != item.pubkey)
+            nFailed++;
+    }
+    Report("recover (OpenSSL)", GetTimeMicros() - nStart, nIters);
+
+    if (nFailed) {
+        fprintf(stderr, "bench_verify: %d operations failed\n", nFailed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "core.h"
+#include "serialize.h"
+#include "util.h"
+#include "version.h"
+
+#include <stdexcept>
+#include <vector>
+
+// About 500kB: a coinbase and 2000 transactions with one input and two
+// pay-to-pubkey-hash outputs each
+CBlock SyntheticBlock()
+{
+    CBlock block;
+    block.nVersion = 2;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    block.nBits = 0x1b0404cb;
+
+    CTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1000 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    block.vtx.push_back(coinbase);
+
+    for (int i = 0; i < 2000; i++) {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i % 3);
+        // DER signature and compressed pubkey sized pushes
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = (j + 1) * COIN / 10;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i + j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void BuildMerkleTree(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock();
+    uint256 hashMerkleRoot;
+    while (state.KeepRunning())
+        hashMerkleRoot = block.BuildMerkleTree();
+    if (hashMerkleRoot != block.hashMerkleRoot)
+        throw std::runtime_error("merkle root changed");
+}
+
+// Serialize the block into a CDataStream and read it back
+static void DataStreamBlockRoundTrip(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    CBlock blockRead;
+    while (state.KeepRunning()) {
+        ss.clear();
+        ss << block;
+        ss >> blockRead;
+    }
+    if (blockRead.GetHash() != block.GetHash() || blockRead.vtx.size() != block.vtx.size())
+        throw std::runtime_error("block changed in the round trip");
+}
+
+BENCHMARK(BuildMerkleTree);
+BENCHMARK(DataStreamBlockRoundTrip);
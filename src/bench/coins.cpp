@@ -0,0 +1,74 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "coins.h"
+#include "util.h"
+
+#include <stdexcept>
+#include <vector>
+
+static const unsigned int nCoinsInParent = 20000;
+static const unsigned int nCoinsPerIteration = 1000;
+
+// A cache holding nCoinsInParent pay-to-pubkey-hash outputs, like pcoinsTip
+// between flushes, and the txids to use from it in a random order
+static void FillParent(CCoinsViewCache& parent, std::vector<uint256>& vTxids)
+{
+    std::vector<uint256> vAll;
+    for (unsigned int i = 0; i < nCoinsInParent; i++) {
+        uint256 txid = GetRandHash();
+        CCoinsModifier coins = parent.ModifyCoins(txid);
+        coins->nVersion = 1;
+        coins->nHeight = 1000 + i;
+        coins->vout.resize(1 + i % 3);
+        for (unsigned int j = 0; j < coins->vout.size(); j++) {
+            coins->vout[j].nValue = COIN + i;
+            coins->vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i + j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        vAll.push_back(txid);
+    }
+    for (unsigned int i = 0; i < nCoinsPerIteration; i++)
+        vTxids.push_back(vAll[GetRand(vAll.size())]);
+}
+
+// Reading coins through a fresh cache, as validating a block does
+static void CoinsCacheFetch(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache parent(base);
+    std::vector<uint256> vTxids;
+    FillParent(parent, vTxids);
+
+    int64_t nValue = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(parent, true);
+        for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); ++it)
+            nValue += cache.GetCoins(*it).vout[0].nValue;
+    }
+    if (nValue <= 0)
+        throw std::runtime_error("coins not found");
+}
+
+// Changing coins in a fresh cache and writing them back to its parent, as
+// connecting a block does
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache parent(base);
+    std::vector<uint256> vTxids;
+    FillParent(parent, vTxids);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(parent, true);
+        for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); ++it)
+            cache.ModifyCoins(*it)->vout[0].nValue ^= 1;
+        if (!cache.Flush())
+            throw std::runtime_error("flush failed");
+    }
+}
+
+BENCHMARK(CoinsCacheFetch);
+BENCHMARK(CoinsCacheFlush);
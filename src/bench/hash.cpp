@@ -0,0 +1,38 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "core.h"
+#include "hash.h"
+#include "util.h"
+
+#include <vector>
+
+// A block header: what every proof of work check hashes
+static void HashBlake_80B(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 2;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = GetTime();
+    header.nBits = 0x1b0404cb;
+    header.nNonce = 0;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetHash();
+    }
+}
+
+static void HashBlake_1MB(benchmark::State& state)
+{
+    std::vector<unsigned char> vData(1000000, 0x5a);
+    uint256 hash;
+    while (state.KeepRunning())
+        hash = HashBlake(vData.begin(), vData.end());
+}
+
+BENCHMARK(HashBlake_80B);
+BENCHMARK(HashBlake_1MB);
@@ -0,0 +1,96 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "darksend.h"
+#include "main.h"
+#include "masternodeman.h"
+#include "netbase.h"
+#include "util.h"
+#include "version.h"
+#ifdef ENABLE_WALLET
+#include "init.h"
+#include "wallet.h"
+#endif
+
+#include <stdexcept>
+#include <vector>
+
+static const int nMasternodes = 1000;
+
+// Ranking nMasternodes masternodes for the tip, as payment voting and the
+// darksend queue do
+static void GetMasternodeRanks(benchmark::State& state)
+{
+    int nHeight = chainActive.Height();
+    if (nHeight <= 0)
+        throw std::runtime_error("no chain to rank for");
+
+    CKey key;
+    key.MakeNewKey(true);
+    for (int i = 0; i < nMasternodes; i++) {
+        CService addr(strprintf("10.%d.%d.1", i / 256, i % 256), Params().GetDefaultPort());
+        CTxIn vin(COutPoint(GetRandHash(), i % 2));
+        CMasternode mn(addr, vin, key.GetPubKey(), std::vector<unsigned char>(), GetAdjustedTime(), key.GetPubKey(), PROTOCOL_VERSION, CScript(), 0);
+        // don't look the collateral up in the coins
+        mn.unitTest = true;
+        mn.UpdateLastSeen();
+        mnodeman.Add(mn);
+    }
+
+    size_t nRanked = 0;
+    while (state.KeepRunning())
+        nRanked = mnodeman.GetMasternodeRanks(nHeight, 0).size();
+    mnodeman.Clear();
+    if (nRanked != (size_t)nMasternodes)
+        throw std::runtime_error(strprintf("ranked %u masternodes of %d", nRanked, nMasternodes));
+}
+
+BENCHMARK(GetMasternodeRanks);
+
+#ifdef ENABLE_WALLET
+static const int nDenomChains = 100;
+static const int nDenomRounds = 8;
+
+// Mixing rounds of the last outputs of nDenomChains chains of nDenomRounds
+// denominated wallet transactions, as coin selection for darksend asks
+static void GetInputDarksendRounds(benchmark::State& state)
+{
+    if (!pwalletMain || darkSendDenominations.empty())
+        throw std::runtime_error("no wallet");
+
+    CKey key;
+    key.MakeNewKey(true);
+    pwalletMain->AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    std::vector<CTxIn> vTips;
+    for (int i = 0; i < nDenomChains; i++) {
+        COutPoint prevout(GetRandHash(), 0);
+        for (int j = 0; j < nDenomRounds; j++) {
+            CTransaction tx;
+            tx.vin.push_back(CTxIn(prevout));
+            tx.vout.resize(2);
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                tx.vout[k].nValue = darkSendDenominations[(i + k) % darkSendDenominations.size()];
+                tx.vout[k].scriptPubKey = scriptPubKey;
+            }
+            pwalletMain->AddToWallet(CWalletTx(pwalletMain, tx), true);
+            prevout = COutPoint(tx.GetHash(), 0);
+        }
+        vTips.push_back(CTxIn(prevout));
+    }
+
+    while (state.KeepRunning()) {
+        for (std::vector<CTxIn>::const_iterator it = vTips.begin(); it != vTips.end(); ++it)
+            GetInputDarksendRounds(*it);
+    }
+    if (GetInputDarksendRounds(vTips[0]) != nDenomRounds - 1)
+        throw std::runtime_error("wrong number of rounds");
+}
+
+BENCHMARK(GetInputDarksendRounds);
+#endif
@@ -0,0 +1,75 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "core.h"
+#include "key.h"
+#include "main.h"
+#include "miner.h"
+#include "script.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <stdexcept>
+#include <vector>
+
+extern uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+static const int nMempoolTxs = 1000;
+
+// A block template from a mempool of nMempoolTxs signed transactions, each
+// spending a pay-to-pubkey-hash coin put into pcoinsTip for it
+static void CreateNewBlock(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (!chainActive.Tip())
+            throw std::runtime_error("no chain to build on");
+
+        for (int i = 0; i < nMempoolTxs; i++) {
+            uint256 txidFrom = GetRandHash();
+            {
+                CCoinsModifier coins = pcoinsTip->ModifyCoins(txidFrom);
+                coins->nVersion = 1;
+                coins->nHeight = 1;
+                coins->vout.resize(1);
+                coins->vout[0].nValue = COIN;
+                coins->vout[0].scriptPubKey = scriptPubKey;
+            }
+
+            int64_t nFee = 10000 + i;
+            CTransaction tx;
+            tx.vin.push_back(CTxIn(COutPoint(txidFrom, 0)));
+            tx.vout.push_back(CTxOut(COIN - nFee, scriptPubKey));
+            uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+            std::vector<unsigned char> vchSig;
+            if (!key.Sign(hash, vchSig))
+                throw std::runtime_error("signing failed");
+            vchSig.push_back((unsigned char)SIGHASH_ALL);
+            tx.vin[0].scriptSig = CScript() << vchSig << key.GetPubKey();
+
+            mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, GetTime(), 0, chainActive.Height()));
+        }
+    }
+
+    size_t nBlockTx = 0;
+    while (state.KeepRunning()) {
+        CBlockTemplate* pblocktemplate = ::CreateNewBlock(scriptPubKey);
+        if (!pblocktemplate)
+            throw std::runtime_error("CreateNewBlock failed");
+        nBlockTx = pblocktemplate->block.vtx.size();
+        delete pblocktemplate;
+    }
+    mempool.clear();
+    if (nBlockTx != (size_t)nMempoolTxs + 1)
+        throw std::runtime_error(strprintf("block template has %u transactions, expected %d", nBlockTx, nMempoolTxs + 1));
+}
+
+BENCHMARK(CreateNewBlock);
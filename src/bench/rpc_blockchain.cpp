@@ -0,0 +1,115 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "core.h"
+#include "main.h"
+#include "rpcprotocol.h"
+#include "rpcserver.h"
+#include "util.h"
+
+#include "json/json_spirit_value.h"
+
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+
+using namespace json_spirit;
+
+// Throws away what is written to it, as a client reading the reply would
+class CDiscardStreamBuf : public std::streambuf
+{
+public:
+    CDiscardStreamBuf() : nBytes(0) {}
+    size_t nBytes;
+
+protected:
+    int overflow(int c)
+    {
+        nBytes++;
+        return c;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n)
+    {
+        nBytes += n;
+        return n;
+    }
+};
+
+// The synthetic block, written to a block file of its own and indexed on top of
+// the tip but off the main chain, so that getblock finds it on disk
+static uint256 WriteBenchBlock()
+{
+    static uint256 hashBlock;
+    if (hashBlock != 0)
+        return hashBlock;
+
+    LOCK(cs_main);
+    CBlock block = SyntheticBlock();
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    CDiskBlockPos pos(1, 0);
+    if (!WriteBlockToDisk(block, pos))
+        throw std::runtime_error("can't write the block");
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first->first;
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = pindex->pprev->nHeight + 1;
+    pindex->nChainWork = pindex->pprev->nChainWork + pindex->GetBlockWork();
+    pindex->nFile = pos.nFile;
+    pindex->nDataPos = pos.nPos;
+    pindex->nStatus = BLOCK_VALID_TREE | BLOCK_HAVE_DATA;
+    hashBlock = block.GetHash();
+    return hashBlock;
+}
+
+// getblock with transaction details as replied to an HTTP/1.0 client: the
+// result is built as a json_spirit tree and rendered into one reply string
+static void GetBlockVerboseTree(benchmark::State& state)
+{
+    Array params;
+    params.push_back(WriteBenchBlock().GetHex());
+    params.push_back(true);
+
+    CDiscardStreamBuf buf;
+    std::ostream os(&buf);
+    while (state.KeepRunning()) {
+        std::string strReply = JSONRPCReply(getblock(params, false), Value::null, 1);
+        os << HTTPReply(HTTP_OK, strReply, true) << std::flush;
+    }
+    if (buf.nBytes == 0)
+        throw std::runtime_error("nothing written");
+}
+
+// The same reply streamed to an HTTP/1.1 client, a chunk at a time, as
+// StreamRPCReply does it
+static void GetBlockVerboseStream(benchmark::State& state)
+{
+    Array params;
+    params.push_back(WriteBenchBlock().GetHex());
+    params.push_back(true);
+
+    CDiscardStreamBuf buf;
+    std::ostream os(&buf);
+    while (state.KeepRunning()) {
+        CHTTPChunkedStreamBuf chunked(os, HTTP_OK, true);
+        std::ostream osReply(&chunked);
+        CJSONStreamWriter writer(osReply);
+        writer.BeginObject();
+        writer.Key("result");
+        if (!getblock_stream(params, writer))
+            throw std::runtime_error("getblock_stream declined");
+        writer.WritePair("error", Value::null);
+        writer.WritePair("id", 1);
+        writer.EndObject();
+        osReply << "\n";
+        chunked.Finish();
+    }
+    if (buf.nBytes == 0)
+        throw std::runtime_error("nothing written");
+}
+
+BENCHMARK(GetBlockVerboseTree);
+BENCHMARK(GetBlockVerboseStream);
@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/bench.h"
+
+#include "core.h"
+#include "key.h"
+#include "script.h"
+
+#include <stdexcept>
+#include <vector>
+
+extern uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+// Spending a pay-to-pubkey-hash output, as block validation does with an
+// empty signature cache
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CTransaction txFrom;
+    txFrom.vout.resize(1);
+    txFrom.vout[0].nValue = COIN;
+    txFrom.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    CTransaction txTo;
+    txTo.vin.resize(1);
+    txTo.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    txTo.vout.resize(1);
+    txTo.vout[0].nValue = COIN - 10000;
+    txTo.vout[0].scriptPubKey = txFrom.vout[0].scriptPubKey;
+    // signed by hand: SignSignature would verify the result and leave it in
+    // the signature cache, and NOCACHE below keeps it out of there too
+    uint256 hash = SignatureHash(txFrom.vout[0].scriptPubKey, txTo, 0, SIGHASH_ALL);
+    std::vector<unsigned char> vchSig;
+    if (!key.Sign(hash, vchSig))
+        throw std::runtime_error("signing failed");
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    txTo.vin[0].scriptSig = CScript() << vchSig << key.GetPubKey();
+
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_NOCACHE;
+    while (state.KeepRunning()) {
+        if (!VerifyScript(txTo.vin[0].scriptSig, txFrom.vout[0].scriptPubKey, txTo, 0, flags, 0))
+            throw std::runtime_error("script verification failed");
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
@@ -0,0 +1,161 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "hash.h"
+#include "main.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include <boost/foreach.hpp>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
+    header(block), nonce(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    FillShortTxIDSelector();
+
+    // the receiver can't have the coinbase yet
+    prefilledtxn.resize(1);
+    prefilledtxn[0].index = 0;
+    prefilledtxn[0].tx = block.vtx[0];
+
+    shorttxids.reserve(block.vtx.size() - 1);
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        shorttxids.push_back(CShortTxID(GetShortID(block.vtx[i].GetHash())));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector()
+{
+    CHashWriter ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header << nonce;
+    uint256 hashKey = ss.GetHash();
+    nShortIDKey0 = hashKey.Get64(0);
+    nShortIDKey1 = hashKey.Get64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(nShortIDKey0, nShortIDKey1, txhash) & 0xffffffffffffULL;
+}
+
+ReadStatus CPartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool, const std::vector<CTransaction>& vExtraTxn)
+{
+    size_t nTxCount = cmpctblock.BlockTxCount();
+    if (cmpctblock.header.IsNull() || nTxCount == 0 || nTxCount > MAX_BLOCK_SIZE / MIN_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    header = cmpctblock.header;
+    vtx.assign(nTxCount, CTransaction());
+    vHave.assign(nTxCount, false);
+    nPrefilled = nFromPool = 0;
+
+    BOOST_FOREACH(const CPrefilledTransaction& prefilled, cmpctblock.prefilledtxn)
+    {
+        if (prefilled.index >= nTxCount || vHave[prefilled.index] || prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        vtx[prefilled.index] = prefilled.tx;
+        vHave[prefilled.index] = true;
+        nPrefilled++;
+    }
+
+    // the short IDs take the remaining positions in order
+    std::map<uint64_t, uint16_t> mapShortIDs;
+    std::vector<CShortTxID>::const_iterator itShort = cmpctblock.shorttxids.begin();
+    for (uint16_t i = 0; i < nTxCount; i++)
+    {
+        if (vHave[i])
+            continue;
+        // two transactions of the block with the same short ID, by chance or on purpose
+        if (!mapShortIDs.insert(std::make_pair((*itShort).nID, i)).second)
+            return READ_STATUS_FAILED;
+        ++itShort;
+    }
+
+    // Several candidates for one position leave it to be requested
+    std::vector<bool> vAmbiguous(nTxCount, false);
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator mi = pool.mapTx.begin(); mi != pool.mapTx.end(); ++mi)
+        {
+            std::map<uint64_t, uint16_t>::const_iterator it = mapShortIDs.find(cmpctblock.GetShortID(mi->first));
+            if (it == mapShortIDs.end() || vAmbiguous[it->second])
+                continue;
+            if (vHave[it->second]) {
+                vtx[it->second] = CTransaction();
+                vHave[it->second] = false;
+                vAmbiguous[it->second] = true;
+                continue;
+            }
+            vtx[it->second] = mi->second.GetTx();
+            vHave[it->second] = true;
+        }
+    }
+    BOOST_FOREACH(const CTransaction& tx, vExtraTxn)
+    {
+        uint256 hash = tx.GetHash();
+        std::map<uint64_t, uint16_t>::const_iterator it = mapShortIDs.find(cmpctblock.GetShortID(hash));
+        if (it == mapShortIDs.end() || vAmbiguous[it->second])
+            continue;
+        if (vHave[it->second]) {
+            if (vtx[it->second].GetHash() != hash) {
+                vtx[it->second] = CTransaction();
+                vHave[it->second] = false;
+                vAmbiguous[it->second] = true;
+            }
+            continue;
+        }
+        vtx[it->second] = tx;
+        vHave[it->second] = true;
+    }
+
+    nFromPool = std::count(vHave.begin(), vHave.end(), true) - nPrefilled;
+    return READ_STATUS_OK;
+}
+
+bool CPartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(index < vHave.size());
+    return vHave[index];
+}
+
+void CPartiallyDownloadedBlock::GetMissing(std::vector<uint16_t>& vIndexes) const
+{
+    vIndexes.clear();
+    for (uint16_t i = 0; i < vHave.size(); i++)
+        if (!vHave[i])
+            vIndexes.push_back(i);
+}
+
+ReadStatus CPartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vMissingTxn) const
+{
+    if (header.IsNull())
+        return READ_STATUS_INVALID;
+
+    block = CBlock(header);
+    block.vtx.resize(vtx.size());
+    size_t nMissing = 0;
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        if (vHave[i]) {
+            block.vtx[i] = vtx[i];
+        } else {
+            if (nMissing >= vMissingTxn.size())
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vMissingTxn[nMissing++];
+        }
+    }
+    if (nMissing != vMissingTxn.size())
+        return READ_STATUS_INVALID;
+
+    // A short ID that matched the wrong mempool transaction shows up here
+    if (block.BuildMerkleTree() != block.hashMerkleRoot)
+        return READ_STATUS_FAILED;
+
+    return READ_STATUS_OK;
+}
@@ -0,0 +1,162 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "core.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CTxMemPool;
+
+/** Compact block relay
+ *
+ *  A peer that sent "sendcmpct" gets new blocks pushed as a "cmpctblock":
+ *  the header, the coinbase, and a 6 byte short ID for every other
+ *  transaction. The short IDs are SipHash-2-4 of the txid, keyed from the
+ *  header and a random nonce so they can't be ground for collisions in
+ *  advance. The receiver fills in what it has in its mempool (or among the
+ *  instantX lock requests), asks for the rest with "getblocktxn" and gets
+ *  them back in a "blocktxn". Whatever goes wrong on the way ends in a
+ *  request for the full block.
+ */
+
+/** Smallest possible serialized transaction; bounds the transaction count of a block */
+static const unsigned int MIN_TRANSACTION_SIZE = 60;
+
+/** A transaction sent in full with a compact block, and its position in the block */
+class CPrefilledTransaction
+{
+public:
+    uint16_t index;
+    CTransaction tx;
+
+    CPrefilledTransaction() : index(0) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(index);
+        READWRITE(tx);
+    )
+};
+
+/** Short ID on the wire: the low 48 bits of a uint64_t */
+class CShortTxID
+{
+public:
+    uint64_t nID;
+
+    CShortTxID(uint64_t nIDIn = 0) : nID(nIDIn) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        CShortTxID* pthis = const_cast<CShortTxID*>(this);
+        uint32_t nLow = (uint32_t)nID;
+        uint16_t nHigh = (uint16_t)(nID >> 32);
+        READWRITE(nLow);
+        READWRITE(nHigh);
+        if (fRead)
+            pthis->nID = ((uint64_t)nHigh << 32) | nLow;
+    )
+};
+
+/** The "cmpctblock" message */
+class CBlockHeaderAndShortTxIDs
+{
+public:
+    CBlockHeader header;
+    uint64_t nonce;
+    std::vector<CShortTxID> shorttxids;
+    std::vector<CPrefilledTransaction> prefilledtxn;
+
+    CBlockHeaderAndShortTxIDs() : nonce(0), nShortIDKey0(0), nShortIDKey1(0) {}
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    /** The short ID of a transaction in this block */
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header);
+        READWRITE(nonce);
+        READWRITE(shorttxids);
+        READWRITE(prefilledtxn);
+        if (fRead)
+            const_cast<CBlockHeaderAndShortTxIDs*>(this)->FillShortTxIDSelector();
+    )
+
+private:
+    uint64_t nShortIDKey0;
+    uint64_t nShortIDKey1;
+
+    void FillShortTxIDSelector();
+};
+
+/** The "getblocktxn" message: the transactions of a compact block that are still missing */
+class CBlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(blockhash);
+        READWRITE(indexes);
+    )
+};
+
+/** The "blocktxn" message: the answer to a "getblocktxn", in the order asked */
+class CBlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(blockhash);
+        READWRITE(txn);
+    )
+};
+
+enum ReadStatus
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, // the peer sent something that can't be right
+    READ_STATUS_FAILED   // it didn't work out; fall back to the full block
+};
+
+/** A block being reconstructed from a compact block */
+class CPartiallyDownloadedBlock
+{
+public:
+    CBlockHeader header;
+
+    // where the transactions came from, for the log
+    unsigned int nPrefilled;
+    unsigned int nFromPool;
+
+    CPartiallyDownloadedBlock() : nPrefilled(0), nFromPool(0) {}
+
+    /** Lay out the block and fill in what can be found in pool or vExtraTxn */
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool, const std::vector<CTransaction>& vExtraTxn);
+    bool IsTxAvailable(size_t index) const;
+    /** The indexes of the transactions InitData couldn't find */
+    void GetMissing(std::vector<uint16_t>& vIndexes) const;
+    /** Complete the block with the missing transactions, in index order */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vMissingTxn) const;
+
+private:
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vHave;
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
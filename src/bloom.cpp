@@ -5,8 +5,12 @@
 #include "bloom.h"
 
 #include "core.h"
+#include "hash.h"
 #include "script.h"
+#include "util.h"
 
+#include <algorithm>
+#include <limits>
 #include <math.h>
 #include <stdlib.h>
 
@@ -180,3 +184,74 @@ void CBloomFilter::UpdateEmptyFull()
     isFull = full;
     isEmpty = empty;
 }
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double nFPRate)
+{
+    double logFPRate = log(nFPRate);
+    // The optimal number of hash functions is log(fpRate) / log(0.5)
+    nHashFuncs = max(1, min((int)(logFPRate / log(0.5) + 0.5), (int)MAX_HASH_FUNCS));
+    // Each generation holds half the elements, and up to three are live at once
+    nEntriesPerGeneration = (nElements + 1) / 2;
+    unsigned int nMaxElements = nEntriesPerGeneration * 3;
+    // The size for nMaxElements at nFPRate with nHashFuncs hash functions:
+    // -nHashFuncs * nMaxElements / log(1 - exp(log(fpRate) / nHashFuncs))
+    unsigned int nFilterBits = (unsigned int)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(logFPRate / nHashFuncs)));
+    // two words for every 64 positions
+    data.resize(((nFilterBits + 63) / 64) * 2);
+    reset();
+}
+
+void CRollingBloomFilter::insert(const uint256& hash)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration) {
+        nEntriesThisGeneration = 0;
+        nGeneration++;
+        if (nGeneration == 4)
+            nGeneration = 1;
+        // Wipe the positions last set in the generation that now starts over
+        uint64_t nGenerationMask1 = -(uint64_t)(nGeneration & 1);
+        uint64_t nGenerationMask2 = -(uint64_t)(nGeneration >> 1);
+        for (unsigned int p = 0; p < data.size(); p += 2) {
+            uint64_t p1 = data[p], p2 = data[p + 1];
+            uint64_t mask = (p1 ^ nGenerationMask1) | (p2 ^ nGenerationMask2);
+            data[p] = p1 & mask;
+            data[p + 1] = p2 & mask;
+        }
+    }
+    nEntriesThisGeneration++;
+
+    // nHashFuncs positions from one SipHash, by double hashing
+    uint64_t h = SipHashUint256(k0, k1, hash);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    for (unsigned int n = 0; n < nHashFuncs; n++) {
+        uint32_t hn = h1 + n * h2;
+        int bit = hn & 0x3F;
+        uint32_t pos = (hn >> 6) % (data.size() / 2) * 2;
+        data[pos] = (data[pos] & ~((uint64_t)1 << bit)) | ((uint64_t)(nGeneration & 1)) << bit;
+        data[pos + 1] = (data[pos + 1] & ~((uint64_t)1 << bit)) | ((uint64_t)(nGeneration >> 1)) << bit;
+    }
+}
+
+bool CRollingBloomFilter::contains(const uint256& hash) const
+{
+    uint64_t h = SipHashUint256(k0, k1, hash);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    for (unsigned int n = 0; n < nHashFuncs; n++) {
+        uint32_t hn = h1 + n * h2;
+        int bit = hn & 0x3F;
+        uint32_t pos = (hn >> 6) % (data.size() / 2) * 2;
+        // a position with generation 0 is empty
+        if (!(((data[pos] | data[pos + 1]) >> bit) & 1))
+            return false;
+    }
+    return true;
+}
+
+void CRollingBloomFilter::reset()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    std::fill(data.begin(), data.end(), 0);
+}
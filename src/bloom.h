@@ -7,6 +7,7 @@
 
 #include "serialize.h"
 
+#include <stdint.h>
 #include <vector>
 
 class COutPoint;
@@ -89,4 +90,37 @@ public:
     void UpdateEmptyFull();
 };
 
+/**
+ * RollingBloomFilter is a probabilistic "keep track of most recently inserted" set.
+ * Construct it with the number of items to keep track of, and a false-positive rate.
+ *
+ * contains(item) will always return true if item was one of the last N things
+ * insert()'ed ... but may also return true for items that were not inserted.
+ *
+ * Its size is fixed at construction. Every position holds a 2 bit generation
+ * number; inserting starts a new generation every N/2 items, which clears the
+ * oldest one, so between N and 1.5 N items are remembered. The hashes are
+ * salted SipHash, so peers can't make their items collide with others.
+ */
+class CRollingBloomFilter
+{
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    // Forget everything, and draw a new salt
+    void reset();
+
+private:
+    unsigned int nEntriesPerGeneration;
+    unsigned int nEntriesThisGeneration;
+    int nGeneration;
+    // the low and high bit of each position's generation, in alternate words
+    std::vector<uint64_t> data;
+    unsigned int nHashFuncs;
+    uint64_t k0, k1;
+};
+
 #endif /* BITCOIN_BLOOM_H */
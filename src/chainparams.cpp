@@ -55,7 +55,8 @@ public:
         nDefaultPort = 11990;
         nRPCPort = 11991;
 
-        bnProofOfWorkLimit = CBigNum(~uint256(0) >> 20);
+        targetProofOfWorkLimit = ~uint256(0) >> 20;
+        bnProofOfWorkLimit = CBigNum(targetProofOfWorkLimit);
         nSubsidyHalvingInterval = 700800; // 2 years
 
         // Genesis block
@@ -175,7 +176,8 @@ public:
         pchMessageStart[2] = 0xc3;
         pchMessageStart[3] = 0x56;
         nSubsidyHalvingInterval = 150;
-        bnProofOfWorkLimit = CBigNum(~uint256(0) >> 1);
+        targetProofOfWorkLimit = ~uint256(0) >> 1;
+        bnProofOfWorkLimit = CBigNum(targetProofOfWorkLimit);
         genesis.nTime = 1513776186;
         genesis.nBits = 0x1e0ffff0;
         genesis.nNonce = 767305;
@@ -125,6 +125,17 @@ namespace Checkpoints
         return fWorkBefore / (fWorkBefore + fWorkAfter);
     }
 
+    bool IsCheckpoint(int nHeight, const uint256& hash)
+    {
+        if (!fEnabled)
+            return false;
+
+        const MapCheckpoints& checkpoints = *Checkpoints().mapCheckpoints;
+
+        MapCheckpoints::const_iterator i = checkpoints.find(nHeight);
+        return i != checkpoints.end() && hash == i->second;
+    }
+
     int GetTotalBlocksEstimate()
     {
         if (!fEnabled)
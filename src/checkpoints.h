@@ -18,6 +18,9 @@ namespace Checkpoints
     // Returns true if block passes checkpoint checks
     bool CheckBlock(int nHeight, const uint256& hash);
 
+    // Returns true if hash is the checkpoint at nHeight
+    bool IsCheckpoint(int nHeight, const uint256& hash);
+
     // Return conservative estimate of total number of blocks, 0 if unknown
     int GetTotalBlocksEstimate();
 
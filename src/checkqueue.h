@@ -5,7 +5,10 @@
 #ifndef CHECKQUEUE_H
 #define CHECKQUEUE_H
 
+#include "util.h"
+
 #include <algorithm>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -15,6 +18,25 @@
 
 template<typename T> class CCheckQueueControl;
 
+/** Counters describing how a CCheckQueue has been performing. */
+struct CCheckQueueStats
+{
+    uint64_t nChecks;          // verifications executed
+    uint64_t nBatches;         // batches executed
+    uint64_t nSteals;          // batches taken from another thread's queue
+    uint64_t nStealMisses;     // full scans of the other queues that found nothing
+    uint64_t nContended;       // per-thread queue locks that were already held
+    int64_t nWorkerIdleMicros; // time worker threads spent waiting for work
+    int64_t nMasterWaitMicros; // time the master spent waiting for workers to finish
+    unsigned int nWorkers;     // registered worker threads (excluding the master)
+    unsigned int nBatchSize;   // current adaptive batch size
+    double dCheckMicros;       // moving average of the cost of one verification
+
+    CCheckQueueStats() : nChecks(0), nBatches(0), nSteals(0), nStealMisses(0), nContended(0),
+                         nWorkerIdleMicros(0), nMasterWaitMicros(0), nWorkers(0), nBatchSize(0),
+                         dCheckMicros(0) {}
+};
+
 /** Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -23,9 +45,22 @@ template<typename T> class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a deque of pending verifications. The master spreads
+  * new work over the workers' deques; a thread takes batches from the back
+  * of its own deque and, once that is empty, steals from the front of the
+  * others'. The batch size adapts to the measured cost of a verification,
+  * so cheap checks are handed out in large batches and expensive ones in
+  * small batches that keep all threads busy until the end.
   */
 template<typename T> class CCheckQueue {
 private:
+    // Verifications queued for one thread, protected by its own lock.
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
     // Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -35,9 +70,23 @@ private:
     // Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    // The queue of elements to be processed.
-    // As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    // Per-thread queues. Slot 0 belongs to the master, workers take slots
+    // 1..nWorkers in the order they start. The vector never changes size, so
+    // it may be read without holding mutex.
+    std::vector<WorkerQueue*> vQueues;
+
+    // The number of registered worker threads.
+    unsigned int nWorkers;
+
+    // The worker queue the next batch of added checks goes to.
+    unsigned int nNextQueue;
+
+    // Incremented whenever checks are added, so a thread that found every
+    // queue empty can tell whether new work arrived while it was looking.
+    uint64_t nGeneration;
+
+    // The number of threads that released mutex to look for or execute a batch.
+    int nBusy;
 
     // The number of workers (including the master) that are idle.
     int nIdle;
@@ -49,8 +98,8 @@ private:
     bool fAllOk;
 
     // Number of verifications that haven't completed yet.
-    // This includes elements that are not anymore in queue, but still in
-    // worker's own batches.
+    // This includes elements that are not anymore in a queue, but still in
+    // a thread's own batch.
     unsigned int nTodo;
 
     // Whether we're shutting down.
@@ -59,96 +108,226 @@ private:
     // The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    // The batch size currently handed out, between 1 and nBatchSize.
+    unsigned int nBatchSizeNow;
+
+    // Aim for batches that take about this long to execute.
+    static const int64_t nTargetBatchMicros = 2000;
+
+    CCheckQueueStats stats;
+
+    static void LockQueue(WorkerQueue *pq, uint64_t &nContended) {
+        if (!pq->mutex.try_lock()) {
+            nContended++;
+            pq->mutex.lock();
+        }
+    }
+
+    // Move up to nMax checks from our own queue (newest first) into vChecks.
+    unsigned int TakeOwn(unsigned int nSlot, std::vector<T> &vChecks, unsigned int nMax, uint64_t &nContended) {
+        WorkerQueue *pq = vQueues[nSlot];
+        LockQueue(pq, nContended);
+        boost::unique_lock<boost::mutex> lock(pq->mutex, boost::adopt_lock);
+        // Leave part of a large queue behind for threads that run dry.
+        unsigned int nNow = std::min(nMax, std::max((unsigned int)1, (unsigned int)(pq->checks.size() + 1) / 2));
+        nNow = std::min(nNow, (unsigned int)pq->checks.size());
+        for (unsigned int i = 0; i < nNow; i++) {
+            vChecks.push_back(T());
+            vChecks.back().swap(pq->checks.back());
+            pq->checks.pop_back();
+        }
+        return nNow;
+    }
+
+    // Steal up to nMax checks (but no more than half) from the oldest end of
+    // another thread's queue.
+    unsigned int Steal(unsigned int nSlot, unsigned int nQueues, std::vector<T> &vChecks, unsigned int nMax, uint64_t &nContended) {
+        for (unsigned int i = 1; i < nQueues; i++) {
+            WorkerQueue *pq = vQueues[(nSlot + i) % nQueues];
+            LockQueue(pq, nContended);
+            boost::unique_lock<boost::mutex> lock(pq->mutex, boost::adopt_lock);
+            if (pq->checks.empty())
+                continue;
+            unsigned int nNow = std::min(nMax, std::max((unsigned int)1, (unsigned int)pq->checks.size() / 2));
+            for (unsigned int j = 0; j < nNow; j++) {
+                vChecks.push_back(T());
+                vChecks.back().swap(pq->checks.front());
+                pq->checks.pop_front();
+            }
+            return nNow;
+        }
+        return 0;
+    }
+
     // Internal function that does bulk of the verification work.
-    bool Loop(bool fMaster = false) {
+    bool Loop(unsigned int nSlot) {
+        bool fMaster = (nSlot == 0);
         boost::condition_variable &cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
         unsigned int nNow = 0;
         bool fOk = true;
+        bool fRan = false;
+        bool fStolen = false;
+        int64_t nBatchMicros = 0;
+        uint64_t nContended = 0;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nTotal++;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            // first do the clean-up of the previous batch (allowing us to do it in the same critsect)
+            if (nNow) {
+                fAllOk &= fOk;
+                nTodo -= nNow;
+                if (nTodo == 0 && !fMaster)
+                    // We processed the last element; inform the master he can exit and return the result
+                    condMaster.notify_one();
+                stats.nChecks += nNow;
+                stats.nBatches++;
+                if (fStolen)
+                    stats.nSteals++;
+                if (fRan) {
+                    // Track the cost of a single check and size batches to match
+                    double dMicros = (double)nBatchMicros / nNow;
+                    stats.dCheckMicros = stats.dCheckMicros == 0 ? dMicros : 0.9 * stats.dCheckMicros + 0.1 * dMicros;
+                    nBatchSizeNow = std::max((unsigned int)1, std::min(nBatchSize,
+                        (unsigned int)(nTargetBatchMicros / std::max(stats.dCheckMicros, 1.0))));
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                nNow = 0;
+            }
+            stats.nContended += nContended;
+            nContended = 0;
+
+            // nTodo counts both queued and running checks, so when it is zero
+            // there is nothing to look for.
+            if (nTodo > 0) {
+                // Check whether we need to do work at all, and remember how much
+                // work had been added before we start looking for it.
+                fOk = fAllOk;
+                uint64_t nGenerationSeen = nGeneration;
+                unsigned int nMax = nBatchSizeNow;
+                unsigned int nQueues = nWorkers + 1;
+                nBusy++;
+
+                lock.unlock();
+                fStolen = false;
+                nNow = TakeOwn(nSlot, vChecks, nMax, nContended);
+                if (nNow == 0) {
+                    nNow = Steal(nSlot, nQueues, vChecks, nMax, nContended);
+                    fStolen = (nNow != 0);
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                     // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                     // queue to the local batch vector instead of copying.
-                     vChecks[i].swap(queue.back());
-                     queue.pop_back();
+                if (nNow) {
+                    // execute work
+                    fRan = fOk;
+                    int64_t nStart = fRan ? GetTimeMicros() : 0;
+                    BOOST_FOREACH(T &check, vChecks)
+                        if (fOk)
+                            fOk = check();
+                    nBatchMicros = fRan ? GetTimeMicros() - nStart : 0;
+                    vChecks.clear();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                lock.lock();
+                nBusy--;
+                if (nNow)
+                    continue;
+                stats.nStealMisses++;
+                if (nBusy == 0 && nTodo == 0 && !fMaster)
+                    condMaster.notify_one();
+
+                // New work may have been added while we were scanning; look again.
+                if (nGeneration != nGenerationSeen)
+                    continue;
             }
-            // execute work
-            BOOST_FOREACH(T &check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            // The master only leaves once no other thread is still looking for
+            // work outside the lock, so the queue is fully idle when Wait() returns.
+            if ((fMaster || fQuit) && nTodo == 0 && nBusy == 0) {
+                nTotal--;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                if (fMaster)
+                    fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            nIdle++;
+            int64_t nWaitStart = GetTimeMicros();
+            cond.wait(lock); // wait
+            if (fMaster)
+                stats.nMasterWaitMicros += GetTimeMicros() - nWaitStart;
+            else
+                stats.nWorkerIdleMicros += GetTimeMicros() - nWaitStart;
+            nIdle--;
         } while(true);
     }
 
 public:
-    // Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) :
-        nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    // Create a new check queue, with room for up to nMaxThreads worker threads
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxThreads = 64) :
+        nWorkers(0), nNextQueue(0), nGeneration(0), nBusy(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0),
+        fQuit(false), nBatchSize(nBatchSizeIn), nBatchSizeNow(nBatchSizeIn) {
+        vQueues.resize(nMaxThreads + 1);
+        for (unsigned int i = 0; i < vQueues.size(); i++)
+            vQueues[i] = new WorkerQueue();
+    }
 
     // Worker thread
     void Thread() {
-        Loop();
+        unsigned int nSlot;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            assert(nWorkers + 1 < vQueues.size());
+            nSlot = ++nWorkers;
+        }
+        Loop(nSlot);
     }
 
     // Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait() {
-        return Loop(true);
+        return Loop(0);
     }
 
     // Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks) {
+        if (vChecks.empty())
+            return;
         boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH(T &check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        // Without workers everything goes to the master's own queue.
+        // Otherwise split the batch into roughly equal parts, one per
+        // worker, starting with the worker after the one that got the
+        // previous batch.
+        unsigned int nQueues = nWorkers ? nWorkers : 1;
+        unsigned int nPart = (vChecks.size() + nQueues - 1) / nQueues;
+        for (unsigned int nPos = 0; nPos < vChecks.size(); nPos += nPart) {
+            unsigned int nSlot = nWorkers ? 1 + (nNextQueue++ % nWorkers) : 0;
+            WorkerQueue *pq = vQueues[nSlot];
+            LockQueue(pq, stats.nContended);
+            boost::unique_lock<boost::mutex> lockQueue(pq->mutex, boost::adopt_lock);
+            unsigned int nEnd = std::min(nPos + nPart, (unsigned int)vChecks.size());
+            for (unsigned int i = nPos; i < nEnd; i++) {
+                pq->checks.push_back(T());
+                vChecks[i].swap(pq->checks.back());
+            }
         }
         nTodo += vChecks.size();
+        nGeneration++;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
+    // Return a snapshot of the statistics
+    CCheckQueueStats GetStats() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCheckQueueStats ret = stats;
+        ret.nWorkers = nWorkers;
+        ret.nBatchSize = nBatchSizeNow;
+        return ret;
+    }
+
     ~CCheckQueue() {
+        for (unsigned int i = 0; i < vQueues.size(); i++)
+            delete vQueues[i];
     }
 
     friend class CCheckQueueControl<T>;
@@ -166,6 +345,7 @@ public:
     CCheckQueueControl(CCheckQueue<T> *pqueueIn) : pqueue(pqueueIn), fDone(false) {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
+            boost::unique_lock<boost::mutex> lock(pqueue->mutex);
             assert(pqueue->nTotal == pqueue->nIdle);
             assert(pqueue->nTodo == 0);
             assert(pqueue->fAllOk == true);
@@ -4,7 +4,10 @@
 
 #include "coins.h"
 
+#include "util.h"
+
 #include <assert.h>
+#include <limits>
 
 // calculate number of bytes for the bitmask, and its number of non-zero bytes
 // each bit in the bitmask represents the availability of one output, but the
@@ -55,7 +58,8 @@ bool CCoinsView::SetCoins(const uint256 &txid, const CCoins &coins) { return fal
 bool CCoinsView::HaveCoins(const uint256 &txid) { return false; }
 uint256 CCoinsView::GetBestBlock() { return uint256(0); }
 bool CCoinsView::SetBestBlock(const uint256 &hashBlock) { return false; }
-bool CCoinsView::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::GetCommitment(CCoinsCommitment &commitment) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) { return false; }
 
 
@@ -66,43 +70,155 @@ bool CCoinsViewBacked::HaveCoins(const uint256 &txid) { return base->HaveCoins(t
 uint256 CCoinsViewBacked::GetBestBlock() { return base->GetBestBlock(); }
 bool CCoinsViewBacked::SetBestBlock(const uint256 &hashBlock) { return base->SetBestBlock(hashBlock); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::GetCommitment(CCoinsCommitment &commitment) { return base->GetCommitment(commitment); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment) { return base->BatchWrite(mapCoins, hashBlock, pcommitment); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) { return base->GetStats(stats); }
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView &baseIn, bool fDummy) : CCoinsViewBacked(baseIn), hashBlock(0) { }
+CCoinsKeyHasher::CCoinsKeyHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) {
-    if (cacheCoins.count(txid)) {
-        coins = cacheCoins[txid];
-        return true;
-    }
-    if (base->GetCoins(txid, coins)) {
-        cacheCoins[txid] = coins;
-        return true;
-    }
-    return false;
+// Hash one output for the commitment, and return its serialized size.
+static uint256 HashCommitmentOutput(const uint256 &txid, const CCoins &coins, unsigned int n, const CTxOut &out, unsigned int &nSize) {
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << txid;
+    ss << VARINT(n);
+    ss << VARINT(coins.nVersion);
+    ss << VARINT(coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0));
+    ss << out;
+    nSize = ss.size();
+    return Hash(ss.begin(), ss.end());
+}
+
+void CCoinsCommitment::AddOutput(const uint256 &txid, const CCoins &coins, unsigned int n, const CTxOut &out) {
+    unsigned int nSize;
+    hashSet += HashCommitmentOutput(txid, coins, n, out, nSize);
+    nTransactionOutputs++;
+    nSerializedSize += nSize;
+    nTotalAmount += out.nValue;
 }
 
-std::map<uint256,CCoins>::iterator CCoinsViewCache::FetchCoins(const uint256 &txid) {
-    std::map<uint256,CCoins>::iterator it = cacheCoins.lower_bound(txid);
-    if (it != cacheCoins.end() && it->first == txid)
+void CCoinsCommitment::RemoveOutput(const uint256 &txid, const CCoins &coins, unsigned int n, const CTxOut &out) {
+    unsigned int nSize;
+    hashSet -= HashCommitmentOutput(txid, coins, n, out, nSize);
+    nTransactionOutputs--;
+    nSerializedSize -= nSize;
+    nTotalAmount -= out.nValue;
+}
+
+void CCoinsCommitment::AddCoins(const uint256 &txid, const CCoins &coins) {
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, coins, i, coins.vout[i]);
+    nTransactions++;
+}
+
+void CCoinsCommitment::RemoveCoins(const uint256 &txid, const CCoins &coins) {
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, coins, i, coins.vout[i]);
+    nTransactions--;
+}
+
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView &baseIn, bool fDummy) : CCoinsViewBacked(baseIn), hashBlock(0), cachedCoinsUsage(0), nEpoch(0), hasModifier(false), fHaveCommitment(false) { }
+
+CCoinsViewCache::~CCoinsViewCache()
+{
+    assert(!hasModifier);
+}
+
+size_t CCoinsViewCache::DynamicMemoryUsage() const {
+    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+}
+
+CCoinsMap::iterator CCoinsViewCache::FetchCoins(const uint256 &txid) {
+    CCoinsMap::iterator it = cacheCoins.find(txid);
+    if (it != cacheCoins.end()) {
+        it->second.nEpoch = nEpoch;
         return it;
+    }
     CCoins tmp;
-    if (!base->GetCoins(txid,tmp))
+    if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
-    std::map<uint256,CCoins>::iterator ret = cacheCoins.insert(it, std::make_pair(txid, CCoins()));
-    tmp.swap(ret->second);
+    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    tmp.swap(ret->second.coins);
+    ret->second.nEpoch = nEpoch;
+    if (ret->second.coins.IsPruned()) {
+        // The parent only has an empty entry for this txid; we can consider our
+        // version as fresh.
+        ret->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
 }
 
-CCoins &CCoinsViewCache::GetCoins(const uint256 &txid) {
-    std::map<uint256,CCoins>::iterator it = FetchCoins(txid);
+bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) {
+    CCoinsMap::iterator it = FetchCoins(txid);
+    if (it != cacheCoins.end()) {
+        coins = it->second.coins;
+        return true;
+    }
+    return false;
+}
+
+const CCoins &CCoinsViewCache::GetCoins(const uint256 &txid) {
+    CCoinsMap::iterator it = FetchCoins(txid);
     assert(it != cacheCoins.end());
-    return it->second;
+    return it->second.coins;
+}
+
+CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
+    assert(!hasModifier);
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = 0;
+    if (ret.second) {
+        if (!base->GetCoins(txid, ret.first->second.coins)) {
+            // The parent view does not have this entry; mark it as fresh.
+            ret.first->second.coins = CCoins();
+            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        } else if (ret.first->second.coins.IsPruned()) {
+            // The parent view only has a pruned entry for this; mark it as fresh.
+            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        }
+    } else {
+        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+    }
+    // Assume that whenever ModifyCoins is called, the entry will be modified.
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nEpoch = nEpoch;
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
+}
+
+CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid) {
+    assert(!hasModifier);
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = 0;
+    if (ret.second) {
+        // Nothing unspent can exist for txid in the base view, so there is
+        // no need to look it up there.
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    } else {
+        // Keep the flags of an existing entry: if it is not fresh, the base
+        // view may have a (pruned) version that still has to be overwritten.
+        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+    }
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nEpoch = nEpoch;
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 bool CCoinsViewCache::SetCoins(const uint256 &txid, const CCoins &coins) {
-    cacheCoins[txid] = coins;
+    assert(!hasModifier);
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        cachedCoinsUsage -= ret.first->second.coins.DynamicMemoryUsage();
+    ret.first->second.coins = coins;
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nEpoch = nEpoch;
+    cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
     return true;
 }
 
@@ -121,20 +237,133 @@ bool CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     return true;
 }
 
-bool CCoinsViewCache::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlockIn) {
-    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
-        cacheCoins[it->first] = it->second;
+bool CCoinsViewCache::GetCommitment(CCoinsCommitment &commitmentOut) {
+    if (!ModifyCommitment())
+        return false;
+    commitmentOut = commitment;
+    return true;
+}
+
+CCoinsCommitment *CCoinsViewCache::ModifyCommitment() {
+    if (!fHaveCommitment)
+        fHaveCommitment = base->GetCommitment(commitment);
+    return fHaveCommitment ? &commitment : NULL;
+}
+
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, const CCoinsCommitment *pcommitment) {
+    assert(!hasModifier);
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
+            bool fChildFresh = (it->second.flags & CCoinsCacheEntry::FRESH);
+            CCoinsMap::iterator itUs = cacheCoins.find(it->first);
+            if (itUs == cacheCoins.end()) {
+                // Move the data up. A pruned entry the child knows our base
+                // does not have either can simply be forgotten.
+                if (!(fChildFresh && it->second.coins.IsPruned())) {
+                    CCoinsCacheEntry& entry = cacheCoins[it->first];
+                    entry.coins.swap(it->second.coins);
+                    entry.flags = CCoinsCacheEntry::DIRTY | (fChildFresh ? CCoinsCacheEntry::FRESH : 0);
+                    entry.nEpoch = nEpoch;
+                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                }
+            } else {
+                cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+                    // Our base does not have an entry, and the child is
+                    // modified and being pruned. This means we can just
+                    // delete it from this cache.
+                    cacheCoins.erase(itUs);
+                } else {
+                    // A normal modification.
+                    itUs->second.coins.swap(it->second.coins);
+                    itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.nEpoch = nEpoch;
+                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                }
+            }
+        }
+        CCoinsMap::iterator itOld = it++;
+        mapCoins.erase(itOld);
+    }
     hashBlock = hashBlockIn;
+    if (pcommitment) {
+        commitment = *pcommitment;
+        fHaveCommitment = true;
+    }
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
-    if (fOk)
+    assert(!hasModifier);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, fHaveCommitment ? &commitment : NULL);
+    if (fOk) {
         cacheCoins.clear();
+        cachedCoinsUsage = 0;
+    }
+    return fOk;
+}
+
+bool CCoinsViewCache::Sync() {
+    assert(!hasModifier);
+    // Move the contents of the modified entries into a separate map for the
+    // base view, and move back whatever it did not consume.
+    CCoinsMap mapDirty;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapDirty[it->first];
+            cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+            entry.coins.swap(it->second.coins);
+            entry.flags = it->second.flags;
+        }
+    }
+    bool fOk = base->BatchWrite(mapDirty, hashBlock, fHaveCommitment ? &commitment : NULL);
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            it++;
+            continue;
+        }
+        CCoinsMap::iterator itDirty = mapDirty.find(it->first);
+        if (itDirty == mapDirty.end()) {
+            // Consumed by the base view; it will be fetched again when needed.
+            assert(fOk);
+            cacheCoins.erase(it++);
+            continue;
+        }
+        it->second.coins.swap(itDirty->second.coins);
+        if (fOk && it->second.coins.IsPruned()) {
+            // The base view no longer has this entry either.
+            cacheCoins.erase(it++);
+            continue;
+        }
+        if (fOk)
+            it->second.flags = 0;
+        cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        it++;
+    }
     return fOk;
 }
 
+void CCoinsViewCache::Trim(size_t nTargetUsage) {
+    assert(!hasModifier);
+    // First pass: entries not used since the previous Trim(). Second pass:
+    // any unmodified entry.
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+            if (DynamicMemoryUsage() <= nTargetUsage) {
+                nEpoch++;
+                return;
+            }
+            if (it->second.flags == 0 && (nPass == 1 || it->second.nEpoch != nEpoch)) {
+                cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+                cacheCoins.erase(it++);
+            } else {
+                it++;
+            }
+        }
+    }
+    nEpoch++;
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() {
     return cacheCoins.size();
 }
@@ -194,3 +423,22 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight)
     }
     return tx.ComputePriority(dResult);
 }
+
+CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
+    assert(!cache.hasModifier);
+    cache.hasModifier = true;
+}
+
+CCoinsModifier::~CCoinsModifier()
+{
+    assert(cache.hasModifier);
+    cache.hasModifier = false;
+    it->second.coins.Cleanup();
+    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
+    if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+        cache.cacheCoins.erase(it);
+    } else {
+        // If the coin still exists after the modification, add the new usage
+        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+    }
+}
@@ -6,6 +6,8 @@
 #define BITCOIN_COINS_H
 
 #include "core.h"
+#include "hash.h"
+#include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -13,6 +15,7 @@
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 /** pruned version of CTransaction: only retains metadata and unspent transaction outputs
  *
@@ -237,8 +240,100 @@ public:
                 return false;
         return true;
     }
+
+    // heap memory used by this object, for cache size accounting
+    size_t DynamicMemoryUsage() const {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH(const CTxOut &out, vout) {
+            const std::vector<unsigned char> *script = &out.scriptPubKey;
+            ret += memusage::DynamicUsage(*script);
+        }
+        return ret;
+    }
+};
+
+class CCoinsKeyHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CCoinsKeyHasher();
+    // This *must* return size_t. With Boost 1.46 on 32-bit systems the
+    // unordered_map will behave unpredictably if the custom hasher returns a
+    // uint64_t, resulting in failures when syncing the chain.
+    size_t operator()(const uint256& key) const {
+        return SipHashUint256(k0, k1, key);
+    }
+};
+
+struct CCoinsCacheEntry
+{
+    CCoins coins; // The actual cached data.
+    unsigned char flags;
+    unsigned int nEpoch; // The flush epoch in which this entry was last used.
+
+    enum Flags {
+        DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
+        FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+    };
+
+    CCoinsCacheEntry() : coins(), flags(0), nEpoch(0) {}
 };
 
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+
+
+/** Rolling commitment to the unspent output set: running totals plus a hash
+ *  of the set that does not depend on the order in which outputs were added
+ *  or removed. It is the sum (mod 2^256) of the double-SHA256 of each output
+ *  serialized with its outpoint and transaction metadata. A sum like this is
+ *  not collision resistant against someone who can choose very many outputs,
+ *  so it serves to audit our own chain state, not as a consensus commitment.
+ *
+ *  nSerializedSize is the total size of those serialized outputs, which,
+ *  unlike the size reported by a database scan, does not depend on the
+ *  database layout.
+ */
+class CCoinsCommitment
+{
+public:
+    uint256 hashSet;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    int64_t nTotalAmount;
+
+    CCoinsCommitment() : hashSet(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    // Add or remove output n of transaction txid, with the metadata taken
+    // from coins. nTransactions is left to the caller.
+    void AddOutput(const uint256 &txid, const CCoins &coins, unsigned int n, const CTxOut &out);
+    void RemoveOutput(const uint256 &txid, const CCoins &coins, unsigned int n, const CTxOut &out);
+
+    // Add or remove all unspent outputs of a transaction.
+    void AddCoins(const uint256 &txid, const CCoins &coins);
+    void RemoveCoins(const uint256 &txid, const CCoins &coins);
+
+    friend bool operator==(const CCoinsCommitment &a, const CCoinsCommitment &b) {
+        return a.hashSet == b.hashSet &&
+               a.nTransactions == b.nTransactions &&
+               a.nTransactionOutputs == b.nTransactionOutputs &&
+               a.nSerializedSize == b.nSerializedSize &&
+               a.nTotalAmount == b.nTotalAmount;
+    }
+    friend bool operator!=(const CCoinsCommitment &a, const CCoinsCommitment &b) {
+        return !(a == b);
+    }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(hashSet);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+    )
+};
 
 struct CCoinsStats
 {
@@ -249,6 +344,7 @@ struct CCoinsStats
     uint64_t nSerializedSize;
     uint256 hashSerialized;
     int64_t nTotalAmount;
+    CCoinsCommitment commitment; // recomputed from scratch
 
     CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
 };
@@ -274,8 +370,15 @@ public:
     // Modify the currently active block hash
     virtual bool SetBestBlock(const uint256 &hashBlock);
 
-    // Do a bulk modification (multiple SetCoins + one SetBestBlock)
-    virtual bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
+    // Retrieve the rolling commitment to the state this view represents, if
+    // it is maintained.
+    virtual bool GetCommitment(CCoinsCommitment &commitment);
+
+    // Do a bulk modification (multiple SetCoins + one SetBestBlock, and the
+    // matching commitment unless pcommitment is NULL).
+    // Only entries marked DIRTY need to be applied. The view may take the
+    // contents of, and erase, the entries of mapCoins it consumed.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment);
 
     // Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats);
@@ -299,20 +402,61 @@ public:
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
+    bool GetCommitment(CCoinsCommitment &commitment);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment);
     bool GetStats(CCoinsStats &stats);
 };
 
+class CCoinsViewCache;
+
+/** A reference to a mutable cache entry. Encapsulating it allows us to run
+ *  cleanup code after the modification is finished, and to keep track of
+ *  the memory used by the cache.
+ */
+class CCoinsModifier
+{
+private:
+    CCoinsViewCache& cache;
+    CCoinsMap::iterator it;
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
+
+public:
+    CCoins* operator->() { return &it->second.coins; }
+    CCoins& operator*() { return it->second.coins; }
+    ~CCoinsModifier();
+    friend class CCoinsViewCache;
+};
+
 
-/** CCoinsView that adds a memory cache for transactions to another CCoinsView */
+/** CCoinsView that adds a memory cache for transactions to another CCoinsView
+ *
+ * Entries are kept in a hash table and carry DIRTY/FRESH flags, so that only
+ * modified entries are written back, and entries that were created and spent
+ * completely between two writes never reach the base view at all.
+ */
 class CCoinsViewCache : public CCoinsViewBacked
 {
 protected:
     uint256 hashBlock;
-    std::map<uint256,CCoins> cacheCoins;
+    CCoinsMap cacheCoins;
+
+    // Memory used by the CCoins objects in cacheCoins, outside the table itself
+    size_t cachedCoinsUsage;
+
+    // Incremented on every Trim(); entries not used since are considered cold
+    unsigned int nEpoch;
+
+    // Whether a CCoinsModifier for this cache is outstanding
+    bool hasModifier;
+
+    // Commitment to the state of this view, once fetched from the base
+    CCoinsCommitment commitment;
+    bool fHaveCommitment;
 
 public:
     CCoinsViewCache(CCoinsView &baseIn, bool fDummy = false);
+    ~CCoinsViewCache();
 
     // Standard CCoinsView methods
     bool GetCoins(const uint256 &txid, CCoins &coins);
@@ -320,20 +464,49 @@ public:
     bool HaveCoins(const uint256 &txid);
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
+    bool GetCommitment(CCoinsCommitment &commitment);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment);
+
+    // Return the commitment of this view for updating along with changes to
+    // the coins, or NULL if the base view does not maintain one.
+    CCoinsCommitment *ModifyCommitment();
 
-    // Return a modifiable reference to a CCoins. Check HaveCoins first.
+    // Return a reference to a CCoins in the cache. Check HaveCoins first.
     // Many methods explicitly require a CCoinsViewCache because of this method, to reduce
     // copying.
-    CCoins &GetCoins(const uint256 &txid);
+    const CCoins &GetCoins(const uint256 &txid);
+
+    // Return a modifiable reference to a CCoins. If no entry with the given
+    // txid exists, a new one is created. Simultaneous modifications are not
+    // allowed.
+    CCoinsModifier ModifyCoins(const uint256 &txid);
+
+    // Like ModifyCoins, but for the outputs of a transaction being connected.
+    // The caller guarantees that the base view has no unspent outputs for
+    // txid (BIP30), which saves a lookup in the base view and lets the entry
+    // be dropped without a write if it is spent completely before the next
+    // flush.
+    CCoinsModifier ModifyNewCoins(const uint256 &txid);
 
     // Push the modifications applied to this cache to its base.
     // Failure to call this method before destruction will cause the changes to be forgotten.
+    // The cache is empty afterwards.
     bool Flush();
 
+    // Push the modifications applied to this cache to its base, but keep
+    // all entries cached (as unmodified).
+    bool Sync();
+
+    // Evict unmodified entries until the memory usage is at most nTargetUsage
+    // bytes, starting with entries that were not used since the previous Trim().
+    void Trim(size_t nTargetUsage);
+
     // Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize();
 
+    // Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+
     /** Amount of bolts coming in to a transaction
         Note that lightweight clients may not know anything besides the hash of previous transactions,
         so may not be able to calculate this.
@@ -351,8 +524,14 @@ public:
 
     const CTxOut &GetOutputFor(const CTxIn& input);
 
+    friend class CCoinsModifier;
+
 private:
-    std::map<uint256,CCoins>::iterator FetchCoins(const uint256 &txid);
+    CCoinsMap::iterator FetchCoins(const uint256 &txid);
+
+    // By deleting the copy constructor, we prevent accidentally using it
+    // when one intends to create a cache on top of a base cache.
+    CCoinsViewCache(const CCoinsViewCache &);
 };
 
 #endif
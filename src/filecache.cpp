@@ -0,0 +1,131 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "filecache.h"
+
+#include "util.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class CFileCache::COpenFile
+{
+public:
+#ifdef WIN32
+    // no pread; reads take turns seeking the one FILE
+    FILE* file;
+    CCriticalSection cs;
+
+    COpenFile(FILE* fileIn) : file(fileIn) {}
+    ~COpenFile() { fclose(file); }
+#else
+    int fd;
+
+    COpenFile(int fdIn) : fd(fdIn) {}
+    ~COpenFile() { close(fd); }
+#endif
+};
+
+CFileCache::COpenFileRef CFileCache::Get(const boost::filesystem::path& path)
+{
+    std::string strPath = path.string();
+    {
+        LOCK(cs);
+        for (std::list<std::pair<std::string, COpenFileRef> >::iterator it = listFiles.begin(); it != listFiles.end(); ++it)
+        {
+            if (it->first == strPath) {
+                listFiles.splice(listFiles.begin(), listFiles, it);
+                return listFiles.front().second;
+            }
+        }
+    }
+
+    // open without holding the lock, reads of other files go on meanwhile
+    COpenFileRef file;
+#ifdef WIN32
+    FILE* fileIn = fopen(strPath.c_str(), "rb");
+    if (!fileIn) {
+        LogPrintf("Unable to open file %s\n", strPath);
+        return COpenFileRef();
+    }
+    file.reset(new COpenFile(fileIn));
+#else
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LogPrintf("Unable to open file %s\n", strPath);
+        return COpenFileRef();
+    }
+#if defined(POSIX_FADV_RANDOM)
+    // no read-ahead past what is asked for
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+    file.reset(new COpenFile(fd));
+#endif
+
+    LOCK(cs);
+    // another thread may have opened it too; keep the one already there
+    for (std::list<std::pair<std::string, COpenFileRef> >::iterator it = listFiles.begin(); it != listFiles.end(); ++it)
+        if (it->first == strPath)
+            return it->second;
+    listFiles.push_front(std::make_pair(strPath, file));
+    if (listFiles.size() > nMaxFiles)
+        listFiles.pop_back();
+    return file;
+}
+
+bool CFileCache::Read(const boost::filesystem::path& path, uint64_t nPos, char* pch, size_t nSize)
+{
+    COpenFileRef file = Get(path);
+    if (!file)
+        return false;
+
+#ifdef WIN32
+    LOCK(file->cs);
+    if (_fseeki64(file->file, nPos, SEEK_SET))
+        return false;
+    return fread(pch, 1, nSize, file->file) == nSize;
+#else
+    while (nSize > 0)
+    {
+        ssize_t nRead = pread(file->fd, pch, nSize, nPos);
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+            return false;
+        pch += nRead;
+        nPos += nRead;
+        nSize -= nRead;
+    }
+    return true;
+#endif
+}
+
+void CFileCache::Prefetch(const boost::filesystem::path& path, uint64_t nPos, uint64_t nLength)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    COpenFileRef file = Get(path);
+    if (file)
+        posix_fadvise(file->fd, nPos, nLength, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+    COpenFileRef file = Get(path);
+    if (file) {
+        struct radvisory ra;
+        ra.ra_offset = nPos;
+        ra.ra_count = std::min(nLength, (uint64_t)0x7fffffff);
+        fcntl(file->fd, F_RDADVISE, &ra);
+    }
+#endif
+}
+
+void CFileCache::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+}
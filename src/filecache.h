@@ -0,0 +1,51 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FILECACHE_H
+#define BITCOIN_FILECACHE_H
+
+#include "sync.h"
+
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+
+/** Files kept open for reading, up to nMaxFiles of them; the least recently
+ *  used one is closed to make room for another.
+ *
+ *  Reads are positioned (pread) so any number of threads can read the same
+ *  file at once without seeking it. A file evicted while a read is still
+ *  going on is closed when that read is done. Files are opened with a hint
+ *  that they will be read at random; Prefetch asks for a range that is about
+ *  to be read in order.
+ */
+class CFileCache
+{
+public:
+    CFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Read nSize bytes at nPos of the file at path; a short read fails */
+    bool Read(const boost::filesystem::path& path, uint64_t nPos, char* pch, size_t nSize);
+    /** Start reading nLength bytes at nPos of the file at path into the OS cache */
+    void Prefetch(const boost::filesystem::path& path, uint64_t nPos, uint64_t nLength);
+    /** Close all files that aren't being read from */
+    void Clear();
+
+private:
+    class COpenFile;
+    typedef boost::shared_ptr<COpenFile> COpenFileRef;
+
+    CCriticalSection cs;
+    // most recently used first
+    std::list<std::pair<std::string, COpenFileRef> > listFiles;
+    size_t nMaxFiles;
+
+    COpenFileRef Get(const boost::filesystem::path& path);
+};
+
+#endif // BITCOIN_FILECACHE_H
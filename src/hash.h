@@ -210,5 +210,24 @@ inline uint160 Hash160(const std::vector<unsigned char>& vch)
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/** SipHash-2-4 of a 256-bit value with the 128-bit key (k0, k1). Used to hash
+ *  txids into in-memory hash tables without letting peers pick the buckets. */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+
+/** Hasher for hashed containers keyed by txids or block hashes. Every
+ *  instance draws its own SipHash key. */
+class CSaltedHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CSaltedHasher();
+    // Must return size_t, see CCoinsKeyHasher.
+    size_t operator()(const uint256& key) const {
+        return SipHashUint256(k0, k1, key);
+    }
+};
+
 
 #endif
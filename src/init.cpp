@@ -58,7 +58,8 @@ int nWalletBackups = 10;
 // anyway.
 #define MIN_CORE_FILEDESCRIPTORS 0
 #else
-#define MIN_CORE_FILEDESCRIPTORS 150
+// LevelDB and the other core files, plus the block files kept open for reading
+#define MIN_CORE_FILEDESCRIPTORS (150 + (int)MAX_OPEN_BLOCK_FILES)
 #endif
 
 // Used to pass flags to the Bind() function
@@ -235,19 +236,29 @@ std::string HelpMessage(HelpMessageMode hmm)
     }
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache) + "\n";
+    strUsage += "  -dbblockcache=<n>      " + _("Set the LevelDB block cache size in megabytes (default: half of the database's share of -dbcache)") + "\n";
+    strUsage += "  -dbwritebuffer=<n>     " + _("Set the LevelDB write buffer size in megabytes (default: a quarter of the database's share of -dbcache)") + "\n";
+    strUsage += "  -dbmaxopenfiles=<n>    " + _("Keep at most <n> LevelDB table files open (default: 64)") + "\n";
+    strUsage += "  -dbcompression         " + _("Compress newly written LevelDB tables with snappy, if available (default: 0)") + "\n";
+    strUsage += "                         " + _("The -db options above can also be set per database as -<db>.<option>, where <db> is chainstate, blockindex or smsg, e.g. -chainstate.maxopenfiles=<n>") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
-    strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
+    strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
+    strUsage += "  -maxorphanblockmem=<n> " + strprintf(_("Keep at most <n> MB of unconnectable blocks in memory, and the rest on disk (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCK_MEMORY) + "\n";
     strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
     strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
     strUsage += "  -pid=<file>            " + _("Specify pid file (default: boltd.pid)") + "\n";
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup") + "\n";
     strUsage += "  -txindex               " + _("Maintain a full transaction index (default: 0)") + "\n";
+    strUsage += "  -addressindex          " + _("Maintain an index of the outputs and inputs of every address, for the getaddress* calls (default: 0)") + "\n";
+    strUsage += "  -spentindex            " + _("Maintain an index of the input spending every output, for getspentinfo (default: 0)") + "\n";
+    strUsage += "  -utxoperoutput         " + _("Store the chainstate with one record per unspent output, converting an existing chainstate on startup (default: 0)") + "\n";
 
     strUsage += "\n" + _("Connection options:") + "\n";
     strUsage += "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n";
     strUsage += "  -banscore=<n>          " + _("Threshold for disconnecting misbehaving peers (default: 100)") + "\n";
     strUsage += "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n";
     strUsage += "  -bind=<addr>           " + _("Bind to given address and always listen on it. Use [host]:port notation for IPv6") + "\n";
+    strUsage += "  -compactblocks         " + strprintf(_("Ask peers to send new blocks as compact blocks, rebuilt from the mempool (default: %u)"), DEFAULT_COMPACT_BLOCKS) + "\n";
     strUsage += "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n";
     strUsage += "  -discover              " + _("Discover own IP address (default: 1 when listening and no -externalip)") + "\n";
     strUsage += "  -dns                   " + _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)") + "\n";
@@ -256,6 +267,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -externalip=<ip>       " + _("Specify your own public address") + "\n";
     strUsage += "  -listen                " + _("Accept connections from outside (default: 1 if no -proxy or -connect)") + "\n";
     strUsage += "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n";
+    strUsage += "  -msghandlerthreads=<n> " + strprintf(_("Number of threads processing peer messages (default: %u)"), DEFAULT_MESSAGE_HANDLER_THREADS) + "\n";
     strUsage += "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n";
     strUsage += "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n";
     strUsage += "  -onion=<ip:port>       " + _("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: -proxy)") + "\n";
@@ -308,7 +320,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -debug=<category>      " + _("Output debugging information (default: 0, supplying <category> is optional)") + "\n";
     strUsage += "                         " + _("If <category> is not supplied, output all debugging information.") + "\n";
     strUsage += "                         " + _("<category> can be:");
-    strUsage +=                                 " addrman, alert, coindb, db, lock, rand, rpc, selectcoins, mempool, net"; // Don't translate these and qt below
+    strUsage +=                                 " addrman, alert, coindb, db, lock, rand, rpc, selectcoins, mempool, net, reindex"; // Don't translate these and qt below
     if (hmm == HMM_BITCOIN_QT)
         strUsage += ", qt";
     strUsage += ".\n";
@@ -370,6 +382,8 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 9998 or testnet: 19998)") + "\n";
     strUsage += "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n";
     strUsage += "  -rpcthreads=<n>        " + _("Set the number of threads to service RPC calls (default: 4)") + "\n";
+    strUsage += "  -rpcworkqueue=<n>      " + strprintf(_("Set the number of requests that can wait for an RPC thread before clients get an error (default: %u)"), DEFAULT_RPC_WORK_QUEUE) + "\n";
+    strUsage += "  -rpcbatchthreads=<n>   " + strprintf(_("Set the number of threads executing the calls of one batch request (default: %u)"), DEFAULT_RPC_BATCH_THREADS) + "\n";
 
     strUsage += "\n" + _("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)") + "\n";
     strUsage += "  -rpcssl                                  " + _("Use OpenSSL (https) for JSON-RPC connections") + "\n";
@@ -572,9 +586,14 @@ bool AppInit2(boost::thread_group& threadGroup)
     }
 
     // Make sure enough file descriptors are available
-    int nBind = std::max((int)mapArgs.count("-bind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
+#ifdef USE_EPOLL
+    // only the file descriptors the process may open limit the connections
+    nMaxConnections = std::max(nMaxConnections, 0);
+#else
+    int nBind = std::max((int)mapArgs.count("-bind"), 1);
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+#endif
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -968,12 +987,13 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nTotalCache > (nMaxDbCache << 20))
         nTotalCache = (nMaxDbCache << 20); // total cache cannot be greater than nMaxDbCache
     size_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false))
+    bool fBlockTreeIndexes = GetBoolArg("-txindex", false) || GetBoolArg("-addressindex", false) || GetBoolArg("-spentindex", false);
+    if (nBlockTreeDBCache > (1 << 21) && !fBlockTreeIndexes)
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache; // the in-memory coins cache gets the rest
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -999,6 +1019,17 @@ bool AppInit2(boost::thread_group& threadGroup)
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                // Convert the chainstate to the per-output layout if requested,
+                // or finish a conversion that was interrupted.
+                if (GetBoolArg("-utxoperoutput", false) || pcoinsdbview->IsPerOutput()) {
+                    if (!pcoinsdbview->IsPerOutput())
+                        uiInterface.InitMessage(_("Upgrading chainstate database..."));
+                    if (!pcoinsdbview->UpgradeToPerOutput()) {
+                        strLoadError = _("Error upgrading chainstate database");
+                        break;
+                    }
+                }
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1015,12 +1046,37 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Compute the rolling UTXO set commitment once if the chainstate
+                // does not have one yet; from then on it is kept up to date.
+                CCoinsCommitment commitment;
+                if (!pcoinsTip->GetCommitment(commitment)) {
+                    uiInterface.InitMessage(_("Computing UTXO set commitment..."));
+                    pcoinsTip->Flush();
+                    CCoinsStats stats;
+                    CCoinsMap mapNone;
+                    if (!pcoinsdbview->GetStats(stats) || !pcoinsdbview->BatchWrite(mapNone, uint256(0), &stats.commitment)) {
+                        strLoadError = _("Error computing UTXO set commitment");
+                        break;
+                    }
+                    LogPrintf("Computed UTXO set commitment: %u transactions, %u outputs\n", stats.commitment.nTransactions, stats.commitment.nTransactionOutputs);
+                }
+
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", false)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
                     break;
                 }
 
+                // Check for changed -addressindex and -spentindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", false)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+                if (fSpentIndex != GetBoolArg("-spentindex", false)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (!VerifyDB(GetArg("-checklevel", 3),
                               GetArg("-checkblocks", 288))) {
@@ -1377,7 +1433,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("mapAddressBook.size() = %u\n",  pwalletMain ? pwalletMain->mapAddressBook.size() : 0);
 #endif
 
-    StartNode(threadGroup);
+    std::string strNetError;
+    if (!StartNode(threadGroup, strNetError))
+        return InitError(strNetError);
     // InitRPCMining is needed here so getwork/getblocktemplate in the GUI debug console works properly.
     InitRPCMining();
     if (fServer)
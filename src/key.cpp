@@ -2,8 +2,16 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "bolt-config.h"
+#endif
+
 #include "key.h"
 
+#ifdef USE_SECP256K1
+#include "secp256k1/secp256k1.h"
+#endif
+
 #include <openssl/bn.h>
 #include <openssl/ecdsa.h>
 #include <openssl/obj_mac.h>
@@ -356,6 +364,30 @@ public:
     }
 };
 
+#ifdef USE_SECP256K1
+// Build the in-tree secp256k1 engine's generator tables before any thread can verify.
+class CSecp256k1Init {
+public:
+    CSecp256k1Init() {
+        secp256k1_start();
+    }
+    ~CSecp256k1Init() {
+        secp256k1_stop();
+    }
+} instance_of_csecp256k1init;
+
+// Recover a public key with the in-tree engine, accepting the same recovery ids as CECKey::Recover.
+bool Secp256k1RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig, bool fCompressed, unsigned char *pubkey, int &nLen) {
+    if (vchSig.size() != 65)
+        return false;
+    int rec = (vchSig[0] - 27) & ~4;
+    if (rec < 0 || rec >= 3)
+        return false;
+    nLen = 65;
+    return secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, &vchSig[1], pubkey, &nLen, fCompressed, rec) == 1;
+}
+#endif
+
 }; // end of anonymous namespace
 
 bool CKey::Check(const unsigned char *vch) {
@@ -458,37 +490,67 @@ bool CKey::Load(CPrivKey &privkey, CPubKey &vchPubKey, bool fSkipCheck=false) {
     return true;
 }
 
-bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
-    if (!IsValid())
+bool ECC_VerifyOpenSSL(const CPubKey &pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+    if (!pubkey.IsValid())
         return false;
     CECKey key;
-    if (!key.SetPubKey(*this))
+    if (!key.SetPubKey(pubkey))
         return false;
     if (!key.Verify(hash, vchSig))
         return false;
     return true;
 }
 
-bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+bool ECC_RecoverCompactOpenSSL(CPubKey &pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != 65)
         return false;
     CECKey key;
     if (!key.Recover(hash, &vchSig[1], (vchSig[0] - 27) & ~4))
         return false;
-    key.GetPubKey(*this, (vchSig[0] - 27) & 4);
+    key.GetPubKey(pubkey, (vchSig[0] - 27) & 4);
     return true;
 }
 
+bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+#ifdef USE_SECP256K1
+    if (!IsValid() || vchSig.empty())
+        return false;
+    return secp256k1_ecdsa_verify((const unsigned char*)&hash, &vchSig[0], vchSig.size(), begin(), size()) == 1;
+#else
+    return ECC_VerifyOpenSSL(*this, hash, vchSig);
+#endif
+}
+
+bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+#ifdef USE_SECP256K1
+    if (vchSig.size() != 65)
+        return false;
+    int nLen;
+    if (!Secp256k1RecoverCompact(hash, vchSig, ((vchSig[0] - 27) & 4) != 0, vch, nLen))
+        return false;
+    assert(size() == (unsigned int)nLen);
+    return true;
+#else
+    return ECC_RecoverCompactOpenSSL(*this, hash, vchSig);
+#endif
+}
+
 bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
     if (!IsValid())
         return false;
     if (vchSig.size() != 65)
         return false;
+    CPubKey pubkeyRec;
+#ifdef USE_SECP256K1
+    int nLen;
+    if (!Secp256k1RecoverCompact(hash, vchSig, IsCompressed(), pubkeyRec.vch, nLen))
+        return false;
+#else
     CECKey key;
     if (!key.Recover(hash, &vchSig[1], (vchSig[0] - 27) & ~4))
         return false;
-    CPubKey pubkeyRec;
     key.GetPubKey(pubkeyRec, IsCompressed());
+#endif
     if (*this != pubkeyRec)
         return false;
     return true;
@@ -497,20 +559,32 @@ bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
         return false;
+#ifdef USE_SECP256K1
+    return secp256k1_ec_pubkey_verify(begin(), size()) == 1;
+#else
     CECKey key;
     if (!key.SetPubKey(*this))
         return false;
     return true;
+#endif
 }
 
 bool CPubKey::Decompress() {
     if (!IsValid())
         return false;
+#ifdef USE_SECP256K1
+    int nLen = size();
+    if (!secp256k1_ec_pubkey_decompress(vch, &nLen))
+        return false;
+    assert(nLen == 65);
+    return true;
+#else
     CECKey key;
     if (!key.SetPubKey(*this))
         return false;
     key.GetPubKey(*this, false);
     return true;
+#endif
 }
 
 void static BIP32Hash(const unsigned char chainCode[32], unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]) {
@@ -324,4 +324,10 @@ struct CExtKey {
 /** Check that required EC support is available at runtime */
 bool ECC_InitSanityCheck(void);
 
+/** Verify a signature / recover a compact signature's key through OpenSSL,
+ *  regardless of the backend CPubKey was built with. Used to cross-check
+ *  the in-tree secp256k1 engine (see --enable-secp256k1-verify). */
+bool ECC_VerifyOpenSSL(const CPubKey &pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig);
+bool ECC_RecoverCompactOpenSSL(CPubKey &pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig);
+
 #endif
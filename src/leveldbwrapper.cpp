@@ -4,8 +4,12 @@
 
 #include "leveldbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
 
+#include <sstream>
+#include <stdio.h>
+
 #include <boost/filesystem.hpp>
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -25,23 +29,82 @@ void HandleError(const leveldb::Status &status) throw(leveldb_error) {
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize) {
+// Value of -<name>.<key>, falling back to -db<key> and then to nDefault
+static int64_t GetLevelDBArg(const std::string &strName, const std::string &strKey, int64_t nDefault) {
+    std::string strArg = "-" + strName + "." + strKey;
+    if (mapArgs.count(strArg))
+        return GetArg(strArg, nDefault);
+    return GetArg("-db" + strKey, nDefault);
+}
+
+leveldb::Options GetLevelDBOptions(const std::string &strName, size_t nCacheSize) {
+    // By default, half of the budget goes to the block cache and a quarter
+    // to each of the (up to two) write buffers held in memory.
+    int64_t nBlockCacheMiB = GetLevelDBArg(strName, "blockcache", -1);
+    int64_t nWriteBufferMiB = GetLevelDBArg(strName, "writebuffer", -1);
+    size_t nBlockCache = nBlockCacheMiB > 0 ? (size_t)nBlockCacheMiB << 20 : nCacheSize / 2;
+    size_t nWriteBuffer = nWriteBufferMiB > 0 ? (size_t)nWriteBufferMiB << 20 : nCacheSize / 4;
+
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_cache = leveldb::NewLRUCache(nBlockCache);
+    options.write_buffer_size = nWriteBuffer;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // Blocks are stored uncompressed when leveldb was built without snappy,
+    // so enabling this is always safe.
+    options.compression = GetLevelDBArg(strName, "compression", 0) ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = GetLevelDBArg(strName, "maxopenfiles", 64);
+    LogPrint("leveldb", "LevelDB options for %s: block cache %u bytes, write buffer %u bytes, max open files %d, compression %d\n",
+        strName, nBlockCache, nWriteBuffer, options.max_open_files, options.compression);
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory, bool fWipe) {
+static CCriticalSection cs_LevelDBs;
+static std::vector<std::pair<std::string, leveldb::DB*> > vLevelDBs;
+
+void RegisterLevelDB(const std::string &strName, leveldb::DB *pdb) {
+    LOCK(cs_LevelDBs);
+    vLevelDBs.push_back(std::make_pair(strName, pdb));
+}
+
+void UnregisterLevelDB(leveldb::DB *pdb) {
+    LOCK(cs_LevelDBs);
+    for (std::vector<std::pair<std::string, leveldb::DB*> >::iterator it = vLevelDBs.begin(); it != vLevelDBs.end(); it++) {
+        if (it->second == pdb) {
+            vLevelDBs.erase(it);
+            return;
+        }
+    }
+}
+
+void GetLevelDBStats(std::vector<CLevelDBStats> &vStats) {
+    LOCK(cs_LevelDBs);
+    vStats.clear();
+    for (std::vector<std::pair<std::string, leveldb::DB*> >::iterator it = vLevelDBs.begin(); it != vLevelDBs.end(); it++) {
+        CLevelDBStats stats;
+        stats.strName = it->first;
+        std::string strStats;
+        if (it->second->GetProperty("leveldb.stats", &strStats)) {
+            // Skip the header and parse one line per level.
+            std::istringstream ss(strStats);
+            std::string strLine;
+            while (std::getline(ss, strLine)) {
+                CLevelDBLevelStats level;
+                if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles,
+                           &level.dSizeMB, &level.dTimeSec, &level.dReadMB, &level.dWriteMB) == 6)
+                    stats.vLevels.push_back(level);
+            }
+        }
+        vStats.push_back(stats);
+    }
+}
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, const std::string &strName, size_t nCacheSize, bool fMemory, bool fWipe) {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetLevelDBOptions(strName, nCacheSize);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -57,9 +120,11 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCa
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    RegisterLevelDB(strName, pdb);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper() {
+    UnregisterLevelDB(pdb);
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
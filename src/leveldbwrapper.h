@@ -21,6 +21,37 @@ public:
 
 void HandleError(const leveldb::Status &status) throw(leveldb_error);
 
+/** Options for the database called strName (e.g. "chainstate"), based on a
+ *  total cache budget of nCacheSize bytes. Each setting can be overridden
+ *  for all databases (-dbmaxopenfiles=<n>) or for just this one
+ *  (-chainstate.maxopenfiles=<n>). The caller owns block_cache and
+ *  filter_policy of the result. */
+leveldb::Options GetLevelDBOptions(const std::string &strName, size_t nCacheSize);
+
+/** Compaction statistics of one level of a database */
+struct CLevelDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    double dTimeSec;
+    double dReadMB;
+    double dWriteMB;
+};
+
+/** Statistics of an open database, as reported by LevelDB itself */
+struct CLevelDBStats
+{
+    std::string strName;
+    std::vector<CLevelDBLevelStats> vLevels;
+};
+
+/** Databases that are registered here are included in GetLevelDBStats(). A
+ *  database must be unregistered before it is closed. */
+void RegisterLevelDB(const std::string &strName, leveldb::DB *pdb);
+void UnregisterLevelDB(leveldb::DB *pdb);
+void GetLevelDBStats(std::vector<CLevelDBStats> &vStats);
+
 // Batch of changes queued to be written to a CLevelDBWrapper
 class CLevelDBBatch
 {
@@ -79,7 +110,8 @@ private:
     leveldb::DB *pdb;
 
 public:
-    CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    // strName selects the option overrides, see GetLevelDBOptions()
+    CLevelDBWrapper(const boost::filesystem::path &path, const std::string &strName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
     template<typename K, typename V> bool Read(const K& key, V& value) throw(leveldb_error) {
@@ -150,6 +182,12 @@ public:
     leveldb::Iterator *NewIterator() {
         return pdb->NewIterator(iteroptions);
     }
+
+    // Iterator for short scans that stand in for point reads; unlike full
+    // scans, these should populate the block cache just like Read() does.
+    leveldb::Iterator *NewSeekIterator() {
+        return pdb->NewIterator(readoptions);
+    }
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -5,26 +5,44 @@
 #ifndef BITCOIN_LIMITEDMAP_H
 #define BITCOIN_LIMITEDMAP_H
 
-#include <assert.h> // TODO: remove
+#include <assert.h>
 #include <map>
 
-/** STL-like map container that only keeps the N elements with the highest value. */
-template <typename K, typename V> class limitedmap
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+/** STL-like map container that only keeps the N elements with the highest value.
+ *  Lookups go through a hash table; Hash can be a salted hasher when peers choose the keys. */
+template <typename K, typename V, typename Hash = boost::hash<K> > class limitedmap
 {
 public:
     typedef K key_type;
     typedef V mapped_type;
     typedef std::pair<const key_type, mapped_type> value_type;
-    typedef typename std::map<K, V>::const_iterator const_iterator;
-    typedef typename std::map<K, V>::size_type size_type;
+    typedef typename boost::unordered_map<K, V, Hash>::const_iterator const_iterator;
+    typedef typename boost::unordered_map<K, V, Hash>::size_type size_type;
 
 protected:
-    std::map<K, V> map;
-    typedef typename std::map<K, V>::iterator iterator;
-    std::multimap<V, iterator> rmap;
-    typedef typename std::multimap<V, iterator>::iterator rmap_iterator;
+    boost::unordered_map<K, V, Hash> map;
+    typedef typename boost::unordered_map<K, V, Hash>::iterator iterator;
+    // Hash table iterators don't survive a rehash, so this keeps the keys
+    std::multimap<V, K> rmap;
+    typedef typename std::multimap<V, K>::iterator rmap_iterator;
     size_type nMaxSize;
 
+    void erase_rmap(const key_type& k, const mapped_type& v)
+    {
+        std::pair<rmap_iterator, rmap_iterator> itPair = rmap.equal_range(v);
+        for (rmap_iterator it = itPair.first; it != itPair.second; ++it)
+            if (it->second == k)
+            {
+                rmap.erase(it);
+                return;
+            }
+        // Shouldn't ever get here
+        assert(0);
+    }
+
 public:
     limitedmap(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
     const_iterator begin() const { return map.begin(); }
@@ -43,7 +61,7 @@ public:
                 map.erase(rmap.begin()->second);
                 rmap.erase(rmap.begin());
             }
-            rmap.insert(make_pair(x.second, ret.first));
+            rmap.insert(std::make_pair(x.second, x.first));
         }
         return;
     }
@@ -52,37 +70,17 @@ public:
         iterator itTarget = map.find(k);
         if (itTarget == map.end())
             return;
-        std::pair<rmap_iterator, rmap_iterator> itPair = rmap.equal_range(itTarget->second);
-        for (rmap_iterator it = itPair.first; it != itPair.second; ++it)
-            if (it->second == itTarget)
-            {
-                rmap.erase(it);
-                map.erase(itTarget);
-                return;
-            }
-        // Shouldn't ever get here
-        assert(0); //TODO remove me
+        erase_rmap(k, itTarget->second);
         map.erase(itTarget);
     }
     void update(const_iterator itIn, const mapped_type& v)
     {
-        //TODO: When we switch to C++11, use map.erase(itIn, itIn) to get the non-const iterator
         iterator itTarget = map.find(itIn->first);
         if (itTarget == map.end())
             return;
-        std::pair<rmap_iterator, rmap_iterator> itPair = rmap.equal_range(itTarget->second);
-        for (rmap_iterator it = itPair.first; it != itPair.second; ++it)
-            if (it->second == itTarget)
-            {
-                rmap.erase(it);
-                itTarget->second = v;
-                rmap.insert(make_pair(v, itTarget));
-                return;
-            }
-        // Shouldn't ever get here
-        assert(0); //TODO remove me
+        erase_rmap(itTarget->first, itTarget->second);
         itTarget->second = v;
-        rmap.insert(make_pair(v, itTarget));
+        rmap.insert(std::make_pair(v, itTarget->first));
     }
     size_type max_size() const { return nMaxSize; }
     size_type max_size(size_type s)
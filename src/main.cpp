@@ -24,12 +24,14 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "init.h"
 #include "instantx.h"
 #include "darksend.h"
+#include "filecache.h"
 #include "masternodeman.h"
 #include "net.h"
 #include "txdb.h"
@@ -44,6 +46,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 using namespace boost;
@@ -61,6 +65,8 @@ CCriticalSection cs_main;
 CTxMemPool mempool;
 
 map<uint256, CBlockIndex*> mapBlockIndex;
+// Guards insertions into mapBlockIndex against LookupBlockIndex.
+CCriticalSection cs_mapBlockIndex;
 CChain chainActive;
 CChain chainMostWork;
 int64_t nTimeBestReceived = 0;
@@ -69,30 +75,35 @@ bool fImporting = false;
 bool fReindex = false;
 bool fBenchmark = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
 bool fLargeWorkForkFound = false;
 bool fLargeWorkInvalidChainFound = false;
 
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation) */
 int64_t CTransaction::nMinTxFee = 10000;  // Override with -mintxfee
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying and mining) */
 int64_t CTransaction::nMinRelayTxFee = 1000;
 
+// Orphans are looked up for every inv from every peer, so they are kept in
+// hash tables, salted so that peers can't fill a single bucket.
 struct COrphanBlock {
     uint256 hashBlock;
     uint256 hashPrev;
-    vector<unsigned char> vchBlock;
+    vector<unsigned char> vchBlock; // empty when the block is kept on disk
+    bool fOnDisk;
 };
-map<uint256, COrphanBlock*> mapOrphanBlocks;
-multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev;
-
-struct COrphanTx {
-    CTransaction tx;
-    NodeId fromPeer;
-};
-map<uint256, COrphanTx> mapOrphanTransactions;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+typedef boost::unordered_map<uint256, COrphanBlock*, CSaltedHasher> OrphanBlockMap;
+typedef boost::unordered_multimap<uint256, COrphanBlock*, CSaltedHasher> OrphanBlockByPrevMap;
+OrphanBlockMap mapOrphanBlocks;
+OrphanBlockByPrevMap mapOrphanBlocksByPrev;
+// Size of the orphan blocks kept in memory
+static size_t nOrphanBlockBytes = 0;
+
+OrphanTxMap mapOrphanTransactions;
+OrphanTxByPrevMap mapOrphanTransactionsByPrev;
 void EraseOrphansFor(NodeId peer);
 
 // Constant stuff for coinbase transactions we create:
@@ -126,6 +137,9 @@ namespace {
     CBlockIndex *pindexBestInvalid;
     // may contain all CBlockIndex*'s that have validness >=BLOCK_VALID_TRANSACTIONS, and must contain those who aren't failed
     set<CBlockIndex*, CBlockIndexWorkComparator> setBlockIndexValid;
+    // Checkpoints::GetLastCheckpoint(mapBlockIndex), redone only when a
+    // checkpointed block is added to the index
+    CBlockIndex *pindexLastCheckpoint = NULL;
 
     CCriticalSection cs_LastBlockFile;
     CBlockFileInfo infoLastBlockFile;
@@ -141,6 +155,10 @@ namespace {
     // them, if processing happens afterwards. Protected by cs_main.
     map<uint256, NodeId> mapBlockSource;
 
+    // Imported blocks that passed the context-independent checks in the import
+    // pipeline, so that connecting them doesn't redo those. Protected by cs_main.
+    set<uint256> setBlocksChecked;
+
     // Blocks that are in flight, and that are in the queue to be downloaded.
     // Protected by cs_main.
     struct QueuedBlock {
@@ -239,10 +257,15 @@ struct CNodeState {
     int nBlocksToDownload;
     int64_t nLastBlockReceive;
     int64_t nLastBlockProcess;
+    // Whether this peer asked for new blocks as "cmpctblock" instead of an inv.
+    bool fPreferCompactBlocks;
+    // The compact block from this peer whose missing transactions were requested.
+    CPartiallyDownloadedBlock partialBlock;
 
     CNodeState() {
         nMisbehavior = 0;
         fShouldBan = false;
+        fPreferCompactBlocks = false;
         nBlocksToDownload = 0;
         nBlocksInFlight = 0;
         nLastBlockReceive = 0;
@@ -388,6 +411,53 @@ CBlockIndex *CChain::SetTip(CBlockIndex *pindex) {
     return pindex;
 }
 
+CChainSnapshot::CChainSnapshot(const CChainSnapshot *pprev, const CChain &chain) : nHeight(chain.Height()) {
+    int nSegments = (nHeight + SEGMENT_SIZE) / SEGMENT_SIZE;
+    vSegments.reserve(nSegments);
+    for (int s = 0; s < nSegments; s++) {
+        int nStart = s * SEGMENT_SIZE;
+        int nEnd = std::min(nStart + SEGMENT_SIZE, nHeight + 1);
+        // Reuse a full segment of the previous snapshot if its last block is
+        // still in the chain: then so are all the blocks before it.
+        if (pprev && nEnd - nStart == SEGMENT_SIZE && s < (int)pprev->vSegments.size() &&
+            pprev->vSegments[s]->size() == (size_t)SEGMENT_SIZE && pprev->vSegments[s]->back() == chain[nEnd - 1]) {
+            vSegments.push_back(pprev->vSegments[s]);
+            continue;
+        }
+        Segment *pseg = new Segment();
+        pseg->reserve(nEnd - nStart);
+        for (int n = nStart; n < nEnd; n++)
+            pseg->push_back(chain[n]);
+        vSegments.push_back(boost::shared_ptr<const Segment>(pseg));
+    }
+}
+
+static CCriticalSection cs_chainSnapshot;
+static boost::shared_ptr<const CChainSnapshot> pchainSnapshot(new CChainSnapshot());
+
+// Publish a snapshot of chainActive. Called with cs_main held after every
+// change of the tip.
+static void PublishChainSnapshot()
+{
+    boost::shared_ptr<const CChainSnapshot> pprev = GetChainSnapshot();
+    boost::shared_ptr<const CChainSnapshot> pnew(new CChainSnapshot(pprev.get(), chainActive));
+    LOCK(cs_chainSnapshot);
+    pchainSnapshot = pnew;
+}
+
+boost::shared_ptr<const CChainSnapshot> GetChainSnapshot()
+{
+    LOCK(cs_chainSnapshot);
+    return pchainSnapshot;
+}
+
+CBlockIndex *LookupBlockIndex(const uint256 &hash)
+{
+    LOCK(cs_mapBlockIndex);
+    map<uint256, CBlockIndex*>::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
+}
+
 CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
     int nStep = 1;
     std::vector<uint256> vHave;
@@ -469,12 +539,12 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer)
 
 void static EraseOrphanTx(uint256 hash)
 {
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    OrphanTxMap::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
     BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
     {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
+        OrphanTxByPrevMap::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
         itPrev->second.erase(hash);
@@ -487,10 +557,10 @@ void static EraseOrphanTx(uint256 hash)
 void EraseOrphansFor(NodeId peer)
 {
     int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+    OrphanTxMap::iterator iter = mapOrphanTransactions.begin();
     while (iter != mapOrphanTransactions.end())
     {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
+        OrphanTxMap::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
             EraseOrphanTx(maybeErase->second.tx.GetHash());
@@ -506,12 +576,11 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
     unsigned int nEvicted = 0;
     while (mapOrphanTransactions.size() > nMaxOrphans)
     {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        // Evict a random orphan: the first one in or after a random bucket
+        size_t nBucket = GetRand(mapOrphanTransactions.bucket_count());
+        while (mapOrphanTransactions.bucket_size(nBucket) == 0)
+            nBucket = (nBucket + 1) % mapOrphanTransactions.bucket_count();
+        EraseOrphanTx(mapOrphanTransactions.begin(nBucket)->first);
         ++nEvicted;
     }
     return nEvicted;
@@ -1252,6 +1321,142 @@ bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree)
 }
 
 
+bool GetIndexAddress(const CScript &script, unsigned char &nType, uint160 &hashBytes)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return false;
+    if (const CKeyID *keyID = boost::get<CKeyID>(&dest)) {
+        nType = ADDRESS_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID *scriptID = boost::get<CScriptID>(&dest)) {
+        nType = ADDRESS_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+bool GetAddressIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, int64_t> > &vAddressIndex, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    return pblocktree->ReadAddressIndex(nType, hashBytes, vAddressIndex, nStart, nEnd);
+}
+
+bool GetAddressUnspent(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    return pblocktree->ReadAddressUnspentIndex(nType, hashBytes, vUnspent);
+}
+
+bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value)
+{
+    if (!fSpentIndex)
+        return error("%s : spent index not enabled", __func__);
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+// Blocks, transactions and undo data are read through a cache of open block
+// and undo files, rather than opening the file again for every read
+static CFileCache blockFileCache(MAX_OPEN_BLOCK_FILES);
+
+static boost::filesystem::path GetDiskFilePath(int nFile, const char *prefix)
+{
+    return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, nFile);
+}
+
+// Read nSize bytes at pos of a block or undo file into ss
+static bool ReadDiskData(const CDiskBlockPos &pos, const char *prefix, unsigned int nSize, CDataStream &ss)
+{
+    if (pos.IsNull())
+        return false;
+    ss.clear();
+    ss.resize(nSize);
+    if (nSize && !blockFileCache.Read(GetDiskFilePath(pos.nFile, prefix), pos.nPos, &ss[0], nSize))
+        return error("%s : unable to read %u bytes at position %u of %s%05u.dat", __func__, nSize, pos.nPos, prefix, pos.nFile);
+    return true;
+}
+
+// Read the data at pos, whose size is written right in front of it, and nExtra bytes after it
+static bool ReadDiskRecord(const CDiskBlockPos &pos, const char *prefix, unsigned int nExtra, CDataStream &ss)
+{
+    if (pos.IsNull() || pos.nPos < sizeof(unsigned int))
+        return false;
+    CDataStream ssSize(SER_DISK, CLIENT_VERSION);
+    if (!ReadDiskData(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), prefix, sizeof(unsigned int), ssSize))
+        return false;
+    unsigned int nSize;
+    ssSize >> nSize;
+    if (nSize > MAX_SIZE)
+        return error("%s : size %u at position %u of %s%05u.dat is out of range", __func__, nSize, pos.nPos, prefix, pos.nFile);
+    return ReadDiskData(pos, prefix, nSize + nExtra, ss);
+}
+
+// Most transactions are smaller than this; it is what is read for one at first
+static const unsigned int TX_READ_SIZE = 0x4000;
+
+// Read the header of the block a transaction is in, and the transaction
+static bool ReadTxFromDisk(const CDiskTxPos &postx, CBlockHeader &header, CTransaction &tx)
+{
+    // the block size and header in one read
+    unsigned int nHeaderSize = ::GetSerializeSize(header, SER_DISK, CLIENT_VERSION);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    if (postx.IsNull() || postx.nPos < sizeof(unsigned int) ||
+        !ReadDiskData(CDiskBlockPos(postx.nFile, postx.nPos - sizeof(unsigned int)), "blk", sizeof(unsigned int) + nHeaderSize, ss))
+        return false;
+    unsigned int nBlockSize;
+    ss >> nBlockSize >> header;
+    if (nHeaderSize + postx.nTxOffset >= nBlockSize)
+        return error("%s : transaction offset %u past the end of the block", __func__, postx.nTxOffset);
+
+    // then the transaction, or if it is bigger than TX_READ_SIZE the rest of the block
+    CDiskBlockPos pos(postx.nFile, postx.nPos + nHeaderSize + postx.nTxOffset);
+    unsigned int nRemaining = nBlockSize - nHeaderSize - postx.nTxOffset;
+    if (nRemaining > TX_READ_SIZE) {
+        if (!ReadDiskData(pos, "blk", TX_READ_SIZE, ss))
+            return false;
+        try {
+            ss >> tx;
+            return true;
+        } catch (std::ios_base::failure &) {
+            // ran out of data
+        }
+    }
+    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+    if (!ReadDiskData(pos, "blk", nRemaining, ssTx))
+        return false;
+    ssTx >> tx;
+    return true;
+}
+
+bool ReadUndoFileRecord(const CDiskBlockPos &pos, CDataStream &ss)
+{
+    // the checksum follows the undo data
+    return ReadDiskRecord(pos, "rev", sizeof(uint256), ss);
+}
+
+void PrefetchBlockFiles(const std::vector<CDiskBlockPos> &vPos)
+{
+    // one range per file, from the first block up to the end of the last one
+    std::map<int, std::pair<unsigned int, unsigned int> > mapRanges;
+    BOOST_FOREACH(const CDiskBlockPos &pos, vPos)
+    {
+        if (pos.IsNull())
+            continue;
+        std::map<int, std::pair<unsigned int, unsigned int> >::iterator it = mapRanges.find(pos.nFile);
+        if (it == mapRanges.end())
+            it = mapRanges.insert(std::make_pair(pos.nFile, std::make_pair(pos.nPos, pos.nPos))).first;
+        it->second.first = std::min(it->second.first, pos.nPos);
+        it->second.second = std::max(it->second.second, pos.nPos);
+    }
+    for (std::map<int, std::pair<unsigned int, unsigned int> >::const_iterator it = mapRanges.begin(); it != mapRanges.end(); ++it)
+        blockFileCache.Prefetch(GetDiskFilePath(it->first, "blk"), it->second.first, (uint64_t)it->second.second - it->second.first + MAX_BLOCK_SIZE);
+}
+
 // Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1268,12 +1473,10 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 CBlockHeader header;
                 try {
-                    file >> header;
-                    fseek(file, postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    if (!ReadTxFromDisk(postx, header, txOut))
+                        return error("%s : ReadTxFromDisk failed", __func__);
                 } catch (std::exception &e) {
                     return error("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1349,25 +1552,23 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPOW)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (!filein)
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
     // Read block
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    if (!ReadDiskRecord(pos, "blk", 0, ssBlock))
+        return error("ReadBlockFromDisk : ReadDiskRecord failed");
     try {
-        filein >> block;
+        ssBlock >> block;
     }
     catch (std::exception &e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
     // Check the header
-    if (!CheckProofOfWork(block.GetHash(), block.nBits))
+    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
         return error("ReadBlockFromDisk : Errors in block header");
 
     return true;
@@ -1375,22 +1576,99 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), false))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
     return true;
 }
 
+static boost::filesystem::path GetOrphanBlockPath(const uint256& hash)
+{
+    return GetDataDir() / "blocks" / "orphans" / (hash.ToString() + ".dat");
+}
+
+// Keep a copy of an orphan block: in memory, or on disk once the orphans in
+// memory take up -maxorphanblockmem
+static COrphanBlock* StoreOrphanBlock(const CBlock& block)
+{
+    COrphanBlock* porphan = new COrphanBlock();
+    porphan->hashBlock = block.GetHash();
+    porphan->hashPrev = block.hashPrevBlock;
+    porphan->fOnDisk = false;
+
+    size_t nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    if (nOrphanBlockBytes + nSize > (size_t)std::max((int64_t)0, GetArg("-maxorphanblockmem", DEFAULT_MAX_ORPHAN_BLOCK_MEMORY)) * 1000000)
+    {
+        boost::filesystem::path path = GetOrphanBlockPath(porphan->hashBlock);
+        try {
+            // whatever is there is left over from an earlier run
+            static bool fCleared = false;
+            if (!fCleared)
+                boost::filesystem::remove_all(path.parent_path());
+            fCleared = true;
+            boost::filesystem::create_directories(path.parent_path());
+
+            CAutoFile fileout = CAutoFile(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+            if (fileout) {
+                fileout << block;
+                porphan->fOnDisk = true;
+            }
+        } catch (std::exception &e) {
+            LogPrintf("StoreOrphanBlock : writing %s failed - %s\n", path.string(), e.what());
+        }
+    }
+    if (!porphan->fOnDisk)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << block;
+        porphan->vchBlock = std::vector<unsigned char>(ss.begin(), ss.end());
+        nOrphanBlockBytes += porphan->vchBlock.size();
+    }
+    return porphan;
+}
+
+bool static ReadOrphanBlock(const COrphanBlock* porphan, CBlock& block)
+{
+    try {
+        if (porphan->fOnDisk) {
+            CAutoFile filein = CAutoFile(fopen(GetOrphanBlockPath(porphan->hashBlock).string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+            if (!filein)
+                return error("ReadOrphanBlock : unable to open orphan block %s", porphan->hashBlock.ToString());
+            filein >> block;
+        } else {
+            CDataStream ss(porphan->vchBlock, SER_DISK, CLIENT_VERSION);
+            ss >> block;
+        }
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+void static DeleteOrphanBlock(COrphanBlock* porphan)
+{
+    if (porphan->fOnDisk) {
+        try {
+            boost::filesystem::remove(GetOrphanBlockPath(porphan->hashBlock));
+        } catch (boost::filesystem::filesystem_error &e) {
+            LogPrintf("DeleteOrphanBlock : %s\n", e.what());
+        }
+    } else {
+        nOrphanBlockBytes -= porphan->vchBlock.size();
+    }
+    delete porphan;
+}
+
 uint256 static GetOrphanRoot(const uint256& hash)
 {
-    map<uint256, COrphanBlock*>::iterator it = mapOrphanBlocks.find(hash);
+    OrphanBlockMap::iterator it = mapOrphanBlocks.find(hash);
     if (it == mapOrphanBlocks.end())
         return hash;
 
     // Work back to the first block in the orphan chain
     do {
-        map<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocks.find(it->second->hashPrev);
+        OrphanBlockMap::iterator it2 = mapOrphanBlocks.find(it->second->hashPrev);
         if (it2 == mapOrphanBlocks.end())
             return it->first;
         it = it2;
@@ -1405,19 +1683,19 @@ void static PruneOrphanBlocks()
 
     // Pick a random orphan block.
     int pos = insecure_rand() % mapOrphanBlocksByPrev.size();
-    std::multimap<uint256, COrphanBlock*>::iterator it = mapOrphanBlocksByPrev.begin();
+    OrphanBlockByPrevMap::iterator it = mapOrphanBlocksByPrev.begin();
     while (pos--) it++;
 
     // As long as this block has other orphans depending on it, move to one of those successors.
     do {
-        std::multimap<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocksByPrev.find(it->second->hashBlock);
+        OrphanBlockByPrevMap::iterator it2 = mapOrphanBlocksByPrev.find(it->second->hashBlock);
         if (it2 == mapOrphanBlocksByPrev.end())
             break;
         it = it2;
     } while(1);
 
     uint256 hash = it->second->hashBlock;
-    delete it->second;
+    DeleteOrphanBlock(it->second);
     mapOrphanBlocksByPrev.erase(it);
     mapOrphanBlocks.erase(hash);
 }
@@ -1766,7 +2044,8 @@ static const int64_t nMaxActualTimespan = nAveragingTargetTimespan * (100 + nMax
     
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock)
 {
-    unsigned int nProofOfWorkLimit = Params().ProofOfWorkLimit().GetCompact();
+    const uint256& bnProofOfWorkLimit = Params().ProofOfWorkLimitTarget();
+    unsigned int nProofOfWorkLimit = bnProofOfWorkLimit.GetCompact();
 
     // Genesis block
     if (pindexLast == NULL)
@@ -1811,35 +2090,39 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
     if (nActualTimespan > nMaxActualTimespan)
         nActualTimespan = nMaxActualTimespan;
 
-    // Retarget
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexLast->nBits);
-    bnNew *= nActualTimespan;
-    bnNew /= nAveragingTargetTimespan;
+    // Retarget, in 512 bits: near the limit the product doesn't fit in 256
+    uint256 bnOld;
+    bnOld.SetCompact(pindexLast->nBits);
+    uint512 bnProduct(bnOld);
+    bnProduct *= (uint32_t)nActualTimespan;
+    bnProduct /= uint512(nAveragingTargetTimespan);
 
-    if (bnNew > Params().ProofOfWorkLimit())
-        bnNew = Params().ProofOfWorkLimit();
+    uint256 bnNew = bnProduct.trim256();
+    if (bnProduct.bits() > 256 || bnNew > bnProofOfWorkLimit)
+        bnNew = bnProofOfWorkLimit;
 
     /// debug print
     LogPrintf("GetNextWorkRequired RETARGET\n");
     LogPrintf("nTargetTimespan = %d    nActualTimespan = %d\n", nAveragingTargetTimespan, nActualTimespan);
-    LogPrintf("Before: %08x  %s\n", pindexLast->nBits, CBigNum().SetCompact(pindexLast->nBits).getuint256().ToString().c_str());
-    LogPrintf("After:  %08x  %s\n", bnNew.GetCompact(), bnNew.getuint256().ToString().c_str());
+    LogPrintf("Before: %08x  %s\n", pindexLast->nBits, bnOld.ToString());
+    LogPrintf("After:  %08x  %s\n", bnNew.GetCompact(), bnNew.ToString());
 
     return bnNew.GetCompact();
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative;
+    bool fOverflow;
+    uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > Params().ProofOfWorkLimit())
+    if (fNegative || bnTarget == 0 || fOverflow || bnTarget > Params().ProofOfWorkLimitTarget())
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (hash > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1876,7 +2159,7 @@ void CheckForkWarningConditions()
     if (pindexBestForkTip && chainActive.Height() - pindexBestForkTip->nHeight >= 72)
         pindexBestForkTip = NULL;
 
-    if (pindexBestForkTip || (pindexBestInvalid && pindexBestInvalid->nChainWork > chainActive.Tip()->nChainWork + (chainActive.Tip()->GetBlockWork() * 6).getuint256()))
+    if (pindexBestForkTip || (pindexBestInvalid && pindexBestInvalid->nChainWork > chainActive.Tip()->nChainWork + chainActive.Tip()->GetBlockWork() * 6))
     {
         if (!fLargeWorkForkFound && pindexBestForkBase)
         {
@@ -1931,7 +2214,7 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip)
     // We define it this way because it allows us to only store the highest fork tip (+ base) which meets
     // the 7-block condition and from this always have the most-likely-to-cause-warning fork
     if (pfork && (!pindexBestForkTip || (pindexBestForkTip && pindexNewForkTip->nHeight > pindexBestForkTip->nHeight)) &&
-            pindexNewForkTip->nChainWork - pfork->nChainWork > (pfork->GetBlockWork() * 7).getuint256() &&
+            pindexNewForkTip->nChainWork - pfork->nChainWork > pfork->GetBlockWork() * 7 &&
             chainActive.Height() - pindexNewForkTip->nHeight < 72)
     {
         pindexBestForkTip = pindexNewForkTip;
@@ -2012,20 +2295,28 @@ void UpdateTime(CBlockHeader& block, const CBlockIndex* pindexPrev)
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight, const uint256 &txhash)
 {
     bool ret;
+    CCoinsCommitment *pcommitment = inputs.ModifyCommitment();
     // mark inputs spent
     if (!tx.IsCoinBase()) {
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoins &coins = inputs.GetCoins(txin.prevout.hash);
+            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
             CTxInUndo undo;
-            ret = coins.Spend(txin.prevout, undo);
+            ret = coins->Spend(txin.prevout, undo);
             assert(ret);
+            if (pcommitment) {
+                pcommitment->RemoveOutput(txin.prevout.hash, *coins, txin.prevout.n, undo.txout);
+                if (coins->IsPruned())
+                    pcommitment->nTransactions--;
+            }
             txundo.vprevout.push_back(undo);
         }
     }
 
     // add outputs
-    ret = inputs.SetCoins(txhash, CCoins(tx, nHeight));
-    assert(ret);
+    CCoinsModifier outs = inputs.ModifyNewCoins(txhash);
+    *outs = CCoins(tx, nHeight);
+    if (pcommitment)
+        pcommitment->AddCoins(txhash, *outs);
 }
 
 bool CScriptCheck::operator()() const {
@@ -2136,6 +2427,15 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     bool fClean = true;
 
+    CCoinsCommitment *pcommitment = view.ModifyCommitment();
+
+    // VerifyDB disconnects blocks from a throwaway view (asking whether that
+    // went cleanly); the address and spent indexes must be left alone then.
+    bool fUpdateIndexes = pfClean == NULL && (fAddressIndex || fSpentIndex);
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
@@ -2155,21 +2455,35 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
         // specially with outsEmpty.
-        CCoins outsEmpty;
-        CCoins &outs = view.HaveCoins(hash) ? view.GetCoins(hash) : outsEmpty;
-        outs.ClearUnspendable();
+        {
+        CCoinsModifier outs = view.ModifyCoins(hash);
+        outs->ClearUnspendable();
 
         CCoins outsBlock = CCoins(tx, pindex->nHeight);
         // The CCoins serialization does not serialize negative numbers.
         // No network rules currently depend on the version here, so an inconsistency is harmless
         // but it must be corrected before txout nversion ever influences a network rule.
         if (outsBlock.nVersion < 0)
-            outs.nVersion = outsBlock.nVersion;
-        if (outs != outsBlock)
+            outs->nVersion = outsBlock.nVersion;
+        if (*outs != outsBlock)
             fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
         // remove outputs
-        outs = CCoins();
+        if (pcommitment)
+            pcommitment->RemoveCoins(hash, *outs);
+        *outs = CCoins();
+        }
+
+        if (fUpdateIndexes && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                unsigned char nType;
+                uint160 hashBytes;
+                if (!GetIndexAddress(tx.vout[k].scriptPubKey, nType, hashBytes))
+                    continue;
+                vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
 
         // restore inputs
         if (i > 0) { // not coinbases
@@ -2185,6 +2499,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     // undo data contains height: this is the last output of the prevout tx being spent
                     if (!coins.IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
+                    if (pcommitment)
+                        pcommitment->RemoveCoins(out.hash, coins);
                     coins = CCoins();
                     coins.fCoinBase = undo.fCoinBase;
                     coins.nHeight = undo.nHeight;
@@ -2193,17 +2509,47 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     if (coins.IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
                 }
-                if (coins.IsAvailable(out.n))
+                if (coins.IsAvailable(out.n)) {
                     fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
+                    if (pcommitment)
+                        pcommitment->RemoveOutput(out.hash, coins, out.n, coins.vout[out.n]);
+                }
+                bool fWasPruned = coins.IsPruned();
                 if (coins.vout.size() < out.n+1)
                     coins.vout.resize(out.n+1);
                 coins.vout[out.n] = undo.txout;
+                if (pcommitment) {
+                    pcommitment->AddOutput(out.hash, coins, out.n, undo.txout);
+                    if (fWasPruned)
+                        pcommitment->nTransactions++;
+                }
                 if (!view.SetCoins(out.hash, coins))
                     return error("DisconnectBlock() : cannot restore coin inputs");
+
+                if (fUpdateIndexes) {
+                    unsigned char nType;
+                    uint160 hashBytes;
+                    if (fAddressIndex && GetIndexAddress(undo.txout.scriptPubKey, nType, hashBytes)) {
+                        vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, hash, j, true), -undo.txout.nValue));
+                        vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins.nHeight)));
+                    }
+                    if (fSpentIndex)
+                        vSpentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
 
+    if (fAddressIndex && fUpdateIndexes) {
+        if (!pblocktree->EraseAddressIndex(vAddressIndex))
+            return error("DisconnectBlock() : failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(vAddressUnspent))
+            return error("DisconnectBlock() : failed to write address unspent index");
+    }
+    if (fSpentIndex && fUpdateIndexes)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return error("DisconnectBlock() : failed to write spent index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2240,19 +2586,36 @@ void static FlushBlockFile(bool fFinalize = false)
 }
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
+bool static WriteChainState(CValidationState &state);
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+// Set by ConnectTip when it leaves the chain state write of the block it just
+// connected to the next ConnectBlock, which does it while the script checks
+// of its own block run.
+static bool fChainStateWriteDeferred = false;
+static uint64_t nChainStateWritesOverlapped = 0;
 
 void ThreadScriptCheck() {
     RenameThread("bolt-scriptch");
     scriptcheckqueue.Thread();
 }
 
-bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
+void GetScriptCheckStats(CCheckQueueStats &stats, uint64_t &nOverlappedWrites)
+{
+    AssertLockHeld(cs_main);
+    stats = scriptcheckqueue.GetStats();
+    nOverlappedWrites = nChainStateWritesOverlapped;
+}
+
+static bool CheckBlockLocksAndPayments(const CBlock& block, CValidationState& state);
+
+bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fCheckedBlock)
 {
     AssertLockHeld(cs_main);
-    // Check it again in case a previous version let a bad block in
-    if (!CheckBlock(block, state, !fJustCheck, !fJustCheck))
+    // Check it again in case a previous version let a bad block in; one the
+    // import pipeline has just checked only needs the checks against the chain
+    if (fCheckedBlock ? !CheckBlockLocksAndPayments(block, state) : !CheckBlock(block, state, !fJustCheck, !fJustCheck))
         return false;
 
     // verify that the view's current state corresponds to the previous block
@@ -2315,6 +2678,9 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -2355,6 +2721,35 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
         if (!tx.IsCoinBase())
             blockundo.vtxundo.push_back(txundo);
 
+        if (fAddressIndex || fSpentIndex) {
+            const uint256 &txhash = block.GetTxHash(i);
+            // txundo holds the outputs the inputs just spent
+            for (unsigned int j = 0; j < txundo.vprevout.size(); j++) {
+                const COutPoint &prevout = tx.vin[j].prevout;
+                const CTxOut &txout = txundo.vprevout[j].txout;
+                unsigned char nType = ADDRESS_NONE;
+                uint160 hashBytes;
+                bool fHasAddress = GetIndexAddress(txout.scriptPubKey, nType, hashBytes);
+                if (fAddressIndex && fHasAddress) {
+                    vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, j, true), -txout.nValue));
+                    vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                }
+                if (fSpentIndex)
+                    vSpentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, txout.nValue, nType, hashBytes)));
+            }
+            if (fAddressIndex) {
+                for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                    const CTxOut &txout = tx.vout[k];
+                    unsigned char nType;
+                    uint160 hashBytes;
+                    if (!GetIndexAddress(txout.scriptPubKey, nType, hashBytes))
+                        continue;
+                    vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, k, false), txout.nValue));
+                    vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue(txout.nValue, txout.scriptPubKey, pindex->nHeight)));
+                }
+            }
+        }
+
         vPos.push_back(std::make_pair(block.GetTxHash(i), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
@@ -2368,6 +2763,15 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
                                block.vtx[0].GetValueOut(), GetBlockValue(pindex->pprev->nBits, pindex->pprev->nHeight, nFees)),
                                REJECT_INVALID, "bad-cb-amount");
 
+    // The worker threads are verifying this block's scripts now. Use the time
+    // to write out the chain state the previous block left pending; pcoinsTip
+    // still holds exactly that state, as this block only lives in view so far.
+    if (!fJustCheck && fChainStateWriteDeferred) {
+        if (!WriteChainState(state))
+            return false;
+        nChainStateWritesOverlapped++;
+    }
+
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros() - nStart;
@@ -2403,6 +2807,17 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort(_("Failed to write transaction index"));
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(vAddressIndex))
+            return state.Abort(_("Failed to write address index"));
+        if (!pblocktree->UpdateAddressUnspentIndex(vAddressUnspent))
+            return state.Abort(_("Failed to write address unspent index"));
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return state.Abort(_("Failed to write spent index"));
+
     // add this block to the view's block chain
     bool ret;
     ret = view.SetBestBlock(pindex->GetBlockHash());
@@ -2418,7 +2833,9 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
 // Update the on-disk chain state.
 bool static WriteChainState(CValidationState &state) {
     static int64_t nLastWrite = 0;
-    if (!IsInitialBlockDownload() || pcoinsTip->GetCacheSize() > nCoinCacheSize || GetTimeMicros() > nLastWrite + 600*1000000) {
+    fChainStateWriteDeferred = false;
+    bool fCacheFull = pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage;
+    if (!IsInitialBlockDownload() || fCacheFull || GetTimeMicros() > nLastWrite + 600*1000000) {
         // Typical CCoins structures on disk are around 100 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
@@ -2428,8 +2845,13 @@ bool static WriteChainState(CValidationState &state) {
             return state.Error("out of disk space");
         FlushBlockFile();
         pblocktree->Sync();
-        if (!pcoinsTip->Flush())
+        // Only modified entries are written; the rest of the cache stays
+        // warm. When it has grown over its limit, evict unmodified entries,
+        // those not used recently first, until it is down to half of it.
+        if (!pcoinsTip->Sync())
             return state.Abort(_("Failed to write to coin database"));
+        if (fCacheFull)
+            pcoinsTip->Trim(nCoinCacheUsage / 2);
         nLastWrite = GetTimeMicros();
     }
     return true;
@@ -2438,6 +2860,7 @@ bool static WriteChainState(CValidationState &state) {
 // Update chainActive and related internal data structures.
 void static UpdateTip(CBlockIndex *pindexNew) {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
 
     // Update best block in wallet (so we can detect restored wallets)
     bool fIsInitialDownload = IsInitialBlockDownload();
@@ -2526,7 +2949,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew) {
     {
         CCoinsViewCache view(*pcoinsTip, true);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        if (!ConnectBlock(block, state, pindexNew, view)) {
+        bool fCheckedBlock = setBlocksChecked.erase(inv.hash) > 0;
+        if (!ConnectBlock(block, state, pindexNew, view, false, fCheckedBlock)) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
             return error("ConnectTip() : ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
@@ -2536,8 +2960,14 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew) {
     }
     if (fBenchmark)
         LogPrintf("- Connect: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
-    // Write the chain state to disk, if necessary.
-    if (!WriteChainState(state))
+    // Write the chain state to disk, if necessary. If another block is about
+    // to be connected on top of this one and its scripts will be checked in
+    // parallel, leave the write to that block's ConnectBlock so it overlaps
+    // with the script checks.
+    if (nScriptCheckThreads && pindexNew != chainMostWork.Tip() &&
+        pindexNew->nHeight + 1 >= Checkpoints::GetTotalBlocksEstimate())
+        fChainStateWriteDeferred = true;
+    else if (!WriteChainState(state))
         return false;
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
@@ -2732,6 +3162,10 @@ bool ActivateBestChain(CValidationState &state) {
         }
     }
 
+    // Do a chain state write the last connected block left pending.
+    if (fChainStateWriteDeferred && !WriteChainState(state))
+        return false;
+
     if (chainActive.Tip() != pindexOldTip) {
         std::string strCmd = GetArg("-blocknotify", "");
         if (!IsInitialBlockDownload() && !strCmd.empty())
@@ -2758,7 +3192,13 @@ bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos
          LOCK(cs_nBlockSequenceId);
          pindexNew->nSequenceId = nBlockSequenceId++;
     }
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    // phashBlock points at the map key, so the entry is reserved empty first and
+    // the index only published to LookupBlockIndex once it is filled in
+    map<uint256, CBlockIndex*>::iterator mi;
+    {
+        LOCK(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(make_pair(hash, (CBlockIndex*)NULL)).first;
+    }
     pindexNew->phashBlock = &((*mi).first);
     map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
@@ -2767,12 +3207,18 @@ bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
     }
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + pindexNew->GetBlockWork().getuint256();
+    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + pindexNew->GetBlockWork();
     pindexNew->nChainTx = (pindexNew->pprev ? pindexNew->pprev->nChainTx : 0) + pindexNew->nTx;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
     pindexNew->nStatus = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA;
+    {
+        LOCK(cs_mapBlockIndex);
+        mi->second = pindexNew;
+    }
+    if (Checkpoints::IsCheckpoint(pindexNew->nHeight, hash))
+        pindexLastCheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
     setBlockIndexValid.insert(pindexNew);
 
     if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindexNew)))
@@ -2900,36 +3346,10 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
 }
 
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
+// The instantX lock and masternode payment checks of CheckBlock. Unlike the
+// rest they depend on the current locks, sporks and chain tip.
+static bool CheckBlockLocksAndPayments(const CBlock& block, CValidationState& state)
 {
-    // These are checks that are independent of context
-    // that can be verified before saving an orphan block.
-
-    // Size limits
-    if (block.vtx.empty() || block.vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
-        return state.DoS(100, error("CheckBlock() : size limits failed"),
-                         REJECT_INVALID, "bad-blk-length");
-
-    // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
-        return state.DoS(50, error("CheckBlock() : proof of work failed"),
-                         REJECT_INVALID, "high-hash");
-
-    // Check timestamp
-    if (block.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
-        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
-                             REJECT_INVALID, "time-too-new");
-
-    // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
-        return state.DoS(100, error("CheckBlock() : first tx is not coinbase"),
-                         REJECT_INVALID, "bad-cb-missing");
-    for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
-            return state.DoS(100, error("CheckBlock() : more than one coinbase"),
-                             REJECT_INVALID, "bad-cb-multiple");
-
-
     // ----------- instantX transaction scanning -----------
 
     if(IsSporkActive(SPORK_3_INSTANTX_BLOCK_FILTERING)){
@@ -3025,6 +3445,40 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         LogPrintf("CheckBlock() : skipping masternode payment checks\n");
     }
 
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckLocksAndPayments)
+{
+    // These are checks that are independent of context
+    // that can be verified before saving an orphan block.
+
+    // Size limits
+    if (block.vtx.empty() || block.vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
+        return state.DoS(100, error("CheckBlock() : size limits failed"),
+                         REJECT_INVALID, "bad-blk-length");
+
+    // Check proof of work matches claimed amount
+    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
+        return state.DoS(50, error("CheckBlock() : proof of work failed"),
+                         REJECT_INVALID, "high-hash");
+
+    // Check timestamp
+    if (block.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
+        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
+                             REJECT_INVALID, "time-too-new");
+
+    // First transaction must be coinbase, the rest must not be
+    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+        return state.DoS(100, error("CheckBlock() : first tx is not coinbase"),
+                         REJECT_INVALID, "bad-cb-missing");
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        if (block.vtx[i].IsCoinBase())
+            return state.DoS(100, error("CheckBlock() : more than one coinbase"),
+                             REJECT_INVALID, "bad-cb-multiple");
+
+    if (fCheckLocksAndPayments && !CheckBlockLocksAndPayments(block, state))
+        return false;
 
     // Check transactions
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
@@ -3119,7 +3573,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
                              REJECT_CHECKPOINT, "checkpoint mismatch");
 
         // Don't accept any forks from the main chain prior to last checkpoint
-        CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
+        CBlockIndex* pcheckpoint = pindexLastCheckpoint;
         if (pcheckpoint && nHeight < pcheckpoint->nHeight)
             return state.DoS(100, error("AcceptBlock() : forked chain older than last checkpoint (height %d)", nHeight));
 
@@ -3180,10 +3634,28 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
     int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
     if (chainActive.Tip()->GetBlockHash() == hash)
     {
+        CInv inv(MSG_BLOCK, hash);
+        CNetPayloadRef cmpctblock;
         LOCK(cs_vNodes);
         BOOST_FOREACH(CNode* pnode, vNodes)
             if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                pnode->PushInventory(CInv(MSG_BLOCK, hash));
+            {
+                // Peers that asked for compact blocks get the block right away
+                // instead of an inv they have to request it with
+                CNodeState *nodestate = State(pnode->GetId());
+                if (nodestate && nodestate->fPreferCompactBlocks)
+                {
+                    if (!pnode->IsInventoryKnown(inv))
+                    {
+                        if (!cmpctblock)
+                            cmpctblock = MakeNetPayload(CBlockHeaderAndShortTxIDs(block));
+                        pnode->PushMessage("cmpctblock", cmpctblock);
+                        pnode->AddInventoryKnown(inv);
+                    }
+                }
+                else
+                    pnode->PushInventory(inv);
+            }
     }
 
     return true;
@@ -3226,7 +3698,7 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd)
     pnode->PushMessage("getblocks", chainActive.GetLocator(pindexBegin), hashEnd);
 }
 
-bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBlockPos *dbp)
+bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBlockPos *dbp, bool fCheckedBlock)
 {
     AssertLockHeld(cs_main);
 
@@ -3247,11 +3719,12 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBl
     if (mapOrphanBlocks.count(hash))
         return state.Invalid(error("ProcessBlock() : already have block (orphan) %s", hash.ToString()), 0, "duplicate");
 
-    // Preliminary checks
-    if (!CheckBlock(*pblock, state))
+    // Preliminary checks; the import pipeline has already done the ones that
+    // do not depend on the chain state
+    if (fCheckedBlock ? !CheckBlockLocksAndPayments(*pblock, state) : !CheckBlock(*pblock, state))
         return error("ProcessBlock() : CheckBlock FAILED");
 
-    CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
+    CBlockIndex* pcheckpoint = pindexLastCheckpoint;
     if (pcheckpoint && pblock->hashPrevBlock != (chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256(0)))
     {
         // Extra checks to prevent "fill up memory by spamming with bogus blocks"
@@ -3281,14 +3754,7 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBl
         // Accept orphans as long as there is a node to request its parents from
         if (pfrom) {
             PruneOrphanBlocks();
-            COrphanBlock* pblock2 = new COrphanBlock();
-            {
-                CDataStream ss(SER_DISK, CLIENT_VERSION);
-                ss << *pblock;
-                pblock2->vchBlock = std::vector<unsigned char>(ss.begin(), ss.end());
-            }
-            pblock2->hashBlock = hash;
-            pblock2->hashPrev = pblock->hashPrevBlock;
+            COrphanBlock* pblock2 = StoreOrphanBlock(*pblock);
             mapOrphanBlocks.insert(make_pair(hash, pblock2));
             mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrev, pblock2));
 
@@ -3299,8 +3765,12 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBl
     }
 
     // Store to disk
-    if (!AcceptBlock(*pblock, state, dbp))
+    if (fCheckedBlock)
+        setBlocksChecked.insert(hash);
+    if (!AcceptBlock(*pblock, state, dbp)) {
+        setBlocksChecked.erase(hash);
         return error("ProcessBlock() : AcceptBlock FAILED");
+    }
 
     // Recursively process any orphan blocks that depended on this one
     vector<uint256> vWorkQueue;
@@ -3308,22 +3778,20 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBl
     for (unsigned int i = 0; i < vWorkQueue.size(); i++)
     {
         uint256 hashPrev = vWorkQueue[i];
-        for (multimap<uint256, COrphanBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev);
-             ++mi)
+        std::pair<OrphanBlockByPrevMap::iterator, OrphanBlockByPrevMap::iterator> range = mapOrphanBlocksByPrev.equal_range(hashPrev);
+        for (OrphanBlockByPrevMap::iterator mi = range.first; mi != range.second; ++mi)
         {
             CBlock block;
+            if (ReadOrphanBlock(mi->second, block))
             {
-                CDataStream ss(mi->second->vchBlock, SER_DISK, CLIENT_VERSION);
-                ss >> block;
+                block.BuildMerkleTree();
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan resolution (that is, feeding people an invalid block based on LegitBlockX in order to get anyone relaying LegitBlockX banned)
+                CValidationState stateDummy;
+                if (AcceptBlock(block, stateDummy))
+                    vWorkQueue.push_back(mi->second->hashBlock);
             }
-            block.BuildMerkleTree();
-            // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan resolution (that is, feeding people an invalid block based on LegitBlockX in order to get anyone relaying LegitBlockX banned)
-            CValidationState stateDummy;
-            if (AcceptBlock(block, stateDummy))
-                vWorkQueue.push_back(mi->second->hashBlock);
             mapOrphanBlocks.erase(mi->second->hashBlock);
-            delete mi->second;
+            DeleteOrphanBlock(mi->second);
         }
         mapOrphanBlocksByPrev.erase(hashPrev);
     }
@@ -3523,7 +3991,7 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
 {
     if (pos.IsNull())
         return NULL;
-    boost::filesystem::path path = GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
+    boost::filesystem::path path = GetDiskFilePath(pos.nFile, prefix);
     boost::filesystem::create_directories(path.parent_path());
     FILE* file = fopen(path.string().c_str(), "rb+");
     if (!file && !fReadOnly)
@@ -3564,8 +4032,12 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
-    mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
+    {
+        LOCK(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(make_pair(hash, (CBlockIndex*)NULL)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        mi->second = pindexNew;
+    }
 
     return pindexNew;
 }
@@ -3589,13 +4061,14 @@ bool static LoadBlockIndexDB()
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->GetBlockWork().getuint256();
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->GetBlockWork();
         pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
         if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS && !(pindex->nStatus & BLOCK_FAILED_MASK))
             setBlockIndexValid.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
     }
+    pindexLastCheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3612,11 +4085,18 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent output indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     std::map<uint256, CBlockIndex*>::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
     LogPrintf("LoadBlockIndexDB(): hashBestChain=%s height=%d date=%s progress=%f\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
@@ -3665,7 +4145,7 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= 2*nCoinCacheSize + 32000) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -3701,10 +4181,15 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
 
 void UnloadBlockIndex()
 {
-    mapBlockIndex.clear();
-    setBlockIndexValid.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
+    {
+        LOCK(cs_mapBlockIndex);
+        mapBlockIndex.clear();
+    }
+    setBlockIndexValid.clear();
     pindexBestInvalid = NULL;
+    pindexLastCheckpoint = NULL;
 }
 
 bool LoadBlockIndex()
@@ -3725,6 +4210,12 @@ bool InitBlockIndex() {
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", false);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Likewise for -addressindex and -spentindex
+    fAddressIndex = GetBoolArg("-addressindex", false);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", false);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3820,26 +4311,35 @@ void PrintBlockTree()
     }
 }
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+static const unsigned int IMPORT_BATCH_SIZE = 128;
+
+/** A block read from an external file, with the result of its context-free checks */
+struct CImportBlock
 {
-    int64_t nStart = GetTimeMillis();
+    uint64_t nPos;
+    CBlock block;
+    bool fChecked;
 
-    int nLoaded = 0;
-    try {
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nStartByte = 0;
-        if (dbp) {
-            // (try to) skip already indexed part
-            CBlockFileInfo info;
-            if (pblocktree->ReadBlockFileInfo(dbp->nFile, info)) {
-                nStartByte = info.nSize;
-                blkdat.Seek(info.nSize);
-            }
-        }
-        uint64_t nRewind = blkdat.GetPos();
-        while (blkdat.good() && !blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    CImportBlock(uint64_t nPosIn) : nPos(nPosIn), fChecked(false) {}
+};
 
+/** Locates and deserializes the blocks of an external block file, in file order */
+class CImportReader
+{
+public:
+    CImportReader(FILE* fileIn, uint64_t nStartByteIn) :
+        blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION), nStartByte(nStartByteIn)
+    {
+        if (nStartByte)
+            blkdat.Seek(nStartByte);
+        nRewind = blkdat.GetPos();
+    }
+
+    /** Append up to IMPORT_BATCH_SIZE blocks from the file to vBlocks, none at its end */
+    void Read(std::vector<CImportBlock>& vBlocks)
+    {
+        vBlocks.reserve(IMPORT_BATCH_SIZE);
+        while (vBlocks.size() < IMPORT_BATCH_SIZE && blkdat.good() && !blkdat.eof()) {
             blkdat.SetPos(nRewind);
             nRewind++; // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
@@ -3864,23 +4364,173 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
                 // read block
                 uint64_t nBlockPos = blkdat.GetPos();
                 blkdat.SetLimit(nBlockPos + nSize);
-                CBlock block;
-                blkdat >> block;
+                vBlocks.push_back(CImportBlock(nBlockPos));
+                blkdat >> vBlocks.back().block;
                 nRewind = blkdat.GetPos();
 
-                // process block
-                if (nBlockPos >= nStartByte) {
+                // skip the part of the file that is already indexed
+                if (nBlockPos < nStartByte)
+                    vBlocks.pop_back();
+            } catch (std::exception &e) {
+                vBlocks.pop_back();
+                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+    }
+
+private:
+    CBufferedFile blkdat;
+    uint64_t nStartByte;
+    uint64_t nRewind;
+};
+
+static void CheckImportBlocks(std::vector<CImportBlock>* pvBlocks, unsigned int nThread, unsigned int nThreads)
+{
+    for (unsigned int i = nThread; i < pvBlocks->size(); i += nThreads)
+    {
+        CImportBlock& imp = (*pvBlocks)[i];
+        CValidationState state;
+        imp.fChecked = CheckBlock(imp.block, state, true, true, false);
+    }
+}
+
+/** A batch of blocks being read and checked by a background thread */
+class CImportBatch
+{
+public:
+    std::vector<CImportBlock> vBlocks;
+    std::string strError;
+
+    CImportBatch() : fRunning(false) {}
+    ~CImportBatch() { Wait(); }
+
+    /** Start reading the next blocks from reader; it must not be in use by another batch */
+    void Start(CImportReader* preader)
+    {
+        threads.create_thread(boost::bind(&CImportBatch::Run, this, preader));
+        fRunning = true;
+    }
+
+    void Wait()
+    {
+        if (fRunning)
+            threads.join_all();
+        fRunning = false;
+    }
+
+private:
+    boost::thread_group threads;
+    bool fRunning;
+
+    void Run(CImportReader* preader)
+    {
+        try {
+            preader->Read(vBlocks);
+        } catch (std::runtime_error &e) {
+            strError = e.what();
+            return;
+        }
+
+        // the hashing, merkle and transaction checks don't need the chain, so
+        // spread them over all cores
+        unsigned int nThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+        boost::thread_group checkers;
+        for (unsigned int i = 0; i < nThreads && i < vBlocks.size(); i++)
+            checkers.create_thread(boost::bind(&CheckImportBlocks, &vBlocks, i, nThreads));
+        checkers.join_all();
+    }
+};
+
+// Blocks are read and checked a batch ahead on background threads, while the
+// current batch is connected in file order.
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+{
+    // Block file positions of blocks whose parent was not loaded yet, by the
+    // parent's hash; they are read back from disk once it is
+    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+    int64_t nStart = GetTimeMillis();
+
+    // the file is read front to back, let the OS read ahead
+    FileAdviseSequential(fileIn);
+
+    int nLoaded = 0;
+    try {
+        uint64_t nStartByte = 0;
+        if (dbp) {
+            // (try to) skip already indexed part
+            CBlockFileInfo info;
+            if (pblocktree->ReadBlockFileInfo(dbp->nFile, info))
+                nStartByte = info.nSize;
+        }
+        {
+            CImportReader reader(fileIn, nStartByte);
+            boost::scoped_ptr<CImportBatch> pbatch(new CImportBatch());
+            pbatch->Start(&reader);
+            bool fError = false;
+            while (!fError)
+            {
+                pbatch->Wait();
+                if (!pbatch->strError.empty())
+                    throw std::runtime_error(pbatch->strError);
+                if (pbatch->vBlocks.empty())
+                    break;
+
+                boost::scoped_ptr<CImportBatch> pnext(new CImportBatch());
+                pnext->Start(&reader);
+
+                BOOST_FOREACH(CImportBlock& imp, pbatch->vBlocks)
+                {
+                    boost::this_thread::interruption_point();
+
+                    CBlock& block = imp.block;
                     LOCK(cs_main);
                     if (dbp)
-                        dbp->nPos = nBlockPos;
+                        dbp->nPos = imp.nPos;
+
+                    if (dbp && block.hashPrevBlock != 0 && !mapBlockIndex.count(block.hashPrevBlock)) {
+                        LogPrint("reindex", "%s : Out of order block %s, parent %s not known\n", __func__, block.GetHash().ToString(), block.hashPrevBlock.ToString());
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                        continue;
+                    }
+
+                    // a block that failed the early checks goes through them
+                    // again here, to be rejected the usual way
                     CValidationState state;
-                    if (ProcessBlock(state, NULL, &block, dbp))
+                    if (ProcessBlock(state, NULL, &block, dbp, imp.fChecked))
                         nLoaded++;
-                    if (state.IsError())
+                    if (state.IsError()) {
+                        fError = true;
                         break;
+                    }
+
+                    // process the blocks that were waiting for this one
+                    std::deque<uint256> queue;
+                    if (!mapBlocksUnknownParent.empty() && mapBlockIndex.count(block.GetHash()))
+                        queue.push_back(block.GetHash());
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            CBlock blockChild;
+                            CDiskBlockPos posChild = it->second;
+                            if (ReadBlockFromDisk(blockChild, posChild)) {
+                                LogPrint("reindex", "%s : Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(), head.ToString());
+                                CValidationState stateDummy;
+                                if (ProcessBlock(stateDummy, NULL, &blockChild, &posChild)) {
+                                    nLoaded++;
+                                    queue.push_back(blockChild.GetHash());
+                                }
+                            }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                        }
+                    }
                 }
-            } catch (std::exception &e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+
+                pbatch.swap(pnext);
             }
         }
         fclose(fileIn);
@@ -3970,9 +4620,10 @@ string GetWarnings(string strFor)
 // Messages
 //
 
-
+// requires cs_main, which also guards the InstantX, spork and masternode state
 bool static AlreadyHave(const CInv& inv)
 {
+    AssertLockHeld(cs_main);
     switch (inv.type)
     {
     case MSG_TX:
@@ -4002,6 +4653,29 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+// The most recently served blocks, serialized, as new blocks are asked for by
+// most peers at about the same time. Protected by cs_main.
+static const unsigned int MAX_BLOCK_PAYLOADS = 4;
+static std::deque<std::pair<uint256, CNetPayloadRef> > vBlockPayloads;
+
+static CNetPayloadRef GetBlockPayload(CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = pindex->GetBlockHash();
+    for (std::deque<std::pair<uint256, CNetPayloadRef> >::iterator it = vBlockPayloads.begin(); it != vBlockPayloads.end(); ++it)
+        if ((*it).first == hash)
+            return (*it).second;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return MakeNetPayload(block);
+    CNetPayloadRef payload = MakeNetPayload(block);
+    vBlockPayloads.push_back(std::make_pair(hash, payload));
+    if (vBlockPayloads.size() > MAX_BLOCK_PAYLOADS)
+        vBlockPayloads.pop_front();
+    return payload;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4029,7 +4703,7 @@ void static ProcessGetData(CNode* pfrom)
                     // If the requested block is at a height below our last
                     // checkpoint, only serve it if it's in the checkpointed chain
                     int nHeight = mi->second->nHeight;
-                    CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
+                    CBlockIndex* pcheckpoint = pindexLastCheckpoint;
                     if (pcheckpoint && nHeight < pcheckpoint->nHeight) {
                         if (!chainActive.Contains(mi->second))
                         {
@@ -4043,13 +4717,13 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 if (send)
                 {
-                    // Send block from disk
-                    CBlock block;
-                    ReadBlockFromDisk(block, (*mi).second);
+                    // Send block from disk, serialized once for all the peers asking for it
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                        pfrom->PushMessage("block", GetBlockPayload((*mi).second));
                     else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        ReadBlockFromDisk(block, (*mi).second);
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
@@ -4063,7 +4737,7 @@ void static ProcessGetData(CNode* pfrom)
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                if (!pfrom->IsInventoryKnown(CInv(MSG_TX, pair.second)))
                                     pfrom->PushMessage("tx", block.vtx[pair.first]);
                         }
                         // else
@@ -4089,7 +4763,7 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CNetPayloadRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
                         pfrom->PushMessage(inv.GetCommand(), (*mi).second);
                         pushed = true;
@@ -4209,7 +4883,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
-
     if (strCommand == "version")
     {
         // Each connection can only send one version message
@@ -4326,6 +4999,22 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     else if (strCommand == "verack")
     {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+
+        // Ask for new blocks as compact blocks, version 1 of the encoding
+        if (GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS) && pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+            pfrom->PushMessage("sendcmpct", true, (uint64_t)1);
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounce = false;
+        uint64_t nCmpctVersion = 0;
+        vRecv >> fAnnounce >> nCmpctVersion;
+        if (nCmpctVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fPreferCompactBlocks = fAnnounce;
+        }
     }
 
 
@@ -4554,6 +5243,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             //these allow masternodes to publish a limited amount of free transactions
             vRecv >> tx >> vin >> vchSig >> sigTime;
 
+            // the masternode and Darksend state is guarded by cs_main
+            LOCK(cs_main);
             CMasternode* pmn = mnodeman.Find(vin);
             if(pmn != NULL)
             {
@@ -4614,7 +5305,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             set<NodeId> setMisbehaving;
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
+                OrphanTxByPrevMap::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
                 if (itByPrev == mapOrphanTransactionsByPrev.end())
                     continue;
                 for (set<uint256>::iterator mi = itByPrev->second.begin();
@@ -4707,6 +5398,144 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex)
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        int64_t nStart = GetTimeMicros();
+        CInv inv(MSG_BLOCK, cmpctblock.header.GetHash());
+        pfrom->AddInventoryKnown(inv);
+        LogPrint("net", "received compact block %s\n", inv.hash.ToString());
+
+        LOCK(cs_main);
+        // Lock requests can hold transactions the mempool doesn't
+        vector<CTransaction> vLockTxn;
+        for (map<uint256, CTransaction>::iterator it = mapTxLockReq.begin(); it != mapTxLockReq.end(); ++it)
+            vLockTxn.push_back(it->second);
+
+        if (AlreadyHave(inv))
+            return true;
+
+        // Without the parent there's nothing to rebuild against; get the whole
+        // block the usual way and let the orphan handling take it from there
+        if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+            AddBlockToQueue(pfrom->GetId(), inv.hash);
+            return true;
+        }
+
+        // Don't scan the mempool for a block that couldn't be valid anyway
+        if (!CheckProofOfWork(inv.hash, cmpctblock.header.nBits)) {
+            Misbehaving(pfrom->GetId(), 50);
+            return error("cmpctblock : proof of work failed");
+        }
+
+        CNodeState *nodestate = State(pfrom->GetId());
+        CPartiallyDownloadedBlock& partialBlock = nodestate->partialBlock;
+        ReadStatus status = partialBlock.InitData(cmpctblock, mempool, vLockTxn);
+        if (status == READ_STATUS_INVALID) {
+            partialBlock = CPartiallyDownloadedBlock();
+            Misbehaving(pfrom->GetId(), 100);
+            return error("cmpctblock : invalid compact block %s", inv.hash.ToString());
+        }
+        if (status == READ_STATUS_FAILED) {
+            partialBlock = CPartiallyDownloadedBlock();
+            AddBlockToQueue(pfrom->GetId(), inv.hash);
+            return true;
+        }
+
+        CBlockTransactionsRequest req;
+        req.blockhash = inv.hash;
+        partialBlock.GetMissing(req.indexes);
+        LogPrint("net", "compact block %s: %u prefilled, %u from mempool, %u to request\n", inv.hash.ToString(),
+            partialBlock.nPrefilled, partialBlock.nFromPool, req.indexes.size());
+        if (!req.indexes.empty()) {
+            pfrom->PushMessage("getblocktxn", req);
+            return true;
+        }
+
+        CBlock block;
+        status = partialBlock.FillBlock(block, vector<CTransaction>());
+        partialBlock = CPartiallyDownloadedBlock();
+        if (status != READ_STATUS_OK) {
+            AddBlockToQueue(pfrom->GetId(), inv.hash);
+            return true;
+        }
+        LogPrint("net", "reconstructed compact block %s in %.2fms\n", inv.hash.ToString(), (GetTimeMicros() - nStart) * 0.001);
+
+        mapBlockSource[inv.hash] = pfrom->GetId();
+        MarkBlockAsReceived(inv.hash, pfrom->GetId());
+
+        CValidationState state;
+        ProcessBlock(state, pfrom, &block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
+            return true;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, mi->second))
+            return error("getblocktxn : failed to read block %s", req.blockhash.ToString());
+
+        CBlockTransactions resp;
+        resp.blockhash = req.blockhash;
+        resp.txn.reserve(req.indexes.size());
+        BOOST_FOREACH(uint16_t nIndex, req.indexes) {
+            if (nIndex >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("getblocktxn : index %u out of range for block %s", nIndex, req.blockhash.ToString());
+            }
+            resp.txn.push_back(block.vtx[nIndex]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex)
+    {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        int64_t nStart = GetTimeMicros();
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        CPartiallyDownloadedBlock& partialBlock = nodestate->partialBlock;
+        if (partialBlock.header.IsNull() || partialBlock.header.GetHash() != resp.blockhash) {
+            LogPrint("net", "unrequested blocktxn for %s from peer=%d\n", resp.blockhash.ToString(), pfrom->id);
+            return true;
+        }
+
+        CBlock block;
+        ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+        partialBlock = CPartiallyDownloadedBlock();
+        if (status == READ_STATUS_INVALID) {
+            Misbehaving(pfrom->GetId(), 100);
+            return error("blocktxn : wrong number of transactions for block %s", resp.blockhash.ToString());
+        }
+        if (status == READ_STATUS_FAILED) {
+            AddBlockToQueue(pfrom->GetId(), resp.blockhash);
+            return true;
+        }
+        LogPrint("net", "reconstructed compact block %s with %u requested transactions in %.2fms\n", resp.blockhash.ToString(),
+            resp.txn.size(), (GetTimeMicros() - nStart) * 0.001);
+
+        CInv inv(MSG_BLOCK, resp.blockhash);
+        mapBlockSource[inv.hash] = pfrom->GetId();
+        MarkBlockAsReceived(inv.hash, pfrom->GetId());
+
+        CValidationState state;
+        ProcessBlock(state, pfrom, &block);
+    }
+
+
     else if (strCommand == "getaddr")
     {
         pfrom->vAddrToSend.clear();
@@ -4921,6 +5750,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     else
     {
         //probably one the extensions
+        // Their state is read by AlreadyHave, ProcessGetData and ProcessBlock's
+        // hooks, and they check inputs and the chain themselves, so they run
+        // under cs_main like the other handlers that do.
+        LOCK(cs_main);
         darkSendPool.ProcessMessageDarksend(pfrom, strCommand, vRecv);
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
@@ -5192,7 +6025,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                if (pto->filterInventoryKnown.contains(CNode::InventoryKey(inv)))
                     continue;
 
                 // trickle out tx inv to protect privacy
@@ -5213,15 +6046,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+                pto->filterInventoryKnown.insert(CNode::InventoryKey(inv));
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
             }
             pto->vInventoryToSend = vInvWait;
@@ -5301,7 +6131,7 @@ public:
         mapBlockIndex.clear();
 
         // orphan blocks
-        std::map<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocks.begin();
+        OrphanBlockMap::iterator it2 = mapOrphanBlocks.begin();
         for (; it2 != mapOrphanBlocks.end(); it2++)
             delete (*it2).second;
         mapOrphanBlocks.clear();
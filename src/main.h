@@ -27,10 +27,12 @@
 #include "bolt-config.h"
 #endif
 
+#include "addressindex.h"
 #include "bignum.h"
 #include "chainparams.h"
 #include "coins.h"
 #include "core.h"
+#include "hash.h"
 #include "net.h"
 #include "script.h"
 #include "sync.h"
@@ -46,6 +48,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
 // Define difficulty retarget algorithms
 enum DiffMode {
     DIFF_DEFAULT = 0, // Default to invalid 0
@@ -71,14 +76,18 @@ static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
 static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
-/** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
+/** Default for -maxorphanblocks, maximum number of orphan blocks kept */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 750;
+/** Default for -maxorphanblockmem, megabytes of orphan blocks kept in memory; the rest are kept on disk */
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCK_MEMORY = 20;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Number of block and undo files kept open for reading */
+static const unsigned int MAX_OPEN_BLOCK_FILES = 32;
 /** Coinbase transaction outputs can only be spent after this number of new blocks (network rule) */
 static const int COINBASE_MATURITY = 100;
 /** Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX timestamp. */
@@ -87,6 +96,8 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -compactblocks, asking peers for new blocks as compact blocks */
+static const bool DEFAULT_COMPACT_BLOCKS = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 /** Timeout in seconds before considering a block download peer unresponsive. */
@@ -124,7 +135,9 @@ extern bool fReindex;
 extern bool fBenchmark;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
-extern unsigned int nCoinCacheSize;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern size_t nCoinCacheUsage;
 
 extern bool fLargeWorkForkFound;
 extern bool fLargeWorkInvalidChainFound;
@@ -138,12 +151,21 @@ class CBlockTreeDB;
 struct CDiskBlockPos;
 class CTxUndo;
 class CScriptCheck;
+struct CCheckQueueStats;
 class CValidationState;
 class CWalletInterface;
 struct CNodeStateStats;
 
 struct CBlockTemplate;
 
+/** A transaction whose inputs aren't known yet, and the peer that sent it */
+struct COrphanTx {
+    CTransaction tx;
+    NodeId fromPeer;
+};
+typedef boost::unordered_map<uint256, COrphanTx, CSaltedHasher> OrphanTxMap;
+typedef boost::unordered_map<uint256, std::set<uint256>, CSaltedHasher> OrphanTxByPrevMap;
+
 /** Register a wallet to receive updates from core */
 void RegisterWallet(CWalletInterface* pwalletIn);
 /** Unregister a wallet from core */
@@ -160,14 +182,18 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
 
 void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd);
 
-/** Process an incoming block */
-bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBlockPos *dbp = NULL);
+/** Process an incoming block. fCheckedBlock means CheckBlock already passed without the lock and payment checks. */
+bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBlockPos *dbp = NULL, bool fCheckedBlock = false);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** Read the undo data at pos and its checksum from an undo file, through the open file cache */
+bool ReadUndoFileRecord(const CDiskBlockPos &pos, CDataStream &ss);
+/** Hint that the blocks at vPos are about to be read, in order */
+void PrefetchBlockFiles(const std::vector<CDiskBlockPos> &vPos);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -186,6 +212,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Get the script checking queue statistics and the number of chain state writes overlapped with script checks */
+void GetScriptCheckStats(CCheckQueueStats &stats, uint64_t &nOverlappedWrites);
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 /** Calculate the minimum amount of work a received block needs, without knowing its direct parent */
@@ -196,6 +224,14 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
+/** The address an output script pays to, as kept in the address index */
+bool GetIndexAddress(const CScript &script, unsigned char &nType, uint160 &hashBytes);
+/** Look up the address index entries of an address, optionally only those between two heights */
+bool GetAddressIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, int64_t> > &vAddressIndex, int nStart = 0, int nEnd = 0);
+/** Look up the unspent outputs paying to an address */
+bool GetAddressUnspent(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent);
+/** Look up the input that spent an output */
+bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState &state);
 double ConvertBitsToDouble(unsigned int nBits);
@@ -397,16 +433,15 @@ public:
 
     bool ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock)
     {
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-        if (!filein)
-            return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+        // Read undo data and checksum
+        CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+        if (!ReadUndoFileRecord(pos, ssUndo))
+            return error("CBlockUndo::ReadFromDisk : ReadUndoFileRecord failed");
 
-        // Read block
         uint256 hashChecksum;
         try {
-            filein >> *this;
-            filein >> hashChecksum;
+            ssUndo >> *this;
+            ssUndo >> hashChecksum;
         }
         catch (std::exception &e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -616,7 +651,8 @@ public:
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPOW = true);
+/** Read the block of pindex; comparing its hash with the index makes checking its proof of work again needless */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
 
@@ -634,14 +670,16 @@ bool DisconnectBlockAndInputs(CValidationState &state, CTransaction txLock);
 // reprocess a number of blocks to try and get on the correct chain again
 bool DisconnectBlocksAndReprocess(int blocks);
 
-// Apply the effects of this block (with given index) on the UTXO set represented by coins
-bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false);
+// Apply the effects of this block (with given index) on the UTXO set represented by coins.
+// fCheckedBlock skips the context-independent checks, for blocks that just passed them.
+bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false, bool fCheckedBlock = false);
 
 // Add this block to the block index, and if necessary, switch the active block chain to this
 bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos& pos);
 
-// Context-independent validity checks
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+// Context-independent validity checks, plus the instantX lock and masternode payment
+// checks against the current chain tip unless fCheckLocksAndPayments is false
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckLocksAndPayments = true);
 
 // Store block on disk
 // if dbp is provided, the file is known to already reside on disk
@@ -852,13 +890,20 @@ public:
         return (int64_t)nTime;
     }
 
-    CBigNum GetBlockWork() const
+    uint256 GetBlockWork() const
     {
-        CBigNum bnTarget;
-        bnTarget.SetCompact(nBits);
-        if (bnTarget <= 0)
+        bool fNegative;
+        bool fOverflow;
+        uint256 bnTarget;
+        bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
+        if (fNegative || fOverflow || bnTarget == 0)
             return 0;
-        return (CBigNum(1)<<256) / (bnTarget+1);
+        // We need to compute 2**256 / (bnTarget+1), but we can't represent 2**256
+        // as it's too large for a uint256. However, as 2**256 is at least as large
+        // as bnTarget+1, it is equal to ((2**256 - bnTarget - 1) / (bnTarget+1)) + 1,
+        // or ~bnTarget / (bnTarget+1) + 1.
+        uint256 bnWork = ~bnTarget / (bnTarget + uint256(1));
+        return bnWork + uint256(1);
     }
 
     bool CheckIndex() const
@@ -1100,6 +1145,59 @@ extern CChain chainActive;
 /** The currently best known chain of headers (some of which may be invalid). */
 extern CChain chainMostWork;
 
+/** An immutable copy of the active chain, published after every tip change
+ *  so that read-only RPC calls can look up blocks without taking cs_main.
+ *  The chain is stored in fixed-size segments; a new snapshot shares every
+ *  full segment that did not change with the previous one, so publishing
+ *  after a block connect copies at most one segment. Block index entries are
+ *  never freed while the node runs, so the pointers stay valid for as long
+ *  as the snapshot is held.
+ */
+class CChainSnapshot {
+public:
+    static const int SEGMENT_SIZE = 4096;
+
+private:
+    typedef std::vector<CBlockIndex*> Segment;
+    std::vector<boost::shared_ptr<const Segment> > vSegments;
+    int nHeight;
+
+public:
+    CChainSnapshot() : nHeight(-1) {}
+    CChainSnapshot(const CChainSnapshot *pprev, const CChain &chain);
+
+    CBlockIndex *Tip() const {
+        return (*this)[nHeight];
+    }
+
+    CBlockIndex *operator[](int nHeightIn) const {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return (*vSegments[nHeightIn / SEGMENT_SIZE])[nHeightIn % SEGMENT_SIZE];
+    }
+
+    bool Contains(const CBlockIndex *pindex) const {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    CBlockIndex *Next(const CBlockIndex *pindex) const {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return NULL;
+    }
+
+    int Height() const {
+        return nHeight;
+    }
+};
+
+/** Return the most recently published snapshot of chainActive. Does not need cs_main. */
+boost::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
+/** Find a block index entry by hash without holding cs_main. */
+CBlockIndex *LookupBlockIndex(const uint256 &hash);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
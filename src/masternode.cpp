@@ -464,7 +464,7 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
             CMasternode* pmn = mnodeman.Find(vinLP);
             if(pmn != NULL)
             {
-                pmn->Check();
+                mnodeman.CheckMasternode(*pmn);
                 if(!pmn->IsEnabled()) continue;
 
                 newWinner.score = 0;
@@ -191,6 +191,24 @@ void DumpMasternodes()
 
 CMasternodeMan::CMasternodeMan() {
     nDsqCount = 0;
+    nListVersion = 0;
+}
+
+void CMasternodeMan::NotifyChanged(const CTxIn& vin)
+{
+    LOCK(cs);
+
+    vChanges.push_back(make_pair(++nListVersion, vin.prevout));
+    if(vChanges.size() > MASTERNODES_MAX_CHANGES)
+        vChanges.pop_front();
+}
+
+void CMasternodeMan::CheckMasternode(CMasternode& mn)
+{
+    int nState = mn.activeState;
+    mn.Check();
+    if(mn.activeState != nState)
+        NotifyChanged(mn.vin);
 }
 
 bool CMasternodeMan::Add(CMasternode &mn)
@@ -206,6 +224,7 @@ bool CMasternodeMan::Add(CMasternode &mn)
     {
         if(fDebug) LogPrintf("CMasternodeMan: Adding new Masternode %s - %i now\n", mn.addr.ToString().c_str(), size() + 1);
         vMasternodes.push_back(mn);
+        NotifyChanged(mn.vin);
         return true;
     }
 
@@ -217,7 +236,7 @@ void CMasternodeMan::Check()
     LOCK(cs);
 
     BOOST_FOREACH(CMasternode& mn, vMasternodes)
-        mn.Check();
+        CheckMasternode(mn);
 }
 
 void CMasternodeMan::CheckAndRemove()
@@ -231,6 +250,7 @@ void CMasternodeMan::CheckAndRemove()
     while(it != vMasternodes.end()){
         if((*it).activeState == CMasternode::MASTERNODE_REMOVE || (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT){
             if(fDebug) LogPrintf("CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
+            NotifyChanged((*it).vin);
             it = vMasternodes.erase(it);
         } else {
             ++it;
@@ -272,6 +292,8 @@ void CMasternodeMan::CheckAndRemove()
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
+    BOOST_FOREACH(CMasternode& mn, vMasternodes)
+        NotifyChanged(mn.vin);
     vMasternodes.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
@@ -284,7 +306,7 @@ int CMasternodeMan::CountEnabled()
     int i = 0;
 
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.Check();
+        CheckMasternode(mn);
         if(mn.IsEnabled()) i++;
     }
 
@@ -296,7 +318,7 @@ int CMasternodeMan::CountMasternodesAboveProtocol(int protocolVersion)
     int i = 0;
 
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.Check();
+        CheckMasternode(mn);
         if(mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
     }
@@ -355,7 +377,7 @@ CMasternode* CMasternodeMan::FindOldestNotInVec(const std::vector<CTxIn> &vVins,
 
     BOOST_FOREACH(CMasternode &mn, vMasternodes)
     {
-        mn.Check();
+        CheckMasternode(mn);
         if(!mn.IsEnabled()) continue;
 
         if(!RegTest()){
@@ -396,7 +418,7 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
 
     // scan for winner
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.Check();
+        CheckMasternode(mn);
         if(mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
         // calculate the score for each Masternode
@@ -427,7 +449,7 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
         if(mn.protocolVersion < minProtocol) continue;
         if(fOnlyActive) {
-            mn.Check();
+            CheckMasternode(mn);
             if(!mn.IsEnabled()) continue;
         }
 
@@ -463,7 +485,7 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     // scan for winner
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
 
-        mn.Check();
+        CheckMasternode(mn);
 
         if(mn.protocolVersion < minProtocol) continue;
         if(!mn.IsEnabled()) {
@@ -497,7 +519,7 @@ CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight
 
         if(mn.protocolVersion < minProtocol) continue;
         if(fOnlyActive) {
-            mn.Check();
+            CheckMasternode(mn);
             if(!mn.IsEnabled()) continue;
         }
 
@@ -637,6 +659,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             //   after that they just need to match
             if(count == -1 && pmn->pubkey == pubkey && !pmn->UpdatedWithin(MASTERNODE_MIN_DSEE_SECONDS)){
                 pmn->UpdateLastSeen();
+                NotifyChanged(vin);
 
                 if(pmn->sigTime < sigTime){ //take the newest entry
                     LogPrintf("dsee - Got updated entry for %s\n", addr.ToString().c_str());
@@ -647,7 +670,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     pmn->addr = addr;
                     pmn->donationAddress = donationAddress;
                     pmn->donationPercentage = donationPercentage;
-                    pmn->Check();
+                    CheckMasternode(*pmn);
                     if(pmn->IsEnabled())
                         mnodeman.RelayMasternodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion, donationAddress, donationPercentage);
                 }
@@ -779,11 +802,16 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
                 if(!pmn->UpdatedWithin(MASTERNODE_MIN_DSEEP_SECONDS))
                 {
-                    if(stop) pmn->Disable();
+                    if(stop)
+                    {
+                        pmn->Disable();
+                        NotifyChanged(vin);
+                    }
                     else
                     {
                         pmn->UpdateLastSeen();
-                        pmn->Check();
+                        NotifyChanged(vin);
+                        CheckMasternode(*pmn);
                         if(!pmn->IsEnabled()) return;
                     }
                     mnodeman.RelayMasternodeEntryPing(vin, vchSig, sigTime, stop);
@@ -914,12 +942,55 @@ void CMasternodeMan::Remove(CTxIn vin)
     while(it != vMasternodes.end()){
         if((*it).vin == vin){
             if(fDebug) LogPrintf("CMasternodeMan: Removing Masternode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
+            NotifyChanged((*it).vin);
             vMasternodes.erase(it);
             break;
         }
+        ++it;
     }
 }
 
+std::vector<CMasternode> CMasternodeMan::GetFullMasternodeVector(int64_t& nVersionRet)
+{
+    LOCK(cs);
+
+    Check();
+    nVersionRet = nListVersion;
+    return vMasternodes;
+}
+
+bool CMasternodeMan::GetMasternodeChanges(int64_t& nVersion, std::vector<CMasternode>& vChanged, std::vector<CTxIn>& vRemoved)
+{
+    LOCK(cs);
+
+    vChanged.clear();
+    vRemoved.clear();
+    if(nVersion == nListVersion)
+        return true;
+    // the oldest change we know of has to be the one right after nVersion
+    if(nVersion > nListVersion || vChanges.empty() || vChanges.front().first > nVersion + 1)
+    {
+        nVersion = nListVersion;
+        return false;
+    }
+
+    std::set<COutPoint> setChanged;
+    std::deque<std::pair<int64_t, COutPoint> >::const_iterator it = vChanges.end();
+    while(it != vChanges.begin() && (*(it - 1)).first > nVersion)
+        setChanged.insert((*--it).second);
+
+    BOOST_FOREACH(const COutPoint& outpoint, setChanged) {
+        CMasternode* pmn = Find(CTxIn(outpoint));
+        if(pmn != NULL)
+            vChanged.push_back(*pmn);
+        else
+            vRemoved.push_back(CTxIn(outpoint));
+    }
+
+    nVersion = nListVersion;
+    return true;
+}
+
 std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
@@ -18,6 +18,7 @@
 
 #define MASTERNODES_DUMP_SECONDS               (15*60)
 #define MASTERNODES_DSEG_SECONDS               (3*60*60)
+#define MASTERNODES_MAX_CHANGES                10000
 
 using namespace std;
 
@@ -64,6 +65,11 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // version of the list as seen by observers, bumped by every change
+    int64_t nListVersion;
+    // the most recent changes: list version and the Masternode added, changed or removed
+    std::deque<std::pair<int64_t, COutPoint> > vChanges;
+
 public:
     // keep track of dsq count to prevent masternodes from gaming darksend queue
     int64_t nDsqCount;
@@ -94,6 +100,12 @@ public:
     /// Check all Masternodes
     void Check();
 
+    /// Check one Masternode, recording a change of its state
+    void CheckMasternode(CMasternode& mn);
+
+    /// Record that the entry for vin was added, changed or removed
+    void NotifyChanged(const CTxIn& vin);
+
     /// Check all Masternodes and remove inactive
     void CheckAndRemove();
 
@@ -120,6 +132,13 @@ public:
     CMasternode* GetCurrentMasterNode(int mod=1, int64_t nBlockHeight=0, int minProtocol=0);
 
     std::vector<CMasternode> GetFullMasternodeVector() { Check(); return vMasternodes; }
+    /// All Masternodes and the version of the list they make up
+    std::vector<CMasternode> GetFullMasternodeVector(int64_t& nVersionRet);
+
+    /// Masternodes added or changed and removed since version nVersion of the list,
+    /// which is then advanced to the current one. Returns false if these changes are
+    /// no longer all known, and the list has to be fetched again in full.
+    bool GetMasternodeChanges(int64_t& nVersion, std::vector<CMasternode>& vChanged, std::vector<CTxIn>& vRemoved);
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol=0);
     int GetMasternodeRank(const CTxIn &vin, int64_t nBlockHeight, int minProtocol=0, bool fOnlyActive=true);
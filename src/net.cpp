@@ -23,6 +23,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -39,6 +43,9 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Most socket events handled per epoll_wait() call
+#define MAX_EPOLL_EVENTS 256
+
 using namespace std;
 using namespace boost;
 
@@ -65,10 +72,10 @@ int nMaxConnections = 125;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CNetPayloadRef> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
-limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
+limitedmap<CInv, int64_t, CInvHasher> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -458,6 +465,22 @@ CNode* FindNode(const NodeId nodeid)
 }
 
 
+#ifdef USE_EPOLL
+static int hEpollSocket = -1;
+
+/** Register a socket with the socket handler thread: nodes edge-triggered with
+ *  the node as data, listening sockets level-triggered without one. Sockets
+ *  leave the epoll set by themselves when they are closed. */
+static void RegisterSocket(SOCKET hSocket, CNode* pnode)
+{
+    struct epoll_event event;
+    event.events = pnode ? (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) : EPOLLIN;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpollSocket, EPOLL_CTL_ADD, hSocket, &event) == SOCKET_ERROR)
+        LogPrintf("epoll_ctl() failed to add socket: %s\n", NetworkErrorString(errno));
+}
+#endif
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool darkSendMaster)
 {
     if (pszDest == NULL) {
@@ -505,6 +528,9 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool darkSendMaste
         // Add node
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
+#ifdef USE_EPOLL
+        RegisterSocket(hSocket, pnode);
+#endif
 
         {
             LOCK(cs_vNodes);
@@ -733,22 +759,45 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendMessage>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        const CSendMessage &msg = *it;
+        size_t nMsgSize = msg.size();
+        assert(nMsgSize > pnode->nSendOffset);
+        const char* ppch[2];
+        size_t pnSize[2];
+#ifdef WIN32
+        // one piece at a time
+        msg.GetPieces(pnode->nSendOffset, ppch, pnSize);
+        size_t nTried = pnSize[0];
+        int nBytes = send(pnode->hSocket, ppch[0], pnSize[0], MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // the header and a shared payload go out in one call
+        int nPieces = msg.GetPieces(pnode->nSendOffset, ppch, pnSize);
+        struct iovec iov[2];
+        size_t nTried = 0;
+        for (int i = 0; i < nPieces; i++) {
+            iov[i].iov_base = (void*)ppch[i];
+            iov[i].iov_len = pnSize[i];
+            nTried += pnSize[i];
+        }
+        struct msghdr msghdr;
+        memset(&msghdr, 0, sizeof(msghdr));
+        msghdr.msg_iov = iov;
+        msghdr.msg_iovlen = nPieces;
+        int nBytes = sendmsg(pnode->hSocket, &msghdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            if (pnode->nSendOffset == nMsgSize) {
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= nMsgSize;
                 it++;
-            } else {
+            } else if ((size_t)nBytes < nTried) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -776,9 +825,71 @@ void SocketSendData(CNode *pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+/** Wakes a message handler thread when one of its nodes has something for it to do. */
+class CMessageHandlerWakeup
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fWake;
+
+public:
+    CMessageHandlerWakeup() : fWake(false) {}
+
+    void Wake()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fWake = true;
+        }
+        cond.notify_one();
+    }
+
+    /** Wait until woken, or at most nMilliseconds */
+    void Wait(int nMilliseconds)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fWake)
+            cond.timed_wait(lock, boost::posix_time::milliseconds(nMilliseconds));
+        fWake = false;
+    }
+};
+
+// One per message handler thread; a node is handled by the thread at its id modulo their number
+static vector<CMessageHandlerWakeup*> vMessageHandlerWakeups;
+
+unsigned int MessageHandlerThread(NodeId nId, unsigned int nThreads)
+{
+    return (unsigned int)nId % nThreads;
+}
+
+static void WakeMessageHandler(CNode* pnode)
+{
+    if (!vMessageHandlerWakeups.empty())
+        vMessageHandlerWakeups[MessageHandlerThread(pnode->GetId(), vMessageHandlerWakeups.size())]->Wake();
+}
+
+// The node that gets to trickle next. The first message handler thread picks
+// one from all of them on each pass, so the trickle rate doesn't grow with the
+// number of threads; the thread serving it takes it.
+static CCriticalSection cs_nodeTrickle;
+static NodeId nodeTrickle = -1;
+
+static bool TakeTrickleNode(CNode* pnode)
+{
+    LOCK(cs_nodeTrickle);
+    if (nodeTrickle != pnode->GetId())
+        return false;
+    nodeTrickle = -1;
+    return true;
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+#ifdef USE_EPOLL
+    bool fMoreWork = false;
+#endif
     while (true)
     {
         //
@@ -849,6 +960,41 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
+#ifdef USE_EPOLL
+        // Nodes are registered once and edge-triggered: their readiness is latched
+        // in fRecvReady and fSendReady until a recv() or send() would block, so a
+        // wakeup only costs the sockets that changed. Don't wait while a node still
+        // has data buffered in the kernel that it can take.
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+        int nEvents = epoll_wait(hEpollSocket, events, MAX_EPOLL_EVENTS, fMoreWork ? 0 : 50);
+        boost::this_thread::interruption_point();
+        fMoreWork = false;
+
+        if (nEvents == SOCKET_ERROR)
+        {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR)
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                MilliSleep(50);
+            }
+            nEvents = 0;
+        }
+
+        bool fListenReady = false;
+        for (int i = 0; i < nEvents; i++)
+        {
+            CNode* pnode = (CNode*)events[i].data.ptr;
+            if (pnode == NULL) {
+                fListenReady = true;
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fRecvReady = true;
+            if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                pnode->fSendReady = true;
+        }
+#else
         struct timeval timeout;
         timeout.tv_sec  = 0;
         timeout.tv_usec = 50000; // frequency to poll pnode->vSend
@@ -926,13 +1072,18 @@ void ThreadSocketHandler()
             FD_ZERO(&fdsetError);
             MilliSleep(timeout.tv_usec/1000);
         }
+#endif
 
 
         //
         // Accept new connections
         //
         BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+#ifdef USE_EPOLL
+        if (hListenSocket != INVALID_SOCKET && fListenReady)
+#else
         if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+#endif
         {
             struct sockaddr_storage sockaddr;
             socklen_t len = sizeof(sockaddr);
@@ -971,6 +1122,9 @@ void ThreadSocketHandler()
                 LogPrint("net", "accepted connection %s\n", addr.ToString());
                 CNode* pnode = new CNode(hSocket, addr, "", true);
                 pnode->AddRef();
+#ifdef USE_EPOLL
+                RegisterSocket(hSocket, pnode);
+#endif
                 {
                     LOCK(cs_vNodes);
                     vNodes.push_back(pnode);
@@ -998,10 +1152,28 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
+#ifdef USE_EPOLL
+            // the same order as with select() below: drain the send buffer
+            // first, and receive only while there is room for more messages
+            bool fRecv = pnode->fRecvReady;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty())
+                    fRecv = false;
+            }
+            if (fRecv)
+#else
             if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+#endif
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+#ifdef USE_EPOLL
+                if (lockRecv && (
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+#else
                 if (lockRecv)
+#endif
                 {
                     {
                         // typical socket buffer is 8K-64K
@@ -1011,9 +1183,15 @@ void ThreadSocketHandler()
                         {
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
+                            else if (pnode->vRecvMsg.front().complete())
+                                WakeMessageHandler(pnode);
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+#ifdef USE_EPOLL
+                            // keep reading until recv() would block
+                            fMoreWork = true;
+#endif
                         }
                         else if (nBytes == 0)
                         {
@@ -1032,6 +1210,10 @@ void ThreadSocketHandler()
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
                             }
+#ifdef USE_EPOLL
+                            else if (nErr == WSAEWOULDBLOCK)
+                                pnode->fRecvReady = false;
+#endif
                         }
                     }
                 }
@@ -1042,12 +1224,36 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
+#ifdef USE_EPOLL
+            if (pnode->fSendReady)
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty())
+                {
+                    size_t nSendSize = pnode->nSendSize;
+                    SocketSendData(pnode);
+                    // whatever is left waits for the socket to become writable again
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSendReady = false;
+                    // messages wait while the send buffer is full
+                    if (nSendSize >= SendBufferSize() && pnode->nSendSize < SendBufferSize())
+                        WakeMessageHandler(pnode);
+                }
+            }
+#else
             if (FD_ISSET(pnode->hSocket, &fdsetSend))
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
+                    size_t nSendSize = pnode->nSendSize;
                     SocketSendData(pnode);
+                    // messages wait while the send buffer is full
+                    if (nSendSize >= SendBufferSize() && pnode->nSendSize < SendBufferSize())
+                        WakeMessageHandler(pnode);
+                }
             }
+#endif
 
             //
             // Inactivity checking
@@ -1526,9 +1732,13 @@ void static StartSync(const vector<CNode*> &vNodes) {
     }
 }
 
-void ThreadMessageHandler()
+// Each message handler thread serves the nodes whose id modulo the number of
+// threads is nThread, so the messages of one peer are still processed in order,
+// while a peer waiting for cs_main doesn't hold up the peers of other threads.
+void ThreadMessageHandler(unsigned int nThread)
 {
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    CMessageHandlerWakeup* pwakeup = vMessageHandlerWakeups[nThread];
     while (true)
     {
         bool fHaveSyncNode = false;
@@ -1536,22 +1746,38 @@ void ThreadMessageHandler()
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
+            BOOST_FOREACH(CNode* pnode, vNodes) {
                 if (pnode == pnodeSync)
                     fHaveSyncNode = true;
+                if (MessageHandlerThread(pnode->GetId(), vMessageHandlerWakeups.size()) == nThread) {
+                    pnode->AddRef();
+                    vNodesCopy.push_back(pnode);
+                }
+            }
+            if (nThread == 0 && !vNodes.empty()) {
+                LOCK(cs_nodeTrickle);
+                nodeTrickle = vNodes[GetRand(vNodes.size())]->GetId();
             }
         }
 
-        if (!fHaveSyncNode)
-            StartSync(vNodesCopy);
+        // the first thread picks the sync node from all of them
+        if (!fHaveSyncNode && nThread == 0) {
+            vector<CNode*> vNodesAll;
+            {
+                LOCK(cs_vNodes);
+                vNodesAll = vNodes;
+                BOOST_FOREACH(CNode* pnode, vNodesAll)
+                    pnode->AddRef();
+            }
+            StartSync(vNodesAll);
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodesAll)
+                    pnode->Release();
+            }
+        }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-
         bool fSleep = true;
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -1582,7 +1808,7 @@ void ThreadMessageHandler()
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle);
+                    g_signals.SendMessages(pnode, TakeTrickleNode(pnode));
             }
             boost::this_thread::interruption_point();
         }
@@ -1593,8 +1819,9 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
+        // wake up when a node gets a message, or to send what is due
         if (fSleep)
-            MilliSleep(100);
+            pwakeup->Wait(100);
     }
 }
 
@@ -1750,7 +1977,7 @@ void static Discover(boost::thread_group& threadGroup)
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "ext-ip", &ThreadGetMyExternalIP));
 }
 
-void StartNode(boost::thread_group& threadGroup)
+bool StartNode(boost::thread_group& threadGroup, std::string& strError)
 {
     if (semOutbound == NULL) {
         // initialize semaphore
@@ -1761,6 +1988,19 @@ void StartNode(boost::thread_group& threadGroup)
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
+#ifdef USE_EPOLL
+    if (hEpollSocket == -1) {
+        hEpollSocket = epoll_create(MAX_EPOLL_EVENTS);
+        if (hEpollSocket == -1) {
+            strError = strprintf("Error: Couldn't create the epoll instance for network sockets (epoll_create returned error %s)", NetworkErrorString(errno));
+            LogPrintf("%s\n", strError);
+            return false;
+        }
+        BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+            RegisterSocket(hListenSocket, NULL);
+    }
+#endif
+
     Discover(threadGroup);
 
     //
@@ -1787,10 +2027,24 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    StartMessageHandlers(threadGroup, std::max((int)GetArg("-msghandlerthreads", DEFAULT_MESSAGE_HANDLER_THREADS), 1));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
+
+    return true;
+}
+
+void StartMessageHandlers(boost::thread_group& threadGroup, unsigned int nThreads)
+{
+    if (vMessageHandlerWakeups.empty()) {
+        for (unsigned int i = 0; i < std::max(nThreads, 1U); i++)
+            vMessageHandlerWakeups.push_back(new CMessageHandlerWakeup());
+    }
+
+    for (unsigned int i = 0; i < vMessageHandlerWakeups.size(); i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand",
+                                              boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 }
 
 bool StopNode()
@@ -1830,10 +2084,18 @@ public:
             delete pnode;
         vNodes.clear();
         vNodesDisconnected.clear();
+#ifdef USE_EPOLL
+        if (hEpollSocket != -1)
+            close(hEpollSocket);
+        hEpollSocket = -1;
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
+        BOOST_FOREACH(CMessageHandlerWakeup *pwakeup, vMessageHandlerWakeups)
+            delete pwakeup;
+        vMessageHandlerWakeups.clear();
 
 #ifdef WIN32
         // Shutdown Windows Sockets
@@ -1870,7 +2132,7 @@ void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataSt
         }
 
         // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        mapRelay.insert(std::make_pair(inv, CNetPayloadRef(new CNetPayload(ss))));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -1892,6 +2154,8 @@ void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataSt
 void RelayTransactionLockReq(const CTransaction& tx, const uint256& hash, bool relayToAll)
 {
     CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
+    // serialized once for all peers
+    CNetPayloadRef payload = MakeNetPayload(tx);
 
     //broadcast the new lock
     LOCK(cs_vNodes);
@@ -1900,7 +2164,7 @@ void RelayTransactionLockReq(const CTransaction& tx, const uint256& hash, bool r
         if(!relayToAll && !pnode->fRelayTxes)
             continue;
 
-        pnode->PushMessage("txlreq", tx);
+        pnode->PushMessage("txlreq", payload);
     }
 
 }
@@ -26,9 +26,15 @@
 #endif
 
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <openssl/rand.h>
 
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32)
+// Wait for sockets with epoll rather than select(), which has no FD_SETSIZE limit
+#define USE_EPOLL
+#endif
+
 class CAddrMan;
 class CBlockIndex;
 class CNode;
@@ -43,8 +49,12 @@ typedef std::map<CNetAddr, uint64_t> banmap_t;
 static const unsigned int MAX_INV_SZ = 50000;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** The number of inventory items remembered as known to each peer (a fixed size filter of about 53kB) */
+static const unsigned int INVENTORY_KNOWN_ELEMENTS = 5000;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** Default number of message handler threads, each serving its own share of the peers */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
 
 inline unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
@@ -62,7 +72,11 @@ typedef int NodeId;
 CNode* FindNode(const std::string& addrName);
 CNode* FindNode(const NodeId id); //TODO: Remove this
 bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::string()));
-void StartNode(boost::thread_group& threadGroup);
+bool StartNode(boost::thread_group& threadGroup, std::string& strError);
+/** Start the message handler threads, nThreads of them unless they were set up already */
+void StartMessageHandlers(boost::thread_group& threadGroup, unsigned int nThreads);
+/** The message handler thread, out of nThreads, that processes all messages of node nId */
+unsigned int MessageHandlerThread(NodeId nId, unsigned int nThreads);
 bool StopNode();
 void SocketSendData(CNode *pnode);
 
@@ -113,12 +127,70 @@ extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
 
+/** Serialized payload of a message that goes to many peers. It is immutable and
+ *  shared between mapRelay and the send queues of those peers, and its checksum
+ *  is computed once. Network messages hold no key material, so unlike
+ *  CSerializeData it is not zeroed when freed. */
+class CNetPayload
+{
+public:
+    std::vector<char> vData;
+    unsigned int nChecksum;
+
+    CNetPayload(const CDataStream& ss) : vData(ss.begin(), ss.end())
+    {
+        uint256 hash = Hash(vData.begin(), vData.end());
+        memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    }
+};
+typedef boost::shared_ptr<const CNetPayload> CNetPayloadRef;
+
+template<typename T>
+CNetPayloadRef MakeNetPayload(const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << obj;
+    return CNetPayloadRef(new CNetPayload(ss));
+}
+
+/** A message in a send queue: its own bytes (the whole message, or only the
+ *  header), followed by a shared payload if there is one. */
+class CSendMessage
+{
+public:
+    std::vector<char> vData;
+    CNetPayloadRef payload;
+
+    size_t size() const
+    {
+        return vData.size() + (payload ? payload->vData.size() : 0);
+    }
+
+    /** The bytes from nOffset on, in at most two pieces; returns their number */
+    int GetPieces(size_t nOffset, const char* ppch[2], size_t pnSize[2]) const
+    {
+        int nPieces = 0;
+        if (nOffset < vData.size()) {
+            ppch[nPieces] = &vData[nOffset];
+            pnSize[nPieces++] = vData.size() - nOffset;
+            nOffset = 0;
+        } else {
+            nOffset -= vData.size();
+        }
+        if (payload && nOffset < payload->vData.size()) {
+            ppch[nPieces] = &payload->vData[nOffset];
+            pnSize[nPieces++] = payload->vData.size() - nOffset;
+        }
+        return nPieces;
+    }
+};
+
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CNetPayloadRef> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
-extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
+extern limitedmap<CInv, int64_t, CInvHasher> mapAlreadyAskedFor;
 
 extern std::vector<std::string> vAddedNodes;
 extern CCriticalSection cs_vAddedNodes;
@@ -208,7 +280,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendMessage> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -236,6 +308,10 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // Edge-triggered readiness of hSocket, kept by the socket handler thread until
+    // a recv() or send() would block (USE_EPOLL only)
+    bool fRecvReady;
+    bool fSendReady;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in their version message that we should not relay tx invs
@@ -274,7 +350,7 @@ public:
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
@@ -285,7 +361,7 @@ public:
     int64_t nPingUsecTime;
     bool fPingQueued;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000), filterInventoryKnown(INVENTORY_KNOWN_ELEMENTS, 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
@@ -306,6 +382,8 @@ public:
         fNetworkNode = false;
         fSuccessfullyConnected = false;
         fDisconnect = false;
+        fRecvReady = false;
+        fSendReady = false;
         nRefCount = 0;
         nSendSize = 0;
         nSendOffset = 0;
@@ -316,7 +394,6 @@ public:
         fStartSync = false;
         fGetAddr = false;
         fRelayTxes = false;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
         pfilter = new CBloomFilter();
         nPingNonceSent = 0;
         nPingUsecStart = 0;
@@ -422,11 +499,24 @@ public:
     }
 
 
+    // Items of different types can share a hash (a transaction and its lock
+    // request), so the type is folded into the key
+    static uint256 InventoryKey(const CInv& inv)
+    {
+        return inv.hash ^ uint256((uint64_t)inv.type);
+    }
+
+    bool IsInventoryKnown(const CInv& inv)
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.contains(InventoryKey(inv));
+    }
+
     void AddInventoryKnown(const CInv& inv)
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(InventoryKey(inv));
         }
     }
 
@@ -434,7 +524,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(InventoryKey(inv)))
                 vInventoryToSend.push_back(inv);
         }
     }
@@ -447,7 +537,7 @@ public:
         // We're using mapAskFor as a priority queue,
         // the key is the earliest time the request can be sent
         int64_t nRequestTime;
-        limitedmap<CInv, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv);
+        limitedmap<CInv, int64_t, CInvHasher>::const_iterator it = mapAlreadyAskedFor.find(inv);
         if (it != mapAlreadyAskedFor.end())
             nRequestTime = it->second;
         else
@@ -492,7 +582,8 @@ public:
     }
 
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
-    void EndMessage() UNLOCK_FUNCTION(cs_vSend)
+    // With a shared payload, ssSend holds only the header of the message.
+    void EndMessage(const CNetPayloadRef& payload = CNetPayloadRef()) UNLOCK_FUNCTION(cs_vSend)
     {
         // The -*messagestest options are intentionally not documented in the help message,
         // since they are only used during development to debug the networking code and are
@@ -511,19 +602,27 @@ public:
 
         // Set the size
         unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
+        if (payload)
+            nSize += payload->vData.size();
         memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
 
         // Set the checksum
-        uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
         unsigned int nChecksum = 0;
-        memcpy(&nChecksum, &hash, sizeof(nChecksum));
+        if (payload) {
+            nChecksum = payload->nChecksum;
+        } else {
+            uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
+            memcpy(&nChecksum, &hash, sizeof(nChecksum));
+        }
         assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
         memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
 
         LogPrint("net", "(%d bytes)\n", nSize);
 
-        std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-        ssSend.GetAndClear(*it);
+        std::deque<CSendMessage>::iterator it = vSendMsg.insert(vSendMsg.end(), CSendMessage());
+        (*it).vData.assign(ssSend.begin(), ssSend.end());
+        (*it).payload = payload;
+        ssSend.clear();
         nSendSize += (*it).size();
 
         // If write queue empty, attempt "optimistic write"
@@ -535,6 +634,21 @@ public:
 
     void PushVersion();
 
+    /** Push a message whose payload is shared with other peers, without copying it */
+    void PushMessage(const char* pszCommand, const CNetPayloadRef& payload)
+    {
+        try
+        {
+            BeginMessage(pszCommand);
+            EndMessage(payload);
+        }
+        catch (...)
+        {
+            AbortMessage();
+            throw;
+        }
+    }
+
 
     void PushMessage(const char* pszCommand)
     {
@@ -11,6 +11,7 @@
 #define __INCLUDED_PROTOCOL_H__
 
 #include "chainparams.h"
+#include "hash.h"
 #include "netbase.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -116,6 +117,7 @@ class CInv
         )
 
         friend bool operator<(const CInv& a, const CInv& b);
+        friend bool operator==(const CInv& a, const CInv& b);
 
         bool IsKnownType() const;
         const char* GetCommand() const;
@@ -128,6 +130,15 @@ class CInv
         uint256 hash;
 };
 
+/** Hasher for hashed containers keyed by inventory items */
+class CInvHasher : public CSaltedHasher
+{
+public:
+    size_t operator()(const CInv& inv) const {
+        return CSaltedHasher::operator()(inv.hash) ^ inv.type;
+    }
+};
+
 enum
 {
     MSG_TX = 1,
@@ -83,6 +83,7 @@ MasternodeList::MasternodeList(QWidget *parent) :
 
     fFilterUpdated = false;
     nTimeFilterUpdated = GetTime();
+    nNodeListVersion = -1;
     updateNodeList();
 }
 
@@ -301,62 +302,96 @@ void MasternodeList::updateNodeList()
         return;
     }
 
-    static int64_t nTimeListUpdated = GetTime();
+    // a new filter applies to every row, so rebuild the list
+    // MASTERNODELIST_FILTER_COOLDOWN_SECONDS seconds after it was last changed
+    if(fFilterUpdated) {
+        int64_t nSecondsToWait = nTimeFilterUpdated - GetTime() + MASTERNODELIST_FILTER_COOLDOWN_SECONDS;
+        ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", nSecondsToWait)));
+        if(nSecondsToWait > 0) return;
 
-    // to prevent high cpu usage update only once in MASTERNODELIST_UPDATE_SECONDS seconds
-    // or MASTERNODELIST_FILTER_COOLDOWN_SECONDS seconds after filter was last changed
-    int64_t nSecondsToWait = fFilterUpdated
-                            ? nTimeFilterUpdated - GetTime() + MASTERNODELIST_FILTER_COOLDOWN_SECONDS
-                            : nTimeListUpdated - GetTime() + MASTERNODELIST_UPDATE_SECONDS;
+        fFilterUpdated = false;
+        reloadNodeList();
+        return;
+    }
 
-    if(fFilterUpdated) ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", nSecondsToWait)));
-    if(nSecondsToWait > 0) return;
+    if(nNodeListVersion < 0) {
+        reloadNodeList();
+        return;
+    }
 
-    nTimeListUpdated = GetTime();
-    fFilterUpdated = false;
+    // otherwise only redraw the rows of Masternodes that changed
+    std::vector<CMasternode> vChanged;
+    std::vector<CTxIn> vRemoved;
+    if(!mnodeman.GetMasternodeChanges(nNodeListVersion, vChanged, vRemoved)) {
+        reloadNodeList();
+        return;
+    }
+    if(vChanged.empty() && vRemoved.empty()) return;
 
-    QString strToFilter;
+    ui->tableWidgetMasternodes->setSortingEnabled(false);
+    BOOST_FOREACH(const CTxIn& vin, vRemoved)
+        removeNodeListRow(vin.prevout);
+    BOOST_FOREACH(CMasternode& mn, vChanged)
+        updateNodeListRow(mn);
+    ui->countLabel->setText(QString::number(ui->tableWidgetMasternodes->rowCount()));
+    ui->tableWidgetMasternodes->setSortingEnabled(true);
+}
+
+void MasternodeList::reloadNodeList()
+{
     ui->countLabel->setText("Updating...");
     ui->tableWidgetMasternodes->setSortingEnabled(false);
     ui->tableWidgetMasternodes->clearContents();
     ui->tableWidgetMasternodes->setRowCount(0);
-    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    mapNodeListItems.clear();
+    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector(nNodeListVersion);
 
     BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        // populate list
-        // Address, Protocol, Status, Active Seconds, Last Seen, Pub Key
-        QTableWidgetItem *addressItem = new QTableWidgetItem(QString::fromStdString(mn.addr.ToString()));
-        QTableWidgetItem *protocolItem = new QTableWidgetItem(QString::number(mn.protocolVersion));
-        QTableWidgetItem *statusItem = new QTableWidgetItem(QString::fromStdString(mn.Status()));
-        QTableWidgetItem *activeSecondsItem = new QTableWidgetItem(QString::fromStdString(DurationToDHMS(mn.lastTimeSeen - mn.sigTime)));
-        QTableWidgetItem *lastSeenItem = new QTableWidgetItem(QString::fromStdString(DateTimeStrFormat("%Y-%m-%d %H:%M", mn.lastTimeSeen + QDateTime::currentDateTime().utcOffset())));
-        QTableWidgetItem *pubkeyItem = new QTableWidgetItem(QString::fromStdString(CBitcoinAddress(mn.pubkey.GetID()).ToString()));
-
-        if (strCurrentFilter != "")
-        {
-            strToFilter =   addressItem->text() + " " +
-                            protocolItem->text() + " " +
-                            statusItem->text() + " " +
-                            activeSecondsItem->text() + " " +
-                            lastSeenItem->text() + " " +
-                            pubkeyItem->text();
-            if (!strToFilter.contains(strCurrentFilter)) continue;
-        }
-
-        ui->tableWidgetMasternodes->insertRow(0);
-        ui->tableWidgetMasternodes->setItem(0, 0, addressItem);
-        ui->tableWidgetMasternodes->setItem(0, 1, protocolItem);
-        ui->tableWidgetMasternodes->setItem(0, 2, statusItem);
-        ui->tableWidgetMasternodes->setItem(0, 3, activeSecondsItem);
-        ui->tableWidgetMasternodes->setItem(0, 4, lastSeenItem);
-        ui->tableWidgetMasternodes->setItem(0, 5, pubkeyItem);
-    }
+        updateNodeListRow(mn);
 
     ui->countLabel->setText(QString::number(ui->tableWidgetMasternodes->rowCount()));
     ui->tableWidgetMasternodes->setSortingEnabled(true);
 }
 
+void MasternodeList::updateNodeListRow(CMasternode& mn)
+{
+    // Address, Protocol, Status, Active Seconds, Last Seen, Pub Key
+    QStringList columns;
+    columns << QString::fromStdString(mn.addr.ToString())
+            << QString::number(mn.protocolVersion)
+            << QString::fromStdString(mn.Status())
+            << QString::fromStdString(DurationToDHMS(mn.lastTimeSeen - mn.sigTime))
+            << QString::fromStdString(DateTimeStrFormat("%Y-%m-%d %H:%M", mn.lastTimeSeen + QDateTime::currentDateTime().utcOffset()))
+            << QString::fromStdString(CBitcoinAddress(mn.pubkey.GetID()).ToString());
+
+    if (strCurrentFilter != "" && !columns.join(" ").contains(strCurrentFilter)) {
+        removeNodeListRow(mn.vin.prevout);
+        return;
+    }
+
+    std::map<COutPoint, QTableWidgetItem*>::iterator it = mapNodeListItems.find(mn.vin.prevout);
+    if (it != mapNodeListItems.end()) {
+        int nRow = it->second->row();
+        for (int i = 0; i < columns.size(); i++)
+            ui->tableWidgetMasternodes->item(nRow, i)->setText(columns.at(i));
+        return;
+    }
+
+    ui->tableWidgetMasternodes->insertRow(0);
+    for (int i = 0; i < columns.size(); i++)
+        ui->tableWidgetMasternodes->setItem(0, i, new QTableWidgetItem(columns.at(i)));
+    mapNodeListItems[mn.vin.prevout] = ui->tableWidgetMasternodes->item(0, 0);
+}
+
+void MasternodeList::removeNodeListRow(const COutPoint& outpoint)
+{
+    std::map<COutPoint, QTableWidgetItem*>::iterator it = mapNodeListItems.find(outpoint);
+    if (it == mapNodeListItems.end()) return;
+
+    ui->tableWidgetMasternodes->removeRow(it->second->row());
+    mapNodeListItems.erase(it);
+}
+
 void MasternodeList::on_filterLineEdit_textChanged(const QString &strFilterIn)
 {
     strCurrentFilter = strFilterIn;
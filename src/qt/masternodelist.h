@@ -5,13 +5,14 @@
 #include "sync.h"
 #include "util.h"
 
+#include <map>
+
 #include <QMenu>
 #include <QTimer>
 #include <QWidget>
 #include <QCheckBox>
 
 #define MY_MASTERNODELIST_UPDATE_SECONDS                 60
-#define MASTERNODELIST_UPDATE_SECONDS                    15
 #define MASTERNODELIST_FILTER_COOLDOWN_SECONDS            3
 
 /*enum MnCommand {
@@ -33,6 +34,7 @@ class WalletModel;
 
 QT_BEGIN_NAMESPACE
 class QModelIndex;
+class QTableWidgetItem;
 QT_END_NAMESPACE
 
 /** Masternode Manager page widget */
@@ -75,6 +77,15 @@ private:
 
     QString strCurrentFilter;
 
+    // Version of the Masternode list shown in tableWidgetMasternodes, -1 until it is filled
+    int64_t nNodeListVersion;
+    // Address item of each Masternode shown, which knows the row it is in
+    std::map<COutPoint, QTableWidgetItem*> mapNodeListItems;
+
+    void reloadNodeList();
+    void updateNodeListRow(CMasternode& mn);
+    void removeNodeListRow(const COutPoint& outpoint);
+
 private Q_SLOTS:
     void showContextMenu(const QPoint &);
     void on_filterLineEdit_textChanged(const QString &strFilterIn);
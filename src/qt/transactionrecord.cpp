@@ -233,6 +233,7 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
     status.depth = wtx.GetDepthInMainChain();
     status.cur_num_blocks = chainActive.Height();
     status.cur_num_ix_locks = nCompleteTXLocks;
+    status.confirmed_block = 0;
 
     if (!IsFinalTx(wtx, chainActive.Height() + 1))
     {
@@ -296,12 +297,29 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
         }
     }
 
+    // InstantX locks add to the depth of transactions with fewer than 6 blocks
+    // on top, so only trust the block count once that is behind us.
+    if (status.status == TransactionStatus::Confirmed && pindex && chainActive.Contains(pindex) &&
+        chainActive.Height() - pindex->nHeight + 1 >= RecommendedNumConfirmations)
+        status.confirmed_block = pindex;
 }
 
 bool TransactionRecord::statusUpdateNeeded()
 {
     AssertLockHeld(cs_main);
-    return status.cur_num_blocks != chainActive.Height() || status.cur_num_ix_locks != nCompleteTXLocks;
+    if (status.cur_num_blocks == chainActive.Height() && status.cur_num_ix_locks == nCompleteTXLocks)
+        return false;
+
+    // While its block stays in the main chain, a confirmed transaction stays
+    // confirmed and only gets deeper.
+    if (status.confirmed_block && status.cur_num_blocks >= 0 && chainActive.Contains(status.confirmed_block))
+    {
+        status.depth = chainActive.Height() - status.confirmed_block->nHeight + 1;
+        status.cur_num_blocks = chainActive.Height();
+        status.cur_num_ix_locks = nCompleteTXLocks;
+        return false;
+    }
+    return true;
 }
 
 QString TransactionRecord::getTxID() const
@@ -10,6 +10,7 @@
 #include <QList>
 #include <QString>
 
+class CBlockIndex;
 class CWallet;
 class CWalletTx;
 
@@ -20,7 +21,8 @@ class TransactionStatus
 public:
     TransactionStatus():
         countsForBalance(false), sortKey(""),
-        matures_in(0), status(Offline), depth(0), open_for(0), cur_num_blocks(-1)
+        matures_in(0), status(Offline), depth(0), open_for(0), cur_num_blocks(-1),
+        cur_num_ix_locks(0), confirmed_block(0)
     { }
 
     enum Status {
@@ -62,6 +64,10 @@ public:
 
     //** Know when to update transaction for ix locks **/
     int cur_num_ix_locks;
+
+    /** Block of a transaction buried deep enough that, as long as the block
+        stays in the main chain, new blocks only add to the depth. Null otherwise. */
+    const CBlockIndex *confirmed_block;
 };
 
 /** UI model for a transaction. A core transaction can be represented by multiple UI transactions if it has
@@ -140,9 +146,14 @@ public:
      */
     void updateStatus(const CWalletTx &wtx);
 
-    /** Return whether a status update is needed.
+    /** Return whether a status update is needed. Brings the depth of
+        transactions whose status can no longer change up to date in place.
      */
     bool statusUpdateNeeded();
+
+    /** Force a status update on the next call of statusUpdateNeeded().
+     */
+    void invalidateStatus() { status.cur_num_blocks = -1; }
 };
 
 #endif // TRANSACTIONRECORD_H
@@ -24,6 +24,7 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
 
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
@@ -57,7 +58,8 @@ class TransactionTablePriv
 public:
     TransactionTablePriv(CWallet *wallet, TransactionTableModel *parent) :
         wallet(wallet),
-        parent(parent)
+        parent(parent),
+        fLoading(false)
     {
     }
 
@@ -70,20 +72,58 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Wallet transactions are loaded a page at a time, in hash order, so
+     * that the locks are never held for long. While loading, transactions
+     * after hashLoadedUpTo are left to the next pages.
+     */
+    static const int PAGE_SIZE = 500;
+    bool fLoading;
+    uint256 hashLoadedUpTo;
+
+    /* Query entire wallet anew from core, starting with the first page.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
-        cachedWallet.clear();
+        if(!cachedWallet.isEmpty())
+        {
+            parent->beginRemoveRows(QModelIndex(), 0, cachedWallet.size()-1);
+            cachedWallet.clear();
+            parent->endRemoveRows();
+        }
+        fLoading = true;
+        hashLoadedUpTo = 0;
+    }
+
+    /* Load the next page of the wallet and append it to the model.
+     * Returns whether there is more to load.
+     */
+    bool loadNextPage()
+    {
+        if(!fLoading)
+            return false;
+
+        QList<TransactionRecord> toInsert;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.upper_bound(hashLoadedUpTo);
+            for(int n = 0; it != wallet->mapWallet.end() && n < PAGE_SIZE; ++it, ++n)
             {
                 if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                    toInsert.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                hashLoadedUpTo = it->first;
             }
+            fLoading = (it != wallet->mapWallet.end());
         }
+
+        // Everything loaded so far sorts before this page
+        if(!toInsert.isEmpty())
+        {
+            parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size()+toInsert.size()-1);
+            cachedWallet.append(toInsert);
+            parent->endInsertRows();
+        }
+        return fLoading;
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -96,6 +136,10 @@ public:
 
         qDebug() << "TransactionTablePriv::updateWallet : " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
+        // Not loaded yet: the page it is on will show its current state
+        if(fLoading && hashLoadedUpTo < hash)
+            return;
+
         // Find bounds of this transaction in model
         QList<TransactionRecord>::iterator lower = qLowerBound(
             cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
@@ -163,8 +207,10 @@ public:
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
-            // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
-            // visible transactions.
+            // Miscellaneous updates -- status update will take care of this, and is only computed for
+            // visible transactions. It may have moved to another block though, so make sure it is.
+            for(QList<TransactionRecord>::iterator it = lower; it != upper; ++it)
+                it->invalidateStatus();
             break;
         }
     }
@@ -233,6 +279,7 @@ TransactionTableModel::TransactionTableModel(CWallet* wallet, WalletModel *paren
     columns << QString() << tr("Date") << tr("Type") << tr("Address") << tr("Amount");
 
     priv->refreshWallet();
+    loadNextPage();
 
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 
@@ -245,6 +292,19 @@ TransactionTableModel::~TransactionTableModel()
     delete priv;
 }
 
+void TransactionTableModel::loadNextPage()
+{
+    // Give the event loop, and the core, a turn between pages
+    if(priv->loadNextPage())
+        QTimer::singleShot(0, this, SLOT(loadNextPage()));
+}
+
+bool TransactionTableModel::processingQueuedTransactions()
+{
+    // Rows appearing while the wallet loads are not new transactions
+    return fProcessingQueuedTransactions || priv->fLoading;
+}
+
 void TransactionTableModel::updateTransaction(const QString &hash, int status, bool showTransaction)
 {
     uint256 updated;
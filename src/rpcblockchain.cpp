@@ -8,6 +8,8 @@
 #include "main.h"
 #include "sync.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
+#include "leveldbwrapper.h"
 
 #include <stdint.h>
 
@@ -52,53 +54,66 @@ double GetDifficulty(const CBlockIndex* blockindex)
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, json_spirit::Object& entry);
 
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail = true)
+Object blockToJSON(const CChainSnapshot& chain, const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail = true)
 {
     Object result;
     result.push_back(Pair("hash", block.GetHash().GetHex()));
-    CMerkleTx txGen(block.vtx[0]);
-    txGen.SetMerkleBranch(&block);
-    result.push_back(Pair("confirmations", (int)txGen.GetDepthInMainChain()));
+    result.push_back(Pair("confirmations", chain.Contains(blockindex) ? chain.Height() - blockindex->nHeight + 1 : 0));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     Array txs;
     BOOST_FOREACH(const CTransaction&tx, block.vtx)
-        txs.push_back(tx.GetHash().GetHex());
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", HexBits(block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
-
-
-    Array txinfo;
-    BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
         if (fPrintTransactionDetail)
         {
             Object entry;
-
-            entry.push_back(Pair("txid", tx.GetHash().GetHex()));
             TxToJSON(tx, 0, entry);
-
-            txinfo.push_back(entry);
+            txs.push_back(entry);
         }
         else
-            txinfo.push_back(tx.GetHash().GetHex());
+            txs.push_back(tx.GetHash().GetHex());
     }
-
-
+    result.push_back(Pair("tx", txs));
+    result.push_back(Pair("time", block.GetBlockTime()));
+    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    result.push_back(Pair("bits", HexBits(block.nBits)));
+    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    CBlockIndex *pnext = chain.Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
 }
 
+// Same as blockToJSON with transaction details, but each transaction is
+// written out as soon as it is converted.
+static void blockToStream(CJSONStreamWriter& writer, const CChainSnapshot& chain, const CBlock& block, const CBlockIndex* blockindex)
+{
+    Object result = blockToJSON(chain, block, blockindex, false);
+    writer.BeginObject();
+    BOOST_FOREACH(const Pair& pair, result)
+    {
+        if (pair.name_ != "tx")
+        {
+            writer.WritePair(pair.name_, pair.value_);
+            continue;
+        }
+        writer.Key("tx");
+        writer.BeginArray();
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            Object entry;
+            TxToJSON(tx, 0, entry);
+            writer.Write(entry);
+        }
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
 
 Object blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
@@ -127,7 +142,7 @@ Value getblockcount(const Array& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -143,7 +158,10 @@ Value getbestblockhash(const Array& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    CBlockIndex *pindexTip = GetChainSnapshot()->Tip();
+    if (!pindexTip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks in the chain");
+    return pindexTip->GetBlockHash().GetHex();
 }
 
 Value getdifficulty(const Array& params, bool fHelp)
@@ -159,9 +177,62 @@ Value getdifficulty(const Array& params, bool fHelp)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    return GetDifficulty();
+    CBlockIndex *pindexTip = GetChainSnapshot()->Tip();
+    return pindexTip ? GetDifficulty(pindexTip) : 1.0;
+}
+
+// What getrawmempool reports about a transaction, copied out so that the
+// reply can be built without holding mempool.cs.
+struct CMempoolEntryInfo
+{
+    uint256 hash;
+    unsigned int nSize;
+    int64_t nFee;
+    int64_t nTime;
+    unsigned int nHeight;
+    double dStartingPriority;
+    double dCurrentPriority;
+    set<string> setDepends;
+};
+
+static void GetMempoolEntryInfo(vector<CMempoolEntryInfo>& vInfo)
+{
+    int nChainHeight = GetChainSnapshot()->Height();
+    LOCK(mempool.cs);
+    vInfo.reserve(mempool.mapTx.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx)
+    {
+        const CTxMemPoolEntry& e = entry.second;
+        vInfo.push_back(CMempoolEntryInfo());
+        CMempoolEntryInfo& info = vInfo.back();
+        info.hash = entry.first;
+        info.nSize = e.GetTxSize();
+        info.nFee = e.GetFee();
+        info.nTime = e.GetTime();
+        info.nHeight = e.GetHeight();
+        info.dStartingPriority = e.GetPriority(e.GetHeight());
+        info.dCurrentPriority = e.GetPriority(nChainHeight);
+        BOOST_FOREACH(const CTxIn& txin, e.GetTx().vin)
+        {
+            if (mempool.exists(txin.prevout.hash))
+                info.setDepends.insert(txin.prevout.hash.ToString());
+        }
+    }
 }
 
+static Object MempoolEntryToJSON(const CMempoolEntryInfo& e)
+{
+    Object info;
+    info.push_back(Pair("size", (int)e.nSize));
+    info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+    info.push_back(Pair("time", e.nTime));
+    info.push_back(Pair("height", (int)e.nHeight));
+    info.push_back(Pair("startingpriority", e.dStartingPriority));
+    info.push_back(Pair("currentpriority", e.dCurrentPriority));
+    Array depends(e.setDepends.begin(), e.setDepends.end());
+    info.push_back(Pair("depends", depends));
+    return info;
+}
 
 Value getrawmempool(const Array& params, bool fHelp)
 {
@@ -201,30 +272,11 @@ Value getrawmempool(const Array& params, bool fHelp)
 
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        vector<CMempoolEntryInfo> vInfo;
+        GetMempoolEntryInfo(vInfo);
         Object o;
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx)
-        {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            Object info;
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-            Array depends(setDepends.begin(), setDepends.end());
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+        BOOST_FOREACH(const CMempoolEntryInfo& info, vInfo)
+            o.push_back(Pair(info.hash.ToString(), MempoolEntryToJSON(info)));
         return o;
     }
     else
@@ -240,6 +292,20 @@ Value getrawmempool(const Array& params, bool fHelp)
     }
 }
 
+bool getrawmempool_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() != 1 || !params[0].get_bool())
+        return false;
+
+    vector<CMempoolEntryInfo> vInfo;
+    GetMempoolEntryInfo(vInfo);
+    writer.BeginObject();
+    BOOST_FOREACH(const CMempoolEntryInfo& info, vInfo)
+        writer.WritePair(info.hash.ToString(), MempoolEntryToJSON(info));
+    writer.EndObject();
+    return true;
+}
+
 Value getblockhash(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -256,10 +322,10 @@ Value getblockhash(const Array& params, bool fHelp)
         );
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    CBlockIndex* pblockindex = (*GetChainSnapshot())[nHeight];
+    if (!pblockindex)
         throw runtime_error("Block number out of range.");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -310,8 +376,6 @@ Value getblock(const Array& params, bool fHelp)
             "\nExamples:\n"
         );
 
-    LOCK(cs_main);
-
     //std::string strHash = params[0].get_str();
     //uint256 hash(strHash);
     std::string strHash = params[0].get_str();
@@ -322,12 +386,11 @@ Value getblock(const Array& params, bool fHelp)
             verbosity = params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-	
 	if(!ReadBlockFromDisk(block, pblockindex)){
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -337,8 +400,6 @@ Value getblock(const Array& params, bool fHelp)
 		throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
 	}
 
-	ReadBlockFromDisk(block, pblockindex);
-	
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -349,8 +410,27 @@ Value getblock(const Array& params, bool fHelp)
     }
 
     //return blockToJSON(block, pblockindex, verbosity >= 2);
-	return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+	return blockToJSON(*GetChainSnapshot(), block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+
+}
+
+bool getblock_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    // Only the form with transaction details is worth streaming
+    if (params.size() != 2 || !params[1].get_bool())
+        return false;
+
+    uint256 hash(params[0].get_str());
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+
+    blockToStream(writer, *GetChainSnapshot(), block, pblockindex);
+    return true;
 }
 
 
@@ -363,22 +443,33 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "Returns details of a block with given block-number.");
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    boost::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    CBlockIndex* pblockindex = (*chain)[nHeight];
+    if (!pblockindex)
         throw runtime_error("Block number out of range.");
 
     CBlock block;
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    ReadBlockFromDisk(block, pblockindex);
 
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
+    return blockToJSON(*chain, block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+}
 
-    uint256 hash = *pblockindex->phashBlock;
+bool getblockbynumber_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() != 2 || !params[1].get_bool())
+        return false;
 
-    pblockindex = mapBlockIndex[hash];
+    int nHeight = params[0].get_int();
+    boost::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    CBlockIndex* pblockindex = (*chain)[nHeight];
+    if (!pblockindex)
+        throw runtime_error("Block number out of range.");
 
+    CBlock block;
     ReadBlockFromDisk(block, pblockindex);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToStream(writer, *chain, block, pblockindex);
+    return true;
 }
 
 
@@ -415,12 +506,11 @@ Value getblockheader(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if(!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -437,37 +527,67 @@ Value getblockheader(const Array& params, bool fHelp)
 
 Value gettxoutsetinfo(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( verify )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "These come from a rolling commitment that is updated with every block, so this call is fast.\n"
+            "\nArguments:\n"
+            "1. verify    (boolean, optional, default=false) Also scan the whole database, which may take some time,\n"
+            "             and check the commitment against the result\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"bytes_txouts\": n,      (numeric) The total size of the outputs, serialized with their outpoints\n"
+            "  \"hash_set\": \"hash\",    (string) Order independent hash of the set of outputs\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size in the database (only with verify)\n"
+            "  \"hash_serialized\": \"hash\", (string) The hash of the database contents (only with verify)\n"
+            "  \"verified\": true|false  (boolean) Whether the commitment matches the database (only with verify)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "true")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    bool fVerify = false;
+    if (params.size() > 0)
+        fVerify = params[0].get_bool();
+
     Object ret;
 
+    LOCK(cs_main);
+    CCoinsCommitment commitment;
+    bool fCommitment = pcoinsTip->GetCommitment(commitment);
+    uint256 hashBlock = pcoinsTip->GetBestBlock();
+
     CCoinsStats stats;
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    if (fVerify || !fCommitment) {
+        // The scan reads the database, so write out the cache first.
+        if (!pcoinsTip->Sync())
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to write the chain state");
+        if (!pcoinsTip->GetStats(stats))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read UTXO set");
+        if (!fCommitment)
+            commitment = stats.commitment;
+    }
+
+    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    ret.push_back(Pair("height", mi != mapBlockIndex.end() ? (int64_t)mi->second->nHeight : (int64_t)-1));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)commitment.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)commitment.nTransactionOutputs));
+    ret.push_back(Pair("bytes_txouts", (int64_t)commitment.nSerializedSize));
+    ret.push_back(Pair("hash_set", commitment.hashSet.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
+    if (fVerify) {
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        ret.push_back(Pair("verified", stats.hashBlock == hashBlock && stats.commitment == commitment));
     }
     return ret;
 }
@@ -611,3 +731,109 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     obj.push_back(Pair("chainwork",     chainActive.Tip()->nChainWork.GetHex()));
     return obj;
 }
+
+Value getscriptcheckinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getscriptcheckinfo\n"
+            "\nReturns statistics about parallel script verification.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,             (numeric) Number of script verification threads, including the block connecting thread\n"
+            "  \"batchsize\": n,           (numeric) Current adaptive batch size\n"
+            "  \"checkcost_us\": x.xxx,    (numeric) Moving average of the time one script check takes, in microseconds\n"
+            "  \"checks\": n,              (numeric) Script checks executed\n"
+            "  \"batches\": n,             (numeric) Batches executed\n"
+            "  \"steals\": n,              (numeric) Batches taken from another thread's queue\n"
+            "  \"stealmisses\": n,         (numeric) Searches for work that found every queue empty\n"
+            "  \"contended\": n,           (numeric) Queue lock acquisitions that had to wait\n"
+            "  \"workeridle_ms\": n,       (numeric) Total time worker threads spent waiting for work\n"
+            "  \"masterwait_ms\": n,       (numeric) Total time block connection spent waiting for the workers\n"
+            "  \"overlappedwrites\": n     (numeric) Chain state writes done while the next block's scripts were checked\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getscriptcheckinfo", "")
+            + HelpExampleRpc("getscriptcheckinfo", "")
+        );
+
+    CCheckQueueStats stats;
+    uint64_t nOverlappedWrites;
+    GetScriptCheckStats(stats, nOverlappedWrites);
+
+    Object obj;
+    obj.push_back(Pair("threads",          nScriptCheckThreads ? (int)stats.nWorkers + 1 : 1));
+    obj.push_back(Pair("batchsize",        (int)stats.nBatchSize));
+    obj.push_back(Pair("checkcost_us",     stats.dCheckMicros));
+    obj.push_back(Pair("checks",           (int64_t)stats.nChecks));
+    obj.push_back(Pair("batches",          (int64_t)stats.nBatches));
+    obj.push_back(Pair("steals",           (int64_t)stats.nSteals));
+    obj.push_back(Pair("stealmisses",      (int64_t)stats.nStealMisses));
+    obj.push_back(Pair("contended",        (int64_t)stats.nContended));
+    obj.push_back(Pair("workeridle_ms",    stats.nWorkerIdleMicros / 1000));
+    obj.push_back(Pair("masterwait_ms",    stats.nMasterWaitMicros / 1000));
+    obj.push_back(Pair("overlappedwrites", (int64_t)nOverlappedWrites));
+    return obj;
+}
+
+Value getdbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB's own file and compaction statistics for each open database.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",         (string) The database (chainstate, blockindex or smsg)\n"
+            "    \"files\": n,              (numeric) Number of table files\n"
+            "    \"size_mb\": n,            (numeric) Total size of the table files in MiB\n"
+            "    \"compaction_s\": n,       (numeric) Total time spent compacting, in seconds\n"
+            "    \"levels\": [              (array) Per level statistics, for levels that have files or were compacted\n"
+            "      {\n"
+            "        \"level\": n,          (numeric) The level\n"
+            "        \"files\": n,          (numeric) Number of table files\n"
+            "        \"size_mb\": n,        (numeric) Size of the table files in MiB\n"
+            "        \"compaction_s\": n,   (numeric) Time spent compacting into this level, in seconds\n"
+            "        \"read_mb\": n,        (numeric) Data read by those compactions, in MiB\n"
+            "        \"write_mb\": n        (numeric) Data written by those compactions, in MiB\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    std::vector<CLevelDBStats> vStats;
+    GetLevelDBStats(vStats);
+
+    Array ret;
+    BOOST_FOREACH(const CLevelDBStats& stats, vStats) {
+        Object obj;
+        Array levels;
+        int nFiles = 0;
+        double dSizeMB = 0, dTimeSec = 0;
+        BOOST_FOREACH(const CLevelDBLevelStats& level, stats.vLevels) {
+            Object objLevel;
+            objLevel.push_back(Pair("level",        level.nLevel));
+            objLevel.push_back(Pair("files",        level.nFiles));
+            objLevel.push_back(Pair("size_mb",      level.dSizeMB));
+            objLevel.push_back(Pair("compaction_s", level.dTimeSec));
+            objLevel.push_back(Pair("read_mb",      level.dReadMB));
+            objLevel.push_back(Pair("write_mb",     level.dWriteMB));
+            levels.push_back(objLevel);
+            nFiles += level.nFiles;
+            dSizeMB += level.dSizeMB;
+            dTimeSec += level.dTimeSec;
+        }
+        obj.push_back(Pair("name",         stats.strName));
+        obj.push_back(Pair("files",        nFiles));
+        obj.push_back(Pair("size_mb",      dSizeMB));
+        obj.push_back(Pair("compaction_s", dTimeSec));
+        obj.push_back(Pair("levels",       levels));
+        ret.push_back(obj);
+    }
+    return ret;
+}
@@ -211,14 +211,21 @@ Value validateaddress(const Array& params, bool fHelp)
         string currentAddress = address.ToString();
         ret.push_back(Pair("address", currentAddress));
 #ifdef ENABLE_WALLET
-        bool fMine = pwalletMain ? IsMine(*pwalletMain, dest) : false;
-        ret.push_back(Pair("ismine", fMine));
-        if (fMine) {
-            Object detail = boost::apply_visitor(DescribeAddressVisitor(), dest);
-            ret.insert(ret.end(), detail.begin(), detail.end());
+        if (pwalletMain)
+        {
+            // Thread safe command, so only the wallet needs locking
+            LOCK(pwalletMain->cs_wallet);
+            bool fMine = IsMine(*pwalletMain, dest);
+            ret.push_back(Pair("ismine", fMine));
+            if (fMine) {
+                Object detail = boost::apply_visitor(DescribeAddressVisitor(), dest);
+                ret.insert(ret.end(), detail.begin(), detail.end());
+            }
+            if (pwalletMain->mapAddressBook.count(dest))
+                ret.push_back(Pair("account", pwalletMain->mapAddressBook[dest].name));
         }
-        if (pwalletMain && pwalletMain->mapAddressBook.count(dest))
-            ret.push_back(Pair("account", pwalletMain->mapAddressBook[dest].name));
+        else
+            ret.push_back(Pair("ismine", false));
 #endif
     }
     return ret;
@@ -414,3 +421,200 @@ Value makekeypair(const Array& params, bool fHelp)
     result.push_back(Pair("PrivateKey", CBitcoinSecret(key).ToString()));
     return result;
 }
+
+// The address index type and hash of a bolt address
+static void ParseIndexAddress(const Value &value, unsigned char &nType, uint160 &hashBytes)
+{
+    CBitcoinAddress address(value.get_str());
+    CTxDestination dest = address.Get();
+    if (const CKeyID *keyID = boost::get<CKeyID>(&dest)) {
+        nType = ADDRESS_PUBKEYHASH;
+        hashBytes = *keyID;
+    } else if (const CScriptID *scriptID = boost::get<CScriptID>(&dest)) {
+        nType = ADDRESS_SCRIPTHASH;
+        hashBytes = *scriptID;
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Bolt address");
+    }
+}
+
+static bool HeightSort(const std::pair<CAddressUnspentKey, CAddressUnspentValue> &a,
+                       const std::pair<CAddressUnspentKey, CAddressUnspentValue> &b)
+{
+    return a.second.nHeight < b.second.nHeight;
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"boltaddress\"\n"
+            "\nReturns the balance of an address (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"boltaddress\"     (string, required) The bolt address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,     (numeric) The current balance in btc\n"
+            "  \"received\" : x.xxx     (numeric) The total amount received in btc, including change\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+        );
+
+    unsigned char nType;
+    uint160 hashBytes;
+    ParseIndexAddress(params[0], nType, hashBytes);
+
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    if (!GetAddressIndex(nType, hashBytes, vAddressIndex))
+        throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+
+    int64_t nBalance = 0;
+    int64_t nReceived = 0;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+        if (it->second > 0)
+            nReceived += it->second;
+        nBalance += it->second;
+    }
+
+    Object result;
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"boltaddress\"\n"
+            "\nReturns the unspent outputs paying to an address, oldest first (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"boltaddress\"     (string, required) The bolt address\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"boltaddress\", (string) The bolt address\n"
+            "    \"txid\" : \"transactionid\",  (string) The transaction id\n"
+            "    \"vout\" : n,                (numeric) The output number\n"
+            "    \"scriptPubKey\" : \"hex\",    (string) The script of the output\n"
+            "    \"amount\" : x.xxx,          (numeric) The amount in btc\n"
+            "    \"height\" : n               (numeric) The height of the block containing the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+        );
+
+    unsigned char nType;
+    uint160 hashBytes;
+    ParseIndexAddress(params[0], nType, hashBytes);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    if (!GetAddressUnspent(nType, hashBytes, vUnspent))
+        throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+    std::stable_sort(vUnspent.begin(), vUnspent.end(), HeightSort);
+
+    Array result;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vUnspent.begin(); it != vUnspent.end(); it++) {
+        Object entry;
+        entry.push_back(Pair("address", params[0].get_str()));
+        entry.push_back(Pair("txid", it->first.txhash.GetHex()));
+        entry.push_back(Pair("vout", (int)it->first.nIndex));
+        entry.push_back(Pair("scriptPubKey", HexStr(it->second.script.begin(), it->second.script.end())));
+        entry.push_back(Pair("amount", ValueFromAmount(it->second.nValue)));
+        entry.push_back(Pair("height", it->second.nHeight));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+Value getaddresstxids(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddresstxids \"boltaddress\" ( start end )\n"
+            "\nReturns the ids of the transactions paying to or spending from an address, in block\n"
+            "order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"boltaddress\"     (string, required) The bolt address\n"
+            "2. start             (numeric, optional) Only include transactions from this height on\n"
+            "3. end               (numeric, optional) Only include transactions up to this height\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"    (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleCli("getaddresstxids", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 1000 2000")
+            + HelpExampleRpc("getaddresstxids", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 1000, 2000")
+        );
+
+    unsigned char nType;
+    uint160 hashBytes;
+    ParseIndexAddress(params[0], nType, hashBytes);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params.size() > 1)
+        nStart = params[1].get_int();
+    if (params.size() > 2)
+        nEnd = params[2].get_int();
+    if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    if (!GetAddressIndex(nType, hashBytes, vAddressIndex, nStart, nEnd))
+        throw JSONRPCError(RPC_MISC_ERROR, "No information available for address");
+
+    // The entries of one transaction are next to each other
+    Array result;
+    uint256 hashLast = 0;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+        if (it->first.txhash == hashLast)
+            continue;
+        hashLast = it->first.txhash;
+        result.push_back(hashLast.GetHex());
+    }
+    return result;
+}
+
+Value getspentinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input that spent an output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. \"txid\"       (string, required) The transaction id\n"
+            "2. n            (numeric, required) The output number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"transactionid\",  (string) The id of the spending transaction\n"
+            "  \"vin\" : n,                 (numeric) The number of the spending input\n"
+            "  \"height\" : n               (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\" 0")
+            + HelpExampleRpc("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", 0")
+        );
+
+    uint256 txid = ParseHashV(params[0], "txid");
+    int n = params[1].get_int();
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output number");
+
+    CSpentIndexValue value;
+    if (!GetSpentIndex(CSpentIndexKey(txid, n), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    Object result;
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("vin", (int)value.nInputIndex));
+    result.push_back(Pair("height", value.nHeight));
+    return result;
+}
@@ -55,6 +55,32 @@ static string rfc1123Time()
     return DateTimeStrFormat("%a, %d %b %Y %H:%M:%S +0000", GetTime());
 }
 
+static string HTTPReplyHeader(int nStatus, bool keepalive, const string& strLengthHeader)
+{
+    const char *cStatus;
+         if (nStatus == HTTP_OK) cStatus = "OK";
+    else if (nStatus == HTTP_BAD_REQUEST) cStatus = "Bad Request";
+    else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
+    else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
+    else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
+    else if (nStatus == HTTP_SERVICE_UNAVAILABLE) cStatus = "Service Unavailable";
+    else cStatus = "";
+    return strprintf(
+            "HTTP/1.1 %d %s\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "%s\r\n"
+            "Content-Type: application/json\r\n"
+            "Server: bolt-json-rpc/%s\r\n"
+            "\r\n",
+        nStatus,
+        cStatus,
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        strLengthHeader,
+        FormatFullVersion());
+}
+
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
 {
     if (nStatus == HTTP_UNAUTHORIZED)
@@ -74,29 +100,65 @@ string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
             "</HEAD>\r\n"
             "<BODY><H1>401 Unauthorized.</H1></BODY>\r\n"
             "</HTML>\r\n", rfc1123Time(), FormatFullVersion());
-    const char *cStatus;
-         if (nStatus == HTTP_OK) cStatus = "OK";
-    else if (nStatus == HTTP_BAD_REQUEST) cStatus = "Bad Request";
-    else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
-    else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
-    else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
-    else cStatus = "";
-    return strprintf(
-            "HTTP/1.1 %d %s\r\n"
-            "Date: %s\r\n"
-            "Connection: %s\r\n"
-            "Content-Length: %u\r\n"
-            "Content-Type: application/json\r\n"
-            "Server: bolt-json-rpc/%s\r\n"
-            "\r\n"
-            "%s",
-        nStatus,
-        cStatus,
-        rfc1123Time(),
-        keepalive ? "keep-alive" : "close",
-        strMsg.size(),
-        FormatFullVersion(),
-        strMsg);
+    return HTTPReplyHeader(nStatus, keepalive, strprintf("Content-Length: %u", strMsg.size())) + strMsg;
+}
+
+CHTTPChunkedStreamBuf::CHTTPChunkedStreamBuf(std::ostream& streamIn, int nStatusIn, bool fKeepAliveIn) :
+    stream(streamIn), nStatus(nStatusIn), fKeepAlive(fKeepAliveIn), fStarted(false)
+{
+    strBuffer.reserve(CHUNK_SIZE);
+}
+
+bool CHTTPChunkedStreamBuf::Discard()
+{
+    if (fStarted)
+        return false;
+    strBuffer.clear();
+    return true;
+}
+
+void CHTTPChunkedStreamBuf::SendChunk()
+{
+    if (!fStarted)
+    {
+        stream << HTTPReplyHeader(nStatus, fKeepAlive, "Transfer-Encoding: chunked");
+        fStarted = true;
+    }
+    stream << strprintf("%x\r\n", strBuffer.size()) << strBuffer << "\r\n";
+    strBuffer.clear();
+}
+
+void CHTTPChunkedStreamBuf::Finish()
+{
+    if (!fStarted)
+        stream << HTTPReply(nStatus, strBuffer, fKeepAlive);
+    else
+    {
+        if (!strBuffer.empty())
+            SendChunk();
+        stream << "0\r\n\r\n";
+    }
+    stream << std::flush;
+    strBuffer.clear();
+}
+
+int CHTTPChunkedStreamBuf::overflow(int c)
+{
+    if (c != traits_type::eof())
+    {
+        strBuffer += (char)c;
+        if (strBuffer.size() >= CHUNK_SIZE)
+            SendChunk();
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize CHTTPChunkedStreamBuf::xsputn(const char* s, std::streamsize n)
+{
+    strBuffer.append(s, n);
+    if (strBuffer.size() >= CHUNK_SIZE)
+        SendChunk();
+    return n;
 }
 
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
@@ -189,7 +251,28 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0)
+    map<string, string>::const_iterator it = mapHeadersRet.find("transfer-encoding");
+    if (it != mapHeadersRet.end() && boost::iequals(it->second, "chunked"))
+    {
+        while (true)
+        {
+            string str;
+            std::getline(stream, str);
+            unsigned long nChunk = strtoul(str.c_str(), NULL, 16);
+            if (!stream || nChunk == 0)
+                break;
+            if (strMessageRet.size() + nChunk > MAX_SIZE)
+                return HTTP_INTERNAL_SERVER_ERROR;
+            vector<char> vch(nChunk);
+            stream.read(&vch[0], nChunk);
+            strMessageRet.append(vch.begin(), vch.end());
+            std::getline(stream, str);
+        }
+        // Trailer, ends with an empty line
+        map<string, string> mapTrailers;
+        ReadHTTPHeaders(stream, mapTrailers);
+    }
+    else if (nLen > 0)
     {
         vector<char> vch(nLen);
         stream.read(&vch[0], nLen);
@@ -219,6 +302,51 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
 // http://www.codeproject.com/KB/recipes/JSON_Spirit.aspx
 //
 
+void CJSONStreamWriter::BeginObject()
+{
+    if (fNeedComma)
+        stream << ',';
+    stream << '{';
+    fNeedComma = false;
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    stream << '}';
+    fNeedComma = true;
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    if (fNeedComma)
+        stream << ',';
+    stream << '[';
+    fNeedComma = false;
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    stream << ']';
+    fNeedComma = true;
+}
+
+void CJSONStreamWriter::Key(const string& strKey)
+{
+    if (fNeedComma)
+        stream << ',';
+    write_stream(Value(strKey), stream, false);
+    stream << ':';
+    fNeedComma = false;
+}
+
+void CJSONStreamWriter::Write(const Value& value)
+{
+    if (fNeedComma)
+        stream << ',';
+    write_stream(value, stream, false);
+    fNeedComma = true;
+}
+
 string JSONRPCRequest(const string& strMethod, const Array& params, const Value& id)
 {
     Object request;
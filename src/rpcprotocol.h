@@ -8,7 +8,9 @@
 
 #include <list>
 #include <map>
+#include <ostream>
 #include <stdint.h>
+#include <streambuf>
 #include <string>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
@@ -28,6 +30,7 @@ enum HTTPStatusCode
     HTTP_FORBIDDEN             = 403,
     HTTP_NOT_FOUND             = 404,
     HTTP_INTERNAL_SERVER_ERROR = 500,
+    HTTP_SERVICE_UNAVAILABLE   = 503,
 };
 
 // BOLT RPC error codes
@@ -124,6 +127,65 @@ private:
     boost::asio::ssl::stream<typename Protocol::socket>& stream;
 };
 
+/** Output buffer for an HTTP reply whose length is not known up front. Once
+ *  the body outgrows the buffer it is sent with chunked transfer encoding, a
+ *  chunk at a time; a body that fits is sent as an ordinary reply with a
+ *  Content-Length header when Finish() is called. Only for HTTP/1.1 clients.
+ */
+class CHTTPChunkedStreamBuf : public std::streambuf
+{
+public:
+    static const size_t CHUNK_SIZE = 65536;
+
+    CHTTPChunkedStreamBuf(std::ostream& streamIn, int nStatusIn, bool fKeepAliveIn);
+
+    /** Forget the buffered body. Fails once the first chunk has been sent. */
+    bool Discard();
+    /** Send the rest of the body and end the reply. */
+    void Finish();
+
+protected:
+    int overflow(int c);
+    std::streamsize xsputn(const char* s, std::streamsize n);
+
+private:
+    std::ostream& stream;
+    int nStatus;
+    bool fKeepAlive;
+    bool fStarted;
+    std::string strBuffer;
+
+    void SendChunk();
+};
+
+/** Writes JSON text to a stream as it is produced, so that a large RPC result
+ *  does not have to be built as a json_spirit tree and rendered into one
+ *  string first. Parts of the document that are small can still be built as
+ *  json_spirit values and written with Write(). The output is the same as
+ *  write_string(value, false) of the equivalent tree.
+ */
+class CJSONStreamWriter
+{
+public:
+    CJSONStreamWriter(std::ostream& streamIn) : stream(streamIn), fNeedComma(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Start a member of the current object; write its value next. */
+    void Key(const std::string& strKey);
+    void Write(const json_spirit::Value& value);
+    void WritePair(const std::string& strKey, const json_spirit::Value& value) {
+        Key(strKey);
+        Write(value);
+    }
+
+private:
+    std::ostream& stream;
+    bool fNeedComma;
+};
+
 std::string HTTPPost(const std::string& strMsg, const std::map<std::string,std::string>& mapRequestHeaders);
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive);
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
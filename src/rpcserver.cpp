@@ -31,6 +31,8 @@
 #include "wallet.h"
 #endif
 
+#include <set>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -54,9 +56,43 @@ static asio::io_service* rpc_io_service = NULL;
 static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
 static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
+static boost::thread_group* rpc_work_group = NULL;
 static boost::asio::io_service::work *rpc_dummy_work = NULL;
 static std::vector< boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
 
+// Per-command call latencies, including the time spent waiting for cs_main.
+// Bucket i counts calls that took less than 100us * 10^i; the last bucket
+// counts everything slower.
+static const int RPC_LATENCY_BUCKETS = 7;
+struct CRPCCommandStats
+{
+    int64_t nCalls;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    int64_t vBuckets[RPC_LATENCY_BUCKETS];
+
+    CRPCCommandStats() : nCalls(0), nTotalMicros(0), nMaxMicros(0) {
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++)
+            vBuckets[i] = 0;
+    }
+};
+static CCriticalSection cs_rpcStats;
+static map<string, CRPCCommandStats> mapRPCStats;
+
+static void RecordRPCLatency(const string& strMethod, int64_t nMicros)
+{
+    int nBucket = 0;
+    for (int64_t nLimit = 100; nBucket < RPC_LATENCY_BUCKETS - 1 && nMicros >= nLimit; nLimit *= 10)
+        nBucket++;
+
+    LOCK(cs_rpcStats);
+    CRPCCommandStats& stats = mapRPCStats[strMethod];
+    stats.nCalls++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    stats.vBuckets[nBucket]++;
+}
+
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
                   bool fAllowNull)
@@ -230,6 +266,60 @@ Value stop(const Array& params, bool fHelp)
     return "BOLT server stopping";
 }
 
+Value getrpcstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns call counts and latencies of every RPC command called since startup.\n"
+            "Latencies are measured from the moment the call is dispatched and include\n"
+            "the time spent waiting for the chain state lock.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\" : {              (object) One entry per command\n"
+            "    \"calls\" : n,             (numeric) Number of calls\n"
+            "    \"avg_ms\" : x.xxx,        (numeric) Average latency in milliseconds\n"
+            "    \"max_ms\" : x.xxx,        (numeric) Highest latency in milliseconds\n"
+            "    \"histogram\" : {          (object) Number of calls by latency\n"
+            "      \"<0.1ms\" : n,\n"
+            "      \"<1ms\" : n,\n"
+            "      ...\n"
+            "      \">=10s\" : n\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    static const char* const pszBuckets[RPC_LATENCY_BUCKETS] =
+        { "<0.1ms", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s" };
+
+    Object ret;
+    LOCK(cs_rpcStats);
+    for (map<string, CRPCCommandStats>::const_iterator it = mapRPCStats.begin(); it != mapRPCStats.end(); ++it)
+    {
+        const CRPCCommandStats& stats = it->second;
+        Object histogram;
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++)
+            histogram.push_back(Pair(pszBuckets[i], stats.vBuckets[i]));
+
+        Object obj;
+        obj.push_back(Pair("calls", stats.nCalls));
+        obj.push_back(Pair("avg_ms", stats.nTotalMicros / 1000.0 / stats.nCalls));
+        obj.push_back(Pair("max_ms", stats.nMaxMicros / 1000.0));
+        obj.push_back(Pair("histogram", histogram));
+        ret.push_back(Pair(it->first, obj));
+    }
+    if (params.size() > 0 && params[0].get_bool())
+        mapRPCStats.clear();
+    return ret;
+}
+
 
 
 //
@@ -238,125 +328,134 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      actor (function)         okSafeMode threadSafe reqWallet
-  //  ------------------------  -----------------------  ---------- ---------- ---------
+{ //  name                      actor (function)         okSafeMode threadSafe reqWallet streamActor
+  //  ------------------------  -----------------------  ---------- ---------- --------- -----------
     /* Overall control/query calls */
-	{ "makekeypair",			&makekeypair,			 true,      false,      false },
-    { "getinfo",                &getinfo,                true,      false,      false }, /* uses wallet if enabled */
-    { "help",                   &help,                   true,      true,       false },
-    { "stop",                   &stop,                   true,      true,       false },
+	{ "makekeypair",			&makekeypair,			 true,      false,      false, NULL },
+    { "getinfo",                &getinfo,                true,      false,      false, NULL }, /* uses wallet if enabled */
+    { "help",                   &help,                   true,      true,       false, NULL },
+    { "stop",                   &stop,                   true,      true,       false, NULL },
+    { "getrpcstats",            &getrpcstats,            true,      true,       false, NULL },
 
     /* P2P networking */
-    { "getnetworkinfo",         &getnetworkinfo,         true,      false,      false },
-    { "addnode",                &addnode,                true,      true,       false },
-    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,       false },
-    { "getconnectioncount",     &getconnectioncount,     true,      false,      false },
-    { "getnettotals",           &getnettotals,           true,      true,       false },
-    { "getpeerinfo",            &getpeerinfo,            true,      false,      false },
-    { "ping",                   &ping,                   true,      false,      false },
+    { "getnetworkinfo",         &getnetworkinfo,         true,      false,      false, NULL },
+    { "addnode",                &addnode,                true,      true,       false, NULL },
+    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,       false, NULL },
+    { "getconnectioncount",     &getconnectioncount,     true,      false,      false, NULL },
+    { "getnettotals",           &getnettotals,           true,      true,       false, NULL },
+    { "getpeerinfo",            &getpeerinfo,            true,      false,      false, NULL },
+    { "ping",                   &ping,                   true,      false,      false, NULL },
 
     /* Block chain and UTXO */
-    { "getblockchaininfo",      &getblockchaininfo,      true,      false,      false },
-    { "getbestblockhash",       &getbestblockhash,       true,      false,      false },
-    { "getblockcount",          &getblockcount,          true,      false,      false },
-    { "getblock",               &getblock,               false,     false,      false },
-    { "getblockbynumber",       &getblockbynumber,       false,     false,      false },
-    { "getblockheader",         &getblockheader,         false,     false,      false },
-    { "getblockhash",           &getblockhash,           false,     false,      false },
-    { "getdifficulty",          &getdifficulty,          true,      false,      false },
-    { "getrawmempool",          &getrawmempool,          true,      false,      false },
-    { "gettxout",               &gettxout,               true,      false,      false },
-    { "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false },
-    { "verifychain",            &verifychain,            true,      false,      false },
+    { "getblockchaininfo",      &getblockchaininfo,      true,      false,      false, NULL },
+    { "getbestblockhash",       &getbestblockhash,       true,      true,       false, NULL },
+    { "getblockcount",          &getblockcount,          true,      true,       false, NULL },
+    { "getblock",               &getblock,               false,     true,       false, &getblock_stream },
+    { "getblockbynumber",       &getblockbynumber,       false,     true,       false, &getblockbynumber_stream },
+    { "getblockheader",         &getblockheader,         false,     true,       false, NULL },
+    { "getblockhash",           &getblockhash,           false,     true,       false, NULL },
+    { "getdifficulty",          &getdifficulty,          true,      true,       false, NULL },
+    { "getrawmempool",          &getrawmempool,          true,      true,       false, &getrawmempool_stream },
+    { "gettxout",               &gettxout,               true,      false,      false, NULL },
+    { "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false, NULL },
+    { "verifychain",            &verifychain,            true,      false,      false, NULL },
+    { "getscriptcheckinfo",     &getscriptcheckinfo,     true,      false,      false, NULL },
+    { "getdbstats",             &getdbstats,             true,      false,      false, NULL },
 
     /* Mining */
-    { "getblocktemplate",       &getblocktemplate,       true,      false,      false },
-    { "getmininginfo",          &getmininginfo,          true,      false,      false },
-    { "getnetworkhashps",       &getnetworkhashps,       true,      false,      false },
-    { "submitblock",            &submitblock,            false,     false,      false },
+    { "getblocktemplate",       &getblocktemplate,       true,      false,      false, NULL },
+    { "getmininginfo",          &getmininginfo,          true,      false,      false, NULL },
+    { "getnetworkhashps",       &getnetworkhashps,       true,      false,      false, NULL },
+    { "submitblock",            &submitblock,            false,     false,      false, NULL },
 
     /* Raw transactions */
-    { "createrawtransaction",   &createrawtransaction,   false,     false,      false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,     false,      false },
-    { "decodescript",           &decodescript,           false,     false,      false },
-    { "getrawtransaction",      &getrawtransaction,      false,     false,      false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,     false,      false },
-    { "signrawtransaction",     &signrawtransaction,     false,     false,      false }, /* uses wallet if enabled */
+    { "createrawtransaction",   &createrawtransaction,   false,     false,      false, NULL },
+    { "decoderawtransaction",   &decoderawtransaction,   false,     false,      false, NULL },
+    { "decodescript",           &decodescript,           false,     false,      false, NULL },
+    { "getrawtransaction",      &getrawtransaction,      false,     false,      false, NULL },
+    { "sendrawtransaction",     &sendrawtransaction,     false,     false,      false, NULL },
+    { "signrawtransaction",     &signrawtransaction,     false,     false,      false, NULL }, /* uses wallet if enabled */
  
     /* Utility functions */
-    { "createmultisig",         &createmultisig,         true,      true ,      false },
-    { "validateaddress",        &validateaddress,        true,      false,      false }, /* uses wallet if enabled */
-    { "verifymessage",          &verifymessage,          false,     false,      false },
+    { "createmultisig",         &createmultisig,         true,      true ,      false, NULL },
+    { "validateaddress",        &validateaddress,        true,      true,       false, NULL }, /* uses wallet if enabled */
+    { "verifymessage",          &verifymessage,          false,     false,      false, NULL },
+
+    /* Address and spent output indexes */
+    { "getaddressbalance",      &getaddressbalance,      true,      false,      false, NULL },
+    { "getaddressutxos",        &getaddressutxos,        true,      false,      false, NULL },
+    { "getaddresstxids",        &getaddresstxids,        true,      false,      false, NULL },
+    { "getspentinfo",           &getspentinfo,           true,      false,      false, NULL },
 
     /* BOLT features */
-    { "spork",                  &spork,                  true,      false,      false },
-    { "masternode",             &masternode,             true,      false,      true  },
-    { "masternodelist",         &masternodelist,         true,      false,      false },
+    { "spork",                  &spork,                  true,      false,      false, NULL },
+    { "masternode",             &masternode,             true,      false,      true, NULL },
+    { "masternodelist",         &masternodelist,         true,      false,      false, NULL },
 #ifdef ENABLE_WALLET
-    { "darksend",               &darksend,               false,     false,      true  },
+    { "darksend",               &darksend,               false,     false,      true, NULL },
 
     /* Wallet */
-    { "addmultisigaddress",     &addmultisigaddress,     false,     false,      true },
-    { "backupwallet",           &backupwallet,           true,      false,      true },
-    { "dumpprivkey",            &dumpprivkey,            true,      false,      true },
-    { "dumpwallet",             &dumpwallet,             true,      false,      true },
-    { "encryptwallet",          &encryptwallet,          false,     false,      true },
-    { "getaccountaddress",      &getaccountaddress,      true,      false,      true },
-    { "getaccount",             &getaccount,             false,     false,      true },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,      true },
-    { "getbalance",             &getbalance,             false,     false,      true },
-    { "getnewaddress",          &getnewaddress,          true,      false,      true },
-    { "getrawchangeaddress",    &getrawchangeaddress,    true,      false,      true },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,      true },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,      true },
-    { "gettransaction",         &gettransaction,         false,     false,      true },
-    { "getunconfirmedbalance",  &getunconfirmedbalance,  false,     false,      true },
-    { "getwalletinfo",          &getwalletinfo,          true,      false,      true },
-    { "importprivkey",          &importprivkey,          false,     false,      true },
-    { "importwallet",           &importwallet,           false,     false,      true },
-    { "keepass",                &keepass,                false,     false,      true },
-    { "keypoolrefill",          &keypoolrefill,          true,      false,      true },
-    { "listaccounts",           &listaccounts,           false,     false,      true },
-    { "listaddressgroupings",   &listaddressgroupings,   false,     false,      true },
-    { "listlockunspent",        &listlockunspent,        false,     false,      true },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,      true },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,      true },
-    { "listsinceblock",         &listsinceblock,         false,     false,      true },
-    { "listtransactions",       &listtransactions,       false,     false,      true },
-    { "listunspent",            &listunspent,            false,     false,      true },
-    { "lockunspent",            &lockunspent,            false,     false,      true },
-    { "move",                   &movecmd,                false,     false,      true },
-    { "sendfrom",               &sendfrom,               false,     false,      true },
-    { "sendmany",               &sendmany,               false,     false,      true },
-    { "sendtoaddress",          &sendtoaddress,          false,     false,      true },
-    { "setaccount",             &setaccount,             true,      false,      true },
-    { "settxfee",               &settxfee,               false,     false,      true },
-    { "signmessage",            &signmessage,            false,     false,      true },
-    { "walletlock",             &walletlock,             true,      false,      true },
-    { "walletpassphrasechange", &walletpassphrasechange, false,     false,      true },
-    { "walletpassphrase",       &walletpassphrase,       true,      false,      true },
+    { "addmultisigaddress",     &addmultisigaddress,     false,     false,      true, NULL },
+    { "backupwallet",           &backupwallet,           true,      false,      true, NULL },
+    { "dumpprivkey",            &dumpprivkey,            true,      false,      true, NULL },
+    { "dumpwallet",             &dumpwallet,             true,      false,      true, NULL },
+    { "encryptwallet",          &encryptwallet,          false,     false,      true, NULL },
+    { "getaccountaddress",      &getaccountaddress,      true,      false,      true, NULL },
+    { "getaccount",             &getaccount,             false,     false,      true, NULL },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,      true, NULL },
+    { "getbalance",             &getbalance,             false,     false,      true, NULL },
+    { "getnewaddress",          &getnewaddress,          true,      false,      true, NULL },
+    { "getrawchangeaddress",    &getrawchangeaddress,    true,      false,      true, NULL },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,      true, NULL },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,      true, NULL },
+    { "gettransaction",         &gettransaction,         false,     false,      true, NULL },
+    { "getunconfirmedbalance",  &getunconfirmedbalance,  false,     false,      true, NULL },
+    { "getwalletinfo",          &getwalletinfo,          true,      false,      true, NULL },
+    { "importprivkey",          &importprivkey,          false,     true,       true, NULL },
+    { "importwallet",           &importwallet,           false,     true,       true, NULL },
+    { "keepass",                &keepass,                false,     false,      true, NULL },
+    { "keypoolrefill",          &keypoolrefill,          true,      false,      true, NULL },
+    { "listaccounts",           &listaccounts,           false,     false,      true, NULL },
+    { "listaddressgroupings",   &listaddressgroupings,   false,     false,      true, NULL },
+    { "listlockunspent",        &listlockunspent,        false,     false,      true, NULL },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,      true, NULL },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,      true, NULL },
+    { "listsinceblock",         &listsinceblock,         false,     false,      true, NULL },
+    { "listtransactions",       &listtransactions,       false,     false,      true, NULL },
+    { "listunspent",            &listunspent,            false,     false,      true, NULL },
+    { "lockunspent",            &lockunspent,            false,     false,      true, NULL },
+    { "move",                   &movecmd,                false,     false,      true, NULL },
+    { "sendfrom",               &sendfrom,               false,     false,      true, NULL },
+    { "sendmany",               &sendmany,               false,     false,      true, NULL },
+    { "sendtoaddress",          &sendtoaddress,          false,     false,      true, NULL },
+    { "setaccount",             &setaccount,             true,      false,      true, NULL },
+    { "settxfee",               &settxfee,               false,     false,      true, NULL },
+    { "signmessage",            &signmessage,            false,     false,      true, NULL },
+    { "walletlock",             &walletlock,             true,      false,      true, NULL },
+    { "walletpassphrasechange", &walletpassphrasechange, false,     false,      true, NULL },
+    { "walletpassphrase",       &walletpassphrase,       true,      false,      true, NULL },
 
     /* Instant Send */
-    { "instantsendtoaddress",          &instantsendtoaddress,          false,     false,      true },
+    { "instantsendtoaddress",          &instantsendtoaddress,          false,     false,      true, NULL },
 
     /* Private Send */
 
     /*
      */
-    { "scanforprivatetxns",     &scanforprivatetxns,     false,     false,     false }, 
-    { "scanforalltxns",         &scanforalltxns,     false,     false,     false }, 
-    /*{ "importprivateaddress",   &importprivateaddress,   false,     false,     true },
+    { "scanforprivatetxns",     &scanforprivatetxns,     false,     false,     false, NULL }, 
+    { "scanforalltxns",         &scanforalltxns,         false,     true,       false, NULL },
+    /*{ "importprivateaddress",   &importprivateaddress,   false,     false,      true, NULL },
     */
-    { "importprivateaddress",   &importprivateaddress,   false,     false,     true },
-    { "getnewprivateaddress",   &getnewprivateaddress,   false,     false,     true },
-    { "listprivateaddresses",   &listprivateaddresses,   false,     false,     true },
-    { "sendtoprivateaddress",   &sendtoprivateaddress,   false,     false,     true },
+    { "importprivateaddress",   &importprivateaddress,   false,     false,     true, NULL },
+    { "getnewprivateaddress",   &getnewprivateaddress,   false,     false,     true, NULL },
+    { "listprivateaddresses",   &listprivateaddresses,   false,     false,     true, NULL },
+    { "sendtoprivateaddress",   &sendtoprivateaddress,   false,     false,     true, NULL },
 
     /* Wallet-enabled mining */
-    { "getgenerate",            &getgenerate,            true,      false,      false },
-    { "gethashespersec",        &gethashespersec,        true,      false,      false },
-    { "getwork",                &getwork,                true,      false,      true  },
-    { "setgenerate",            &setgenerate,            true,      true,       false },
+    { "getgenerate",            &getgenerate,            true,      false,      false, NULL },
+    { "gethashespersec",        &gethashespersec,        true,      false,      false, NULL },
+    { "getwork",                &getwork,                true,      false,      true, NULL },
+    { "setgenerate",            &setgenerate,            true,      true,       false, NULL },
 #endif // ENABLE_WALLET
 };
 
@@ -433,6 +532,11 @@ public:
     virtual std::iostream& stream() = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
+
+    /** Whether the next request may already sit in the stream's buffers. */
+    virtual bool input_pending() = 0;
+    /** Call handler on the I/O thread once the client sends more data. */
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler) = 0;
 };
 
 template <typename Protocol>
@@ -442,8 +546,9 @@ public:
     AcceptedConnectionImpl(
             asio::io_service& io_service,
             ssl::context &context,
-            bool fUseSSL) :
+            bool fUseSSLIn) :
         sslStream(io_service, context),
+        fUseSSL(fUseSSLIn),
         _d(sslStream, fUseSSL),
         _stream(_d)
     {
@@ -462,17 +567,125 @@ public:
     virtual void close()
     {
         _stream.close();
+        // The device can't close the socket itself; closing it here also
+        // cancels a parked wait for the next request
+        boost::system::error_code ec;
+        sslStream.lowest_layer().close(ec);
+    }
+
+    virtual bool input_pending()
+    {
+        // Data already decrypted by OpenSSL is invisible to the socket
+        return fUseSSL || _stream.rdbuf()->in_avail() > 0;
+    }
+
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler)
+    {
+        sslStream.next_layer().async_read_some(asio::null_buffers(), boost::bind(handler, asio::placeholders::error));
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
+    bool fUseSSL;
     SSLIOStreamDevice<Protocol> _d;
     iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
 };
 
-void ServiceConnection(AcceptedConnection *conn);
+/**
+ * Connections with a request waiting, and the RPC threads serving them. The
+ * I/O thread only accepts connections and watches idle keep-alive ones, so
+ * idle clients cost no thread; as soon as a client sends data its
+ * connection is queued here. The queue is bounded so that a flood of
+ * requests is turned away with 503 instead of piling up.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+    size_t nMaxDepth;
+    bool fRunning;
+
+public:
+    CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    bool Enqueue(const boost::function<void()>& func)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(func);
+        cond.notify_one();
+        return true;
+    }
+
+    void Run()
+    {
+        while (true)
+        {
+            boost::function<void()> func;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    return;
+                func.swap(queue.front());
+                queue.pop_front();
+            }
+            try {
+                func();
+            } catch (std::exception& e) {
+                PrintExceptionContinue(&e, "rpcworker");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "rpcworker");
+            }
+        }
+    }
+
+    void Interrupt()
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        fRunning = false;
+        queue.clear();
+        cond.notify_all();
+    }
+};
+static CRPCWorkQueue* rpc_work_queue = NULL;
+
+// Keep-alive connections waiting on the I/O thread for their next request
+static boost::mutex cs_parkedConnections;
+static std::set<boost::shared_ptr<AcceptedConnection> > setParkedConnections;
+
+void ServiceConnection(boost::shared_ptr<AcceptedConnection> conn);
+
+// Hand a connection with a request waiting to the RPC threads, or turn the
+// client away if too many are waiting already.
+static void QueueRPCConnection(boost::shared_ptr<AcceptedConnection> conn, bool fUseSSL)
+{
+    if (rpc_work_queue->Enqueue(boost::bind(&ServiceConnection, conn)))
+        return;
+    LogPrint("rpc", "ThreadRPCServer work queue full, rejecting request from %s\n", conn->peer_address_to_string());
+    // Replying over SSL would mean a handshake on the I/O thread
+    if (!fUseSSL)
+        conn->stream() << HTTPReply(HTTP_SERVICE_UNAVAILABLE, "", false) << std::flush;
+    conn->close();
+}
+
+static void RPCConnectionReadable(boost::shared_ptr<AcceptedConnection> conn, const boost::system::error_code& error)
+{
+    {
+        boost::mutex::scoped_lock lock(cs_parkedConnections);
+        setParkedConnections.erase(conn);
+    }
+    if (error)
+        conn->close();
+    else
+        QueueRPCConnection(conn, false);
+}
 
 // Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
@@ -536,10 +749,8 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
             conn->stream() << HTTPReply(HTTP_FORBIDDEN, "", false) << std::flush;
         conn->close();
     }
-    else {
-        ServiceConnection(conn.get());
-        conn->close();
-    }
+    else
+        QueueRPCConnection(conn, fUseSSL);
 }
 
 void StartRPCThreads()
@@ -657,9 +868,14 @@ void StartRPCThreads()
         return;
     }
 
-    rpc_worker_group = new boost::thread_group();
+    rpc_work_queue = new CRPCWorkQueue(std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORK_QUEUE), 1));
+    rpc_work_group = new boost::thread_group();
     for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+        rpc_work_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_work_queue));
+
+    // One thread for accepting, idle connections and timers
+    rpc_worker_group = new boost::thread_group();
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
 }
 
 void StartDummyRPCThread()
@@ -698,9 +914,32 @@ void StopRPCThreads()
     }
     deadlineTimers.clear();
 
+    // Stop the I/O thread before the work queue, as its handlers queue
+    // connections that turn readable
     rpc_io_service->stop();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
+    if (rpc_work_group != NULL)
+        rpc_work_group->join_all();
+
+    // Cancel the waits of the parked connections and let their handlers run,
+    // which closes them or turns them away from the stopped queue
+    std::set<boost::shared_ptr<AcceptedConnection> > setParked;
+    {
+        boost::mutex::scoped_lock lock(cs_parkedConnections);
+        setParked.swap(setParkedConnections);
+    }
+    BOOST_FOREACH(const boost::shared_ptr<AcceptedConnection>& conn, setParked)
+        conn->close();
+    setParked.clear();
+    rpc_io_service->reset();
+    rpc_io_service->poll();
+
+    delete rpc_work_group; rpc_work_group = NULL;
+    delete rpc_work_queue; rpc_work_queue = NULL;
     delete rpc_dummy_work; rpc_dummy_work = NULL;
     delete rpc_worker_group; rpc_worker_group = NULL;
     delete rpc_ssl_context; rpc_ssl_context = NULL;
@@ -792,20 +1031,160 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
+// Reply to a single request through the method's stream actor, if it has one.
+// The reply is sent in chunks as it is written, so the client must speak
+// HTTP/1.1. Returns false if nothing was sent and the request still has to be
+// executed normally.
+static bool StreamRPCReply(std::ostream& stream, const JSONRequest& jreq, bool& fRun)
+{
+    CHTTPChunkedStreamBuf buf(stream, HTTP_OK, fRun);
+    std::ostream os(&buf);
+    CJSONStreamWriter writer(os);
+    writer.BeginObject();
+    writer.Key("result");
+    try
+    {
+        if (!tableRPC.executeStream(jreq.strMethod, jreq.params, writer))
+            return false;
+    }
+    catch (...)
+    {
+        // Nothing sent yet: let the caller send an ordinary error reply
+        if (buf.Discard())
+            throw;
+        // Part of the result is out already. The only way left to tell the
+        // client is to close the connection before the last chunk.
+        LogPrintf("ThreadRPCServer %s failed while streaming its reply\n", jreq.strMethod);
+        fRun = false;
+        return true;
+    }
+    writer.WritePair("error", Value::null);
+    writer.WritePair("id", jreq.id);
+    writer.EndObject();
+    os << "\n";
+    buf.Finish();
+    return true;
+}
+
+/**
+ * The thread-safe calls of a batch request, shared between the connection
+ * thread and the RPC worker threads that help it execute them. The
+ * connection thread takes calls from the queue as well, so the batch
+ * completes even when every worker is busy with another connection.
+ */
+class CRPCBatch
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condDone;
+    const Array& vReq;
+    const std::vector<unsigned int> vQueue; // indexes into vReq
+    std::vector<Object>& vResults;
+    unsigned int nNext;                      // next position in vQueue
+    unsigned int nDone;
+
+    // Claim the next call, if there is one left.
+    bool Next(unsigned int& nIndex) {
+        boost::mutex::scoped_lock lock(mutex);
+        if (nNext >= vQueue.size())
+            return false;
+        nIndex = vQueue[nNext++];
+        return true;
+    }
+
+public:
+    CRPCBatch(const Array& vReqIn, const std::vector<unsigned int>& vQueueIn, std::vector<Object>& vResultsIn) :
+        vReq(vReqIn), vQueue(vQueueIn), vResults(vResultsIn), nNext(0), nDone(0) {}
+
+    // Execute calls until the queue is empty. vReq and vResults are only
+    // touched for a claimed call, which Wait() outlives.
+    void Work() {
+        unsigned int nIndex;
+        while (Next(nIndex))
+        {
+            Object result;
+            try {
+                result = JSONRPCExecOne(vReq[nIndex]);
+            } catch (...) {
+                result = JSONRPCReplyObj(Value::null, JSONRPCError(RPC_INTERNAL_ERROR, "Internal error"), Value::null);
+            }
+            boost::mutex::scoped_lock lock(mutex);
+            vResults[nIndex].swap(result);
+            if (++nDone == vQueue.size())
+                condDone.notify_all();
+        }
+    }
+
+    void Wait() {
+        boost::mutex::scoped_lock lock(mutex);
+        while (nDone < vQueue.size())
+            condDone.wait(lock);
+    }
+};
+
+static bool IsThreadSafeRequest(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& method = find_value(req.get_obj(), "method");
+    if (method.type() != str_type)
+        return false;
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->threadSafe;
+}
+
 static string JSONRPCExecBatch(const Array& vReq)
 {
-    Array ret;
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<Object> vResults(vReq.size());
+
+    // Thread-safe calls can run on other RPC threads. The rest take cs_main
+    // anyway and are executed here, in order.
+    std::vector<unsigned int> vParallel, vSerial;
     for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        (IsThreadSafeRequest(vReq[reqIdx]) ? vParallel : vSerial).push_back(reqIdx);
+
+    int nHelpers = std::min((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), (int)vParallel.size()) - 1;
+    boost::shared_ptr<CRPCBatch> batch(new CRPCBatch(vReq, vParallel, vResults));
+    for (int i = 0; i < nHelpers; i++)
+        if (!rpc_work_queue->Enqueue(boost::bind(&CRPCBatch::Work, batch)))
+            break;
+
+    BOOST_FOREACH(unsigned int reqIdx, vSerial)
+        vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+    batch->Work();
+    batch->Wait();
+
+    Array ret;
+    ret.reserve(vResults.size());
+    BOOST_FOREACH(Object& result, vResults)
+    {
+        ret.push_back(Object());
+        ret.back().get_obj().swap(result);
+    }
+    LogPrint("rpc", "ThreadRPCServer batch of %u calls (%u thread safe, %d helpers) took %.2fms\n",
+        vReq.size(), vParallel.size(), std::max(nHelpers, 0), (GetTimeMicros() - nTimeStart) * 0.001);
 
     return write_string(Value(ret), false) + "\n";
 }
 
-void ServiceConnection(AcceptedConnection *conn)
+void ServiceConnection(boost::shared_ptr<AcceptedConnection> conn)
 {
     bool fRun = true;
-    while (fRun && !ShutdownRequested())
+    for (int nRequests = 0; fRun && !ShutdownRequested(); nRequests++)
     {
+        // Between requests on a keep-alive connection, wait for the next
+        // one on the I/O thread instead of blocking this one
+        if (nRequests > 0 && !conn->input_pending())
+        {
+            {
+                boost::mutex::scoped_lock lock(cs_parkedConnections);
+                setParkedConnections.insert(conn);
+            }
+            conn->async_wait_readable(boost::bind(&RPCConnectionReadable, conn, _1));
+            return;
+        }
+
         int nProto = 0;
         map<string, string> mapHeaders;
         string strRequest, strMethod, strURI;
@@ -857,6 +1236,9 @@ void ServiceConnection(AcceptedConnection *conn)
             if (valRequest.type() == obj_type) {
                 jreq.parse(valRequest);
 
+                if (nProto >= 1 && StreamRPCReply(conn->stream(), jreq, fRun))
+                    continue;
+
                 Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
                 // Send reply
@@ -881,9 +1263,11 @@ void ServiceConnection(AcceptedConnection *conn)
             break;
         }
     }
+    conn->close();
 }
 
-json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+// Look up a method and check that it may be called now.
+static const CRPCCommand *FindRPCCommand(const std::string &strMethod)
 {
     // Find method
     const CRPCCommand *pcmd = tableRPC[strMethod];
@@ -900,6 +1284,41 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    return pcmd;
+}
+
+bool CRPCTable::executeStream(const std::string &strMethod, const json_spirit::Array &params, CJSONStreamWriter& writer) const
+{
+    const CRPCCommand *pcmd = FindRPCCommand(strMethod);
+    // Writing to the client can block, so never hold locks while doing it
+    if (!pcmd->streamActor || !pcmd->threadSafe)
+        return false;
+
+    int64_t nTimeStart = GetTimeMicros();
+    try
+    {
+        if (!pcmd->streamActor(params, writer))
+            return false;
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
+        return true;
+    }
+    catch (std::exception& e)
+    {
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+    catch (...)
+    {
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
+        throw;
+    }
+}
+
+json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+{
+    const CRPCCommand *pcmd = FindRPCCommand(strMethod);
+
+    int64_t nTimeStart = GetTimeMicros();
     try
     {
         // Execute
@@ -922,12 +1341,19 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
             }
 #endif // !ENABLE_WALLET
         }
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
         return result;
     }
     catch (std::exception& e)
     {
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
+    catch (...)
+    {
+        RecordRPCLatency(strMethod, GetTimeMicros() - nTimeStart);
+        throw;
+    }
 }
 
 std::string HelpExampleCli(string methodname, string args){
@@ -67,8 +67,21 @@ void RPCTypeCheck(const json_spirit::Object& o,
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
+/** Default for -rpcworkqueue, the number of connections that can wait for an RPC thread */
+static const int DEFAULT_RPC_WORK_QUEUE = 16;
+
+/** Default for -rpcbatchthreads, the number of threads executing the calls of one batch request */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
 
+/**
+ * Writes the result of a call straight to the reply instead of returning it.
+ * Returns false, before writing anything, to leave the call to the normal
+ * actor. Errors must be thrown before the first write as well.
+ */
+typedef bool(*rpcstreamfn_type)(const json_spirit::Array& params, CJSONStreamWriter& writer);
+
 class CRPCCommand
 {
 public:
@@ -77,6 +90,7 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    rpcstreamfn_type streamActor; // optional, only used for threadSafe commands
 };
 
 /**
@@ -99,6 +113,13 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /**
+     * Execute a method through its stream actor, if it has one.
+     * @returns false if the result has to be produced by execute() instead.
+     * @throws an exception (json_spirit::Value) when an error happens.
+     */
+    bool executeStream(const std::string &method, const json_spirit::Array &params, CJSONStreamWriter& writer) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -179,6 +200,10 @@ extern json_spirit::Value walletpassphrasechange(const json_spirit::Array& param
 extern json_spirit::Value walletlock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value encryptwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validateaddress(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddresstxids(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getspentinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwalletinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
@@ -200,13 +225,18 @@ extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, boo
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern bool getrawmempool_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
+extern bool getblockbynumber_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
+extern bool getblock_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value getblockheader(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value verifychain(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getscriptcheckinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getdbstats(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value GenerateRandomSecret(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnewprivateaddress(const json_spirit::Array& params, bool fHelp); 
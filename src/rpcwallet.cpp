@@ -508,16 +508,23 @@ Value getreceivedbyaddress(const Array& params, bool fHelp)
 
     // Tally
     int64_t nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    CWallet::TxReceived::const_iterator mi = pwalletMain->mapReceived.find(address.Get());
+    if (mi != pwalletMain->mapReceived.end())
     {
-        const CWalletTx& wtx = (*it).second;
-        if (wtx.IsCoinBase() || !IsFinalTx(wtx))
-            continue;
+        BOOST_FOREACH(const COutPoint& outpoint, mi->second)
+        {
+            map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.find(outpoint.hash);
+            if (it == pwalletMain->mapWallet.end())
+                continue;
+            const CWalletTx& wtx = it->second;
+            if (wtx.IsCoinBase() || !IsFinalTx(wtx))
+                continue;
 
-        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+            const CTxOut& txout = wtx.vout[outpoint.n];
             if (txout.scriptPubKey == scriptPubKey)
                 if (wtx.GetDepthInMainChain() >= nMinDepth)
                     nAmount += txout.nValue;
+        }
     }
 
     return  ValueFromAmount(nAmount);
@@ -557,18 +564,23 @@ Value getreceivedbyaccount(const Array& params, bool fHelp)
 
     // Tally
     int64_t nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    BOOST_FOREACH(const CTxDestination& address, setAddress)
     {
-        const CWalletTx& wtx = (*it).second;
-        if (wtx.IsCoinBase() || !IsFinalTx(wtx))
+        CWallet::TxReceived::const_iterator mi = pwalletMain->mapReceived.find(address);
+        if (mi == pwalletMain->mapReceived.end() || !IsMine(*pwalletMain, address))
             continue;
 
-        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+        BOOST_FOREACH(const COutPoint& outpoint, mi->second)
         {
-            CTxDestination address;
-            if (ExtractDestination(txout.scriptPubKey, address) && IsMine(*pwalletMain, address) && setAddress.count(address))
-                if (wtx.GetDepthInMainChain() >= nMinDepth)
-                    nAmount += txout.nValue;
+            map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.find(outpoint.hash);
+            if (it == pwalletMain->mapWallet.end())
+                continue;
+            const CWalletTx& wtx = it->second;
+            if (wtx.IsCoinBase() || !IsFinalTx(wtx))
+                continue;
+
+            if (wtx.GetDepthInMainChain() >= nMinDepth)
+                nAmount += wtx.vout[outpoint.n].nValue;
         }
     }
 
@@ -596,7 +608,7 @@ int64_t GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMi
     }
 
     // Tally internal accounting entries
-    nBalance += walletdb.GetAccountCreditDebit(strAccount);
+    nBalance += pwalletMain->GetAccountCreditDebit(strAccount);
 
     return nBalance;
 }
@@ -748,6 +760,9 @@ Value movecmd(const Array& params, bool fHelp)
     if (!walletdb.TxnCommit())
         throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
 
+    pwalletMain->LoadAccountingEntry(debit);
+    pwalletMain->LoadAccountingEntry(credit);
+
     return true;
 }
 
@@ -968,27 +983,30 @@ Value ListReceived(const Array& params, bool fByAccounts)
 
     // Tally
     map<CBitcoinAddress, tallyitem> mapTally;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    BOOST_FOREACH(const PAIRTYPE(CTxDestination, set<COutPoint>)& received, pwalletMain->mapReceived)
     {
-        const CWalletTx& wtx = (*it).second;
-
-        if (wtx.IsCoinBase() || !IsFinalTx(wtx))
-            continue;
-
-        int nDepth = wtx.GetDepthInMainChain();
-        if (nDepth < nMinDepth)
+        const CTxDestination& address = received.first;
+        if (!IsMine(*pwalletMain, address))
             continue;
 
-        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+        BOOST_FOREACH(const COutPoint& outpoint, received.second)
         {
-            CTxDestination address;
-            if (!ExtractDestination(txout.scriptPubKey, address) || !IsMine(*pwalletMain, address))
+            map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.find(outpoint.hash);
+            if (it == pwalletMain->mapWallet.end())
+                continue;
+            const CWalletTx& wtx = it->second;
+
+            if (wtx.IsCoinBase() || !IsFinalTx(wtx))
+                continue;
+
+            int nDepth = wtx.GetDepthInMainChain();
+            if (nDepth < nMinDepth)
                 continue;
 
             tallyitem& item = mapTally[address];
-            item.nAmount += txout.nValue;
+            item.nAmount += wtx.vout[outpoint.n].nValue;
             item.nConf = min(item.nConf, nDepth);
-            item.txids.push_back(wtx.GetHash());
+            item.txids.push_back(outpoint.hash);
         }
     }
 
@@ -1274,11 +1292,10 @@ Value listtransactions(const Array& params, bool fHelp)
 
     Array ret;
 
-    std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
+    const CWallet::TxItems& txOrdered = pwalletMain->OrderedTxItems();
 
     // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
@@ -1366,10 +1383,8 @@ Value listaccounts(const Array& params, bool fHelp)
         }
     }
 
-    list<CAccountingEntry> acentries;
-    CWalletDB(pwalletMain->strWalletFile).ListAccountCreditDebit("*", acentries);
-    BOOST_FOREACH(const CAccountingEntry& entry, acentries)
-        mapAccountBalances[entry.strAccount] += entry.nCreditDebit;
+    BOOST_FOREACH(const PAIRTYPE(string, int64_t)& creditDebit, pwalletMain->mapAccountCreditDebit)
+        mapAccountBalances[creditDebit.first] += creditDebit.second;
 
     Object ret;
     BOOST_FOREACH(const PAIRTYPE(string, int64_t)& accountBalance, mapAccountBalances) {
@@ -1439,12 +1454,17 @@ Value listsinceblock(const Array& params, bool fHelp)
 
     Array transactions;
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
+    // Walk the activity log rather than mapWallet, so that the transactions
+    // come out in wallet order without copying each of them.
+    const CWallet::TxItems& txOrdered = pwalletMain->OrderedTxItems();
+    for (CWallet::TxItems::const_iterator it = txOrdered.begin(); it != txOrdered.end(); ++it)
     {
-        CWalletTx tx = (*it).second;
+        const CWalletTx *pwtx = (*it).second.first;
+        if (pwtx == 0)
+            continue;
 
-        if (depth == -1 || tx.GetDepthInMainChain() < depth)
-            ListTransactions(tx, "*", 0, true, transactions);
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth)
+            ListTransactions(*pwtx, "*", 0, true, transactions);
     }
 
     CBlockIndex *pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -2326,7 +2346,7 @@ Value sendtoprivateaddress(const Array& params, bool fHelp)
                     continue;
                 };
                 
-                pwalletMain->mapWallet.erase(hash);
+                pwalletMain->UnloadWalletTx(hash);
                 pwalletMain->NotifyTransactionChanged(pwalletMain, hash, CT_DELETED);
                 
                 nTransactions++;
@@ -2357,7 +2377,7 @@ Value scanforalltxns(const Array& params, bool fHelp)
     Object result;
     int32_t nFromHeight = 0;
     
-    CBlockIndex *pindex = chainActive.Genesis();
+    CBlockIndex *pindex;
     
     
     if (params.size() > 0)
@@ -2365,47 +2385,27 @@ Value scanforalltxns(const Array& params, bool fHelp)
     
 
 
-    if (nFromHeight > 0)
-    {
-        pindex = chainActive[chainActive.Height()];
-        while (pindex->nHeight > nFromHeight
-            && pindex->pprev)
-            pindex = pindex->pprev;
-    };
-    
-    if (pindex == NULL)
-        throw runtime_error("Genesis Block is not set.");
-    
-    // -- locks in AddToWalletIfInvolvingMe
-   
-        
-       
-
-
-
-
-
-    
-    if (nFromHeight > 0)
-    {
-        pindex = chainActive[chainActive.Height()];
-        while (pindex->nHeight > nFromHeight
-            && pindex->pprev)
-            pindex = pindex->pprev;
-    };
-    
-    if (pindex == NULL)
-        throw runtime_error("Genesis Block is not set.");
-    
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
         
-        pwalletMain->MarkDirty();
+        pindex = chainActive.Genesis();
+        if (nFromHeight > 0)
+        {
+            pindex = chainActive[chainActive.Height()];
+            while (pindex->nHeight > nFromHeight
+                && pindex->pprev)
+                pindex = pindex->pprev;
+        };
         
-        pwalletMain->ScanForWalletTransactions(pindex, true);
-        pwalletMain->ReacceptWalletTransactions();
+        if (pindex == NULL)
+            throw runtime_error("Genesis Block is not set.");
+        
+        pwalletMain->MarkDirty();
     }
     
+    pwalletMain->ScanForWalletTransactions(pindex, true);
+    pwalletMain->ReacceptWalletTransactions();
+    
     result.push_back(Pair("result", "Scan complete."));
     
     return result;
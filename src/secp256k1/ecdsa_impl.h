@@ -0,0 +1,166 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_ECDSA_IMPL_H
+#define SECP256K1_ECDSA_IMPL_H
+
+typedef struct {
+    secp256k1_scalar_t r, s;
+} secp256k1_ecdsa_sig_t;
+
+// p - n: x coordinates below this have a second candidate x + n during recovery.
+static const secp256k1_fe_t secp256k1_ecdsa_const_p_minus_order = {{
+    0x402DA1722FC9BAEEULL, 0x4551231950B75FC4ULL, 1, 0
+}};
+
+// The group order n as a field element.
+static const secp256k1_fe_t secp256k1_ecdsa_const_order_as_fe = {{
+    0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+}};
+
+// Read one BER length field. Returns 0 if it is malformed or runs past the end.
+static int secp256k1_ecdsa_der_read_len(size_t *len, const unsigned char **sig, const unsigned char *sigend) {
+    if (*sig >= sigend)
+        return 0;
+    unsigned char b = *(*sig)++;
+    if (!(b & 0x80)) {
+        *len = b;
+        return 1;
+    }
+    // Long form; indefinite lengths (0x80) are not valid for primitive types.
+    size_t lenlen = b & 0x7F;
+    if (lenlen == 0 || lenlen > (size_t)(sigend - *sig))
+        return 0;
+    while (lenlen > 0 && **sig == 0) {
+        (*sig)++;
+        lenlen--;
+    }
+    if (lenlen > sizeof(size_t) - 1)
+        return 0;
+    size_t ret = 0;
+    while (lenlen > 0) {
+        ret = (ret << 8) | *(*sig)++;
+        lenlen--;
+    }
+    *len = ret;
+    return 1;
+}
+
+// Read one INTEGER. Values that do not fit in 256 bits or are negative are
+// reported through *invalid; such a signature can never verify (OpenSSL
+// rejects them too), but it is still well-formed.
+static int secp256k1_ecdsa_der_read_int(secp256k1_scalar_t *r, int *invalid, const unsigned char **sig, const unsigned char *sigend) {
+    size_t len;
+    if (*sig >= sigend || *(*sig)++ != 0x02)
+        return 0;
+    if (!secp256k1_ecdsa_der_read_len(&len, sig, sigend) || len > (size_t)(sigend - *sig))
+        return 0;
+    const unsigned char *p = *sig;
+    *sig += len;
+    if (len > 0 && (p[0] & 0x80))
+        *invalid = 1;
+    while (len > 0 && *p == 0) {
+        p++;
+        len--;
+    }
+    unsigned char b32[32] = {0};
+    if (len > 32) {
+        *invalid = 1;
+        len = 0;
+    }
+    memcpy(b32 + 32 - len, p, len);
+    int overflow;
+    secp256k1_scalar_set_b32(r, b32, &overflow);
+    if (overflow)
+        *invalid = 1;
+    return 1;
+}
+
+// Parse a BER-encoded signature the way OpenSSL's d2i_ECDSA_SIG does: non-minimal
+// lengths and zero padding are tolerated, trailing bytes after the SEQUENCE are
+// ignored. Returns 0 if the encoding is unparseable; *invalid is set if r or s is
+// out of range.
+static int secp256k1_ecdsa_sig_parse(secp256k1_ecdsa_sig_t *r, int *invalid, const unsigned char *sig, int size) {
+    const unsigned char *sigend = sig + size;
+    size_t seqlen;
+    *invalid = 0;
+    if (size <= 0 || *sig++ != 0x30)
+        return 0;
+    if (!secp256k1_ecdsa_der_read_len(&seqlen, &sig, sigend) || seqlen > (size_t)(sigend - sig))
+        return 0;
+    const unsigned char *seqend = sig + seqlen;
+    if (!secp256k1_ecdsa_der_read_int(&r->r, invalid, &sig, seqend))
+        return 0;
+    if (!secp256k1_ecdsa_der_read_int(&r->s, invalid, &sig, seqend))
+        return 0;
+    if (sig != seqend)
+        return 0;
+    return 1;
+}
+
+static int secp256k1_ecdsa_sig_verify(const secp256k1_ecdsa_sig_t *sig, const secp256k1_ge_t *pubkey, const secp256k1_scalar_t *message) {
+    if (secp256k1_scalar_is_zero(&sig->r) || secp256k1_scalar_is_zero(&sig->s))
+        return 0;
+
+    secp256k1_scalar_t sn, u1, u2;
+    secp256k1_scalar_inverse_var(&sn, &sig->s);
+    secp256k1_scalar_mul(&u1, &sn, message);
+    secp256k1_scalar_mul(&u2, &sn, &sig->r);
+
+    secp256k1_gej_t pubkeyj, pr;
+    secp256k1_gej_set_ge(&pubkeyj, pubkey);
+    secp256k1_ecmult(&pr, &pubkeyj, &u2, &u1);
+    if (pr.infinity)
+        return 0;
+
+    // Compare x(R) mod n against r without converting R to affine: the
+    // affine x is either r or (when r < p - n) possibly r + n.
+    unsigned char c[32];
+    secp256k1_fe_t xr;
+    secp256k1_scalar_get_b32(c, &sig->r);
+    secp256k1_fe_set_b32(&xr, c);
+    if (secp256k1_gej_eq_x(&xr, &pr))
+        return 1;
+    if (secp256k1_fe_cmp_var(&xr, &secp256k1_ecdsa_const_p_minus_order) >= 0)
+        return 0;
+    secp256k1_fe_add(&xr, &xr, &secp256k1_ecdsa_const_order_as_fe);
+    return secp256k1_gej_eq_x(&xr, &pr);
+}
+
+// Recover the public key from a compact signature, mirroring the OpenSSL-based
+// ECDSA_SIG_recover_key_GFp in key.cpp (SEC1 4.1.6): r and s are taken as
+// 256-bit integers, x = r + (recid / 2) * n must be below p, and
+// Q = r^-1 (s*R - e*G).
+static int secp256k1_ecdsa_sig_recover(const unsigned char *sig64, secp256k1_ge_t *pubkey, const secp256k1_scalar_t *message, int recid) {
+    secp256k1_fe_t x;
+    secp256k1_scalar_t rn, sn;
+    if (!secp256k1_fe_set_b32(&x, sig64))
+        return 0;
+    if (recid & 2) {
+        if (secp256k1_fe_cmp_var(&x, &secp256k1_ecdsa_const_p_minus_order) >= 0)
+            return 0;
+        secp256k1_fe_add(&x, &x, &secp256k1_ecdsa_const_order_as_fe);
+    }
+    secp256k1_scalar_set_b32(&rn, sig64, NULL);
+    secp256k1_scalar_set_b32(&sn, sig64 + 32, NULL);
+    if (secp256k1_scalar_is_zero(&rn))
+        return 0;
+
+    secp256k1_ge_t R;
+    if (!secp256k1_ge_set_xo(&R, &x, recid & 1))
+        return 0;
+    secp256k1_gej_t Rj, Qj;
+    secp256k1_gej_set_ge(&Rj, &R);
+
+    secp256k1_scalar_t rinv, u1, u2;
+    secp256k1_scalar_inverse_var(&rinv, &rn);
+    secp256k1_scalar_mul(&u1, &rinv, message);
+    secp256k1_scalar_negate(&u1, &u1);
+    secp256k1_scalar_mul(&u2, &rinv, &sn);
+    secp256k1_ecmult(&Qj, &Rj, &u2, &u1);
+    secp256k1_ge_set_gej(pubkey, &Qj);
+    return !pubkey->infinity;
+}
+
+#endif
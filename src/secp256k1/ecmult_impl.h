@@ -0,0 +1,191 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_ECMULT_IMPL_H
+#define SECP256K1_ECMULT_IMPL_H
+
+// Double-scalar multiplication na*A + ng*G, as needed by verification and
+// recovery. Both scalars are split with the GLV endomorphism into halves of
+// ~128 bits, each written in windowed non-adjacent form, and the four
+// resulting streams share a single chain of doublings (Shamir's trick).
+// Odd multiples of A are computed per call; odd multiples of G and lambda*G
+// come from tables built once by secp256k1_ecmult_start().
+
+// Window size for the per-call table of A: 2^(WINDOW_A-2) points.
+#define WINDOW_A 5
+
+// Window size for the precomputed generator tables: 2^(WINDOW_G-2) points each.
+#define WINDOW_G 12
+
+#define ECMULT_TABLE_SIZE(w) (1 << ((w) - 2))
+
+// Large enough for a wNAF of any 256-bit value.
+#define WNAF_MAX_LEN 258
+
+typedef struct {
+    secp256k1_ge_t pre_g[ECMULT_TABLE_SIZE(WINDOW_G)];     // G, 3G, 5G, ...
+    secp256k1_ge_t pre_g_lam[ECMULT_TABLE_SIZE(WINDOW_G)]; // lambda times the above
+} secp256k1_ecmult_consts_t;
+
+static const secp256k1_ecmult_consts_t *secp256k1_ecmult_consts = NULL;
+
+// Fill pre[0..n) with A, 3A, 5A, ... in Jacobian coordinates.
+static void secp256k1_ecmult_odd_multiples_var(int n, secp256k1_gej_t *pre, const secp256k1_gej_t *a) {
+    secp256k1_gej_t d;
+    pre[0] = *a;
+    secp256k1_gej_double_var(&d, a);
+    for (int i = 1; i < n; i++)
+        secp256k1_gej_add_var(&pre[i], &pre[i - 1], &d);
+}
+
+static void secp256k1_ecmult_start(void) {
+    if (secp256k1_ecmult_consts != NULL)
+        return;
+
+    secp256k1_ecmult_consts_t *ret = (secp256k1_ecmult_consts_t*)malloc(sizeof(secp256k1_ecmult_consts_t));
+    const int n = ECMULT_TABLE_SIZE(WINDOW_G);
+    secp256k1_gej_t *prej = (secp256k1_gej_t*)malloc(sizeof(secp256k1_gej_t) * n);
+    secp256k1_fe_t *zs = (secp256k1_fe_t*)malloc(sizeof(secp256k1_fe_t) * n);
+    secp256k1_fe_t *zis = (secp256k1_fe_t*)malloc(sizeof(secp256k1_fe_t) * n);
+
+    secp256k1_gej_t gj;
+    secp256k1_gej_set_ge(&gj, &secp256k1_ge_const_g);
+    secp256k1_ecmult_odd_multiples_var(n, prej, &gj);
+    secp256k1_ge_set_all_gej(n, ret->pre_g, prej, zs, zis);
+    for (int i = 0; i < n; i++)
+        secp256k1_ge_mul_lambda(&ret->pre_g_lam[i], &ret->pre_g[i]);
+
+    free(zis);
+    free(zs);
+    free(prej);
+
+    secp256k1_ecmult_consts = ret;
+}
+
+static void secp256k1_ecmult_stop(void) {
+    if (secp256k1_ecmult_consts == NULL)
+        return;
+    secp256k1_ecmult_consts_t *c = (secp256k1_ecmult_consts_t*)secp256k1_ecmult_consts;
+    secp256k1_ecmult_consts = NULL;
+    free(c);
+}
+
+// Convert a (non-negative, < 2^256) number to wNAF form with window w: every
+// nonzero digit is odd and lies in (-2^(w-1), 2^(w-1)), and any two nonzero
+// digits are at least w positions apart. Returns the number of digits.
+static int secp256k1_ecmult_wnaf(int *wnaf, const secp256k1_scalar_t *a, int w) {
+    uint64_t x[5] = {a->d[0], a->d[1], a->d[2], a->d[3], 0};
+    int len = 0;
+    while (x[0] | x[1] | x[2] | x[3] | x[4]) {
+        int digit = 0;
+        if (x[0] & 1) {
+            digit = (int)(x[0] & ((1U << w) - 1));
+            if (digit & (1 << (w - 1)))
+                digit -= (1 << w);
+            // x -= digit, leaving x divisible by 2^w
+            secp256k1_uint128 c;
+            if (digit > 0) {
+                uint64_t borrow = (uint64_t)digit;
+                for (int i = 0; i < 5 && borrow; i++) {
+                    c = (secp256k1_uint128)x[i] - borrow;
+                    x[i] = (uint64_t)c;
+                    borrow = (uint64_t)(c >> 64) & 1;
+                }
+            } else {
+                uint64_t carry = (uint64_t)(-digit);
+                for (int i = 0; i < 5 && carry; i++) {
+                    c = (secp256k1_uint128)x[i] + carry;
+                    x[i] = (uint64_t)c;
+                    carry = (uint64_t)(c >> 64);
+                }
+            }
+        }
+        wnaf[len++] = digit;
+        for (int i = 0; i < 4; i++)
+            x[i] = (x[i] >> 1) | (x[i + 1] << 63);
+        x[4] >>= 1;
+    }
+    return len;
+}
+
+// Split a scalar with the endomorphism and write both halves in wNAF form.
+// Halves that are "negative" (above n/2) are negated and their digits flipped.
+static void secp256k1_ecmult_split_wnaf(int *wnaf1, int *len1, int *wnaf2, int *len2, const secp256k1_scalar_t *k, int w) {
+    secp256k1_scalar_t k1, k2;
+    secp256k1_scalar_split_lambda_var(&k1, &k2, k);
+    int neg1 = secp256k1_scalar_is_high(&k1);
+    int neg2 = secp256k1_scalar_is_high(&k2);
+    if (neg1)
+        secp256k1_scalar_negate(&k1, &k1);
+    if (neg2)
+        secp256k1_scalar_negate(&k2, &k2);
+    *len1 = secp256k1_ecmult_wnaf(wnaf1, &k1, w);
+    *len2 = secp256k1_ecmult_wnaf(wnaf2, &k2, w);
+    if (neg1)
+        for (int i = 0; i < *len1; i++)
+            wnaf1[i] = -wnaf1[i];
+    if (neg2)
+        for (int i = 0; i < *len2; i++)
+            wnaf2[i] = -wnaf2[i];
+}
+
+static void secp256k1_ecmult_add_gej_digit(secp256k1_gej_t *r, const secp256k1_gej_t *pre, int n) {
+    if (n > 0) {
+        secp256k1_gej_add_var(r, r, &pre[(n - 1) / 2]);
+    } else {
+        secp256k1_gej_t neg;
+        secp256k1_gej_neg(&neg, &pre[(-n - 1) / 2]);
+        secp256k1_gej_add_var(r, r, &neg);
+    }
+}
+
+static void secp256k1_ecmult_add_ge_digit(secp256k1_gej_t *r, const secp256k1_ge_t *pre, int n) {
+    if (n > 0) {
+        secp256k1_gej_add_ge_var(r, r, &pre[(n - 1) / 2]);
+    } else {
+        secp256k1_ge_t neg;
+        secp256k1_ge_neg(&neg, &pre[(-n - 1) / 2]);
+        secp256k1_gej_add_ge_var(r, r, &neg);
+    }
+}
+
+// r = na*A + ng*G
+static void secp256k1_ecmult(secp256k1_gej_t *r, const secp256k1_gej_t *a, const secp256k1_scalar_t *na, const secp256k1_scalar_t *ng) {
+    const secp256k1_ecmult_consts_t *c = secp256k1_ecmult_consts;
+
+    int wnaf_na1[WNAF_MAX_LEN], wnaf_na2[WNAF_MAX_LEN];
+    int wnaf_ng1[WNAF_MAX_LEN], wnaf_ng2[WNAF_MAX_LEN];
+    int len_na1 = 0, len_na2 = 0, len_ng1, len_ng2;
+
+    secp256k1_gej_t pre_a[ECMULT_TABLE_SIZE(WINDOW_A)];
+    secp256k1_gej_t pre_a_lam[ECMULT_TABLE_SIZE(WINDOW_A)];
+    if (!a->infinity && !secp256k1_scalar_is_zero(na)) {
+        secp256k1_ecmult_split_wnaf(wnaf_na1, &len_na1, wnaf_na2, &len_na2, na, WINDOW_A);
+        secp256k1_ecmult_odd_multiples_var(ECMULT_TABLE_SIZE(WINDOW_A), pre_a, a);
+        for (int i = 0; i < ECMULT_TABLE_SIZE(WINDOW_A); i++)
+            secp256k1_gej_mul_lambda(&pre_a_lam[i], &pre_a[i]);
+    }
+    secp256k1_ecmult_split_wnaf(wnaf_ng1, &len_ng1, wnaf_ng2, &len_ng2, ng, WINDOW_G);
+
+    int bits = len_na1;
+    if (len_na2 > bits) bits = len_na2;
+    if (len_ng1 > bits) bits = len_ng1;
+    if (len_ng2 > bits) bits = len_ng2;
+
+    secp256k1_gej_set_infinity(r);
+    for (int i = bits - 1; i >= 0; i--) {
+        int n;
+        secp256k1_gej_double_var(r, r);
+        if (i < len_na1 && (n = wnaf_na1[i]))
+            secp256k1_ecmult_add_gej_digit(r, pre_a, n);
+        if (i < len_na2 && (n = wnaf_na2[i]))
+            secp256k1_ecmult_add_gej_digit(r, pre_a_lam, n);
+        if (i < len_ng1 && (n = wnaf_ng1[i]))
+            secp256k1_ecmult_add_ge_digit(r, c->pre_g, n);
+        if (i < len_ng2 && (n = wnaf_ng2[i]))
+            secp256k1_ecmult_add_ge_digit(r, c->pre_g_lam, n);
+    }
+}
+
+#endif
@@ -0,0 +1,246 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_FIELD_IMPL_H
+#define SECP256K1_FIELD_IMPL_H
+
+// Field elements modulo p = 2^256 - 2^32 - 977, stored as four 64-bit limbs
+// (least significant first). Every operation returns a fully reduced value,
+// so equality is a plain limb comparison. Apart from the _var functions,
+// all operations run in constant time.
+
+typedef unsigned __int128 secp256k1_uint128;
+
+typedef struct {
+    uint64_t n[4];
+} secp256k1_fe_t;
+
+// 2^256 mod p
+#define SECP256K1_FE_C 0x1000003D1ULL
+
+static const secp256k1_fe_t secp256k1_fe_p = {{
+    0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL
+}};
+
+// If (carry * 2^256 + r) >= p, subtract p. Requires the value to be below 2p.
+static void secp256k1_fe_reduce_once(uint64_t r[4], uint64_t carry) {
+    uint64_t t0, t1, t2, t3;
+    secp256k1_uint128 c = (secp256k1_uint128)r[0] + SECP256K1_FE_C;
+    t0 = (uint64_t)c; c >>= 64;
+    c += r[1]; t1 = (uint64_t)c; c >>= 64;
+    c += r[2]; t2 = (uint64_t)c; c >>= 64;
+    c += r[3]; t3 = (uint64_t)c; c >>= 64;
+    uint64_t mask = -(((uint64_t)c) | carry);
+    r[0] = (t0 & mask) | (r[0] & ~mask);
+    r[1] = (t1 & mask) | (r[1] & ~mask);
+    r[2] = (t2 & mask) | (r[2] & ~mask);
+    r[3] = (t3 & mask) | (r[3] & ~mask);
+}
+
+static void secp256k1_fe_set_int(secp256k1_fe_t *r, uint64_t a) {
+    r->n[0] = a;
+    r->n[1] = r->n[2] = r->n[3] = 0;
+}
+
+static int secp256k1_fe_is_zero(const secp256k1_fe_t *a) {
+    return (a->n[0] | a->n[1] | a->n[2] | a->n[3]) == 0;
+}
+
+static int secp256k1_fe_is_odd(const secp256k1_fe_t *a) {
+    return (int)(a->n[0] & 1);
+}
+
+static int secp256k1_fe_equal(const secp256k1_fe_t *a, const secp256k1_fe_t *b) {
+    return ((a->n[0] ^ b->n[0]) | (a->n[1] ^ b->n[1]) | (a->n[2] ^ b->n[2]) | (a->n[3] ^ b->n[3])) == 0;
+}
+
+// Compare two field elements as integers: -1, 0 or 1.
+static int secp256k1_fe_cmp_var(const secp256k1_fe_t *a, const secp256k1_fe_t *b) {
+    for (int i = 3; i >= 0; i--) {
+        if (a->n[i] > b->n[i]) return 1;
+        if (a->n[i] < b->n[i]) return -1;
+    }
+    return 0;
+}
+
+// Load a big-endian 32-byte number. Returns 0 (and a reduced value) if it is not below p.
+static int secp256k1_fe_set_b32(secp256k1_fe_t *r, const unsigned char *a) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | a[31 - 8*i - 7 + j];
+        r->n[i] = v;
+    }
+    int ok = secp256k1_fe_cmp_var(r, &secp256k1_fe_p) < 0;
+    secp256k1_fe_reduce_once(r->n, 0);
+    return ok;
+}
+
+static void secp256k1_fe_get_b32(unsigned char *r, const secp256k1_fe_t *a) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            r[31 - 8*i - j] = (unsigned char)(a->n[i] >> (8*j));
+}
+
+static void secp256k1_fe_add(secp256k1_fe_t *r, const secp256k1_fe_t *a, const secp256k1_fe_t *b) {
+    secp256k1_uint128 c = (secp256k1_uint128)a->n[0] + b->n[0];
+    r->n[0] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[1] + b->n[1]; r->n[1] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[2] + b->n[2]; r->n[2] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[3] + b->n[3]; r->n[3] = (uint64_t)c; c >>= 64;
+    secp256k1_fe_reduce_once(r->n, (uint64_t)c);
+}
+
+static void secp256k1_fe_negate(secp256k1_fe_t *r, const secp256k1_fe_t *a) {
+    // p - a never borrows because a < p; a == 0 yields p, which reduces to 0.
+    secp256k1_uint128 d = (secp256k1_uint128)secp256k1_fe_p.n[0] - a->n[0];
+    r->n[0] = (uint64_t)d; d = (d >> 64) & 1;
+    d = (secp256k1_uint128)secp256k1_fe_p.n[1] - a->n[1] - (uint64_t)d;
+    r->n[1] = (uint64_t)d; d = (d >> 64) & 1;
+    d = (secp256k1_uint128)secp256k1_fe_p.n[2] - a->n[2] - (uint64_t)d;
+    r->n[2] = (uint64_t)d; d = (d >> 64) & 1;
+    r->n[3] = secp256k1_fe_p.n[3] - a->n[3] - (uint64_t)d;
+    secp256k1_fe_reduce_once(r->n, 0);
+}
+
+static void secp256k1_fe_sub(secp256k1_fe_t *r, const secp256k1_fe_t *a, const secp256k1_fe_t *b) {
+    secp256k1_fe_t nb;
+    secp256k1_fe_negate(&nb, b);
+    secp256k1_fe_add(r, a, &nb);
+}
+
+// Reduce a 512-bit product modulo p.
+static void secp256k1_fe_reduce512(secp256k1_fe_t *r, const uint64_t l[8]) {
+    uint64_t t0, t1, t2, t3;
+    secp256k1_uint128 c;
+    c = (secp256k1_uint128)l[4] * SECP256K1_FE_C + l[0]; t0 = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)l[5] * SECP256K1_FE_C + l[1]; t1 = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)l[6] * SECP256K1_FE_C + l[2]; t2 = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)l[7] * SECP256K1_FE_C + l[3]; t3 = (uint64_t)c; c >>= 64;
+    // Fold the (at most 34-bit) overflow limb back in. If that carries out
+    // once more, t is tiny and the carry is handled by reduce_once.
+    c = (secp256k1_uint128)(uint64_t)c * SECP256K1_FE_C + t0; r->n[0] = (uint64_t)c; c >>= 64;
+    c += t1; r->n[1] = (uint64_t)c; c >>= 64;
+    c += t2; r->n[2] = (uint64_t)c; c >>= 64;
+    c += t3; r->n[3] = (uint64_t)c; c >>= 64;
+    secp256k1_fe_reduce_once(r->n, (uint64_t)c);
+}
+
+// (c0,c1,c2) += a * b
+#define SECP256K1_MULADD(c0, c1, c2, a, b) do { \
+    secp256k1_uint128 t_ = (secp256k1_uint128)(a) * (b); \
+    uint64_t tl_ = (uint64_t)t_, th_ = (uint64_t)(t_ >> 64); \
+    c0 += tl_; th_ += (c0 < tl_); \
+    c1 += th_; c2 += (c1 < th_); \
+} while (0)
+
+// Emit the low accumulator word and shift the accumulator down.
+#define SECP256K1_EXTRACT(out, c0, c1, c2) do { out = c0; c0 = c1; c1 = c2; c2 = 0; } while (0)
+
+static void secp256k1_fe_mul(secp256k1_fe_t *r, const secp256k1_fe_t *a, const secp256k1_fe_t *b) {
+    const uint64_t *x = a->n, *y = b->n;
+    uint64_t l[8];
+    uint64_t c0 = 0, c1 = 0, c2 = 0;
+    SECP256K1_MULADD(c0, c1, c2, x[0], y[0]);
+    SECP256K1_EXTRACT(l[0], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[0], y[1]); SECP256K1_MULADD(c0, c1, c2, x[1], y[0]);
+    SECP256K1_EXTRACT(l[1], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[0], y[2]); SECP256K1_MULADD(c0, c1, c2, x[1], y[1]);
+    SECP256K1_MULADD(c0, c1, c2, x[2], y[0]);
+    SECP256K1_EXTRACT(l[2], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[0], y[3]); SECP256K1_MULADD(c0, c1, c2, x[1], y[2]);
+    SECP256K1_MULADD(c0, c1, c2, x[2], y[1]); SECP256K1_MULADD(c0, c1, c2, x[3], y[0]);
+    SECP256K1_EXTRACT(l[3], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[1], y[3]); SECP256K1_MULADD(c0, c1, c2, x[2], y[2]);
+    SECP256K1_MULADD(c0, c1, c2, x[3], y[1]);
+    SECP256K1_EXTRACT(l[4], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[2], y[3]); SECP256K1_MULADD(c0, c1, c2, x[3], y[2]);
+    SECP256K1_EXTRACT(l[5], c0, c1, c2);
+    SECP256K1_MULADD(c0, c1, c2, x[3], y[3]);
+    l[6] = c0;
+    l[7] = c1;
+    secp256k1_fe_reduce512(r, l);
+}
+
+static void secp256k1_fe_sqr(secp256k1_fe_t *r, const secp256k1_fe_t *a) {
+    secp256k1_fe_mul(r, a, a);
+}
+
+// Multiply by a small constant (at most 2^30).
+static void secp256k1_fe_mul_int(secp256k1_fe_t *r, const secp256k1_fe_t *a, uint64_t m) {
+    uint64_t l[8];
+    secp256k1_uint128 c = (secp256k1_uint128)a->n[0] * m;
+    l[0] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[1] * m; l[1] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[2] * m; l[2] = (uint64_t)c; c >>= 64;
+    c += (secp256k1_uint128)a->n[3] * m; l[3] = (uint64_t)c; c >>= 64;
+    l[4] = (uint64_t)c;
+    l[5] = l[6] = l[7] = 0;
+    secp256k1_fe_reduce512(r, l);
+}
+
+static void secp256k1_fe_sqr_n(secp256k1_fe_t *r, int n) {
+    for (int i = 0; i < n; i++)
+        secp256k1_fe_sqr(r, r);
+}
+
+// Compute a^(2^223 - 1), shared by inversion and square root.
+static void secp256k1_fe_pow_x223(secp256k1_fe_t *x223, secp256k1_fe_t *x22, secp256k1_fe_t *x2, const secp256k1_fe_t *a) {
+    secp256k1_fe_t x3, x6, x9, x11, x44, x88, x176, x220;
+
+    secp256k1_fe_sqr(x2, a); secp256k1_fe_mul(x2, x2, a);
+    secp256k1_fe_sqr(&x3, x2); secp256k1_fe_mul(&x3, &x3, a);
+    x6 = x3; secp256k1_fe_sqr_n(&x6, 3); secp256k1_fe_mul(&x6, &x6, &x3);
+    x9 = x6; secp256k1_fe_sqr_n(&x9, 3); secp256k1_fe_mul(&x9, &x9, &x3);
+    x11 = x9; secp256k1_fe_sqr_n(&x11, 2); secp256k1_fe_mul(&x11, &x11, x2);
+    *x22 = x11; secp256k1_fe_sqr_n(x22, 11); secp256k1_fe_mul(x22, x22, &x11);
+    x44 = *x22; secp256k1_fe_sqr_n(&x44, 22); secp256k1_fe_mul(&x44, &x44, x22);
+    x88 = x44; secp256k1_fe_sqr_n(&x88, 44); secp256k1_fe_mul(&x88, &x88, &x44);
+    x176 = x88; secp256k1_fe_sqr_n(&x176, 88); secp256k1_fe_mul(&x176, &x176, &x88);
+    x220 = x176; secp256k1_fe_sqr_n(&x220, 44); secp256k1_fe_mul(&x220, &x220, &x44);
+    *x223 = x220; secp256k1_fe_sqr_n(x223, 3); secp256k1_fe_mul(x223, x223, &x3);
+}
+
+// r = a^(p-2) = a^-1 (0 maps to 0)
+static void secp256k1_fe_inv(secp256k1_fe_t *r, const secp256k1_fe_t *a) {
+    secp256k1_fe_t x223, x22, x2, t;
+    secp256k1_fe_pow_x223(&x223, &x22, &x2, a);
+    t = x223;
+    secp256k1_fe_sqr_n(&t, 23); secp256k1_fe_mul(&t, &t, &x22);
+    secp256k1_fe_sqr_n(&t, 5);  secp256k1_fe_mul(&t, &t, a);
+    secp256k1_fe_sqr_n(&t, 3);  secp256k1_fe_mul(&t, &t, &x2);
+    secp256k1_fe_sqr_n(&t, 2);  secp256k1_fe_mul(r, &t, a);
+}
+
+// r = a^((p+1)/4). Returns whether r is actually a square root of a.
+static int secp256k1_fe_sqrt(secp256k1_fe_t *r, const secp256k1_fe_t *a) {
+    secp256k1_fe_t x223, x22, x2, t, check;
+    secp256k1_fe_pow_x223(&x223, &x22, &x2, a);
+    t = x223;
+    secp256k1_fe_sqr_n(&t, 23); secp256k1_fe_mul(&t, &t, &x22);
+    secp256k1_fe_sqr_n(&t, 6);  secp256k1_fe_mul(&t, &t, &x2);
+    secp256k1_fe_sqr_n(&t, 2);
+    *r = t;
+    secp256k1_fe_sqr(&check, &t);
+    return secp256k1_fe_equal(&check, a);
+}
+
+// Invert n elements at once with a single field inversion (Montgomery's trick).
+// None of the inputs may be zero.
+static void secp256k1_fe_inv_all(size_t n, secp256k1_fe_t *r, const secp256k1_fe_t *a) {
+    if (n == 0)
+        return;
+    r[0] = a[0];
+    for (size_t i = 1; i < n; i++)
+        secp256k1_fe_mul(&r[i], &r[i - 1], &a[i]);
+    secp256k1_fe_t u;
+    secp256k1_fe_inv(&u, &r[n - 1]);
+    for (size_t i = n - 1; i > 0; i--) {
+        secp256k1_fe_mul(&r[i], &r[i - 1], &u);
+        secp256k1_fe_mul(&u, &u, &a[i]);
+    }
+    r[0] = u;
+}
+
+#endif
@@ -0,0 +1,284 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_GROUP_IMPL_H
+#define SECP256K1_GROUP_IMPL_H
+
+// Points on y^2 = x^3 + 7, in affine (ge) and Jacobian (gej) coordinates.
+// A Jacobian point (X, Y, Z) represents the affine point (X/Z^2, Y/Z^3).
+
+typedef struct {
+    secp256k1_fe_t x;
+    secp256k1_fe_t y;
+    int infinity;
+} secp256k1_ge_t;
+
+typedef struct {
+    secp256k1_fe_t x;
+    secp256k1_fe_t y;
+    secp256k1_fe_t z;
+    int infinity;
+} secp256k1_gej_t;
+
+static const secp256k1_ge_t secp256k1_ge_const_g = {
+    {{0x59F2815B16F81798ULL, 0x029BFCDB2DCE28D9ULL, 0x55A06295CE870B07ULL, 0x79BE667EF9DCBBACULL}},
+    {{0x9C47D08FFB10D4B8ULL, 0xFD17B448A6855419ULL, 0x5DA4FBFC0E1108A8ULL, 0x483ADA7726A3C465ULL}},
+    0
+};
+
+// Cube root of unity mod p matching secp256k1_const_lambda.
+static const secp256k1_fe_t secp256k1_const_beta = {{
+    0xC1396C28719501EEULL, 0x9CF0497512F58995ULL, 0x6E64479EAC3434E9ULL, 0x7AE96A2B657C0710ULL
+}};
+
+static void secp256k1_ge_set_xy(secp256k1_ge_t *r, const secp256k1_fe_t *x, const secp256k1_fe_t *y) {
+    r->infinity = 0;
+    r->x = *x;
+    r->y = *y;
+}
+
+// Whether (x, y) satisfies the curve equation.
+static int secp256k1_ge_is_valid(const secp256k1_ge_t *a) {
+    if (a->infinity)
+        return 0;
+    secp256k1_fe_t y2, x3, seven;
+    secp256k1_fe_sqr(&y2, &a->y);
+    secp256k1_fe_sqr(&x3, &a->x);
+    secp256k1_fe_mul(&x3, &x3, &a->x);
+    secp256k1_fe_set_int(&seven, 7);
+    secp256k1_fe_add(&x3, &x3, &seven);
+    return secp256k1_fe_equal(&y2, &x3);
+}
+
+// Find the point with the given x coordinate and y parity.
+static int secp256k1_ge_set_xo(secp256k1_ge_t *r, const secp256k1_fe_t *x, int odd) {
+    secp256k1_fe_t x3, seven;
+    r->x = *x;
+    r->infinity = 0;
+    secp256k1_fe_sqr(&x3, x);
+    secp256k1_fe_mul(&x3, &x3, x);
+    secp256k1_fe_set_int(&seven, 7);
+    secp256k1_fe_add(&x3, &x3, &seven);
+    if (!secp256k1_fe_sqrt(&r->y, &x3))
+        return 0;
+    if (secp256k1_fe_is_odd(&r->y) != odd)
+        secp256k1_fe_negate(&r->y, &r->y);
+    return 1;
+}
+
+static void secp256k1_ge_neg(secp256k1_ge_t *r, const secp256k1_ge_t *a) {
+    r->infinity = a->infinity;
+    r->x = a->x;
+    secp256k1_fe_negate(&r->y, &a->y);
+}
+
+// lambda * (x, y) = (beta * x, y)
+static void secp256k1_ge_mul_lambda(secp256k1_ge_t *r, const secp256k1_ge_t *a) {
+    *r = *a;
+    secp256k1_fe_mul(&r->x, &r->x, &secp256k1_const_beta);
+}
+
+static void secp256k1_gej_set_infinity(secp256k1_gej_t *r) {
+    r->infinity = 1;
+    secp256k1_fe_set_int(&r->x, 0);
+    secp256k1_fe_set_int(&r->y, 0);
+    secp256k1_fe_set_int(&r->z, 0);
+}
+
+static void secp256k1_gej_set_ge(secp256k1_gej_t *r, const secp256k1_ge_t *a) {
+    r->infinity = a->infinity;
+    r->x = a->x;
+    r->y = a->y;
+    secp256k1_fe_set_int(&r->z, 1);
+}
+
+static void secp256k1_gej_neg(secp256k1_gej_t *r, const secp256k1_gej_t *a) {
+    *r = *a;
+    secp256k1_fe_negate(&r->y, &a->y);
+}
+
+static void secp256k1_gej_mul_lambda(secp256k1_gej_t *r, const secp256k1_gej_t *a) {
+    *r = *a;
+    secp256k1_fe_mul(&r->x, &r->x, &secp256k1_const_beta);
+}
+
+static void secp256k1_ge_set_gej(secp256k1_ge_t *r, const secp256k1_gej_t *a) {
+    if (a->infinity) {
+        r->infinity = 1;
+        return;
+    }
+    secp256k1_fe_t zi, zi2, zi3;
+    secp256k1_fe_inv(&zi, &a->z);
+    secp256k1_fe_sqr(&zi2, &zi);
+    secp256k1_fe_mul(&zi3, &zi2, &zi);
+    secp256k1_fe_mul(&r->x, &a->x, &zi2);
+    secp256k1_fe_mul(&r->y, &a->y, &zi3);
+    r->infinity = 0;
+}
+
+// Convert n Jacobian points (none at infinity) to affine with a single inversion.
+static void secp256k1_ge_set_all_gej(size_t n, secp256k1_ge_t *r, const secp256k1_gej_t *a, secp256k1_fe_t *scratch_z, secp256k1_fe_t *scratch_zi) {
+    for (size_t i = 0; i < n; i++)
+        scratch_z[i] = a[i].z;
+    secp256k1_fe_inv_all(n, scratch_zi, scratch_z);
+    for (size_t i = 0; i < n; i++) {
+        secp256k1_fe_t zi2, zi3;
+        secp256k1_fe_sqr(&zi2, &scratch_zi[i]);
+        secp256k1_fe_mul(&zi3, &zi2, &scratch_zi[i]);
+        secp256k1_fe_mul(&r[i].x, &a[i].x, &zi2);
+        secp256k1_fe_mul(&r[i].y, &a[i].y, &zi3);
+        r[i].infinity = 0;
+    }
+}
+
+// Check whether the affine x coordinate of a equals x (a must not be infinity).
+static int secp256k1_gej_eq_x(const secp256k1_fe_t *x, const secp256k1_gej_t *a) {
+    secp256k1_fe_t z2, xz2;
+    secp256k1_fe_sqr(&z2, &a->z);
+    secp256k1_fe_mul(&xz2, x, &z2);
+    return secp256k1_fe_equal(&xz2, &a->x);
+}
+
+static void secp256k1_gej_double_var(secp256k1_gej_t *r, const secp256k1_gej_t *a) {
+    if (a->infinity || secp256k1_fe_is_zero(&a->y)) {
+        secp256k1_gej_set_infinity(r);
+        return;
+    }
+    secp256k1_fe_t y2, s, m, t, y4;
+    secp256k1_fe_mul(&r->z, &a->y, &a->z);
+    secp256k1_fe_mul_int(&r->z, &r->z, 2);         // Z3 = 2*Y*Z
+    secp256k1_fe_sqr(&y2, &a->y);                  // Y^2
+    secp256k1_fe_mul(&s, &a->x, &y2);
+    secp256k1_fe_mul_int(&s, &s, 4);               // S = 4*X*Y^2
+    secp256k1_fe_sqr(&m, &a->x);
+    secp256k1_fe_mul_int(&m, &m, 3);               // M = 3*X^2
+    secp256k1_fe_sqr(&t, &m);
+    secp256k1_fe_sub(&t, &t, &s);
+    secp256k1_fe_sub(&t, &t, &s);                  // X3 = M^2 - 2*S
+    secp256k1_fe_sqr(&y4, &y2);
+    secp256k1_fe_mul_int(&y4, &y4, 8);             // 8*Y^4
+    secp256k1_fe_sub(&s, &s, &t);
+    secp256k1_fe_mul(&r->y, &m, &s);
+    secp256k1_fe_sub(&r->y, &r->y, &y4);           // Y3 = M*(S - X3) - 8*Y^4
+    r->x = t;
+    r->infinity = 0;
+}
+
+// r = a + b, both in Jacobian coordinates.
+static void secp256k1_gej_add_var(secp256k1_gej_t *r, const secp256k1_gej_t *a, const secp256k1_gej_t *b) {
+    if (a->infinity) {
+        *r = *b;
+        return;
+    }
+    if (b->infinity) {
+        *r = *a;
+        return;
+    }
+    secp256k1_fe_t z22, z12, u1, u2, s1, s2, h, i, h2, h3, t;
+    secp256k1_fe_sqr(&z22, &b->z);
+    secp256k1_fe_sqr(&z12, &a->z);
+    secp256k1_fe_mul(&u1, &a->x, &z22);
+    secp256k1_fe_mul(&u2, &b->x, &z12);
+    secp256k1_fe_mul(&s1, &a->y, &z22); secp256k1_fe_mul(&s1, &s1, &b->z);
+    secp256k1_fe_mul(&s2, &b->y, &z12); secp256k1_fe_mul(&s2, &s2, &a->z);
+    secp256k1_fe_sub(&h, &u2, &u1);
+    secp256k1_fe_sub(&i, &s2, &s1);
+    if (secp256k1_fe_is_zero(&h)) {
+        if (secp256k1_fe_is_zero(&i))
+            secp256k1_gej_double_var(r, a);
+        else
+            secp256k1_gej_set_infinity(r);
+        return;
+    }
+    secp256k1_fe_sqr(&h2, &h);
+    secp256k1_fe_mul(&h3, &h, &h2);
+    secp256k1_fe_mul(&r->z, &a->z, &b->z);
+    secp256k1_fe_mul(&r->z, &r->z, &h);
+    secp256k1_fe_mul(&t, &u1, &h2);
+    secp256k1_fe_sqr(&r->x, &i);
+    secp256k1_fe_sub(&r->x, &r->x, &h3);
+    secp256k1_fe_sub(&r->x, &r->x, &t);
+    secp256k1_fe_sub(&r->x, &r->x, &t);
+    secp256k1_fe_sub(&t, &t, &r->x);
+    secp256k1_fe_mul(&r->y, &t, &i);
+    secp256k1_fe_mul(&h3, &h3, &s1);
+    secp256k1_fe_sub(&r->y, &r->y, &h3);
+    r->infinity = 0;
+}
+
+// r = a + b, with b in affine coordinates (mixed addition).
+static void secp256k1_gej_add_ge_var(secp256k1_gej_t *r, const secp256k1_gej_t *a, const secp256k1_ge_t *b) {
+    if (a->infinity) {
+        secp256k1_gej_set_ge(r, b);
+        return;
+    }
+    if (b->infinity) {
+        *r = *a;
+        return;
+    }
+    secp256k1_fe_t z12, u2, s2, h, i, h2, h3, t;
+    secp256k1_fe_sqr(&z12, &a->z);
+    secp256k1_fe_mul(&u2, &b->x, &z12);
+    secp256k1_fe_mul(&s2, &b->y, &z12); secp256k1_fe_mul(&s2, &s2, &a->z);
+    secp256k1_fe_sub(&h, &u2, &a->x);
+    secp256k1_fe_sub(&i, &s2, &a->y);
+    if (secp256k1_fe_is_zero(&h)) {
+        if (secp256k1_fe_is_zero(&i))
+            secp256k1_gej_double_var(r, a);
+        else
+            secp256k1_gej_set_infinity(r);
+        return;
+    }
+    secp256k1_fe_sqr(&h2, &h);
+    secp256k1_fe_mul(&h3, &h, &h2);
+    secp256k1_fe_mul(&t, &a->x, &h2);
+    secp256k1_fe_t ay = a->y;
+    secp256k1_fe_mul(&r->z, &a->z, &h);
+    secp256k1_fe_sqr(&r->x, &i);
+    secp256k1_fe_sub(&r->x, &r->x, &h3);
+    secp256k1_fe_sub(&r->x, &r->x, &t);
+    secp256k1_fe_sub(&r->x, &r->x, &t);
+    secp256k1_fe_sub(&t, &t, &r->x);
+    secp256k1_fe_mul(&r->y, &t, &i);
+    secp256k1_fe_mul(&h3, &h3, &ay);
+    secp256k1_fe_sub(&r->y, &r->y, &h3);
+    r->infinity = 0;
+}
+
+// Parse a serialized public key: compressed (02/03), uncompressed (04) or
+// hybrid (06/07), the same set of encodings OpenSSL's o2i_ECPublicKey accepts.
+static int secp256k1_eckey_pubkey_parse(secp256k1_ge_t *r, const unsigned char *pub, int size) {
+    secp256k1_fe_t x, y;
+    if (size == 33 && (pub[0] == 0x02 || pub[0] == 0x03)) {
+        if (!secp256k1_fe_set_b32(&x, pub + 1))
+            return 0;
+        return secp256k1_ge_set_xo(r, &x, pub[0] == 0x03);
+    }
+    if (size == 65 && (pub[0] == 0x04 || pub[0] == 0x06 || pub[0] == 0x07)) {
+        if (!secp256k1_fe_set_b32(&x, pub + 1) || !secp256k1_fe_set_b32(&y, pub + 33))
+            return 0;
+        secp256k1_ge_set_xy(r, &x, &y);
+        if ((pub[0] == 0x06 || pub[0] == 0x07) && secp256k1_fe_is_odd(&y) != (pub[0] == 0x07))
+            return 0;
+        return secp256k1_ge_is_valid(r);
+    }
+    return 0;
+}
+
+static int secp256k1_eckey_pubkey_serialize(const secp256k1_ge_t *a, unsigned char *pub, int *size, int compressed) {
+    if (a->infinity)
+        return 0;
+    secp256k1_fe_get_b32(pub + 1, &a->x);
+    if (compressed) {
+        *size = 33;
+        pub[0] = secp256k1_fe_is_odd(&a->y) ? 0x03 : 0x02;
+    } else {
+        *size = 65;
+        pub[0] = 0x04;
+        secp256k1_fe_get_b32(pub + 33, &a->y);
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,274 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_SCALAR_IMPL_H
+#define SECP256K1_SCALAR_IMPL_H
+
+// Scalars modulo the group order n, stored as four 64-bit limbs (least
+// significant first) and kept fully reduced. Scalars only ever hold public
+// values here (signatures, hashes), so the reduction is allowed to be
+// variable-time.
+
+typedef struct {
+    uint64_t d[4];
+} secp256k1_scalar_t;
+
+static const uint64_t secp256k1_scalar_n[4] = {
+    0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+};
+
+// 2^256 - n
+static const uint64_t secp256k1_scalar_nc[3] = {
+    0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 1
+};
+
+// n / 2
+static const uint64_t secp256k1_scalar_nh[4] = {
+    0xDFE92F46681B20A0ULL, 0x5D576E7357A4501DULL, 0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL
+};
+
+// r[0..an+bn) = a * b
+static void secp256k1_mul_limbs(uint64_t *r, const uint64_t *a, int an, const uint64_t *b, int bn) {
+    for (int i = 0; i < an + bn; i++)
+        r[i] = 0;
+    for (int i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < bn; j++) {
+            secp256k1_uint128 t = (secp256k1_uint128)a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+        r[i + bn] = carry;
+    }
+}
+
+static int secp256k1_scalar_cmp_limbs(const uint64_t a[4], const uint64_t b[4]) {
+    for (int i = 3; i >= 0; i--) {
+        if (a[i] > b[i]) return 1;
+        if (a[i] < b[i]) return -1;
+    }
+    return 0;
+}
+
+// If (carry * 2^256 + r) >= n, subtract n. Requires the value to be below 2n.
+static void secp256k1_scalar_reduce_once(secp256k1_scalar_t *r, int carry) {
+    if (!carry && secp256k1_scalar_cmp_limbs(r->d, secp256k1_scalar_n) < 0)
+        return;
+    secp256k1_uint128 c = 0;
+    for (int i = 0; i < 4; i++) {
+        c += (secp256k1_uint128)r->d[i] + (i < 3 ? secp256k1_scalar_nc[i] : 0);
+        r->d[i] = (uint64_t)c;
+        c >>= 64;
+    }
+}
+
+static void secp256k1_scalar_clear(secp256k1_scalar_t *r) {
+    r->d[0] = r->d[1] = r->d[2] = r->d[3] = 0;
+}
+
+static void secp256k1_scalar_set_int(secp256k1_scalar_t *r, uint64_t v) {
+    secp256k1_scalar_clear(r);
+    r->d[0] = v;
+}
+
+// Load a big-endian 32-byte number, reducing it modulo n. *overflow (if not
+// NULL) reports whether the input was not below n.
+static void secp256k1_scalar_set_b32(secp256k1_scalar_t *r, const unsigned char *b32, int *overflow) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | b32[24 - 8*i + j];
+        r->d[i] = v;
+    }
+    int over = secp256k1_scalar_cmp_limbs(r->d, secp256k1_scalar_n) >= 0;
+    secp256k1_scalar_reduce_once(r, 0);
+    if (overflow)
+        *overflow = over;
+}
+
+static void secp256k1_scalar_get_b32(unsigned char *r, const secp256k1_scalar_t *a) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            r[31 - 8*i - j] = (unsigned char)(a->d[i] >> (8*j));
+}
+
+static int secp256k1_scalar_is_zero(const secp256k1_scalar_t *a) {
+    return (a->d[0] | a->d[1] | a->d[2] | a->d[3]) == 0;
+}
+
+// Whether a > n/2.
+static int secp256k1_scalar_is_high(const secp256k1_scalar_t *a) {
+    return secp256k1_scalar_cmp_limbs(a->d, secp256k1_scalar_nh) > 0;
+}
+
+static void secp256k1_scalar_add(secp256k1_scalar_t *r, const secp256k1_scalar_t *a, const secp256k1_scalar_t *b) {
+    secp256k1_uint128 c = 0;
+    for (int i = 0; i < 4; i++) {
+        c += (secp256k1_uint128)a->d[i] + b->d[i];
+        r->d[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    secp256k1_scalar_reduce_once(r, (int)c);
+}
+
+static void secp256k1_scalar_negate(secp256k1_scalar_t *r, const secp256k1_scalar_t *a) {
+    if (secp256k1_scalar_is_zero(a)) {
+        secp256k1_scalar_clear(r);
+        return;
+    }
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        secp256k1_uint128 d = (secp256k1_uint128)secp256k1_scalar_n[i] - a->d[i] - borrow;
+        r->d[i] = (uint64_t)d;
+        borrow = (uint64_t)(d >> 64) & 1;
+    }
+}
+
+// Reduce a 512-bit number modulo n by repeatedly folding the part above
+// 2^256 back in as hi * (2^256 - n).
+static void secp256k1_scalar_reduce512(secp256k1_scalar_t *r, const uint64_t l[8]) {
+    uint64_t m[8];
+    for (int i = 0; i < 8; i++)
+        m[i] = l[i];
+    while (m[4] | m[5] | m[6] | m[7]) {
+        uint64_t t[8];
+        secp256k1_mul_limbs(t, &m[4], 4, secp256k1_scalar_nc, 3);
+        t[7] = 0;
+        secp256k1_uint128 c = 0;
+        for (int i = 0; i < 8; i++) {
+            c += (secp256k1_uint128)t[i] + (i < 4 ? m[i] : 0);
+            m[i] = (uint64_t)c;
+            c >>= 64;
+        }
+    }
+    for (int i = 0; i < 4; i++)
+        r->d[i] = m[i];
+    secp256k1_scalar_reduce_once(r, 0);
+}
+
+static void secp256k1_scalar_mul(secp256k1_scalar_t *r, const secp256k1_scalar_t *a, const secp256k1_scalar_t *b) {
+    uint64_t l[8];
+    secp256k1_mul_limbs(l, a->d, 4, b->d, 4);
+    secp256k1_scalar_reduce512(r, l);
+}
+
+// r = round(a * b / 2^shift), for shift >= 256.
+static void secp256k1_scalar_mul_shift_var(secp256k1_scalar_t *r, const secp256k1_scalar_t *a, const secp256k1_scalar_t *b, unsigned int shift) {
+    uint64_t l[8];
+    secp256k1_mul_limbs(l, a->d, 4, b->d, 4);
+    unsigned int limbs = shift >> 6;
+    unsigned int bits = shift & 63;
+    for (unsigned int i = 0; i < 4; i++) {
+        unsigned int src = limbs + i;
+        uint64_t lo = src < 8 ? l[src] : 0;
+        uint64_t hi = src + 1 < 8 ? l[src + 1] : 0;
+        r->d[i] = bits ? (lo >> bits) | (hi << (64 - bits)) : lo;
+    }
+    unsigned int roundbit = shift - 1;
+    if ((l[roundbit >> 6] >> (roundbit & 63)) & 1) {
+        secp256k1_scalar_t one;
+        secp256k1_scalar_set_int(&one, 1);
+        secp256k1_scalar_add(r, r, &one);
+    }
+}
+
+// Halve x modulo n (x < n).
+static void secp256k1_scalar_half_var(uint64_t x[4]) {
+    uint64_t top = 0;
+    if (x[0] & 1) {
+        secp256k1_uint128 c = 0;
+        for (int i = 0; i < 4; i++) {
+            c += (secp256k1_uint128)x[i] + secp256k1_scalar_n[i];
+            x[i] = (uint64_t)c;
+            c >>= 64;
+        }
+        top = (uint64_t)c;
+    }
+    for (int i = 0; i < 3; i++)
+        x[i] = (x[i] >> 1) | (x[i + 1] << 63);
+    x[3] = (x[3] >> 1) | (top << 63);
+}
+
+static int secp256k1_limbs_is_one(const uint64_t x[4]) {
+    return x[0] == 1 && (x[1] | x[2] | x[3]) == 0;
+}
+
+// a -= b, for a >= b
+static void secp256k1_limbs_sub(uint64_t a[4], const uint64_t b[4]) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        secp256k1_uint128 d = (secp256k1_uint128)a[i] - b[i] - borrow;
+        a[i] = (uint64_t)d;
+        borrow = (uint64_t)(d >> 64) & 1;
+    }
+}
+
+// r = a^-1 (mod n) for nonzero a, using the binary extended Euclidean
+// algorithm. Variable-time, which is fine for the public values it sees.
+static void secp256k1_scalar_inverse_var(secp256k1_scalar_t *r, const secp256k1_scalar_t *a) {
+    // Invariants: x1 * a == u and x2 * a == v (mod n).
+    uint64_t u[4] = {a->d[0], a->d[1], a->d[2], a->d[3]};
+    uint64_t v[4] = {secp256k1_scalar_n[0], secp256k1_scalar_n[1], secp256k1_scalar_n[2], secp256k1_scalar_n[3]};
+    secp256k1_scalar_t x1, x2, t;
+    secp256k1_scalar_set_int(&x1, 1);
+    secp256k1_scalar_clear(&x2);
+    while (!secp256k1_limbs_is_one(u) && !secp256k1_limbs_is_one(v)) {
+        while (!(u[0] & 1)) {
+            for (int i = 0; i < 3; i++)
+                u[i] = (u[i] >> 1) | (u[i + 1] << 63);
+            u[3] >>= 1;
+            secp256k1_scalar_half_var(x1.d);
+        }
+        while (!(v[0] & 1)) {
+            for (int i = 0; i < 3; i++)
+                v[i] = (v[i] >> 1) | (v[i + 1] << 63);
+            v[3] >>= 1;
+            secp256k1_scalar_half_var(x2.d);
+        }
+        if (secp256k1_scalar_cmp_limbs(u, v) >= 0) {
+            secp256k1_limbs_sub(u, v);
+            secp256k1_scalar_negate(&t, &x2);
+            secp256k1_scalar_add(&x1, &x1, &t);
+        } else {
+            secp256k1_limbs_sub(v, u);
+            secp256k1_scalar_negate(&t, &x1);
+            secp256k1_scalar_add(&x2, &x2, &t);
+        }
+    }
+    *r = secp256k1_limbs_is_one(u) ? x1 : x2;
+}
+
+// GLV endomorphism: lambda * (x, y) = (beta * x, y), with lambda^3 == 1 (mod n).
+static const secp256k1_scalar_t secp256k1_const_lambda = {{
+    0xDF02967C1B23BD72ULL, 0x122E22EA20816678ULL, 0xA5261C028812645AULL, 0x5363AD4CC05C30E0ULL
+}};
+
+// Split k into r1 + r2 * lambda == k (mod n), with r1 and r2 (or their
+// negations) at most ~128 bits long. See "Guide to Elliptic Curve
+// Cryptography", algorithm 3.74.
+static void secp256k1_scalar_split_lambda_var(secp256k1_scalar_t *r1, secp256k1_scalar_t *r2, const secp256k1_scalar_t *k) {
+    static const secp256k1_scalar_t minus_b1 = {{
+        0x6F547FA90ABFE4C3ULL, 0xE4437ED6010E8828ULL, 0, 0
+    }};
+    static const secp256k1_scalar_t minus_b2 = {{
+        0xD765CDA83DB1562CULL, 0x8A280AC50774346DULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+    }};
+    static const secp256k1_scalar_t g1 = {{
+        0xE893209A45DBB031ULL, 0x3DAA8A1471E8CA7FULL, 0xE86C90E49284EB15ULL, 0x3086D221A7D46BCDULL
+    }};
+    static const secp256k1_scalar_t g2 = {{
+        0x1571B4AE8AC47F71ULL, 0x221208AC9DF506C6ULL, 0x6F547FA90ABFE4C4ULL, 0xE4437ED6010E8828ULL
+    }};
+    secp256k1_scalar_t c1, c2;
+    secp256k1_scalar_mul_shift_var(&c1, k, &g1, 384);
+    secp256k1_scalar_mul_shift_var(&c2, k, &g2, 384);
+    secp256k1_scalar_mul(&c1, &c1, &minus_b1);
+    secp256k1_scalar_mul(&c2, &c2, &minus_b2);
+    secp256k1_scalar_add(r2, &c1, &c2);
+    secp256k1_scalar_mul(r1, r2, &secp256k1_const_lambda);
+    secp256k1_scalar_negate(r1, r1);
+    secp256k1_scalar_add(r1, r1, k);
+}
+
+#endif
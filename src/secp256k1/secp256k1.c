@@ -0,0 +1,64 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "secp256k1.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "field_impl.h"
+#include "scalar_impl.h"
+#include "group_impl.h"
+#include "ecmult_impl.h"
+#include "ecdsa_impl.h"
+
+void secp256k1_start(void) {
+    secp256k1_ecmult_start();
+}
+
+void secp256k1_stop(void) {
+    secp256k1_ecmult_stop();
+}
+
+int secp256k1_ecdsa_verify(const unsigned char *msg32, const unsigned char *sig, int siglen, const unsigned char *pubkey, int pubkeylen) {
+    secp256k1_ge_t q;
+    secp256k1_ecdsa_sig_t s;
+    secp256k1_scalar_t m;
+    int invalid;
+
+    if (!secp256k1_eckey_pubkey_parse(&q, pubkey, pubkeylen))
+        return -1;
+    if (!secp256k1_ecdsa_sig_parse(&s, &invalid, sig, siglen))
+        return -2;
+    if (invalid)
+        return 0;
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    return secp256k1_ecdsa_sig_verify(&s, &q, &m);
+}
+
+int secp256k1_ecdsa_recover_compact(const unsigned char *msg32, const unsigned char *sig64, unsigned char *pubkey, int *pubkeylen, int compressed, int recid) {
+    secp256k1_ge_t q;
+    secp256k1_scalar_t m;
+
+    if (recid < 0 || recid > 3)
+        return 0;
+    secp256k1_scalar_set_b32(&m, msg32, NULL);
+    if (!secp256k1_ecdsa_sig_recover(sig64, &q, &m, recid))
+        return 0;
+    return secp256k1_eckey_pubkey_serialize(&q, pubkey, pubkeylen, compressed);
+}
+
+int secp256k1_ec_pubkey_verify(const unsigned char *pubkey, int pubkeylen) {
+    secp256k1_ge_t q;
+    return secp256k1_eckey_pubkey_parse(&q, pubkey, pubkeylen);
+}
+
+int secp256k1_ec_pubkey_decompress(unsigned char *pubkey, int *pubkeylen) {
+    secp256k1_ge_t q;
+    if (!secp256k1_eckey_pubkey_parse(&q, pubkey, *pubkeylen))
+        return 0;
+    return secp256k1_eckey_pubkey_serialize(&q, pubkey, pubkeylen, 0);
+}
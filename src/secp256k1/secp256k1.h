@@ -0,0 +1,62 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SECP256K1_H
+#define SECP256K1_H
+
+// Minimal secp256k1 engine for signature verification and public key
+// recovery. Only public data ever passes through it, so signing and
+// private key operations stay on the OpenSSL code path in key.cpp.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Build the precomputed generator tables. Must be called before any other
+ *  function; calling it more than once is harmless. */
+void secp256k1_start(void);
+
+/** Free the precomputed tables. */
+void secp256k1_stop(void);
+
+/** Verify an ECDSA signature.
+ *  msg32:     the 32-byte message hash being verified
+ *  sig:       the signature being verified (BER/DER encoded, parsed as laxly as OpenSSL does)
+ *  pubkey:    the public key to verify with (compressed, uncompressed or hybrid)
+ *  Returns: 1 for a correct signature
+ *           0 for an incorrect signature
+ *          -1 for an invalid public key
+ *          -2 for an invalid signature encoding
+ */
+int secp256k1_ecdsa_verify(const unsigned char *msg32,
+                           const unsigned char *sig, int siglen,
+                           const unsigned char *pubkey, int pubkeylen);
+
+/** Recover an ECDSA public key from a compact signature.
+ *  msg32:      the 32-byte message hash assumed to be signed
+ *  sig64:      signature as 32-byte r followed by 32-byte s
+ *  compressed: whether to serialize the recovered key compressed
+ *  recid:      the recovery id (0-3)
+ *  pubkey:     receives the recovered key (33 or 65 bytes)
+ *  Returns: 1 if recovery succeeded, 0 otherwise.
+ */
+int secp256k1_ecdsa_recover_compact(const unsigned char *msg32,
+                                    const unsigned char *sig64,
+                                    unsigned char *pubkey, int *pubkeylen,
+                                    int compressed, int recid);
+
+/** Check whether a serialized public key is a valid curve point.
+ *  Returns: 1 if valid, 0 otherwise. */
+int secp256k1_ec_pubkey_verify(const unsigned char *pubkey, int pubkeylen);
+
+/** Convert a valid public key to its 65-byte uncompressed form, in place.
+ *  pubkey must point to a 65-byte buffer.
+ *  Returns: 1 on success, 0 if the key is invalid. */
+int secp256k1_ec_pubkey_decompress(unsigned char *pubkey, int *pubkeylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
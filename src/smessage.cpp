@@ -50,6 +50,9 @@ Notes:
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+
 
 #include "base58.h"
 #include "db.h"
@@ -99,6 +102,7 @@ CCriticalSection cs_smsg;
 CCriticalSection cs_smsgDB;
 
 leveldb::DB *smsgDB = NULL;
+leveldb::Options smsgDBOptions;
 
 
 namespace fs = boost::filesystem;
@@ -220,22 +224,41 @@ bool SecMsgDB::Open(const char* pszMode)
         return false;
     };
     
-    leveldb::Options options;
-    options.create_if_missing = fCreate;
-    leveldb::Status s = leveldb::DB::Open(options, fullpath.string(), &smsgDB);
+    smsgDBOptions = GetLevelDBOptions("smsg", 8 << 20);
+    smsgDBOptions.create_if_missing = fCreate;
+    leveldb::Status s = leveldb::DB::Open(smsgDBOptions, fullpath.string(), &smsgDB);
     
     if (!s.ok())
     {
         printf("SecMsgDB::open() - Error opening db: %s.\n", s.ToString().c_str());
+        SecMsgDB::Close();
         return false;
     };
     
+    RegisterLevelDB("smsg", smsgDB);
     pdb = smsgDB;
     
     return true;
 };
 
 
+void SecMsgDB::Close()
+{
+    // -- caller must hold cs_smsgDB
+    if (smsgDB)
+    {
+        UnregisterLevelDB(smsgDB);
+        delete smsgDB;
+        smsgDB = NULL;
+    };
+    
+    delete smsgDBOptions.block_cache;
+    smsgDBOptions.block_cache = NULL;
+    delete smsgDBOptions.filter_policy;
+    smsgDBOptions.filter_policy = NULL;
+};
+
+
 class SecMsgBatchScanner : public leveldb::WriteBatch::Handler
 {
 public:
@@ -728,7 +751,10 @@ void ThreadSecureMsgPow(void* parg)
                 continue;
             
             // -- fifo (smallest key first)
-            it = dbOutbox.pdb->NewIterator(leveldb::ReadOptions());
+            // -- a bulk scan, keep it out of the block cache
+            leveldb::ReadOptions readOptions;
+            readOptions.fill_cache = false;
+            it = dbOutbox.pdb->NewIterator(readOptions);
         }
         // -- break up lock, SecureMsgSetHash will take long
         
@@ -1203,8 +1229,7 @@ bool SecureMsgShutdown()
     if (smsgDB)
     {
         LOCK(cs_smsgDB);
-        delete smsgDB;
-        smsgDB = NULL;
+        SecMsgDB::Close();
     };
     
     // -- main program will wait 5 seconds for threads to terminate.
@@ -1319,8 +1344,7 @@ bool SecureMsgDisable()
     if (smsgDB)
     {
         LOCK(cs_smsgDB);
-        delete smsgDB;
-        smsgDB = NULL;
+        SecMsgDB::Close();
     };
     
     
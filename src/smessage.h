@@ -295,6 +295,7 @@ public:
     };
     
     bool Open(const char* pszMode="r+");
+    static void Close();
     
     bool ScanBatch(const CDataStream& key, std::string* value, bool* deleted) const;
     
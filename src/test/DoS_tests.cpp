@@ -21,13 +21,14 @@
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/unordered_map.hpp>
 
 // Tests this internal-to-main.cpp method:
 extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
 extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-extern std::map<uint256, CTransaction> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern OrphanTxMap mapOrphanTransactions;
+extern OrphanTxByPrevMap mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
 {
@@ -152,11 +153,10 @@ BOOST_AUTO_TEST_CASE(DoS_checknbits)
 
 CTransaction RandomOrphan()
 {
-    std::map<uint256, CTransaction>::iterator it;
-    it = mapOrphanTransactions.lower_bound(GetRandHash());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second;
+    size_t nBucket = GetRand(mapOrphanTransactions.bucket_count());
+    while (mapOrphanTransactions.bucket_size(nBucket) == 0)
+        nBucket = (nBucket + 1) % mapOrphanTransactions.bucket_count();
+    return mapOrphanTransactions.begin(nBucket)->second.tx;
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -26,6 +26,16 @@ GetResults(CWalletDB& walletdb, std::map<int64_t, CAccountingEntry>& results)
     {
         results[ae.nOrderPos] = ae;
     }
+
+    // The activity log must be indexed by the new positions
+    const CWallet::TxItems& txOrdered = pwalletMain->OrderedTxItems();
+    BOOST_CHECK(txOrdered.size() == pwalletMain->mapWallet.size() + pwalletMain->laccentries.size());
+    for (CWallet::TxItems::const_iterator it = txOrdered.begin(); it != txOrdered.end(); ++it)
+    {
+        const CWalletTx *pwtx = (*it).second.first;
+        const CAccountingEntry *pacentry = (*it).second.second;
+        BOOST_CHECK((*it).first == (pwtx ? pwtx->nOrderPos : pacentry->nOrderPos));
+    }
 }
 
 BOOST_AUTO_TEST_CASE(acc_orderupgrade)
@@ -44,6 +54,7 @@ BOOST_AUTO_TEST_CASE(acc_orderupgrade)
     ae.strOtherAccount = "b";
     ae.strComment = "";
     walletdb.WriteAccountingEntry(ae);
+    pwalletMain->LoadAccountingEntry(ae);
 
     wtx.mapValue["comment"] = "z";
     pwalletMain->AddToWallet(wtx);
@@ -54,6 +65,7 @@ BOOST_AUTO_TEST_CASE(acc_orderupgrade)
     ae.nTime = 1333333336;
     ae.strOtherAccount = "c";
     walletdb.WriteAccountingEntry(ae);
+    pwalletMain->LoadAccountingEntry(ae);
 
     GetResults(walletdb, results);
 
@@ -70,6 +82,7 @@ BOOST_AUTO_TEST_CASE(acc_orderupgrade)
     ae.strOtherAccount = "d";
     ae.nOrderPos = pwalletMain->IncOrderPosNext();
     walletdb.WriteAccountingEntry(ae);
+    pwalletMain->LoadAccountingEntry(ae);
 
     GetResults(walletdb, results);
 
@@ -112,6 +125,7 @@ BOOST_AUTO_TEST_CASE(acc_orderupgrade)
     ae.strOtherAccount = "e";
     ae.nOrderPos = -1;
     walletdb.WriteAccountingEntry(ae);
+    pwalletMain->LoadAccountingEntry(ae);
 
     GetResults(walletdb, results);
 
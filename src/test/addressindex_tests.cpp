@@ -0,0 +1,109 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static std::string SerializeKey(const CAddressIndexKey &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    // Serialized keys of one address must sort by height, then by position
+    // in the block, for height range scans to work.
+    uint160 hashBytes(12345);
+    int heights[] = {0, 1, 255, 256, 65535, 65536, 1 << 24, 0x7fffffff};
+    for (unsigned int i = 1; i < sizeof(heights) / sizeof(heights[0]); i++) {
+        BOOST_CHECK(SerializeKey(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashBytes, heights[i - 1], 1000)) <
+                    SerializeKey(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashBytes, heights[i], 0)));
+    }
+    BOOST_CHECK(SerializeKey(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashBytes, 10, 255)) <
+                SerializeKey(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashBytes, 10, 256)));
+
+    CAddressIndexKey key(ADDRESS_SCRIPTHASH, hashBytes, 70000, 3, uint256(42), 7, true);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    CAddressIndexKey key2;
+    ss >> key2;
+    BOOST_CHECK_EQUAL(key2.nAddressType, ADDRESS_SCRIPTHASH);
+    BOOST_CHECK(key2.hashBytes == hashBytes);
+    BOOST_CHECK_EQUAL(key2.nHeight, 70000);
+    BOOST_CHECK_EQUAL(key2.nTxIndex, 3U);
+    BOOST_CHECK(key2.txhash == uint256(42));
+    BOOST_CHECK_EQUAL(key2.nIndex, 7U);
+    BOOST_CHECK(key2.fSpending);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_db)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(1), hashB(2);
+
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vWrite;
+    for (int nHeight = 1; nHeight <= 300; nHeight++) {
+        vWrite.push_back(std::make_pair(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashA, nHeight, 1, uint256(nHeight), 0, false), 100));
+        vWrite.push_back(std::make_pair(CAddressIndexKey(ADDRESS_PUBKEYHASH, hashB, nHeight, 1, uint256(nHeight), 1, false), 5));
+    }
+    vWrite.push_back(std::make_pair(CAddressIndexKey(ADDRESS_SCRIPTHASH, hashA, 5, 1, uint256(5), 2, false), 7));
+    BOOST_CHECK(db.WriteAddressIndex(vWrite));
+
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vRead;
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, hashA, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 300U);
+
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, hashA, vRead, 250, 260));
+    BOOST_CHECK_EQUAL(vRead.size(), 11U);
+    for (unsigned int i = 0; i < vRead.size(); i++) {
+        BOOST_CHECK_EQUAL(vRead[i].first.nHeight, 250 + (int)i);
+        BOOST_CHECK(vRead[i].first.hashBytes == hashA);
+        BOOST_CHECK_EQUAL(vRead[i].second, 100);
+    }
+
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_SCRIPTHASH, hashA, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 1U);
+
+    vWrite.resize(2);
+    BOOST_CHECK(db.EraseAddressIndex(vWrite));
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, hashA, vRead, 1, 1));
+    BOOST_CHECK(vRead.empty());
+
+    // Unspent outputs: a null value erases
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_PUBKEYHASH, hashA, uint256(1), 0), CAddressUnspentValue(100, CScript(), 1)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_PUBKEYHASH, hashA, uint256(2), 0), CAddressUnspentValue(200, CScript(), 2)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_PUBKEYHASH, hashB, uint256(3), 0), CAddressUnspentValue(300, CScript(), 3)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_PUBKEYHASH, hashA, uint256(1), 0), CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUnspent));
+    vUnspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(ADDRESS_PUBKEYHASH, hashA, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 200);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nHeight, 2);
+
+    // Spent outputs
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(CSpentIndexKey(uint256(1), 0), CSpentIndexValue(uint256(9), 3, 10, 100, ADDRESS_PUBKEYHASH, hashA)));
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    CSpentIndexValue value;
+    BOOST_CHECK(db.ReadSpentIndex(CSpentIndexKey(uint256(1), 0), value));
+    BOOST_CHECK(value.txid == uint256(9));
+    BOOST_CHECK_EQUAL(value.nInputIndex, 3U);
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(uint256(1), 1), value));
+    vSpent[0].second = CSpentIndexValue();
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(uint256(1), 0), value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+// A block with a coinbase and nTx-1 other transactions, all distinct
+static CBlock BuildBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nBits = 0x207fffff;
+    block.nTime = 1500000000;
+    for (unsigned int i = 0; i < nTx; i++) {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i;
+        if (i == 0) {
+            tx.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+        } else {
+            tx.vin[0].prevout.hash = GetRandHash();
+            tx.vin[0].prevout.n = 0;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << cmpctblock;
+    CBlockHeaderAndShortTxIDs result;
+    ss >> result;
+    return result;
+}
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+BOOST_AUTO_TEST_CASE(compact_block_roundtrip)
+{
+    CBlock block = BuildBlock(10);
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.prefilledtxn.size(), 1U);
+    BOOST_CHECK_EQUAL(cmpctblock.shorttxids.size(), 9U);
+
+    // 6 bytes per short ID on the wire, and the same IDs on the other side
+    CBlockHeaderAndShortTxIDs received = RoundTrip(cmpctblock);
+    BOOST_CHECK_EQUAL(received.header.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(received.shorttxids, SER_NETWORK, PROTOCOL_VERSION), 1U + 9 * 6);
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        BOOST_CHECK(received.shorttxids[i - 1].nID < (1ULL << 48));
+        BOOST_CHECK_EQUAL(received.shorttxids[i - 1].nID, received.GetShortID(block.vtx[i].GetHash()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_reconstruct)
+{
+    CBlock block = BuildBlock(10);
+    CTxMemPool pool;
+    // transactions 1-4 from the mempool, 5 from the extra transactions
+    for (unsigned int i = 1; i < 5; i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+    vector<CTransaction> vExtraTxn(1, block.vtx[5]);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool, vExtraTxn) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.nPrefilled, 1U);
+    BOOST_CHECK_EQUAL(partialBlock.nFromPool, 5U);
+    for (unsigned int i = 0; i < 6; i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+
+    vector<uint16_t> vIndexes;
+    partialBlock.GetMissing(vIndexes);
+    BOOST_CHECK_EQUAL(vIndexes.size(), 4U);
+    BOOST_CHECK_EQUAL(vIndexes[0], 6);
+    BOOST_CHECK_EQUAL(vIndexes[3], 9);
+
+    vector<CTransaction> vMissingTxn;
+    BOOST_FOREACH(uint16_t nIndex, vIndexes)
+        vMissingTxn.push_back(block.vtx[nIndex]);
+
+    // too few transactions is the peer's fault
+    CBlock result;
+    vector<CTransaction> vTooFew(vMissingTxn.begin(), vMissingTxn.end() - 1);
+    BOOST_CHECK(partialBlock.FillBlock(result, vTooFew) == READ_STATUS_INVALID);
+
+    // the wrong ones only mean the full block is needed
+    vector<CTransaction> vWrong(vMissingTxn);
+    swap(vWrong[0], vWrong[1]);
+    BOOST_CHECK(partialBlock.FillBlock(result, vWrong) == READ_STATUS_FAILED);
+
+    BOOST_CHECK(partialBlock.FillBlock(result, vMissingTxn) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(result.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(result.BuildMerkleTree().ToString(), block.hashMerkleRoot.ToString());
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_invalid)
+{
+    CBlock block = BuildBlock(3);
+    CTxMemPool pool;
+    vector<CTransaction> vExtraTxn;
+    CPartiallyDownloadedBlock partialBlock;
+
+    // a prefilled transaction past the end of the block
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    cmpctblock.prefilledtxn[0].index = 3;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool, vExtraTxn) == READ_STATUS_INVALID);
+
+    // two prefilled transactions for one position
+    cmpctblock = CBlockHeaderAndShortTxIDs(block);
+    cmpctblock.prefilledtxn.push_back(cmpctblock.prefilledtxn[0]);
+    cmpctblock.shorttxids.pop_back();
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool, vExtraTxn) == READ_STATUS_INVALID);
+
+    // two transactions with the same short ID
+    cmpctblock = CBlockHeaderAndShortTxIDs(block);
+    cmpctblock.shorttxids[1] = cmpctblock.shorttxids[0];
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool, vExtraTxn) == READ_STATUS_FAILED);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
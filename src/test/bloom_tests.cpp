@@ -451,4 +451,36 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256("0x02981fa052f0481dbc5868f4fc2166035a10f27a03cfd2de67326471df5bc041"), 0)));
 }
 
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    // remembers at least the last 100 entries, with 1% false positives
+    CRollingBloomFilter rb(100, 0.01);
+
+    std::vector<uint256> data(399);
+    unsigned int nHits = 0;
+    for (unsigned int i = 0; i < data.size(); i++) {
+        data[i] = GetRandHash();
+        if (rb.contains(data[i]))
+            nHits++;
+        rb.insert(data[i]);
+        BOOST_CHECK(rb.contains(data[i]));
+    }
+    BOOST_CHECK(nHits < 20);
+
+    // the last 100 are still there
+    for (unsigned int i = data.size() - 100; i < data.size(); i++)
+        BOOST_CHECK(rb.contains(data[i]));
+
+    // about 100 of 10000 others match
+    nHits = 0;
+    for (int i = 0; i < 10000; i++)
+        if (rb.contains(GetRandHash()))
+            nHits++;
+    BOOST_CHECK(nHits < 175);
+
+    rb.reset();
+    for (unsigned int i = 0; i < data.size(); i++)
+        BOOST_CHECK(!rb.contains(data[i]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+// A check that counts how often it ran and returns a preset result.
+class CCountingCheck
+{
+public:
+    static boost::mutex mutex;
+    static unsigned int nRun;
+
+    bool fResult;
+
+    CCountingCheck(bool fResultIn = true) : fResult(fResultIn) {}
+
+    bool operator()() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nRun++;
+        return fResult;
+    }
+
+    void swap(CCountingCheck &check) {
+        std::swap(fResult, check.fResult);
+    }
+};
+
+boost::mutex CCountingCheck::mutex;
+unsigned int CCountingCheck::nRun = 0;
+
+static void RunWorker(CCheckQueue<CCountingCheck> *pqueue)
+{
+    pqueue->Thread();
+}
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers)
+{
+    CCheckQueue<CCountingCheck> queue(128);
+    CCountingCheck::nRun = 0;
+    {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(1000);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(CCountingCheck::nRun, 1000U);
+    BOOST_CHECK_EQUAL(queue.GetStats().nChecks, 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers)
+{
+    CCheckQueue<CCountingCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&RunWorker, &queue));
+
+    // Many rounds of differently sized batches, as ConnectBlock would add
+    // them; every check must run exactly once and the queue must be idle
+    // again after each round (CCheckQueueControl asserts that).
+    CCountingCheck::nRun = 0;
+    unsigned int nExpected = 0;
+    for (int nRound = 0; nRound < 200; nRound++) {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        for (unsigned int nSize = 0; nSize < 40; nSize += 1 + nRound % 7) {
+            std::vector<CCountingCheck> vChecks(nSize);
+            control.Add(vChecks);
+            nExpected += nSize;
+        }
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(CCountingCheck::nRun, nExpected);
+
+    CCheckQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nChecks, nExpected);
+    BOOST_CHECK(stats.nBatchSize >= 1 && stats.nBatchSize <= 128);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CCountingCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&RunWorker, &queue));
+
+    for (int nRound = 0; nRound < 50; nRound++) {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(500);
+        if (nRound % 2)
+            vChecks[nRound * 7].fResult = false;
+        control.Add(vChecks);
+        BOOST_CHECK_EQUAL(control.Wait(), nRound % 2 == 0);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,348 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+// Backing store that behaves like CCoinsViewDB: it only applies DIRTY
+// entries, never stores pruned ones, and leaves the batch alone.
+class CCoinsViewTest : public CCoinsView
+{
+    uint256 hashBestBlock_;
+    std::map<uint256, CCoins> map_;
+
+public:
+    unsigned int nWrites;
+
+    CCoinsViewTest() : nWrites(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins)
+    {
+        std::map<uint256, CCoins>::iterator it = map_.find(txid);
+        if (it == map_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid)
+    {
+        return map_.count(txid) != 0;
+    }
+
+    uint256 GetBestBlock() { return hashBestBlock_; }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment* pcommitment)
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned())
+                continue;
+            nWrites++;
+            if (it->second.coins.IsPruned())
+                map_.erase(it->first);
+            else
+                map_[it->first] = it->second.coins;
+        }
+        if (hashBlock != uint256(0))
+            hashBestBlock_ = hashBlock;
+        return true;
+    }
+
+    bool GetStats(CCoinsStats& stats) { return false; }
+};
+
+CCoins RandomCoins()
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = insecure_rand() % 1000;
+    coins.vout.resize(1 + insecure_rand() % 4);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = 1 + insecure_rand() % 100000;
+        coins.vout[i].scriptPubKey.assign(insecure_rand() % 40 + 1, (unsigned char)i);
+    }
+    return coins;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(coins_tests)
+
+// Apply random modifications through a stack of caches and compare the
+// result against a plain map, while flushing, syncing and trimming at random.
+BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
+{
+    seed_insecure_rand(true);
+
+    std::map<uint256, CCoins> result;
+    CCoinsViewTest base;
+    std::vector<CCoinsViewCache*> stack;
+    stack.push_back(new CCoinsViewCache(base));
+
+    std::vector<uint256> txids;
+    txids.resize(200);
+    for (unsigned int i = 0; i < txids.size(); i++)
+        txids[i] = GetRandHash();
+
+    for (unsigned int i = 0; i < 20000; i++) {
+        uint256 txid = txids[insecure_rand() % txids.size()];
+        CCoins& coins = result[txid];
+        CCoinsViewCache* top = stack.back();
+
+        switch (insecure_rand() % 4) {
+        case 0: {
+            // Create or replace through ModifyCoins.
+            CCoins newCoins = RandomCoins();
+            *top->ModifyCoins(txid) = newCoins;
+            coins = newCoins;
+            break;
+        }
+        case 1: {
+            // Spend one output.
+            if (!coins.IsPruned()) {
+                unsigned int n = insecure_rand() % coins.vout.size();
+                CCoinsModifier entry = top->ModifyCoins(txid);
+                entry->Spend(n);
+                coins.Spend(n);
+            }
+            break;
+        }
+        case 2: {
+            // Create the outputs of a new transaction.
+            if (coins.IsPruned()) {
+                CCoins newCoins = RandomCoins();
+                *top->ModifyNewCoins(txid) = newCoins;
+                coins = newCoins;
+            }
+            break;
+        }
+        case 3: {
+            // Overwrite through SetCoins.
+            CCoins newCoins = RandomCoins();
+            if (insecure_rand() % 4 == 0)
+                newCoins = CCoins();
+            top->SetCoins(txid, newCoins);
+            coins = newCoins;
+            break;
+        }
+        }
+
+        // Every tenth step, compare all views with the expected state.
+        if (insecure_rand() % 10 == 0) {
+            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+                CCoins found;
+                bool fHave = stack.back()->GetCoins(it->first, found);
+                if (it->second.IsPruned())
+                    BOOST_CHECK(!fHave || found.IsPruned());
+                else
+                    BOOST_CHECK(fHave && found == it->second);
+            }
+        }
+
+        if (insecure_rand() % 100 == 0) {
+            // Sync or flush the top cache, or trim it after syncing.
+            switch (insecure_rand() % 3) {
+            case 0: BOOST_CHECK(stack.back()->Flush()); break;
+            case 1: BOOST_CHECK(stack.back()->Sync()); break;
+            case 2:
+                BOOST_CHECK(stack.back()->Sync());
+                stack.back()->Trim(stack.back()->DynamicMemoryUsage() / 2);
+                break;
+            }
+        }
+
+        if (insecure_rand() % 100 == 0) {
+            // Push or pop a cache level.
+            if (stack.size() > 1 && insecure_rand() % 2 == 0) {
+                BOOST_CHECK(stack.back()->Flush());
+                delete stack.back();
+                stack.pop_back();
+            } else if (stack.size() < 4) {
+                CCoinsView* tip = stack.back();
+                stack.push_back(new CCoinsViewCache(*tip));
+            }
+        }
+    }
+
+    // Everything must end up in the backing store.
+    while (!stack.empty()) {
+        BOOST_CHECK(stack.back()->Flush());
+        delete stack.back();
+        stack.pop_back();
+    }
+    for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+        CCoins found;
+        bool fHave = base.GetCoins(it->first, found);
+        BOOST_CHECK_EQUAL(fHave, !it->second.IsPruned());
+        if (fHave)
+            BOOST_CHECK(found == it->second);
+    }
+}
+
+// Reading coins must not cause writes, and outputs created and spent between
+// two writes must never reach the backing store.
+BOOST_AUTO_TEST_CASE(coins_cache_dirty_fresh)
+{
+    CCoinsViewTest base;
+    uint256 txidOld = GetRandHash();
+    uint256 txidNew = GetRandHash();
+    {
+        CCoinsViewCache cache(base);
+        cache.SetCoins(txidOld, RandomCoins());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(base.nWrites, 1U);
+
+    CCoinsViewCache cache(base);
+    BOOST_CHECK(cache.HaveCoins(txidOld));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.nWrites, 1U);
+
+    {
+        CCoinsModifier coins = cache.ModifyNewCoins(txidNew);
+        *coins = RandomCoins();
+    }
+    {
+        CCoinsModifier coins = cache.ModifyCoins(txidNew);
+        for (unsigned int i = 0; i < coins->vout.size(); i++)
+            coins->Spend(i);
+    }
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.nWrites, 1U);
+    BOOST_CHECK(!base.HaveCoins(txidNew));
+
+    // After a sync everything is clean, so trimming to zero empties the cache.
+    cache.Trim(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(cache.HaveCoins(txidOld));
+}
+
+// The per-output chainstate layout must return the same coins as the
+// per-transaction one, both after converting and after further writes.
+BOOST_AUTO_TEST_CASE(coins_db_peroutput)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    BOOST_CHECK(!db.IsPerOutput());
+
+    std::map<uint256, CCoins> expected;
+    {
+        CCoinsViewCache cache(db);
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = GetRandHash();
+            CCoins coins = RandomCoins();
+            if (coins.vout.size() > 1)
+                coins.vout[0].SetNull();
+            expected[txid] = coins;
+            cache.SetCoins(txid, coins);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    BOOST_CHECK(db.UpgradeToPerOutput());
+    BOOST_CHECK(db.IsPerOutput());
+    BOOST_CHECK(db.UpgradeToPerOutput());
+
+    // Spend outputs and create new transactions on top of the converted
+    // database, with a flush in between.
+    for (int nRound = 0; nRound < 2; nRound++) {
+        CCoinsViewCache cache(db);
+        for (std::map<uint256, CCoins>::iterator it = expected.begin(); it != expected.end(); it++) {
+            CCoins found;
+            if (it->second.IsPruned()) {
+                BOOST_CHECK(!db.GetCoins(it->first, found));
+                continue;
+            }
+            BOOST_CHECK(db.GetCoins(it->first, found));
+            BOOST_CHECK(found == it->second);
+            if (insecure_rand() % 2) {
+                unsigned int n = insecure_rand() % it->second.vout.size();
+                CCoinsModifier coins = cache.ModifyCoins(it->first);
+                coins->Spend(n);
+                it->second.Spend(n);
+            }
+        }
+        for (int i = 0; i < 5; i++) {
+            uint256 txid = GetRandHash();
+            CCoins coins = RandomCoins();
+            *cache.ModifyNewCoins(txid) = coins;
+            expected[txid] = coins;
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    for (std::map<uint256, CCoins>::iterator it = expected.begin(); it != expected.end(); it++) {
+        CCoins found;
+        bool fHave = db.GetCoins(it->first, found);
+        BOOST_CHECK_EQUAL(fHave, !it->second.IsPruned());
+        BOOST_CHECK_EQUAL(db.HaveCoins(it->first), !it->second.IsPruned());
+        if (fHave)
+            BOOST_CHECK(found == it->second);
+    }
+}
+
+// A commitment kept up to date along with the changes to a cache must match
+// the one recomputed from the database, whatever the order of the changes.
+BOOST_AUTO_TEST_CASE(coins_commitment)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    CCoinsCommitment commitment;
+    BOOST_CHECK(!db.GetCommitment(commitment));
+    CCoinsMap mapNone;
+    BOOST_CHECK(db.BatchWrite(mapNone, uint256(0), &commitment));
+
+    std::vector<uint256> txids;
+    for (int nRound = 0; nRound < 3; nRound++) {
+        CCoinsViewCache cache(db);
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = GetRandHash();
+            CCoinsModifier coins = cache.ModifyNewCoins(txid);
+            *coins = RandomCoins();
+            cache.ModifyCommitment()->AddCoins(txid, *coins);
+            txids.push_back(txid);
+        }
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = txids[insecure_rand() % txids.size()];
+            if (!cache.HaveCoins(txid))
+                continue;
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            unsigned int n = insecure_rand() % coins->vout.size();
+            if (!coins->IsAvailable(n))
+                continue;
+            CCoinsCommitment *pcommitment = cache.ModifyCommitment();
+            pcommitment->RemoveOutput(txid, *coins, n, coins->vout[n]);
+            coins->Spend(n);
+            if (coins->IsPruned())
+                pcommitment->nTransactions--;
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    BOOST_CHECK(db.GetCommitment(commitment));
+    CCoinsStats stats;
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK(stats.commitment == commitment);
+    BOOST_CHECK_EQUAL(stats.commitment.nTransactions, stats.nTransactions);
+    BOOST_CHECK_EQUAL(stats.commitment.nTransactionOutputs, stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.commitment.nTotalAmount, stats.nTotalAmount);
+
+    // An empty write leaves the commitment alone; writing coins without
+    // keeping it up to date drops it.
+    BOOST_CHECK(db.BatchWrite(mapNone, uint256(0), NULL));
+    BOOST_CHECK(db.GetCommitment(commitment));
+    CCoinsMap mapCoins;
+    mapCoins[GetRandHash()].coins = RandomCoins();
+    mapCoins.begin()->second.flags = CCoinsCacheEntry::DIRTY;
+    BOOST_CHECK(db.BatchWrite(mapCoins, uint256(0), NULL));
+    BOOST_CHECK(!db.GetCommitment(commitment));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -28,3 +28,83 @@ static const CBitcoinAddress addr2C("Xta1praZQjyELweyMByXyiREw1ZRsjXzVp");
 
 static const string strAddressBad("Xta1praZQjyELweyMByXyiREw1ZRsjXzVP");
 
+BOOST_AUTO_TEST_SUITE(key_tests)
+
+// Every verification and recovery must give the same answer through CPubKey
+// (the in-tree secp256k1 engine when built with --enable-secp256k1-verify)
+// and through OpenSSL.
+BOOST_AUTO_TEST_CASE(key_verify_backends_agree)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 1);
+        CPubKey pubkey = key.GetPubKey();
+        BOOST_CHECK(pubkey.IsFullyValid());
+
+        uint256 hash = GetRandHash();
+        vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        BOOST_CHECK(pubkey.Verify(hash, vchSig));
+        BOOST_CHECK(ECC_VerifyOpenSSL(pubkey, hash, vchSig));
+
+        // A different message must fail in both.
+        uint256 hashOther = hash;
+        hashOther ^= 1;
+        BOOST_CHECK(!pubkey.Verify(hashOther, vchSig));
+        BOOST_CHECK(!ECC_VerifyOpenSSL(pubkey, hashOther, vchSig));
+
+        // Flip single bits across the whole encoding.
+        for (unsigned int nBit = 0; nBit < vchSig.size() * 8; nBit += 5)
+        {
+            vector<unsigned char> vchBad(vchSig);
+            vchBad[nBit / 8] ^= 1 << (nBit % 8);
+            BOOST_CHECK_EQUAL(pubkey.Verify(hash, vchBad), ECC_VerifyOpenSSL(pubkey, hash, vchBad));
+        }
+
+        // Trailing garbage and truncation.
+        vector<unsigned char> vchLong(vchSig);
+        vchLong.push_back(0x01);
+        BOOST_CHECK_EQUAL(pubkey.Verify(hash, vchLong), ECC_VerifyOpenSSL(pubkey, hash, vchLong));
+        vector<unsigned char> vchShort(vchSig.begin(), vchSig.end() - 1);
+        BOOST_CHECK_EQUAL(pubkey.Verify(hash, vchShort), ECC_VerifyOpenSSL(pubkey, hash, vchShort));
+
+        // The other serialization of the same key.
+        CPubKey pubkeyFull(pubkey);
+        BOOST_CHECK(pubkeyFull.Decompress());
+        BOOST_CHECK(pubkeyFull.size() == 65);
+        BOOST_CHECK(pubkeyFull.Verify(hash, vchSig));
+        BOOST_CHECK(ECC_VerifyOpenSSL(pubkeyFull, hash, vchSig));
+
+        // Compact signatures and key recovery.
+        vector<unsigned char> vchCompact;
+        BOOST_CHECK(key.SignCompact(hash, vchCompact));
+        CPubKey pubkeyRec, pubkeyRecOpenSSL;
+        BOOST_CHECK(pubkeyRec.RecoverCompact(hash, vchCompact));
+        BOOST_CHECK(ECC_RecoverCompactOpenSSL(pubkeyRecOpenSSL, hash, vchCompact));
+        BOOST_CHECK(pubkeyRec == pubkey);
+        BOOST_CHECK(pubkeyRecOpenSSL == pubkey);
+        BOOST_CHECK(pubkey.VerifyCompact(hash, vchCompact));
+        BOOST_CHECK(!pubkey.VerifyCompact(hashOther, vchCompact));
+
+        for (int nRec = 27; nRec < 35; nRec++)
+        {
+            vector<unsigned char> vchRec(vchCompact);
+            vchRec[0] = nRec;
+            CPubKey a, b;
+            bool fA = a.RecoverCompact(hashOther, vchRec);
+            bool fB = ECC_RecoverCompactOpenSSL(b, hashOther, vchRec);
+            BOOST_CHECK_EQUAL(fA, fB);
+            if (fA && fB)
+                BOOST_CHECK(a == b);
+        }
+    }
+
+    // Points that are not on the curve.
+    vector<unsigned char> vchBadKey(33, 0x00);
+    vchBadKey[0] = 0x02;
+    vchBadKey[32] = 0x05;
+    BOOST_CHECK(!CPubKey(vchBadKey).IsFullyValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,8 +4,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "core.h"
+#include "init.h"
 #include "main.h"
+#include "util.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 BOOST_AUTO_TEST_SUITE(main_tests)
@@ -23,4 +26,84 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 2099999997690000ULL);
 }
 
+static void WriteFramedBlock(CAutoFile& fileout, const CBlock& block)
+{
+    unsigned int nSize = fileout.GetSerializeSize(block);
+    fileout << FLATDATA(Params().MessageStart()) << nSize << block;
+}
+
+BOOST_AUTO_TEST_CASE(import_pipeline)
+{
+    CBlock genesis = Params().GenesisBlock();
+
+    // A child of the genesis block without the work for it
+    CBlock child;
+    child.nVersion = 1;
+    child.hashPrevBlock = genesis.GetHash();
+    child.nTime = genesis.nTime + 60;
+    child.nBits = genesis.nBits;
+    child.nNonce = 0;
+    CTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinbase.vout.resize(1);
+    child.vtx.push_back(txCoinbase);
+    child.hashMerkleRoot = child.BuildMerkleTree();
+
+    // More batches than one of the genesis block, with junk in between, then
+    // the child and a block cut short at the end of the file
+    boost::filesystem::path path = GetDataDir() / "import_test.dat";
+    {
+        CAutoFile fileout = CAutoFile(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE((FILE*)fileout != NULL);
+        const unsigned char junk[] = {0x00, 0xff, Params().MessageStart()[0]};
+        for (int i = 0; i < 300; i++) {
+            fileout << FLATDATA(junk);
+            WriteFramedBlock(fileout, genesis);
+        }
+        WriteFramedBlock(fileout, child);
+        unsigned int nSize = fileout.GetSerializeSize(child);
+        fileout << FLATDATA(Params().MessageStart()) << nSize;
+    }
+
+    // The duplicates and the child are all turned away, without an error
+    BOOST_CHECK(!LoadExternalBlockFile(fopen(path.string().c_str(), "rb")));
+    BOOST_CHECK(!ShutdownRequested());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+        BOOST_CHECK(!mapBlockIndex.count(child.GetHash()));
+    }
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(connect_checked_block)
+{
+    LOCK(cs_main);
+
+    // The genesis block with a second coinbase fails CheckBlock, but keeps its hash
+    CBlock block = Params().GenesisBlock();
+    CTransaction txBogus(block.vtx[0]);
+    txBogus.vout[0].nValue++;
+    block.vtx.push_back(txBogus);
+    BOOST_CHECK(block.GetHash() == Params().HashGenesisBlock());
+
+    CCoinsView viewBase;
+    {
+        CCoinsViewCache view(viewBase);
+        CValidationState state;
+        BOOST_CHECK(!ConnectBlock(block, state, chainActive.Genesis(), view));
+        BOOST_CHECK(state.IsInvalid());
+    }
+
+    // A block the import pipeline has checked doesn't go through CheckBlock again
+    {
+        CCoinsViewCache view(viewBase);
+        CValidationState state;
+        BOOST_CHECK(ConnectBlock(block, state, chainActive.Genesis(), view, false, true));
+        BOOST_CHECK(view.GetBestBlock() == block.GetHash());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
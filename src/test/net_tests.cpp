@@ -0,0 +1,115 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the message handler threads
+//
+
+#include "net.h"
+#include "util.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+static const unsigned int nTestThreads = 4;
+static const unsigned int nTestNodes = 12;
+static const unsigned int nTestRounds = 5;
+
+static boost::mutex mutexRecord;
+static std::map<NodeId, std::set<boost::thread::id> > mapNodeThreads;
+static std::map<boost::thread::id, std::set<NodeId> > mapThreadNodes;
+static std::map<NodeId, unsigned int> mapNodeCalls;
+static std::set<NodeId> setBusy;
+static bool fOverlap = false;
+
+// Stands in for ProcessMessages, recording which thread handles each node and
+// whether a node is ever handled by two threads at once
+static bool RecordProcessMessages(CNode* pnode)
+{
+    NodeId id = pnode->GetId();
+    {
+        boost::unique_lock<boost::mutex> lock(mutexRecord);
+        if (!setBusy.insert(id).second)
+            fOverlap = true;
+        mapNodeThreads[id].insert(boost::this_thread::get_id());
+        mapThreadNodes[boost::this_thread::get_id()].insert(id);
+        mapNodeCalls[id]++;
+    }
+    MilliSleep(1);
+    {
+        boost::unique_lock<boost::mutex> lock(mutexRecord);
+        setBusy.erase(id);
+    }
+    return true;
+}
+
+static bool AllNodesHandled(const std::vector<CNode*>& vTestNodes)
+{
+    boost::unique_lock<boost::mutex> lock(mutexRecord);
+    BOOST_FOREACH(CNode* pnode, vTestNodes)
+        if (mapNodeCalls[pnode->GetId()] < nTestRounds)
+            return false;
+    return true;
+}
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(message_handler_threads)
+{
+    std::vector<CNode*> vTestNodes;
+    for (unsigned int i = 0; i < nTestNodes; i++) {
+        CAddress addr(CService(CNetAddr(strprintf("10.0.0.%u", i + 1)), 11111));
+        vTestNodes.push_back(new CNode(INVALID_SOCKET, addr, "", true));
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vTestNodes)
+            vNodes.push_back(pnode);
+    }
+
+    boost::signals2::connection conn = GetNodeSignals().ProcessMessages.connect(&RecordProcessMessages);
+    boost::thread_group threadGroup;
+    StartMessageHandlers(threadGroup, nTestThreads);
+    for (int i = 0; i < 1000 && !AllNodesHandled(vTestNodes); i++)
+        MilliSleep(10);
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    conn.disconnect();
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vTestNodes)
+            vNodes.erase(std::find(vNodes.begin(), vNodes.end(), pnode));
+    }
+
+    BOOST_CHECK(AllNodesHandled(vTestNodes));
+    BOOST_CHECK(!fOverlap);
+    BOOST_CHECK_EQUAL(mapThreadNodes.size(), nTestThreads);
+
+    BOOST_FOREACH(CNode* pnode, vTestNodes) {
+        // every message of a node is handled by the same thread, in order
+        const std::set<boost::thread::id>& setThreads = mapNodeThreads[pnode->GetId()];
+        BOOST_CHECK_EQUAL(setThreads.size(), 1U);
+        if (setThreads.size() != 1)
+            continue;
+
+        // and nodes share that thread exactly when their ids map to it
+        BOOST_FOREACH(CNode* pother, vTestNodes) {
+            bool fSameThread = mapNodeThreads[pother->GetId()] == setThreads;
+            bool fSameSlot = MessageHandlerThread(pnode->GetId(), nTestThreads) == MessageHandlerThread(pother->GetId(), nTestThreads);
+            BOOST_CHECK_EQUAL(fSameThread, fSameSlot);
+        }
+    }
+
+    BOOST_FOREACH(CNode* pnode, vTestNodes)
+        delete pnode;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
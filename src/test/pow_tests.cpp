@@ -0,0 +1,135 @@
+// Copyright (c) 2017-2018 The Bolt Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bignum.h"
+#include "chainparams.h"
+#include "main.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// The retarget and work calculations as they were done with CBigNum; the
+// uint256 versions in main must give the very same bits.
+
+static const int64_t nRefAveragingInterval = 8;
+static const int64_t nRefAveragingTargetTimespan = nRefAveragingInterval * 60;
+static const int64_t nRefMinActualTimespan = nRefAveragingTargetTimespan * (100 - 1) / 100;
+static const int64_t nRefMaxActualTimespan = nRefAveragingTargetTimespan * (100 + 3) / 100;
+
+static unsigned int RefGetNextWorkRequired(const CBlockIndex* pindexLast)
+{
+    unsigned int nProofOfWorkLimit = Params().ProofOfWorkLimit().GetCompact();
+    if (pindexLast == NULL || pindexLast->nHeight+1 < nRefAveragingInterval)
+        return nProofOfWorkLimit;
+
+    const CBlockIndex* pindexFirst = pindexLast;
+    for (int i = 0; pindexFirst && i < nRefAveragingInterval-1; i++)
+        pindexFirst = pindexFirst->pprev;
+
+    int64_t nActualTimespan = pindexLast->GetBlockTime() - pindexFirst->GetBlockTime();
+    if (nActualTimespan < nRefMinActualTimespan)
+        nActualTimespan = nRefMinActualTimespan;
+    if (nActualTimespan > nRefMaxActualTimespan)
+        nActualTimespan = nRefMaxActualTimespan;
+
+    CBigNum bnNew;
+    bnNew.SetCompact(pindexLast->nBits);
+    bnNew *= nActualTimespan;
+    bnNew /= nRefAveragingTargetTimespan;
+    if (bnNew > Params().ProofOfWorkLimit())
+        bnNew = Params().ProofOfWorkLimit();
+    return bnNew.GetCompact();
+}
+
+static uint256 RefGetBlockWork(unsigned int nBits)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    if (bnTarget <= 0)
+        return 0;
+    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+}
+
+// nBits with a random size and mantissa, sign bit clear
+static unsigned int RandomBits()
+{
+    return ((insecure_rand() % 36) << 24) | (insecure_rand() & 0x007fffff);
+}
+
+BOOST_AUTO_TEST_SUITE(pow_tests)
+
+BOOST_AUTO_TEST_CASE(compact_matches_bignum)
+{
+    for (int i = 0; i < 100000; i++)
+    {
+        unsigned int nBits = RandomBits();
+        bool fNegative, fOverflow;
+        uint256 bn;
+        bn.SetCompact(nBits, &fNegative, &fOverflow);
+        BOOST_CHECK(!fNegative);
+
+        CBigNum bnRef;
+        bnRef.SetCompact(nBits);
+        BOOST_CHECK_EQUAL(fOverflow, bnRef > CBigNum(~uint256(0)));
+
+        CBlockIndex index;
+        index.nBits = nBits;
+        BOOST_CHECK(index.GetBlockWork() == RefGetBlockWork(nBits));
+
+        if (fOverflow)
+            continue;
+        BOOST_CHECK(bn == bnRef.getuint256());
+        BOOST_CHECK_EQUAL(bn.GetCompact(), bnRef.GetCompact());
+    }
+
+    // the sign bit on a zero mantissa is not negative
+    bool fNegative;
+    uint256().SetCompact(0x04800000, &fNegative);
+    BOOST_CHECK(!fNegative);
+    uint256().SetCompact(0x04923456, &fNegative);
+    BOOST_CHECK(fNegative);
+    BOOST_CHECK_EQUAL(uint256().SetCompact(0x04923456).GetCompact(true), 0x04923456U);
+    BOOST_CHECK_EQUAL(uint256(0x80).GetCompact(), 0x02008000U);
+    BOOST_CHECK_EQUAL(uint256().GetCompact(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(retarget_matches_bignum)
+{
+    const CChainParams::Network networks[] = { CChainParams::MAIN, CChainParams::REGTEST };
+    for (unsigned int n = 0; n < sizeof(networks) / sizeof(networks[0]); n++)
+    {
+        SelectParams(networks[n]);
+
+        // A chain whose blocks come too fast, too slow and out of order in
+        // turn, so targets move both ways and hit both clamps and the limit.
+        std::vector<CBlockIndex> blocks(20000);
+        for (unsigned int i = 0; i < blocks.size(); i++)
+        {
+            CBlockIndex* pindexPrev = i ? &blocks[i - 1] : NULL;
+            blocks[i].pprev = pindexPrev;
+            blocks[i].nHeight = i;
+            if (pindexPrev)
+            {
+                int nPhase = (i / 500) % 3;
+                int64_t nSpacing = nPhase == 0 ? insecure_rand() % 30 : nPhase == 1 ? 60 + insecure_rand() % 600 : insecure_rand() % 180;
+                blocks[i].nTime = pindexPrev->nTime + nSpacing - (insecure_rand() % 8 == 0 ? 120 : 0);
+            }
+            else
+                blocks[i].nTime = 1500000000;
+
+            CBlockHeader header;
+            header.nTime = blocks[i].nTime;
+            unsigned int nBits = GetNextWorkRequired(pindexPrev, &header);
+            BOOST_CHECK_EQUAL(nBits, RefGetNextWorkRequired(pindexPrev));
+            blocks[i].nBits = nBits;
+            BOOST_CHECK(blocks[i].GetBlockWork() == RefGetBlockWork(nBits));
+        }
+    }
+    SelectParams(CChainParams::MAIN);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
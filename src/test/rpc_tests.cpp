@@ -6,8 +6,11 @@
 #include "rpcclient.h"
 
 #include "base58.h"
+#include "init.h"
+#include "util.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace std;
@@ -138,4 +141,135 @@ BOOST_AUTO_TEST_CASE(rpc_parse_monetary_values)
     BOOST_CHECK(AmountFromValue(ValueFromString("20999999.99999999")) == 2099999999999999LL);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_stream_writer)
+{
+    Object inner;
+    inner.push_back(Pair("amount", ValueFromAmount(150000000LL)));
+    inner.push_back(Pair("escaped", "a\"b\\c\n"));
+    Array arr;
+    arr.push_back(1);
+    arr.push_back(Value::null);
+    arr.push_back(inner);
+    Object tree;
+    tree.push_back(Pair("array", arr));
+    tree.push_back(Pair("empty", Array()));
+    tree.push_back(Pair("flag", true));
+
+    ostringstream os;
+    CJSONStreamWriter writer(os);
+    writer.BeginObject();
+    writer.Key("array");
+    writer.BeginArray();
+    writer.Write(1);
+    writer.Write(Value::null);
+    writer.Write(inner);
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.WritePair("flag", true);
+    writer.EndObject();
+
+    BOOST_CHECK_EQUAL(os.str(), write_string(Value(tree), false));
+}
+
+static string ReadReplyBody(const string& strReply)
+{
+    istringstream is(strReply);
+    int nProto = 0;
+    BOOST_CHECK_EQUAL(ReadHTTPStatus(is, nProto), HTTP_OK);
+    map<string, string> mapHeaders;
+    string strBody;
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(is, mapHeaders, strBody, nProto), HTTP_OK);
+    return strBody;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_chunked_reply)
+{
+    // A short body goes out as a normal reply
+    ostringstream osShort;
+    CHTTPChunkedStreamBuf bufShort(osShort, HTTP_OK, true);
+    ostream streamShort(&bufShort);
+    streamShort << "short";
+    bufShort.Finish();
+    BOOST_CHECK(osShort.str().find("Content-Length: 5\r\n") != string::npos);
+    BOOST_CHECK_EQUAL(ReadReplyBody(osShort.str()), "short");
+
+    // A long one in chunks, and can no longer be taken back
+    string strLong;
+    for (int i = 0; strLong.size() < 3 * CHTTPChunkedStreamBuf::CHUNK_SIZE; i++)
+        strLong += strprintf("%d,", i);
+    ostringstream osLong;
+    CHTTPChunkedStreamBuf bufLong(osLong, HTTP_OK, true);
+    ostream streamLong(&bufLong);
+    streamLong << strLong;
+    BOOST_CHECK(!bufLong.Discard());
+    bufLong.Finish();
+    BOOST_CHECK(osLong.str().find("Transfer-Encoding: chunked\r\n") != string::npos);
+    BOOST_CHECK_EQUAL(ReadReplyBody(osLong.str()), strLong);
+}
+
+static const std::string strTestRPCPort = "28932";
+
+static void SendGetBlockCount(ostream& stream)
+{
+    string strRequest = JSONRPCRequest("getblockcount", Array(), 1);
+    stream << "POST / HTTP/1.1\r\n"
+           << "Authorization: Basic " << EncodeBase64(mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"]) << "\r\n"
+           << "Content-Length: " << strRequest.size() << "\r\n"
+           << "\r\n" << strRequest << std::flush;
+}
+
+static int ReadReplyStatus(istream& stream)
+{
+    int nProto = 0;
+    int nStatus = ReadHTTPStatus(stream, nProto);
+    map<string, string> mapHeaders;
+    string strBody;
+    ReadHTTPMessage(stream, mapHeaders, strBody, nProto);
+    return nStatus;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_work_queue)
+{
+    mapArgs["-rpcuser"] = "rpctest";
+    mapArgs["-rpcpassword"] = "rpctestpassword0123456789";
+    mapArgs["-rpcport"] = strTestRPCPort;
+    mapArgs["-rpcthreads"] = "1";
+    mapArgs["-rpcworkqueue"] = "1";
+    StartRPCThreads();
+    BOOST_REQUIRE(!ShutdownRequested());
+
+    // The only RPC thread waits for the first client's request, the second
+    // client waits in the queue and the third is turned away
+    boost::asio::ip::tcp::iostream streamBusy("127.0.0.1", strTestRPCPort);
+    MilliSleep(200);
+    boost::asio::ip::tcp::iostream streamQueued("127.0.0.1", strTestRPCPort);
+    MilliSleep(200);
+    boost::asio::ip::tcp::iostream streamRejected("127.0.0.1", strTestRPCPort);
+    BOOST_CHECK_EQUAL(ReadReplyStatus(streamRejected), HTTP_SERVICE_UNAVAILABLE);
+
+    // Both are served in turn, and then parked on the I/O thread
+    SendGetBlockCount(streamBusy);
+    BOOST_CHECK_EQUAL(ReadReplyStatus(streamBusy), HTTP_OK);
+    SendGetBlockCount(streamQueued);
+    BOOST_CHECK_EQUAL(ReadReplyStatus(streamQueued), HTTP_OK);
+
+    // A parked connection is queued again when its next request comes in
+    SendGetBlockCount(streamBusy);
+    BOOST_CHECK_EQUAL(ReadReplyStatus(streamBusy), HTTP_OK);
+
+    // Stopping closes the connections that are still parked
+    StopRPCThreads();
+    string strLine;
+    BOOST_CHECK(!std::getline(streamBusy, strLine));
+    BOOST_CHECK(!std::getline(streamQueued, strLine));
+
+    mapArgs.erase("-rpcuser");
+    mapArgs.erase("-rpcpassword");
+    mapArgs.erase("-rpcport");
+    mapArgs.erase("-rpcthreads");
+    mapArgs.erase("-rpcworkqueue");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -179,6 +179,53 @@ BOOST_AUTO_TEST_CASE(script_invalid)
     }
 }
 
+// Feed every (signature, public key) pair pushed by a test script through both
+// ECDSA backends and check that they agree, whatever the verdict.
+static void CheckSigBackendsAgree(const CScript& scriptSig, const CScript& scriptPubKey, const string& strTest)
+{
+    vector<vector<unsigned char> > vSigs;
+    vector<CPubKey> vKeys;
+    const CScript* scripts[] = { &scriptSig, &scriptPubKey };
+    BOOST_FOREACH(const CScript* script, scripts)
+    {
+        CScript::const_iterator pc = script->begin();
+        opcodetype opcode;
+        vector<unsigned char> vch;
+        while (pc < script->end() && script->GetOp(pc, opcode, vch))
+        {
+            if (vch.size() > 1 && vch[0] == 0x30)
+                vSigs.push_back(vch);
+            CPubKey pubkey(vch);
+            if (pubkey.IsValid())
+                vKeys.push_back(pubkey);
+        }
+    }
+
+    CTransaction tx;
+    BOOST_FOREACH(const vector<unsigned char>& vchSigIn, vSigs)
+    {
+        vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end() - 1);
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, vchSigIn.back());
+        BOOST_FOREACH(const CPubKey& pubkey, vKeys)
+            BOOST_CHECK_MESSAGE(pubkey.Verify(hash, vchSig) == ECC_VerifyOpenSSL(pubkey, hash, vchSig), strTest);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(script_sig_backends_agree)
+{
+    Array tests = read_json(std::string(json_tests::script_valid, json_tests::script_valid + sizeof(json_tests::script_valid)));
+    Array testsInvalid = read_json(std::string(json_tests::script_invalid, json_tests::script_invalid + sizeof(json_tests::script_invalid)));
+    tests.insert(tests.end(), testsInvalid.begin(), testsInvalid.end());
+
+    BOOST_FOREACH(Value& tv, tests)
+    {
+        Array test = tv.get_array();
+        if (test.size() < 2)
+            continue;
+        CheckSigBackendsAgree(ParseScript(test[0].get_str()), ParseScript(test[1].get_str()), write_string(tv, false));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(script_PushData)
 {
     // Check that PUSHDATA1, PUSHDATA2, and PUSHDATA4 create the same value on
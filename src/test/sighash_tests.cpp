@@ -5,6 +5,7 @@
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
+#include "key.h"
 #include "main.h"
 #include "util.h"
 #include "serialize.h"
@@ -161,6 +162,43 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+// Goal: check that both ECDSA backends agree on signatures over random signature hashes
+BOOST_AUTO_TEST_CASE(sighash_sig_backends_agree)
+{
+    seed_insecure_rand(false);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CPubKey pubkeyFull(pubkey);
+    BOOST_CHECK(pubkeyFull.Decompress());
+
+    for (int i=0; i<500; i++) {
+        int nHashType = insecure_rand();
+        CTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        int nIn = insecure_rand() % txTo.vin.size();
+        uint256 sh = SignatureHash(scriptCode, txTo, nIn, nHashType);
+
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(sh, vchSig));
+        BOOST_CHECK(pubkey.Verify(sh, vchSig));
+        BOOST_CHECK(ECC_VerifyOpenSSL(pubkey, sh, vchSig));
+        BOOST_CHECK(pubkeyFull.Verify(sh, vchSig));
+        BOOST_CHECK(ECC_VerifyOpenSSL(pubkeyFull, sh, vchSig));
+
+        // Signed over a different transaction.
+        uint256 shOther = SignatureHash(scriptCode, txTo, nIn, nHashType ^ 1);
+        BOOST_CHECK_EQUAL(pubkey.Verify(shOther, vchSig), ECC_VerifyOpenSSL(pubkey, shOther, vchSig));
+
+        // Corrupted signature.
+        vchSig[insecure_rand() % vchSig.size()] ^= 1 << (insecure_rand() % 8);
+        BOOST_CHECK_EQUAL(pubkey.Verify(sh, vchSig), ECC_VerifyOpenSSL(pubkey, sh, vchSig));
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
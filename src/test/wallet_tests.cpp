@@ -303,4 +303,58 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(received_index)
+{
+    CWallet walletReceived;
+    LOCK(walletReceived.cs_wallet);
+
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CTxDestination dest1 = key1.GetPubKey().GetID();
+    CTxDestination dest2 = key2.GetPubKey().GetID();
+
+    // Two outputs to dest1 and one that pays to no destination
+    CTransaction tx1;
+    tx1.vout.resize(3);
+    tx1.vout[0].scriptPubKey.SetDestination(dest1);
+    tx1.vout[1].scriptPubKey.SetDestination(dest1);
+    tx1.vout[2].scriptPubKey << OP_RETURN;
+    uint256 hash1 = tx1.GetHash();
+    BOOST_CHECK(walletReceived.AddToWallet(CWalletTx(&walletReceived, tx1), true));
+
+    set<COutPoint> setExpected;
+    setExpected.insert(COutPoint(hash1, 0));
+    setExpected.insert(COutPoint(hash1, 1));
+    BOOST_CHECK_EQUAL(walletReceived.mapReceived.size(), 1U);
+    BOOST_CHECK(walletReceived.mapReceived[dest1] == setExpected);
+
+    // One output each to dest2 and dest1
+    CTransaction tx2;
+    tx2.nLockTime = 1;
+    tx2.vout.resize(2);
+    tx2.vout[0].scriptPubKey.SetDestination(dest2);
+    tx2.vout[1].scriptPubKey.SetDestination(dest1);
+    uint256 hash2 = tx2.GetHash();
+    BOOST_CHECK(walletReceived.AddToWallet(CWalletTx(&walletReceived, tx2), true));
+
+    setExpected.insert(COutPoint(hash2, 1));
+    BOOST_CHECK_EQUAL(walletReceived.mapReceived.size(), 2U);
+    BOOST_CHECK(walletReceived.mapReceived[dest1] == setExpected);
+    BOOST_CHECK_EQUAL(walletReceived.mapReceived[dest2].size(), 1U);
+
+    // Unloading a transaction takes only its own outputs away
+    BOOST_CHECK(walletReceived.UnloadWalletTx(hash1));
+    BOOST_CHECK(!walletReceived.UnloadWalletTx(hash1));
+    setExpected.clear();
+    setExpected.insert(COutPoint(hash2, 1));
+    BOOST_CHECK_EQUAL(walletReceived.mapReceived.size(), 2U);
+    BOOST_CHECK(walletReceived.mapReceived[dest1] == setExpected);
+
+    // and drops the destinations left without outputs
+    BOOST_CHECK(walletReceived.UnloadWalletTx(hash2));
+    BOOST_CHECK(walletReceived.mapReceived.empty());
+    BOOST_CHECK(walletReceived.mapWallet.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
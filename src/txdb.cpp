@@ -8,10 +8,56 @@
 #include "core.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 using namespace std;
 
+/** Key of an output record in the per-output chainstate layout. The VARINT
+ *  encoding keeps the outputs of one transaction sorted by index. */
+struct CCoinsOutKey
+{
+    uint256 txid;
+    unsigned int n;
+
+    CCoinsOutKey() : txid(0), n(0) {}
+    CCoinsOutKey(const uint256 &txidIn, unsigned int nIn) : txid(txidIn), n(nIn) {}
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    )
+};
+
+/** Value of an output record in the per-output chainstate layout: the
+ *  compressed output plus the metadata of the transaction it belongs to. */
+class CCoinsOutRecord
+{
+public:
+    int nTxVersion;
+    unsigned int nHeight;
+    bool fCoinBase;
+    CTxOut txout;
+
+    CCoinsOutRecord() : nTxVersion(0), nHeight(0), fCoinBase(false) {}
+    CCoinsOutRecord(const CCoins &coins, unsigned int n) : nTxVersion(coins.nVersion), nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), txout(coins.vout[n]) {}
+
+    IMPLEMENT_SERIALIZE(({
+        unsigned int nCode = 0;
+        if (!fRead)
+            nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nTxVersion));
+        READWRITE(VARINT(nCode));
+        if (fRead) {
+            CCoinsOutRecord *pthis = const_cast<CCoinsOutRecord*>(this);
+            pthis->nHeight = nCode / 2;
+            pthis->fCoinBase = nCode & 1;
+        }
+        CTxOutCompressor txoutc(REF(txout));
+        READWRITE(txoutc);
+    });)
+};
+
 void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
     if (coins.IsPruned())
         batch.Erase(make_pair('c', hash));
@@ -23,20 +69,92 @@ void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", "chainstate", nCacheSize, fMemory, fWipe), fPerOutput(false) {
+    fPerOutput = db.Exists(make_pair('F', string("peroutput")));
+}
+
+bool CCoinsViewDB::ReadOutputs(const uint256 &txid, CCoins &coins) {
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair('o', txid);
+    string strPrefix = ssPrefix.str();
+
+    coins = CCoins();
+    bool fFound = false;
+    leveldb::Iterator *pcursor = db.NewSeekIterator();
+    try {
+        for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CCoinsOutKey key;
+            ssKey >> chType >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsOutRecord record;
+            ssValue >> record;
+
+            if (key.n >= coins.vout.size())
+                coins.vout.resize(key.n + 1);
+            coins.vout[key.n] = record.txout;
+            coins.nVersion = record.nTxVersion;
+            coins.nHeight = record.nHeight;
+            coins.fCoinBase = record.fCoinBase;
+            fFound = true;
+        }
+    } catch (std::exception &e) {
+        delete pcursor;
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    leveldb::Status status = pcursor->status();
+    delete pcursor;
+    HandleError(status);
+    return fFound;
+}
+
+// Write the changes to the outputs of one transaction. Only records that
+// differ from what is stored are written, so spending a single output of a
+// large transaction only erases that output's record. Unless the caller
+// knows there is nothing stored yet (fFresh), that needs a look at the
+// current records; the cache of the coins view has read those recently, so
+// this is normally served from the LevelDB block cache.
+void CCoinsViewDB::BatchWriteOutputs(CLevelDBBatch &batch, const uint256 &txid, const CCoins &coins, bool fFresh) {
+    CCoins old;
+    if (!fFresh)
+        ReadOutputs(txid, old);
+    bool fSameTx = old.nVersion == coins.nVersion && old.nHeight == coins.nHeight && old.fCoinBase == coins.fCoinBase;
+    unsigned int nSize = std::max(old.vout.size(), coins.vout.size());
+    for (unsigned int i = 0; i < nSize; i++) {
+        bool fOld = i < old.vout.size() && !old.vout[i].IsNull();
+        bool fNew = i < coins.vout.size() && !coins.vout[i].IsNull();
+        if (fNew) {
+            if (!fOld || !fSameTx || old.vout[i] != coins.vout[i])
+                batch.Write(make_pair('o', CCoinsOutKey(txid, i)), CCoinsOutRecord(coins, i));
+        } else if (fOld) {
+            batch.Erase(make_pair('o', CCoinsOutKey(txid, i)));
+        }
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) {
+    if (fPerOutput)
+        return ReadOutputs(txid, coins);
     return db.Read(make_pair('c', txid), coins);
 }
 
 bool CCoinsViewDB::SetCoins(const uint256 &txid, const CCoins &coins) {
     CLevelDBBatch batch;
-    BatchWriteCoins(batch, txid, coins);
+    if (fPerOutput)
+        BatchWriteOutputs(batch, txid, coins, false);
+    else
+        BatchWriteCoins(batch, txid, coins);
     return db.WriteBatch(batch);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) {
+    if (fPerOutput) {
+        CCoins coins;
+        return ReadOutputs(txid, coins);
+    }
     return db.Exists(make_pair('c', txid));
 }
 
@@ -53,19 +171,106 @@ bool CCoinsViewDB::SetBestBlock(const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
-bool CCoinsViewDB::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock) {
-    LogPrint("coindb", "Committing %u changed transactions to coin database...\n", (unsigned int)mapCoins.size());
+bool CCoinsViewDB::GetCommitment(CCoinsCommitment &commitment) {
+    return db.Read('S', commitment);
+}
 
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment) {
     CLevelDBBatch batch;
-    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
-        BatchWriteCoins(batch, it->first, it->second);
+    size_t count = 0;
+    size_t changed = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        // Unmodified entries need no write, and a fresh pruned entry was never
+        // in the database in the first place.
+        if ((it->second.flags & CCoinsCacheEntry::DIRTY) &&
+            !((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned())) {
+            if (fPerOutput)
+                BatchWriteOutputs(batch, it->first, it->second.coins, it->second.flags & CCoinsCacheEntry::FRESH);
+            else
+                BatchWriteCoins(batch, it->first, it->second.coins);
+            changed++;
+        }
+        count++;
+    }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
-
+    // The stored commitment must always match the stored coins; if the
+    // writer did not keep it up to date, drop it so that it is recomputed.
+    if (pcommitment)
+        batch.Write('S', *pcommitment);
+    else if (changed > 0)
+        batch.Erase('S');
+
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::UpgradeToPerOutput() {
+    // Mark the database first: an interrupted conversion then simply
+    // continues on the next start, as every transaction is moved in a single
+    // batch and is therefore always stored in exactly one of the layouts.
+    if (!fPerOutput) {
+        if (!db.Write(make_pair('F', string("peroutput")), '1', true))
+            return false;
+        fPerOutput = true;
+    }
+
+    leveldb::Iterator *pcursor = db.NewIterator();
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << 'c';
+    pcursor->Seek(ssKeySet.str());
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nTransactions = 0, nOutputs = 0;
+    CLevelDBBatch batch;
+    unsigned int nBatch = 0;
+    while (pcursor->Valid()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            uint256 txid;
+            ssKey >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull()) {
+                    batch.Write(make_pair('o', CCoinsOutKey(txid, i)), CCoinsOutRecord(coins, i));
+                    nOutputs++;
+                }
+            }
+            batch.Erase(make_pair('c', txid));
+            nTransactions++;
+            if (++nBatch >= 10000) {
+                if (!db.WriteBatch(batch)) {
+                    delete pcursor;
+                    return false;
+                }
+                batch = CLevelDBBatch();
+                nBatch = 0;
+                LogPrintf("Upgrading chainstate: %u transactions converted so far\n", nTransactions);
+            }
+            pcursor->Next();
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    delete pcursor;
+    if (!db.WriteBatch(batch, true))
+        return false;
+    if (nTransactions > 0)
+        LogPrintf("Upgraded chainstate to per-output layout: %u transactions, %u outputs  %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", "blockindex", nCacheSize, fMemory, fWipe) {
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
@@ -107,6 +312,27 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read('l', nFile);
 }
 
+// Both layouts are iterated in txid order and feed the same data into the
+// hash, so hash_serialized does not depend on the layout.
+void static ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &txhash, const CCoins &coins) {
+    ss << txhash;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+    stats.commitment.AddCoins(txhash, coins);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
     leveldb::Iterator *pcursor = db.NewIterator();
     pcursor->SeekToFirst();
@@ -114,7 +340,10 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    int64_t nTotalAmount = 0;
+    stats.nTotalAmount = 0;
+    // Outputs of the transaction currently being collected (per-output layout)
+    uint256 txhashOut;
+    CCoins coinsOut;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -129,22 +358,27 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
                 ssValue >> coins;
                 uint256 txhash;
                 ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
+                ApplyStats(stats, ss, txhash, coins);
                 stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            } else if (chType == 'o') {
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                CCoinsOutRecord record;
+                ssValue >> record;
+                CCoinsOutKey key;
+                ssKey >> key;
+                if (key.txid != txhashOut && !coinsOut.vout.empty()) {
+                    ApplyStats(stats, ss, txhashOut, coinsOut);
+                    coinsOut = CCoins();
+                }
+                txhashOut = key.txid;
+                if (key.n >= coinsOut.vout.size())
+                    coinsOut.vout.resize(key.n + 1);
+                coinsOut.vout[key.n] = record.txout;
+                coinsOut.nVersion = record.nTxVersion;
+                coinsOut.nHeight = record.nHeight;
+                coinsOut.fCoinBase = record.fCoinBase;
+                stats.nSerializedSize += slKey.size() + slValue.size();
             }
             pcursor->Next();
         } catch (std::exception &e) {
@@ -152,9 +386,12 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
         }
     }
     delete pcursor;
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
+    if (!coinsOut.vout.empty())
+        ApplyStats(stats, ss, txhashOut, coinsOut);
+    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(stats.hashBlock);
+    if (mi != mapBlockIndex.end())
+        stats.nHeight = mi->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -169,6 +406,116 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair('a', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair('a', it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, int64_t> > &vect, int nStart, int nEnd) {
+    leveldb::Iterator *pcursor = NewSeekIterator();
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('a', CAddressIndexKey(nType, hashBytes, nStart > 0 ? nStart : 0));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (key.nAddressType != nType || key.hashBytes != hashBytes)
+                break;
+            if (nEnd > 0 && key.nHeight > nEnd)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            int64_t nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(key, nValue));
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    delete pcursor;
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    leveldb::Iterator *pcursor = NewSeekIterator();
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressUnspentKey(nType, hashBytes));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            CAddressUnspentKey key;
+            ssKey >> key;
+            if (key.nAddressType != nType || key.hashBytes != hashBytes)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    delete pcursor;
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(make_pair('p', key), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
 }
@@ -25,20 +25,43 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 // min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+/** CCoinsView backed by the LevelDB coin database (chainstate/)
+ *
+ *  The database uses one of two layouts:
+ *  - per transaction: one 'c' record holding the CCoins of each transaction
+ *    with unspent outputs (the original format).
+ *  - per output: one 'o' record per unspent output, keyed by (txid, n) and
+ *    holding the compressed output plus its transaction's metadata. Spending
+ *    one output of a transaction with many outputs then only deletes that
+ *    output's record instead of rewriting all the others.
+ *  UpgradeToPerOutput() converts the former into the latter.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+    bool fPerOutput;
+
+    bool ReadOutputs(const uint256 &txid, CCoins &coins);
+    void BatchWriteOutputs(CLevelDBBatch &batch, const uint256 &txid, const CCoins &coins, bool fFresh);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+    // Whether the database uses the per-output layout.
+    bool IsPerOutput() const { return fPerOutput; }
+
+    // Convert the database to the per-output layout. Safe to call on an
+    // empty or already converted database; also finishes an interrupted
+    // conversion.
+    bool UpgradeToPerOutput();
+
     bool GetCoins(const uint256 &txid, CCoins &coins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
+    bool GetCommitment(CCoinsCommitment &commitment);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsCommitment *pcommitment);
     bool GetStats(CCoinsStats &stats);
 };
 
@@ -61,6 +84,13 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect);
+    bool ReadAddressIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, int64_t> > &vect, int nStart = 0, int nEnd = 0);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndex(unsigned char nType, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
@@ -1271,6 +1271,16 @@ void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
 #endif
 }
 
+// this function tells the OS that a file is going to be read sequentially, so it reads ahead further
+// it is advisory, like AllocateFileRange
+void FileAdviseSequential(FILE *file) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(F_RDAHEAD)
+    fcntl(fileno(file), F_RDAHEAD, 1);
+#endif
+}
+
 void ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
@@ -32,6 +32,7 @@
 #include "instantx.h"
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <openssl/rand.h>
 
 
@@ -465,6 +466,38 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToReceived(const uint256& wtxid)
+{
+    assert(mapWallet.count(wtxid));
+    const CWalletTx& thisTx = mapWallet[wtxid];
+
+    for (unsigned int i = 0; i < thisTx.vout.size(); i++)
+    {
+        CTxDestination address;
+        if (ExtractDestination(thisTx.vout[i].scriptPubKey, address))
+            mapReceived[address].insert(COutPoint(wtxid, i));
+    }
+}
+
+void CWallet::RemoveFromReceived(const uint256& wtxid)
+{
+    assert(mapWallet.count(wtxid));
+    const CWalletTx& thisTx = mapWallet[wtxid];
+
+    for (unsigned int i = 0; i < thisTx.vout.size(); i++)
+    {
+        CTxDestination address;
+        if (!ExtractDestination(thisTx.vout[i].scriptPubKey, address))
+            continue;
+        TxReceived::iterator it = mapReceived.find(address);
+        if (it == mapReceived.end())
+            continue;
+        it->second.erase(COutPoint(wtxid, i));
+        if (it->second.empty())
+            mapReceived.erase(it);
+    }
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -595,29 +628,20 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
     return nRet;
 }
 
-CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount)
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
 {
-    AssertLockHeld(cs_wallet); // mapWallet
-    CWalletDB walletdb(strWalletFile);
-
-    // First: get all CWalletTx and CAccountingEntry into a sorted-by-order multimap.
-    TxItems txOrdered;
-
-    // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
-    // would make this much faster for applications that do this a lot.
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        CWalletTx* wtx = &((*it).second);
-        txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
-    }
-    acentries.clear();
-    walletdb.ListAccountCreditDebit(strAccount, acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
-    {
-        txOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
-    }
+    AssertLockHeld(cs_wallet); // laccentries, wtxOrdered
+    laccentries.push_back(acentry);
+    CAccountingEntry& entry = laccentries.back();
+    wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+    mapAccountCreditDebit[entry.strAccount] += entry.nCreditDebit;
+}
 
-    return txOrdered;
+int64_t CWallet::GetAccountCreditDebit(const std::string& strAccount) const
+{
+    AssertLockHeld(cs_wallet); // mapAccountCreditDebit
+    std::map<std::string, int64_t>::const_iterator it = mapAccountCreditDebit.find(strAccount);
+    return it == mapAccountCreditDebit.end() ? 0 : it->second;
 }
 
 void CWallet::MarkDirty()
@@ -635,9 +659,12 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
     if (fFromLoadWallet)
     {
-        mapWallet[hash] = wtxIn;
-        mapWallet[hash].BindWallet(this);
+        CWalletTx& wtx = mapWallet[hash];
+        wtx = wtxIn;
+        wtx.BindWallet(this);
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        AddToReceived(hash);
     }
     else
     {
@@ -651,6 +678,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
+            wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0)
@@ -662,9 +690,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                     {
                         // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                         int64_t latestTolerated = latestNow + 300;
-                        std::list<CAccountingEntry> acentries;
-                        TxItems txOrdered = OrderedTxItems(acentries);
-                        for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+                        for (TxItems::reverse_iterator it = wtxOrdered.rbegin(); it != wtxOrdered.rend(); ++it)
                         {
                             CWalletTx *const pwtx = (*it).second.first;
                             if (pwtx == &wtx)
@@ -698,6 +724,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                              wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            AddToReceived(hash);
         }
 
         bool fUpdated = false;
@@ -823,12 +850,32 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (UnloadWalletTx(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
     return;
 }
 
+bool CWallet::UnloadWalletTx(const uint256 &hash)
+{
+    AssertLockHeld(cs_wallet); // mapWallet, wtxOrdered
+    map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return false;
+    pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(mi->second.nOrderPos);
+    for (TxItems::iterator it = range.first; it != range.second; ++it)
+    {
+        if (it->second.first == &mi->second)
+        {
+            wtxOrdered.erase(it);
+            break;
+        }
+    }
+    RemoveFromReceived(hash);
+    mapWallet.erase(mi);
+    return true;
+}
+
 
 bool CWallet::IsMine(const CTxIn &txin) const
 {
@@ -1043,15 +1090,105 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+// Blocks a rescan reads ahead at once
+static const unsigned int RESCAN_BATCH_SIZE = 100;
+
+/** A block read ahead by a rescan, with the hashes of its transactions and which
+ *  of them may involve the wallet: those paying to one of its keys or scripts,
+ *  and those with an OP_RETURN output, which may pay to a stealth address. */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    std::vector<uint256> vHash;
+    std::vector<bool> vCandidate;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+};
+
+static bool HasOpReturn(const CTransaction& tx)
+{
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        if (!txout.scriptPubKey.empty() && txout.scriptPubKey[0] == OP_RETURN)
+            return true;
+    return false;
+}
+
+// Reader thread nThread of nThreads: reads every nThreads-th block of the batch
+// and looks for candidates. The key store has its own lock, so neither cs_main
+// nor cs_wallet is needed.
+static void ReadRescanBlocks(const CWallet* pwallet, std::vector<CRescanBlock>* pvBlocks, unsigned int nThread, unsigned int nThreads)
+{
+    for (unsigned int i = nThread; i < pvBlocks->size(); i += nThreads)
+    {
+        CRescanBlock& rb = (*pvBlocks)[i];
+        rb.fRead = ReadBlockFromDisk(rb.block, rb.pindex);
+        BOOST_FOREACH(const CTransaction& tx, rb.block.vtx)
+        {
+            rb.vHash.push_back(tx.GetHash());
+            rb.vCandidate.push_back(pwallet->IsMine(tx) || HasOpReturn(tx));
+        }
+    }
+}
+
+/** A batch of blocks being read ahead by background threads */
+class CRescanBatch
+{
+public:
+    std::vector<CRescanBlock> vBlocks;
+
+    CRescanBatch() : fRunning(false) {}
+    ~CRescanBatch() { Wait(); }
+
+    /** Start reading up to RESCAN_BATCH_SIZE blocks of the main chain from pindex on */
+    void Start(const CWallet* pwallet, CBlockIndex* pindex)
+    {
+        std::vector<CDiskBlockPos> vPos;
+        {
+            LOCK(cs_main);
+            while (pindex && vBlocks.size() < RESCAN_BATCH_SIZE)
+            {
+                vBlocks.push_back(CRescanBlock(pindex));
+                vPos.push_back(pindex->GetBlockPos());
+                pindex = chainActive.Next(pindex);
+            }
+        }
+        // the batch is mostly one stretch of a block file
+        PrefetchBlockFiles(vPos);
+
+        unsigned int nThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+        for (unsigned int i = 0; i < nThreads && i < vBlocks.size(); i++)
+            threads.create_thread(boost::bind(&ReadRescanBlocks, pwallet, &vBlocks, i, nThreads));
+        fRunning = true;
+    }
+
+    void Wait()
+    {
+        if (fRunning)
+            threads.join_all();
+        fRunning = false;
+    }
+
+private:
+    boost::thread_group threads;
+    bool fRunning;
+};
+
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
 // exist in the wallet will be updated.
+// Blocks are read ahead, and checked for transactions that may be ours, a
+// batch at a time on background threads; the locks are only taken to add what
+// they found.
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1060,29 +1197,77 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex)
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+
+    boost::scoped_ptr<CRescanBatch> pbatch(new CRescanBatch());
+    pbatch->Start(this, pindex);
+    while (!pbatch->vBlocks.empty())
+    {
+        pbatch->Wait();
+
+        // read the next batch while this one is added
+        CBlockIndex* pindexNext;
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK(cs_main);
+            // after a reorganisation continue from where the chains fork
+            pindex = pbatch->vBlocks.back().pindex;
+            while (!chainActive.Contains(pindex))
+                pindex = pindex->pprev;
+            pindexNext = chainActive.Next(pindex);
+        }
+        boost::scoped_ptr<CRescanBatch> pbatchNext(new CRescanBatch());
+        pbatchNext->Start(this, pindexNext);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        CBlockIndex* pindexFork = NULL;
+        {
+            LOCK2(cs_main, cs_wallet);
+            BOOST_FOREACH(CRescanBlock& rb, pbatch->vBlocks)
             {
-                if (AddToWalletIfInvolvingMe(tx.GetHash(), tx, &block, fUpdate))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                // a reorganisation took this block, and the rest of the batch
+                // after it, out of the main chain
+                if (!chainActive.Contains(rb.pindex)) {
+                    pindexFork = rb.pindex;
+                    while (!chainActive.Contains(pindexFork))
+                        pindexFork = pindexFork->pprev;
+                    pindex = pindexFork;
+                    pindexNext = chainActive.Next(pindexFork);
+                    break;
+                }
+                if (!rb.fRead)
+                    continue;
+                for (unsigned int i = 0; i < rb.block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = rb.block.vtx[i];
+                    // already ours, or spending from a transaction of ours, which may
+                    // itself have been found in an earlier block of this rescan
+                    bool fInvolved = rb.vCandidate[i] || mapWallet.count(rb.vHash[i]);
+                    for (unsigned int j = 0; j < tx.vin.size() && !fInvolved && !tx.IsCoinBase(); j++)
+                        fInvolved = mapWallet.count(tx.vin[j].prevout.hash);
+                    if (fInvolved && AddToWalletIfInvolvingMe(rb.vHash[i], tx, &rb.block, fUpdate))
+                        ret++;
+                }
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        // the next batch was read from the stale chain too; start again from the fork
+        if (pindexFork) {
+            pbatchNext.reset(new CRescanBatch());
+            pbatchNext->Start(this, pindexNext);
+        }
+
+        if (dProgressTip - dProgressStart > 0.0)
+            ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+        }
+
+        pbatch.swap(pbatchNext);
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -2751,9 +2936,9 @@ std::map<CTxDestination, int64_t> CWallet::GetAddressBalances()
 
     {
         LOCK(cs_wallet);
-        BOOST_FOREACH(PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet)
+        BOOST_FOREACH(const PAIRTYPE(uint256, CWalletTx)& walletEntry, mapWallet)
         {
-            CWalletTx *pcoin = &walletEntry.second;
+            const CWalletTx *pcoin = &walletEntry.second;
 
             if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
                 continue;
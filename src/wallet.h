@@ -134,6 +134,9 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    void AddToReceived(const uint256& wtxid);
+    void RemoveFromReceived(const uint256& wtxid);
+
 public:
     bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = true) const;
     bool SelectCoinsDark(int64_t nValueMin, int64_t nValueMax, std::vector<CTxIn>& setCoinsRet, int64_t& nValueRet, int nDarksendRoundsMin, int nDarksendRoundsMax) const;
@@ -220,6 +223,14 @@ public:
     }
 
     std::map<uint256, CWalletTx> mapWallet;
+    // Per account sum of the accounting entries
+    std::map<std::string, int64_t> mapAccountCreditDebit;
+
+    // Outputs of wallet transactions by the destination they pay to, so that
+    // what an address received can be tallied from its own outputs. Whether
+    // they count (confirmations, conflicts, IsMine) is decided when tallying.
+    typedef std::map<CTxDestination, std::set<COutPoint> > TxReceived;
+    TxReceived mapReceived;
 
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
@@ -291,17 +302,33 @@ public:
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
 
+    /** The wallet's activity log: every transaction and accounting entry by
+        nOrderPos. Kept up to date as they are added and erased, so callers
+        walk it (under cs_wallet) instead of rebuilding it.
+     */
+    TxItems wtxOrdered;
+
+    /** Accounting entries, kept in memory for the activity log */
+    std::list<CAccountingEntry> laccentries;
+
     /** Get the wallet's activity log
         @return multimap of ordered transactions and accounting entries
-        @warning Returned pointers are *only* valid within the scope of passed acentries
      */
-    TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
+    const TxItems& OrderedTxItems() const { AssertLockHeld(cs_wallet); return wtxOrdered; }
+
+    /** Add an accounting entry already written to the database to the activity log */
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
+
+    /** Sum of the accounting entries of an account */
+    int64_t GetAccountCreditDebit(const std::string& strAccount) const;
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet=false);
     void SyncTransaction(const uint256 &hash, const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const uint256 &hash, const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
+    /** Forget a transaction without touching the database */
+    bool UnloadWalletTx(const uint256 &hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();